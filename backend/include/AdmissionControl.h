@@ -0,0 +1,93 @@
+#ifndef SWEET_SHOP_ADMISSION_CONTROL_H
+#define SWEET_SHOP_ADMISSION_CONTROL_H
+
+#include <crow.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "ConcurrencyLimiter.h"
+
+// Crow middleware bounding the work the server accepts. Each API request
+// belongs to a route class with its own adaptive concurrency limit; a
+// request over it is shed at once with 503 and Retry-After instead of
+// piling up behind a slow database or holding an I/O worker while it
+// waits. /api/batch fans out into many reads, so it has a class of its
+// own rather than taking one catalog slot.
+// Everything outside /api (metrics, preflight) and the /api/live
+// WebSocket is never limited.
+struct AdmissionControl {
+    enum RouteClass { Auth, Catalog, Purchase, Admin, Batch, None };
+
+    struct context {
+        ConcurrencyLimiter* limiter{nullptr};
+        std::chrono::steady_clock::time_point start;
+    };
+
+    AdmissionControl() {
+        // Admin work is rare and expensive and must not crowd out the
+        // shop; a batch fans out to up to 20 reads, so few run at once
+        limiters_[Auth].reset(new ConcurrencyLimiter("auth", options(16, 64)));
+        limiters_[Catalog].reset(new ConcurrencyLimiter("catalog", options(64, 512)));
+        limiters_[Purchase].reset(new ConcurrencyLimiter("purchase", options(32, 256)));
+        limiters_[Admin].reset(new ConcurrencyLimiter("admin", options(4, 16)));
+        limiters_[Batch].reset(new ConcurrencyLimiter("batch", options(4, 32)));
+    }
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx) {
+        RouteClass cls = classify(req);
+        if (cls == None) return;
+        ConcurrencyLimiter& limiter = *limiters_[cls];
+        if (!limiter.tryAcquire()) {
+            crow::json::wvalue body;
+            body["error"] = "Server is busy, please retry";
+            res = crow::response(503, body);
+            res.add_header("Retry-After", std::to_string(limiter.retryAfterSeconds()));
+            res.end();
+            return;
+        }
+        ctx.limiter = &limiter;
+        ctx.start = std::chrono::steady_clock::now();
+    }
+
+    void after_handle(crow::request& /*req*/, crow::response& res, context& ctx) {
+        if (!ctx.limiter) return; // shed or unlimited
+        // Only an unavailable or slow backend is an overload signal; a 500
+        // is a handler bug and says nothing about load.
+        bool failed = res.code == 503 || res.code == 504;
+        ctx.limiter->release(std::chrono::steady_clock::now() - ctx.start, failed);
+        ctx.limiter = nullptr;
+    }
+
+    ConcurrencyLimiter& limiter(RouteClass cls) { return *limiters_[cls]; }
+
+    static RouteClass classify(const crow::request& req) {
+        const std::string& url = req.url;
+        if (url.compare(0, 5, "/api/") != 0 || req.method == crow::HTTPMethod::Options) return None;
+        if (url == "/api/live") return None; // long-lived WebSocket
+        if (url.compare(0, 10, "/api/auth/") == 0) return Auth;
+        if (url.compare(0, 11, "/api/admin/") == 0) return Admin;
+        if (url == "/api/batch") return Batch;
+        bool post = req.method == crow::HTTPMethod::Post;
+        if (post && (endsWith(url, "/purchase") || endsWith(url, "/restock"))) return Purchase;
+        return Catalog;
+    }
+
+private:
+    static ConcurrencyLimiter::Options options(int initial, int max) {
+        ConcurrencyLimiter::Options o;
+        o.initialLimit = initial;
+        o.maxLimit = max;
+        return o;
+    }
+
+    static bool endsWith(const std::string& s, const std::string& suffix) {
+        return s.size() >= suffix.size() &&
+            s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    std::unique_ptr<ConcurrencyLimiter> limiters_[None];
+};
+
+#endif // SWEET_SHOP_ADMISSION_CONTROL_H
@@ -0,0 +1,49 @@
+#ifndef SWEET_SHOP_ASSET_CACHE_H
+#define SWEET_SHOP_ASSET_CACHE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Compression.h"
+
+// The frontend's static files, read once at startup. Each asset keeps its
+// bytes with precompressed variants and a strong ETag (content hash), so
+// serving one is a map lookup with no disk access. Files larger than
+// kMaxCachedSize stay on disk and are streamed by the server instead.
+//
+// The cache is immutable after load(), so lookups need no locking.
+class AssetCache {
+public:
+    struct Asset {
+        std::string contentType;
+        std::string etag;          // quoted, ready for the ETag header
+        std::string cacheControl;
+        std::shared_ptr<const compression::PrecompressedBody> body; // null when on disk
+        std::string diskPath;      // set when body is null
+    };
+
+    static const std::size_t kMaxCachedSize = 1024 * 1024;
+
+    // Loads every file under root, keyed by its path relative to root with
+    // a leading '/'. "/" serves indexPath. False if root is unreadable.
+    bool load(const std::string& root, const std::string& indexPath = "/public/index.html");
+
+    // Null when there is no such asset
+    const Asset* find(const std::string& urlPath) const;
+
+    std::size_t size() const { return assets_.size(); }
+    std::size_t bytes() const { return bytes_; }
+
+    static std::string contentTypeFor(const std::string& path);
+    // True for names carrying a content hash, e.g. app.3f9a1c2e.js; those
+    // never change and may be cached by browsers for a year
+    static bool isHashedName(const std::string& path);
+
+private:
+    std::unordered_map<std::string, Asset> assets_;
+    std::size_t bytes_{0};
+};
+
+#endif // SWEET_SHOP_ASSET_CACHE_H
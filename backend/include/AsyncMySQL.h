@@ -0,0 +1,156 @@
+#ifndef SWEET_SHOP_ASYNC_MYSQL_H
+#define SWEET_SHOP_ASYNC_MYSQL_H
+
+#include <mysql.h>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Non-blocking MySQL client on the MySQL 8 *_nonblocking C API. A pool of
+// connections is driven by one event-loop thread (epoll on Linux, poll
+// elsewhere), so a handful of threads keeps many queries in flight and
+// no caller thread ever waits on a network round trip.
+//
+// Completion callbacks run on the loop thread: they must not block, and
+// may submit further queries.
+//
+// Work waiting for a connection is bounded: a statement or session that
+// finds no free connection within kQueueTimeout fails with ok == false
+// (a null session), and submissions beyond kMaxQueued waiting ones fail
+// at once. While the server is unreachable callers therefore get an
+// error instead of waiting for it to come back.
+class AsyncMySQL {
+public:
+    struct Result {
+        bool ok{false};
+        std::vector<std::map<std::string, std::string>> rows;
+        unsigned long long insertId{0};
+        unsigned long long affectedRows{0};
+        std::string error;
+    };
+    using Callback = std::function<void(Result)>;
+
+    // One pooled connection leased for a sequence of dependent statements
+    // such as a transaction. Statements run in submission order; the
+    // connection returns to the pool once the last reference is dropped
+    // and its queue has drained.
+    class Session {
+    public:
+        ~Session();
+        void query(std::string sql, Callback done);
+
+    private:
+        friend class AsyncMySQL;
+        Session(AsyncMySQL& owner, std::size_t conn) : owner_(owner), conn_(conn) {}
+
+        AsyncMySQL& owner_;
+        std::size_t conn_;
+    };
+    using SessionCallback = std::function<void(std::shared_ptr<Session>)>;
+
+    static constexpr std::chrono::milliseconds kQueueTimeout{3000};
+    static constexpr std::size_t kMaxQueued = 4096; // statements, and sessions
+
+    AsyncMySQL(const std::string& host,
+               const std::string& user,
+               const std::string& password,
+               const std::string& dbName,
+               unsigned int port = 3306,
+               std::size_t connections = 8);
+    ~AsyncMySQL();
+
+    // Starts the loop thread; connections are opened in the background
+    bool start();
+    void stop();
+
+    // Runs one statement on the next free connection
+    void query(std::string sql, Callback done);
+    // Leases a connection as soon as one is free; ready(nullptr) when
+    // none is free in time
+    void session(SessionCallback ready);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Op {
+        std::string sql;
+        Callback done;
+        Clock::time_point queued;
+        Clock::time_point sent;
+    };
+
+    struct SessionWaiter {
+        SessionCallback ready;
+        Clock::time_point queued;
+    };
+
+    enum class ConnState { Down, Connecting, Idle, Sending, Storing };
+
+    struct Conn {
+        MYSQL* mysql{nullptr};
+        ConnState state{ConnState::Down};
+        int fd{-1};
+        Clock::time_point retryAt;
+        Op op;
+        bool leased{false};
+        bool leaseEnded{false};
+        std::deque<Op> sessionOps;
+    };
+
+    // Queues fn to run on the loop thread; false once stopped
+    bool post(std::function<void()> fn);
+    void loop();
+    void dispatch();
+    // Fails queued work that has waited longer than kQueueTimeout
+    void expire(Clock::time_point now);
+    void drive(std::size_t index);
+    void begin(Conn& conn, Op op);
+    void finish(Conn& conn, Result result);
+    void reset(Conn& conn, const char* why);
+
+    // Poller hooks, implemented per platform in the .cpp
+    bool openPoller();
+    void closePoller();
+    void watch(std::size_t index, int fd);
+    void unwatch(int fd);
+    void wake();
+    // Fills ready with connection indexes whose sockets are readable
+    void waitEvents(int timeoutMs, std::vector<std::size_t>& ready);
+
+    std::string host_;
+    std::string user_;
+    std::string password_;
+    std::string database_;
+    unsigned int port_;
+    std::string endpoint_; // host:port, for the slow query log
+
+    // Loop-thread state
+    std::vector<Conn> conns_;
+    std::deque<Op> pending_;
+    std::deque<SessionWaiter> sessionWaiters_;
+    bool dirty_{false}; // a connection became free; dispatch again before sleeping
+    std::string shape_; // querylog buffer
+
+    std::mutex inboxMutex_;
+    std::vector<std::function<void()>> inbox_;
+    bool running_{false};
+    std::thread thread_;
+
+    int pollFd_{-1};
+    int wakeFd_{-1};
+    std::vector<int> watched_; // fds, for the poll() fallback
+
+    // non-copyable
+    AsyncMySQL(const AsyncMySQL&) = delete;
+    AsyncMySQL& operator=(const AsyncMySQL&) = delete;
+};
+
+#endif // SWEET_SHOP_ASYNC_MYSQL_H
@@ -3,12 +3,14 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
-class Database; // forward declaration
+class Storage; // forward declaration
+class ShopListener;
 
 class Auth {
 public:
-    Auth(Database& db, const std::string& jwtSecret);
+    Auth(Storage& db, const std::string& jwtSecret);
 
     std::string registerUser(const std::string& username,
                              const std::string& password,
@@ -22,11 +24,17 @@ public:
     std::map<std::string, std::string>
     decodeToken(const std::string& token) const;
 
+    // Notified after each successful registration
+    void addListener(ShopListener* listener);
+
+    // Hex SHA-256 digest stored in users.password_hash
+    std::string hashPassword(const std::string& plaintext) const;
+
 private:
-    Database& db_;
+    Storage& db_;
     std::string secret_;
+    std::vector<ShopListener*> listeners_;
 
-    std::string hashPassword(const std::string& plaintext) const;
     bool verifyPassword(const std::string& plaintext,
                         const std::string& hash) const;
     std::string createToken(
@@ -0,0 +1,53 @@
+#ifndef SWEET_SHOP_CATALOG_IO_H
+#define SWEET_SHOP_CATALOG_IO_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Sweet.h"
+
+// Catalog import and export as CSV or NDJSON. Both formats carry the
+// columns id, name, description, category, price and quantity, so an
+// export can be edited and imported back. On import id is optional: rows
+// without one become new sweets.
+//
+// CSV follows RFC 4180 (quoted fields may hold commas, quotes and line
+// breaks) and needs a header row naming the columns, in any order.
+// NDJSON is one flat JSON object per line.
+namespace catalogio {
+
+enum class Format { Csv, Ndjson };
+
+// "csv" or "ndjson"; also accepts the text/csv and application/x-ndjson
+// media types. False for anything else.
+bool parseFormat(const std::string& name, Format& out);
+
+struct RowError {
+    std::size_t record{0}; // 1-based data record (CSV) or line (NDJSON)
+    std::string message;
+};
+
+struct ParseResult {
+    std::vector<Sweet> sweets;  // valid rows, in input order; id 0 = new
+    std::vector<RowError> errors;
+    std::size_t records{0};     // data records seen, valid or not
+};
+
+// Splits input into records and parses and validates them on up to
+// `threads` threads (0 = one per core), keeping input order. Invalid rows
+// are reported in errors and left out of sweets. A CSV without the
+// required columns yields a single error for record 0.
+ParseResult parse(const std::string& input, Format format, unsigned threads = 0);
+
+// Export. appendHeader writes the CSV header row (nothing for NDJSON);
+// appendSweet writes one record including its line break.
+void appendHeader(Format format, std::string& out);
+void appendSweet(Format format, const Sweet& sweet, std::string& out);
+
+// Media type of an export in this format
+const char* contentType(Format format);
+
+} // namespace catalogio
+
+#endif // SWEET_SHOP_CATALOG_IO_H
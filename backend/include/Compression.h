@@ -0,0 +1,60 @@
+#ifndef SWEET_SHOP_COMPRESSION_H
+#define SWEET_SHOP_COMPRESSION_H
+
+#include <cstddef>
+#include <string>
+
+// Response body compression. gzip is always available (zlib); Brotli is
+// used when the build defines SWEET_SHOP_HAVE_BROTLI.
+namespace compression {
+
+enum class Encoding { Identity, Gzip, Brotli };
+
+// Bodies smaller than this are sent as-is: the framing overhead and CPU
+// outweigh the few bytes saved
+const std::size_t kMinSize = 1024;
+
+// Best encoding the client accepts per its Accept-Encoding header,
+// preferring Brotli, then gzip. Honours q=0 exclusions.
+Encoding negotiate(const std::string& acceptEncoding);
+
+// Content-Encoding token; empty for Identity
+const char* name(Encoding encoding);
+
+// Level trades CPU for size: 1-9 for gzip, 0-11 for Brotli. False when
+// the encoder fails or is not compiled in.
+bool gzip(const std::string& in, std::string& out, int level);
+bool brotli(const std::string& in, std::string& out, int quality);
+
+// Levels for bodies rebuilt whenever their data changes, like the
+// catalog: most of the size win of the maximum settings for a small
+// fraction of the CPU (Brotli 11 is ~50x slower than 5)
+const int kDynamicGzipLevel = 6;
+const int kDynamicBrotliQuality = 5;
+
+// A body held in every encoding, compressed once. Used for payloads
+// served many times, like the catalog and static files.
+class PrecompressedBody {
+public:
+    // At maximum effort, for static files. compress=false keeps only the
+    // identity variant (images, fonts).
+    explicit PrecompressedBody(std::string identity, bool compress = true);
+    // At the given levels
+    PrecompressedBody(std::string identity, int gzipLevel, int brotliQuality);
+
+    const std::string& identity() const { return identity_; }
+    // The variant to send for an Accept-Encoding header; sets encoding
+    // to what was chosen (Identity when compression does not pay off)
+    const std::string& select(const std::string& acceptEncoding, Encoding& encoding) const;
+
+private:
+    void compress(int gzipLevel, int brotliQuality);
+
+    std::string identity_;
+    std::string gzip_;   // empty when not worth sending
+    std::string brotli_;
+};
+
+} // namespace compression
+
+#endif // SWEET_SHOP_COMPRESSION_H
@@ -0,0 +1,59 @@
+#ifndef SWEET_SHOP_CONCURRENCY_LIMITER_H
+#define SWEET_SHOP_CONCURRENCY_LIMITER_H
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "Metrics.h"
+
+// Adaptive concurrency limit for one class of requests. A request over
+// the limit is refused at once rather than queued, so no I/O thread ever
+// sleeps waiting for a slot. The limit follows a latency gradient (Vegas / gradient2
+// style): it grows while recent latency stays close to the long-run
+// baseline and shrinks as queueing inflates it. A failed request
+// (503/504, the backend failing) cuts the limit multiplicatively, as
+// in AIMD.
+class ConcurrencyLimiter {
+public:
+    struct Options {
+        int initialLimit = 20;
+        int minLimit = 2;
+        int maxLimit = 200;
+        double tolerance = 1.5;                       // latency inflation tolerated before shrinking
+        double smoothing = 0.2;                       // weight of each new limit estimate
+        double backoff = 0.9;                         // multiplier applied on failure
+    };
+
+    ConcurrencyLimiter(const std::string& name, const Options& options);
+
+    // Takes a slot if one is free; false means shed the request
+    bool tryAcquire();
+    // Returns a slot taken by tryAcquire(). latency is the time the request
+    // held the slot; failed marks backend failures.
+    void release(std::chrono::nanoseconds latency, bool failed);
+
+    int limit() const;
+    // Seconds a shed client should wait before retrying
+    int retryAfterSeconds() const;
+
+private:
+    void update(double rttNanos, bool failed);
+
+    Options options_;
+    mutable std::mutex mutex_;
+    double limit_;
+    int inflight_{0};
+    double shortRtt_{0.0};  // fast EWMA of recent latency
+    double longRtt_{0.0};   // slow EWMA, the uncongested baseline
+
+    metrics::Gauge& limitGauge_;
+    metrics::Gauge& inflightGauge_;
+    metrics::Counter& rejected_;
+
+    // non-copyable
+    ConcurrencyLimiter(const ConcurrencyLimiter&) = delete;
+    ConcurrencyLimiter& operator=(const ConcurrencyLimiter&) = delete;
+};
+
+#endif // SWEET_SHOP_CONCURRENCY_LIMITER_H
@@ -0,0 +1,115 @@
+#ifndef SWEET_SHOP_CORS_H
+#define SWEET_SHOP_CORS_H
+
+#include <crow.h>
+
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Crow middleware applying one CORS policy to every response. Header
+// values are built once by configure(), so a preflight costs a few header
+// copies and never reaches admission control or a route handler. A long
+// Access-Control-Max-Age lets browsers skip most preflights entirely.
+//
+// Crow may answer OPTIONS itself before any middleware runs, so the
+// preflight headers are applied in after_handle as well.
+struct Cors {
+    struct Policy {
+        std::string origins = "*";  // comma-separated, or "*" for any
+        std::string methods = "GET, POST, PUT, PATCH, DELETE, OPTIONS";
+        std::string headers = "Content-Type, Authorization, Idempotency-Key";
+        std::string exposeHeaders = "ETag, Retry-After, Idempotent-Replayed, Feed-Seq";
+        int maxAge = 86400;         // seconds; browsers cap this (Chrome at 2h)
+    };
+
+    struct context {
+        bool preflight{false};
+    };
+
+    Cors() { configure(Policy()); }
+
+    // Call before the server starts
+    void configure(const Policy& policy) {
+        anyOrigin_ = false;
+        origins_.clear();
+        std::size_t pos = 0;
+        while (pos <= policy.origins.size()) {
+            std::size_t comma = policy.origins.find(',', pos);
+            if (comma == std::string::npos) comma = policy.origins.size();
+            std::string origin = trim(policy.origins.substr(pos, comma - pos));
+            pos = comma + 1;
+            if (origin == "*") {
+                anyOrigin_ = true;
+            } else if (!origin.empty()) {
+                origins_.insert(origin);
+            }
+        }
+        preflightHeaders_ = {
+            {"Access-Control-Allow-Methods", policy.methods},
+            {"Access-Control-Allow-Headers", policy.headers},
+            {"Access-Control-Max-Age", std::to_string(policy.maxAge)},
+        };
+        exposeHeaders_ = policy.exposeHeaders;
+    }
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx) {
+        if (!isPreflight(req)) return;
+        ctx.preflight = true;
+        res = crow::response(204);
+        applyPreflight(req, res);
+        res.end();
+    }
+
+    void after_handle(crow::request& req, crow::response& res, context& ctx) {
+        if (ctx.preflight) return; // answered in before_handle
+        if (isPreflight(req)) {
+            res.code = 204;
+            res.body.clear();
+            applyPreflight(req, res);
+            return;
+        }
+        if (allowOrigin(req, res) && !exposeHeaders_.empty()) {
+            res.set_header("Access-Control-Expose-Headers", exposeHeaders_);
+        }
+    }
+
+private:
+    static bool isPreflight(const crow::request& req) {
+        return req.method == crow::HTTPMethod::Options &&
+            !req.get_header_value("Access-Control-Request-Method").empty();
+    }
+
+    // Sets Access-Control-Allow-Origin when the request's origin passes
+    bool allowOrigin(const crow::request& req, crow::response& res) const {
+        if (anyOrigin_) {
+            res.set_header("Access-Control-Allow-Origin", "*");
+            return true;
+        }
+        // The answer depends on Origin, so shared caches must key on it
+        res.add_header("Vary", "Origin");
+        const std::string& origin = req.get_header_value("Origin");
+        if (origin.empty() || origins_.count(origin) == 0) return false;
+        res.set_header("Access-Control-Allow-Origin", origin);
+        return true;
+    }
+
+    void applyPreflight(const crow::request& req, crow::response& res) const {
+        if (!allowOrigin(req, res)) return; // browser will block the request
+        for (const auto& header : preflightHeaders_) res.set_header(header.first, header.second);
+    }
+
+    static std::string trim(const std::string& s) {
+        std::size_t begin = s.find_first_not_of(" \t");
+        if (begin == std::string::npos) return "";
+        return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+    }
+
+    bool anyOrigin_{true};
+    std::unordered_set<std::string> origins_;
+    std::vector<std::pair<std::string, std::string>> preflightHeaders_;
+    std::string exposeHeaders_;
+};
+
+#endif // SWEET_SHOP_CORS_H
@@ -3,11 +3,24 @@
 
 #include <mysql.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-class Database {
+#include "AsyncMySQL.h"
+#include "ReplicaSet.h"
+#include "Storage.h"
+
+// MySQL implementation of Storage
+class Database : public Storage {
 public:
     Database(const std::string& host,
              const std::string& user,
@@ -24,28 +37,113 @@ public:
     bool createUser(const std::string& username,
                     const std::string& passwordHash,
                     const std::string& email,
-                    bool isAdmin = false);
-    std::map<std::string, std::string> getUserByUsername(const std::string& username);
+                    bool isAdmin = false,
+                    int* outId = nullptr) override;
+    std::map<std::string, std::string> getUserByUsername(const std::string& username) override;
 
     // Sweet operations
     bool createSweet(const std::string& name,
                      const std::string& description,
                      const std::string& category,
                      double price,
-                     int quantity);
-    std::vector<std::map<std::string, std::string>> getAllSweets();
-    std::map<std::string, std::string> getSweetById(int id);
+                     int quantity,
+                     int* outId = nullptr) override;
+    std::vector<std::map<std::string, std::string>> getAllSweets(bool* ok = nullptr) override;
+    std::map<std::string, std::string> getSweetById(int id) override;
     bool updateSweet(int id,
                      const std::string& name,
                      const std::string& description,
                      const std::string& category,
                      double price,
-                     int quantity);
-    bool deleteSweet(int id);
+                     int quantity) override;
+    bool deleteSweet(int id) override;
+    bool upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                      std::vector<int>* outIds = nullptr,
+                      std::vector<bool>* outCreated = nullptr) override;
+    bool patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                     std::vector<std::map<std::string, std::string>>* outRows = nullptr) override;
 
     // Purchases
-    bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal);
-    bool restockSweet(int sweetId, int quantity);
+    bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                       std::map<std::string, std::string>* outPurchase = nullptr,
+                       const std::string& idempotencyKey = "") override;
+    bool restockSweet(int sweetId, int quantity,
+                      const std::string& idempotencyKey = "") override;
+    // Split stock lives in sweet_stock_slots. Restocks and absolute
+    // quantity writes go to the sweets row; a purchase that finds no slot
+    // able to cover it locks them all and spreads the whole stock again.
+    bool setStockSlots(int sweetId, int slots) override;
+    std::vector<std::map<std::string, std::string>> getStockSlots(int sweetId) override;
+    std::vector<std::map<std::string, std::string>>
+    getPurchasesByUser(int userId,
+                       const std::string& beforeDate,
+                       int beforeId,
+                       int limit,
+                       bool* ok = nullptr) override;
+    std::map<std::string, std::string> getPurchaseById(int id) override;
+
+    // Idempotency keys
+    std::map<std::string, std::string> getIdempotencyKey(const std::string& key) override;
+
+    // Aggregates
+    std::map<std::string, std::string> getSalesTotals() override;
+    std::vector<std::map<std::string, std::string>> getRevenueByCategory(bool* ok = nullptr) override;
+    long long getMaxPurchaseId() override;
+    std::vector<std::map<std::string, std::string>> getHourlySales(long long maxPurchaseId) override;
+
+    // Audit
+    bool logAudit(int userId,
+                  const std::string& action,
+                  const std::string& targetType,
+                  int targetId,
+                  const std::string& details) override;
+
+    // Non-blocking catalog reads and purchases. They use the AsyncMySQL
+    // pool once startAsync() has run, and the blocking path otherwise.
+    bool startAsync(std::size_t connections = 8);
+    void getAllSweetsAsync(RowsCallback done) override;
+    void getSweetByIdAsync(int id, RowCallback done) override;
+    void purchaseSweetAsync(int userId, int sweetId, int quantity,
+                            const std::string& idempotencyKey, PurchaseCallback done) override;
+    void getIdempotencyKeyAsync(const std::string& key, RowCallback done) override;
+
+    // Sends catalog reads and user lookups, blocking and non-blocking, to
+    // healthy read replicas. Writes and every other read stay on the
+    // primary. So do reads of a row this process wrote within the last
+    // maxLag + 1 s, which a replica in rotation may not have applied yet.
+    // Purchases and restocks do not count as writes of the whole catalog,
+    // so listings may show stock up to maxLag old. Call before serving
+    // traffic.
+    void useReplicas(std::unique_ptr<ReplicaSet> replicas);
+
+    // Shard maintenance, used by ShardedDatabase to move a sweet between
+    // servers. SweetRows is everything stored about one sweet: its sweets
+    // row, its purchases and its idempotency keys. A split sweet's row
+    // carries its whole stock, and stockSlots how many slots to re-split
+    // it into.
+    struct SweetRows {
+        std::map<std::string, std::string> sweet;
+        std::vector<std::map<std::string, std::string>> purchases;
+        std::vector<std::map<std::string, std::string>> idempotencyKeys;
+        int stockSlots{0};
+    };
+    bool listSweetIds(std::vector<int>& ids);
+    // False on error; an unknown id gives an empty sweet
+    bool exportSweet(int id, SweetRows& out);
+    // Writes the rows in one transaction, keeping ids and timestamps.
+    // Purchases and keys already present are left alone.
+    bool importSweet(const SweetRows& rows);
+    // Deletes the sweet with its purchases and keys in one transaction
+    bool dropSweet(int id);
+    // Takes count consecutive ids from the sweet_id_seq counter, above
+    // every id in this database's sweets table, and returns the first,
+    // or -1
+    long long reserveSweetIds(int count);
+    // Makes later reserveSweetIds / purchase ids larger than floor
+    bool raiseSweetIdFloor(long long floor);
+    bool raisePurchaseIdFloor(long long floor);
+    // The server's auto_increment_increment and auto_increment_offset
+    bool idSpacing(long long& increment, long long& offset);
 
     // Utility
     std::string escape(const std::string& input);
@@ -57,6 +155,81 @@ private:
     std::string password_;
     std::string database_;
     unsigned int port_;
+    std::string endpoint_; // host:port, for the slow query log
+
+    // The statement execute() last ran, until it is logged
+    std::string statementShape_;
+    std::chrono::steady_clock::time_point statementStart_;
+    bool statementOpen_{false};
+
+    // Holds the connection lock while in scope. Only a thread's outermost
+    // acquisition is timed into the pool wait histogram; nested ones, such
+    // as connect() inside a query, already hold it.
+    class ConnectionLock {
+    public:
+        explicit ConnectionLock(Database& db);
+        ~ConnectionLock();
+
+    private:
+        Database& db_;
+
+        // non-copyable
+        ConnectionLock(const ConnectionLock&) = delete;
+        ConnectionLock& operator=(const ConnectionLock&) = delete;
+    };
+    ConnectionLock lockConnection();
+    // mysql_query on the current connection, counting failures and timing
+    // it into the querylog. A statement with a result set is timed until
+    // storeResult() has read its rows.
+    int execute(const char* query);
+    MYSQL_RES* storeResult();
+    void logStatement(std::chrono::steady_clock::time_point end, std::uint64_t rows, const char* error);
+
+    // Runs a SELECT and returns every row keyed by column name; ok, when
+    // given, tells an error apart from an empty result
+    std::vector<std::map<std::string, std::string>> queryRows(const std::string& query,
+                                                               bool* ok = nullptr);
+
+    // Stock decrement of purchaseSweet, inside its transaction. Split
+    // means the sweet turned out to have slots and the caller should roll
+    // back and take from them instead.
+    enum class Take { Taken, Failed, Split };
+    Take takeFromRow(int sweetId, int quantity, double& price, std::string& name);
+    Take takeFromSlots(int sweetId, int quantity, double& price, std::string& name);
+    // Replaces the sweet's slots with count slots sharing stock evenly and
+    // zeroes its row; count 1 drops the slots and puts stock in the row
+    bool writeSlots(int sweetId, int count, long long stock);
+
+    // Sweets this process has seen split, so their purchases skip the row
+    // lock. Another process changing the mode is noticed at the next
+    // purchase, which then switches path.
+    bool isSplit(int sweetId);
+    void markSplit(int sweetId, bool split);
+
+    // Read-after-write tracking for replica routing. Keys are "catalog",
+    // "sweet:<id>" and "user:<name>"; a pinned key is read from the primary.
+    void pin(const std::string& key);
+    bool pinned(const std::string& key);
+    // Runs a replica-eligible SELECT on a replica; false (use the primary)
+    // when pinKey is pinned, no replica is healthy or the query fails
+    bool replicaRead(const std::string& query, const std::string& pinKey,
+                     std::vector<std::map<std::string, std::string>>& rows);
+    // Non-blocking replica-eligible SELECT; falls back to the primary pool
+    void readAsync(std::string query, const std::string& pinKey, AsyncMySQL::Callback done);
+
+    // Serializes use of the single connection across Crow worker threads.
+    std::recursive_mutex mutex_;
+    std::atomic<std::thread::id> lockOwner_{std::thread::id()};
+    int lockDepth_{0}; // guarded by mutex_
+
+    std::unique_ptr<AsyncMySQL> async_;
+
+    std::mutex splitMutex_;
+    std::unordered_set<int> split_;
+
+    std::unique_ptr<ReplicaSet> replicas_;
+    std::mutex pinsMutex_;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> pins_; // key -> expiry
 
     // non-copyable
     Database(const Database&) = delete;
@@ -0,0 +1,191 @@
+#ifndef SWEET_SHOP_HTTP_METRICS_H
+#define SWEET_SHOP_HTTP_METRICS_H
+
+#include <crow.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Metrics.h"
+
+// Crow middleware recording per-route latency and error counts. Requests
+// are labelled by method and the template of the route they matched, with
+// parameters written as ":id" / ":path" (GET /api/sweets/:id). Routes are
+// declared through addRoute(); a request matching none of them, and every
+// 404 or 405, shares the "unmatched" label, so no request can create a
+// series of its own.
+struct HttpMetrics {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Call for every route before the app runs, with the URL given to
+    // CROW_ROUTE
+    void addRoute(const std::string& url) {
+        routes_.push_back(parse(url));
+    }
+
+    void before_handle(crow::request& /*req*/, crow::response& /*res*/, context& ctx) {
+        ctx.start = std::chrono::steady_clock::now();
+    }
+
+    void after_handle(crow::request& req, crow::response& res, context& ctx) {
+        auto elapsed = std::chrono::steady_clock::now() - ctx.start;
+        std::size_t route = res.code == 404 || res.code == 405 ? kUnmatched : match(req.url);
+        Series& series = seriesFor(route, req.method);
+        series.latency->record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        if (res.code >= 500) {
+            series.serverErrors->inc();
+        } else if (res.code >= 400) {
+            series.clientErrors->inc();
+        }
+    }
+
+    // "METHOD template" of the declared route matching req, or "unmatched"
+    std::string routeLabel(const crow::request& req) const {
+        return label(match(req.url), req.method);
+    }
+
+private:
+    static constexpr std::size_t kUnmatched = static_cast<std::size_t>(-1);
+
+    struct Segment {
+        enum Kind { Literal, Int, Uint, Any, Path } kind;
+        std::string text; // Literal only
+    };
+
+    struct Route {
+        std::vector<Segment> segments;
+        std::string path; // "/api/sweets/:id", built once
+    };
+
+    struct Series {
+        metrics::Histogram* latency;
+        metrics::Counter* clientErrors;
+        metrics::Counter* serverErrors;
+    };
+
+    static Route parse(const std::string& url) {
+        Route route;
+        std::size_t i = 0;
+        while (i < url.size()) {
+            std::size_t next = url.find('/', i);
+            if (next == std::string::npos) next = url.size();
+            if (next > i) {
+                std::string text = url.substr(i, next - i);
+                Segment segment{Segment::Literal, std::string()};
+                if (text == "<path>") {
+                    segment.kind = Segment::Path;
+                    route.path += "/:path";
+                } else if (text == "<int>" || text == "<uint>" || text == "<string>" || text == "<double>") {
+                    segment.kind = text == "<int>" ? Segment::Int : text == "<uint>" ? Segment::Uint : Segment::Any;
+                    route.path += "/:id";
+                } else {
+                    route.path += "/" + text;
+                    segment.text = std::move(text);
+                }
+                route.segments.push_back(std::move(segment));
+            }
+            i = next + 1;
+        }
+        if (route.path.empty()) route.path = "/";
+        return route;
+    }
+
+    static bool isNumber(const char* s, std::size_t n, bool sign) {
+        std::size_t i = sign && n > 0 && (s[0] == '-' || s[0] == '+') ? 1 : 0;
+        if (n <= i) return false;
+        for (; i < n; ++i) {
+            if (s[i] < '0' || s[i] > '9') return false;
+        }
+        return true;
+    }
+
+    // Walks the URL in place; empty segments are skipped as in Crow
+    static bool matches(const Route& route, const std::string& url, std::size_t& literals) {
+        std::size_t pos = 0;
+        for (const Segment& want : route.segments) {
+            while (pos < url.size() && url[pos] == '/') ++pos;
+            if (want.kind == Segment::Path) return pos < url.size(); // the rest, at least one segment
+            if (pos >= url.size()) return false;
+            std::size_t end = url.find('/', pos);
+            if (end == std::string::npos) end = url.size();
+            const char* s = url.data() + pos;
+            std::size_t n = end - pos;
+            switch (want.kind) {
+            case Segment::Int:
+                if (!isNumber(s, n, true)) return false;
+                break;
+            case Segment::Uint:
+                if (!isNumber(s, n, false)) return false;
+                break;
+            case Segment::Any:
+                break;
+            default:
+                if (url.compare(pos, n, want.text) != 0) return false;
+                ++literals;
+            }
+            pos = end;
+        }
+        while (pos < url.size() && url[pos] == '/') ++pos;
+        return pos == url.size();
+    }
+
+    // Index of the declared route matching url, or kUnmatched. Literal
+    // segments beat parameters, as in Crow's router. Does not allocate.
+    std::size_t match(const std::string& url) const {
+        std::size_t best = kUnmatched;
+        std::size_t bestLiterals = 0;
+        for (std::size_t i = 0; i < routes_.size(); ++i) {
+            std::size_t literals = 0;
+            if (!matches(routes_[i], url, literals)) continue;
+            if (best == kUnmatched || literals > bestLiterals) {
+                best = i;
+                bestLiterals = literals;
+            }
+        }
+        return best;
+    }
+
+    std::string label(std::size_t route, crow::HTTPMethod method) const {
+        if (route == kUnmatched) return "unmatched";
+        return crow::method_name(method) + " " + routes_[route].path;
+    }
+
+    // Registry lookups take a lock, so each worker thread keeps its own
+    // map, keyed by route and method; only a miss builds the label
+    Series& seriesFor(std::size_t route, crow::HTTPMethod method) const {
+        thread_local std::unordered_map<std::uint64_t, Series> cache;
+        // 404/405 share one series whatever the method
+        std::uint64_t key = route == kUnmatched
+            ? ~std::uint64_t(0)
+            : static_cast<std::uint64_t>(route) << 8 | static_cast<std::uint64_t>(method);
+        auto it = cache.find(key);
+        if (it != cache.end()) return it->second;
+        std::string labels = "route=\"" + metrics::escapeLabel(label(route, method)) + "\"";
+        Series s;
+        s.latency = &metrics::histogram("sweet_shop_http_request_seconds", labels,
+                                        "HTTP request latency by route");
+        s.clientErrors = &metrics::counter("sweet_shop_http_errors_total",
+                                           labels + ",class=\"4xx\"",
+                                           "HTTP error responses by route");
+        s.serverErrors = &metrics::counter("sweet_shop_http_errors_total",
+                                           labels + ",class=\"5xx\"",
+                                           "HTTP error responses by route");
+        return cache.emplace(key, s).first->second;
+    }
+
+    // Parsed URL templates; only written before the app runs
+    std::vector<Route> routes_;
+};
+
+// CROW_ROUTE that also declares the route to HttpMetrics
+#define SHOP_ROUTE(app, url) \
+    ((app).get_middleware<HttpMetrics>().addRoute(url), CROW_ROUTE(app, url))
+
+#endif // SWEET_SHOP_HTTP_METRICS_H
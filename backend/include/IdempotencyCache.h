@@ -0,0 +1,85 @@
+#ifndef SWEET_SHOP_IDEMPOTENCY_CACHE_H
+#define SWEET_SHOP_IDEMPOTENCY_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Metrics.h"
+
+// In-process front of the idempotency_keys table, so a burst of client
+// retries costs a hash lookup instead of a transaction. Keys spread over
+// lock shards, each an LRU list capped at capacity / shards entries, and
+// expire after ttl. A key is claimed while its first request runs; a
+// duplicate arriving meanwhile is told so instead of racing it to
+// storage.
+//
+// Outcomes go to sweet_shop_idempotency_requests_total{result}.
+class IdempotencyCache {
+public:
+    enum class Claim {
+        New,        // caller runs the request, then calls complete() or release()
+        Done,       // an earlier request finished; stored holds its result
+        InProgress, // an earlier request with the same key is still running
+        Mismatch,   // the key was used for a different request
+    };
+
+    explicit IdempotencyCache(std::size_t capacity = 65536,
+                              std::chrono::seconds ttl = std::chrono::hours(24),
+                              std::size_t shards = 16);
+
+    // fingerprint names the operation and its arguments, e.g. "purchase:7:2"
+    Claim claim(const std::string& key,
+                const std::string& fingerprint,
+                std::map<std::string, std::string>& stored);
+    // Records the outcome of the request that used key
+    void complete(const std::string& key,
+                  const std::string& fingerprint,
+                  std::map<std::string, std::string> result);
+    // Drops a claim whose request failed, so a retry runs it again
+    void release(const std::string& key);
+
+    std::size_t size() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string fingerprint;
+        bool done{false};
+        std::map<std::string, std::string> result;
+        Clock::time_point expires;
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru; // most recently used first
+    };
+
+    Shard& shardFor(const std::string& key);
+    // Caller holds shard.mutex
+    void insert(Shard& shard, const std::string& key, Entry entry);
+
+    std::size_t perShard_;
+    std::chrono::seconds ttl_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    metrics::Counter& fresh_;
+    metrics::Counter& replayed_;
+    metrics::Counter& inProgress_;
+    metrics::Counter& mismatched_;
+
+    // non-copyable
+    IdempotencyCache(const IdempotencyCache&) = delete;
+    IdempotencyCache& operator=(const IdempotencyCache&) = delete;
+};
+
+#endif // SWEET_SHOP_IDEMPOTENCY_CACHE_H
@@ -0,0 +1,39 @@
+#ifndef SWEET_SHOP_INVENTORY_FEED_H
+#define SWEET_SHOP_INVENTORY_FEED_H
+
+#include <string>
+
+#include "ShopEvents.h"
+#include "Topic.h"
+
+// Publishes committed catalog changes to a Topic as compact JSON deltas,
+// so open pages can patch their copy of the catalog instead of polling:
+//
+//   {"type":"upsert","sweet":{...}}       created or edited
+//   {"type":"delete","id":7}
+//   {"type":"stock","id":7,"delta":-2}    purchase or restock
+//   {"type":"reset"}                      bulk import: reload the catalog
+//
+// Deltas are relative, so a page must not apply one its copy already
+// includes: the catalog read returns the topic's sequence number as of
+// the read (SweetManager::setCatalogVersion).
+class InventoryFeed : public ShopListener {
+public:
+    explicit InventoryFeed(Topic& topic) : topic_(topic) {}
+
+    void onSweetCreated(const Sweet& sweet) override;
+    void onSweetUpdated(const Sweet& sweet) override;
+    void onSweetDeleted(int sweetId) override;
+    // One reset instead of a delta per row, which would push the whole
+    // ring out and reset every subscriber anyway
+    void onSweetsImported(const std::vector<Sweet>& sweets, const std::vector<bool>& created) override;
+    void onPurchase(const Purchase& purchase) override;
+    void onRestock(int sweetId, int quantity) override;
+
+private:
+    void publishStock(int sweetId, int delta);
+
+    Topic& topic_;
+};
+
+#endif // SWEET_SHOP_INVENTORY_FEED_H
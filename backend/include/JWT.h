@@ -18,12 +18,14 @@ public:
     // Verify signature and expiry. Returns true if valid.
     bool verify(const std::string& token) const;
 
+    // base64url codec used for every token segment
+    std::string base64UrlEncode(const std::string& input) const;
+    std::string base64UrlDecode(const std::string& input) const;
+
 private:
     std::string secret_;
 
     // Helpers (implementation details in JWT.cpp)
-    std::string base64UrlEncode(const std::string& input) const;
-    std::string base64UrlDecode(const std::string& input) const;
     std::string hmacSha256(const std::string& data) const;
 };
 
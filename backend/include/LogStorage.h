@@ -0,0 +1,232 @@
+#ifndef SWEET_SHOP_LOG_STORAGE_H
+#define SWEET_SHOP_LOG_STORAGE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Storage.h"
+#include "WriteAheadLog.h"
+
+// Embedded, durable Storage engine for deployments without MySQL (edge
+// kiosks). All rows live in memory behind hash indexes; every mutation is
+// appended to a write-ahead log and acknowledged once the group-commit
+// fsync covering it completes. Once the active WAL segment grows past
+// snapshotEveryBytes, a background thread writes a compacted snapshot of
+// the whole state and drops the segments it covers, so recovery replays
+// at most one snapshot plus the WAL written since.
+//
+// Data directory layout:
+//   snapshot-<n>.snap  state as of the start of wal segment n
+//   wal-<n>.log        mutations, replayed in order on open()
+//
+// Writers serialize on one lock while applying and appending, then wait
+// for durability without it, so one fsync covers many writers. A reader
+// may see a mutation a moment before its writer's fsync returns. A failed
+// write or fsync turns the engine read-only and takes every mutation that
+// did not reach the disk back out of memory, so a call that returned
+// false has changed nothing.
+class LogStorage : public Storage {
+public:
+    explicit LogStorage(const std::string& dataDir,
+                        std::uint64_t snapshotEveryBytes = 64ull << 20,
+                        std::chrono::microseconds groupCommitWindow = std::chrono::microseconds(0));
+    ~LogStorage() override;
+
+    // Recovers state from the data directory and starts the log
+    bool open();
+
+    // User operations
+    bool createUser(const std::string& username,
+                    const std::string& passwordHash,
+                    const std::string& email,
+                    bool isAdmin = false,
+                    int* outId = nullptr) override;
+    std::map<std::string, std::string> getUserByUsername(const std::string& username) override;
+
+    // Sweet operations
+    bool createSweet(const std::string& name,
+                     const std::string& description,
+                     const std::string& category,
+                     double price,
+                     int quantity,
+                     int* outId = nullptr) override;
+    std::vector<std::map<std::string, std::string>> getAllSweets(bool* ok = nullptr) override;
+    std::map<std::string, std::string> getSweetById(int id) override;
+    bool updateSweet(int id,
+                     const std::string& name,
+                     const std::string& description,
+                     const std::string& category,
+                     double price,
+                     int quantity) override;
+    bool deleteSweet(int id) override;
+    bool upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                      std::vector<int>* outIds = nullptr,
+                      std::vector<bool>* outCreated = nullptr) override;
+    bool patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                     std::vector<std::map<std::string, std::string>>* outRows = nullptr) override;
+
+    // Purchases
+    bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                       std::map<std::string, std::string>* outPurchase = nullptr,
+                       const std::string& idempotencyKey = "") override;
+    bool restockSweet(int sweetId, int quantity,
+                      const std::string& idempotencyKey = "") override;
+    std::vector<std::map<std::string, std::string>>
+    getPurchasesByUser(int userId,
+                       const std::string& beforeDate,
+                       int beforeId,
+                       int limit,
+                       bool* ok = nullptr) override;
+    std::map<std::string, std::string> getPurchaseById(int id) override;
+
+    // Idempotency keys
+    std::map<std::string, std::string> getIdempotencyKey(const std::string& key) override;
+
+    // Aggregates
+    std::map<std::string, std::string> getSalesTotals() override;
+    std::vector<std::map<std::string, std::string>> getRevenueByCategory(bool* ok = nullptr) override;
+    long long getMaxPurchaseId() override;
+    std::vector<std::map<std::string, std::string>> getHourlySales(long long maxPurchaseId) override;
+
+    // Audit
+    bool logAudit(int userId,
+                  const std::string& action,
+                  const std::string& targetType,
+                  int targetId,
+                  const std::string& details) override;
+
+private:
+    struct UserRecord {
+        int id{0};
+        std::string username;
+        std::string passwordHash;
+        std::string email;
+        bool isAdmin{false};
+        std::string createdAt;
+    };
+
+    struct SweetRecord {
+        int id{0};
+        std::string name;
+        std::string description;
+        std::string category;
+        double price{0.0};
+        int quantity{0};
+        std::string createdAt;
+        std::string updatedAt;
+        long long purchases{0}; // enforces ON DELETE RESTRICT
+    };
+
+    struct PurchaseRecord {
+        int id{0};
+        int userId{0};
+        int sweetId{0};
+        std::string sweetName;
+        int quantity{0};
+        double totalPrice{0.0};
+        std::string purchaseDate;
+    };
+
+    struct AuditRecord {
+        int id{0};
+        int userId{0};
+        std::string action;
+        std::string targetType;
+        int targetId{0};
+        std::string details;
+        std::string createdAt;
+    };
+
+    // idempotency_keys row; purchaseId is 0 for restocks
+    struct KeyRecord {
+        std::string operation;
+        int sweetId{0};
+        int quantity{0};
+        int purchaseId{0};
+        std::string createdAt;
+    };
+
+    // Everything a snapshot captures
+    struct State {
+        std::unordered_map<int, UserRecord> users;
+        std::unordered_map<std::string, int> userIds; // username index
+        std::unordered_map<int, SweetRecord> sweets;
+        std::unordered_map<int, PurchaseRecord> purchases;
+        // user id -> (purchase_date, id) -> purchase id, for keyset paging
+        std::unordered_map<int, std::map<std::pair<std::string, int>, int>> history;
+        std::vector<AuditRecord> audit;
+        std::unordered_map<std::string, KeyRecord> keys;
+        std::deque<std::pair<std::string, std::string>> keyOrder; // (created_at, key), oldest first
+        int nextUserId{1};
+        int nextSweetId{1};
+        int nextPurchaseId{1};
+        int nextAuditId{1};
+    };
+
+    // What a record is about to overwrite, so the mutation can be taken
+    // back out of the state if its commit fails
+    struct Undo {
+        std::uint64_t lsn{0};
+        int nextIds[4]{}; // users, sweets, purchases, audit
+        std::size_t auditSize{0};
+        std::vector<std::pair<int, std::string>> users; // added: id, username
+        std::vector<std::pair<int, std::optional<SweetRecord>>> sweets; // earlier row, if any
+        std::vector<int> purchases; // added
+        std::vector<std::pair<std::string, std::optional<KeyRecord>>> keys;
+    };
+
+    // Applies one WAL or snapshot record; false if it does not decode
+    static bool apply(State& state, const std::string& record);
+    static void capture(const State& state, const std::string& record, Undo& undo);
+    static void restore(State& state, const Undo& undo);
+    static void writeSnapshot(const State& state, std::string& out);
+    // Records a key and forgets those past their lifetime
+    static void recordKey(State& state, const std::string& key, KeyRecord record);
+
+    // Applies and appends a record while the caller holds mutex_
+    // exclusively. Returns its LSN, or 0 with state_ unchanged once the
+    // log has failed.
+    std::uint64_t log(const std::string& record);
+    // Waits for the LSN outside mutex_ and wakes the snapshotter if due.
+    // On failure, rolls back every mutation the log did not make durable.
+    bool commit(std::uint64_t lsn);
+    void rollback();
+    void snapshotLoop();
+    bool takeSnapshot();
+
+    static std::map<std::string, std::string> sweetRow(const SweetRecord& s);
+    static std::map<std::string, std::string> purchaseRow(const PurchaseRecord& p);
+
+    std::string dir_;
+    std::uint64_t snapshotEveryBytes_;
+    std::chrono::microseconds groupCommitWindow_;
+
+    mutable std::shared_mutex mutex_;
+    State state_;
+    std::deque<Undo> undo_; // mutations not yet known durable, oldest first
+    std::unique_ptr<WriteAheadLog> wal_;
+
+    std::mutex snapshotMutex_;
+    std::condition_variable snapshotWake_;
+    bool snapshotDue_{false};
+    bool stopping_{false};
+    std::thread snapshotter_;
+
+    // non-copyable
+    LogStorage(const LogStorage&) = delete;
+    LogStorage& operator=(const LogStorage&) = delete;
+};
+
+#endif // SWEET_SHOP_LOG_STORAGE_H
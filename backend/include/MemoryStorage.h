@@ -0,0 +1,184 @@
+#ifndef SWEET_SHOP_MEMORY_STORAGE_H
+#define SWEET_SHOP_MEMORY_STORAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Storage.h"
+
+// Concurrent in-memory Storage engine, for load-testing the HTTP and auth
+// layers without a MySQL server. Sweets and purchase histories live in
+// lock stripes so unrelated rows never contend. A purchase holds the
+// sweet's stripe across the stock check, the decrement and the history
+// insert, so it is all-or-nothing and never oversells. Aggregate reads
+// visit stripes one at a time and are not a point-in-time snapshot,
+// like READ COMMITTED scans. Nothing is persisted.
+class MemoryStorage : public Storage {
+public:
+    explicit MemoryStorage(std::size_t stripes = 64);
+
+    // User operations
+    bool createUser(const std::string& username,
+                    const std::string& passwordHash,
+                    const std::string& email,
+                    bool isAdmin = false,
+                    int* outId = nullptr) override;
+    std::map<std::string, std::string> getUserByUsername(const std::string& username) override;
+
+    // Sweet operations
+    bool createSweet(const std::string& name,
+                     const std::string& description,
+                     const std::string& category,
+                     double price,
+                     int quantity,
+                     int* outId = nullptr) override;
+    std::vector<std::map<std::string, std::string>> getAllSweets(bool* ok = nullptr) override;
+    std::map<std::string, std::string> getSweetById(int id) override;
+    bool updateSweet(int id,
+                     const std::string& name,
+                     const std::string& description,
+                     const std::string& category,
+                     double price,
+                     int quantity) override;
+    bool deleteSweet(int id) override;
+    bool upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                      std::vector<int>* outIds = nullptr,
+                      std::vector<bool>* outCreated = nullptr) override;
+    bool patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                     std::vector<std::map<std::string, std::string>>* outRows = nullptr) override;
+
+    // Purchases
+    bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                       std::map<std::string, std::string>* outPurchase = nullptr,
+                       const std::string& idempotencyKey = "") override;
+    bool restockSweet(int sweetId, int quantity,
+                      const std::string& idempotencyKey = "") override;
+    std::vector<std::map<std::string, std::string>>
+    getPurchasesByUser(int userId,
+                       const std::string& beforeDate,
+                       int beforeId,
+                       int limit,
+                       bool* ok = nullptr) override;
+    std::map<std::string, std::string> getPurchaseById(int id) override;
+
+    // Idempotency keys
+    std::map<std::string, std::string> getIdempotencyKey(const std::string& key) override;
+
+    // Aggregates
+    std::map<std::string, std::string> getSalesTotals() override;
+    std::vector<std::map<std::string, std::string>> getRevenueByCategory(bool* ok = nullptr) override;
+    long long getMaxPurchaseId() override;
+    std::vector<std::map<std::string, std::string>> getHourlySales(long long maxPurchaseId) override;
+
+    // Audit
+    bool logAudit(int userId,
+                  const std::string& action,
+                  const std::string& targetType,
+                  int targetId,
+                  const std::string& details) override;
+
+private:
+    struct UserRecord {
+        int id{0};
+        std::string username;
+        std::string passwordHash;
+        std::string email;
+        bool isAdmin{false};
+        std::string createdAt;
+    };
+
+    struct SweetRecord {
+        int id{0};
+        std::string name;
+        std::string description;
+        std::string category;
+        double price{0.0};
+        int quantity{0};
+        std::string createdAt;
+        std::string updatedAt;
+        long long purchases{0}; // enforces ON DELETE RESTRICT
+    };
+
+    struct PurchaseRecord {
+        int id{0};
+        int userId{0};
+        int sweetId{0};
+        std::string sweetName;
+        int quantity{0};
+        double totalPrice{0.0};
+        std::string purchaseDate;
+    };
+
+    struct AuditRecord {
+        int id{0};
+        int userId{0};
+        std::string action;
+        std::string targetType;
+        int targetId{0};
+        std::string details;
+        std::string createdAt;
+    };
+
+    // idempotency_keys row; purchaseId is 0 for restocks
+    struct KeyRecord {
+        std::string operation;
+        int sweetId{0};
+        int quantity{0};
+        int purchaseId{0};
+        std::string createdAt;
+    };
+
+    // Per-user history ordered by (purchase_date, id) for keyset paging
+    using History = std::map<std::pair<std::string, int>, PurchaseRecord>;
+
+    template <typename Rows>
+    struct Stripe {
+        std::mutex mutex;
+        Rows rows;
+    };
+
+    Stripe<std::unordered_map<int, SweetRecord>>& sweetStripe(int id);
+    Stripe<std::unordered_map<int, History>>& historyStripe(int userId);
+    Stripe<std::unordered_map<int, std::pair<int, std::string>>>& purchaseIndexStripe(int id);
+
+    // Caller holds keysMutex_; also forgets keys past their lifetime
+    void recordKey(const std::string& key, KeyRecord record);
+
+    static std::map<std::string, std::string> sweetRow(const SweetRecord& s);
+    static std::map<std::string, std::string> purchaseRow(const PurchaseRecord& p);
+
+    std::size_t stripeCount_;
+    std::vector<Stripe<std::unordered_map<int, SweetRecord>>> sweets_;
+    std::vector<Stripe<std::unordered_map<int, History>>> histories_;
+    // purchase id -> (user id, purchase_date), to find a row in histories_
+    std::vector<Stripe<std::unordered_map<int, std::pair<int, std::string>>>> purchaseIndex_;
+
+    std::shared_mutex usersMutex_;
+    std::unordered_map<std::string, UserRecord> users_;
+
+    std::mutex keysMutex_;
+    std::unordered_map<std::string, KeyRecord> keys_;
+    std::deque<std::pair<std::string, std::string>> keyOrder_; // (created_at, key), oldest first
+
+    std::mutex auditMutex_;
+    std::vector<AuditRecord> audit_;
+
+    std::atomic<int> nextUserId_{1};
+    std::atomic<int> nextSweetId_{1};
+    std::atomic<int> nextPurchaseId_{1};
+    std::atomic<int> nextAuditId_{1};
+
+    // non-copyable
+    MemoryStorage(const MemoryStorage&) = delete;
+    MemoryStorage& operator=(const MemoryStorage&) = delete;
+};
+
+#endif // SWEET_SHOP_MEMORY_STORAGE_H
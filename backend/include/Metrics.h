@@ -0,0 +1,117 @@
+#ifndef SWEET_SHOP_METRICS_H
+#define SWEET_SHOP_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace metrics {
+
+// Latency histogram with log-linear buckets: 8 sub-buckets per power of
+// two (at most 12.5% relative error) from 1 ns up to ~18 minutes.
+// record() is a relaxed atomic increment on a shard picked per thread,
+// so concurrent writers never share a cache line or take a lock.
+class Histogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxExponent = 40;
+    static constexpr int kBuckets = (kMaxExponent - kSubBits + 1) * kSubBuckets;
+    static constexpr int kShards = 8;
+
+    struct Snapshot {
+        std::vector<std::uint64_t> counts; // kBuckets entries
+        std::uint64_t count{0};
+        std::uint64_t sumNanos{0};
+
+        // Upper bound of the bucket holding the given quantile (0..1)
+        std::uint64_t percentile(double q) const;
+        void merge(const Snapshot& other);
+    };
+
+    void record(std::uint64_t nanos) {
+        Shard& s = shards_[shardIndex()];
+        s.counts[bucketFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+        s.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const;
+
+    static int bucketFor(std::uint64_t nanos);
+    // Exclusive upper bound of a bucket, in nanoseconds
+    static std::uint64_t bucketUpperBound(int bucket);
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<std::uint64_t>, kBuckets> counts{};
+        std::atomic<std::uint64_t> sumNanos{0};
+    };
+
+    static std::size_t shardIndex();
+
+    std::array<Shard, kShards> shards_;
+};
+
+class Counter {
+public:
+    void inc(std::uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+class Gauge {
+public:
+    void set(std::int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(std::int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    std::int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::int64_t> value_{0};
+};
+
+// Series are created on first use and live for the whole process, so
+// callers should look them up once and keep the reference. `labels` is
+// the Prometheus label list without braces, e.g. method="getAllSweets".
+Histogram& histogram(const std::string& name, const std::string& labels,
+                     const std::string& help = "");
+Counter& counter(const std::string& name, const std::string& labels,
+                 const std::string& help = "");
+Gauge& gauge(const std::string& name, const std::string& labels,
+             const std::string& help = "");
+
+// A label value with backslash, double quote and newline escaped as the
+// exposition format requires
+std::string escapeLabel(const std::string& value);
+
+// Every registered series in Prometheus text exposition format 0.0.4.
+// Histograms are exported in seconds.
+std::string renderPrometheus();
+
+// Records the lifetime of the object into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        histogram_.record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+} // namespace metrics
+
+#endif // SWEET_SHOP_METRICS_H
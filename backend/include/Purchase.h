@@ -0,0 +1,16 @@
+#ifndef SWEET_SHOP_PURCHASE_H
+#define SWEET_SHOP_PURCHASE_H
+
+#include <string>
+
+struct Purchase {
+    int id{0};
+    int userId{0};
+    int sweetId{0};
+    std::string sweetName;
+    int quantity{0};
+    double totalPrice{0.0};
+    std::string purchaseDate;
+};
+
+#endif // SWEET_SHOP_PURCHASE_H
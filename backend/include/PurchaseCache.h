@@ -0,0 +1,62 @@
+#ifndef SWEET_SHOP_PURCHASE_CACHE_H
+#define SWEET_SHOP_PURCHASE_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Purchase.h"
+
+// Keeps the most recent purchases of recently active users so the first
+// page of "my orders" does not touch the database. Entries are seeded from
+// the first history page read from the database and kept current by
+// append() on every committed purchase. A seeded page is trusted for ttl
+// only, so purchases committed by another server process show up after
+// at most that long.
+class RecentPurchaseCache {
+public:
+    explicit RecentPurchaseCache(std::size_t perUser = 20,
+                                 std::size_t maxUsers = 1024,
+                                 std::chrono::milliseconds ttl = std::chrono::seconds(30));
+
+    // Copies the newest `limit` purchases into out. Returns false when the
+    // user is not cached or the cache cannot answer for that many rows.
+    bool getFirstPage(int userId, int limit, std::vector<Purchase>& out);
+
+    // Seeds a user from a first page read from the database (newest first).
+    // `complete` means the page holds the user's entire history.
+    void fill(int userId, const std::vector<Purchase>& newestFirst, bool complete);
+
+    // Records a committed purchase.
+    void append(const Purchase& purchase);
+
+    // Forgets a user, e.g. after a purchase whose outcome is unknown.
+    void invalidate(int userId);
+
+    std::size_t perUserCapacity() const { return perUser_; }
+
+private:
+    struct Entry {
+        std::deque<Purchase> rows; // newest first
+        bool seeded{false};
+        bool complete{false};
+        std::chrono::steady_clock::time_point seededAt;
+        std::list<int>::iterator lru;
+    };
+
+    Entry& touch(int userId);
+    void trim(Entry& entry);
+
+    std::size_t perUser_;
+    std::size_t maxUsers_;
+    std::chrono::milliseconds ttl_;
+    std::mutex mutex_;
+    std::unordered_map<int, Entry> entries_;
+    std::list<int> lru_; // most recently used first
+};
+
+#endif // SWEET_SHOP_PURCHASE_CACHE_H
@@ -0,0 +1,63 @@
+#ifndef SWEET_SHOP_QUERY_LOG_H
+#define SWEET_SHOP_QUERY_LOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace querylog {
+
+// Per-statement timing for the MySQL clients. Every statement is
+// aggregated under its shape: the SQL with literals replaced by '?' and
+// lists of them by "(...)", so "WHERE id=7" and "WHERE id=9" count
+// together and values never reach the log. The last kSlowEntries
+// statements at or above the threshold are kept as well.
+//
+// Recording a statement costs one pass over its text and one short lock,
+// microseconds beside a round trip to the server. Only slow statements
+// and new shapes allocate.
+constexpr std::size_t kSlowEntries = 256;
+// Distinct shapes kept; later ones are counted under "(other)"
+constexpr std::size_t kMaxShapes = 1000;
+
+struct ShapeStats {
+    std::string shape;
+    std::uint64_t calls{0};
+    std::uint64_t errors{0};
+    std::uint64_t slow{0};
+    std::uint64_t rows{0}; // returned or affected
+    std::uint64_t totalNanos{0};
+    std::uint64_t maxNanos{0};
+};
+
+struct SlowQuery {
+    std::string shape;
+    std::string server; // host:port
+    std::chrono::system_clock::time_point at;
+    std::uint64_t nanos{0};
+    std::uint64_t rows{0};
+    std::string error; // mysql_error, empty on success
+};
+
+// Writes the shape of sql into out, reusing its capacity
+void shape(const char* sql, std::size_t length, std::string& out);
+
+// error is null or empty for a statement that succeeded
+void record(const std::string& shape, const std::string& server,
+            std::uint64_t nanos, std::uint64_t rows, const char* error);
+
+// 100 ms unless changed
+void setThreshold(std::chrono::nanoseconds threshold);
+std::chrono::nanoseconds threshold();
+
+// Most total time first
+std::vector<ShapeStats> shapes();
+// Newest first
+std::vector<SlowQuery> slowQueries();
+void reset();
+
+} // namespace querylog
+
+#endif // SWEET_SHOP_QUERY_LOG_H
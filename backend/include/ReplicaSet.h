@@ -0,0 +1,118 @@
+#ifndef SWEET_SHOP_REPLICA_SET_H
+#define SWEET_SHOP_REPLICA_SET_H
+
+#include <mysql.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "AsyncMySQL.h"
+#include "Metrics.h"
+
+// Read replicas of the primary MySQL server. A monitor thread runs
+// SHOW REPLICA STATUS (SHOW SLAVE STATUS before 8.0.22) on each replica
+// every checkEvery; a replica takes reads only while both replication
+// threads run and Seconds_Behind_Source is at most maxLag. Reads go round
+// robin over the healthy ones, and every method reports failure rather
+// than waiting when none is, so the caller falls back to the primary.
+//
+// Exported per replica as sweet_shop_db_replica_lag_seconds and
+// sweet_shop_db_replica_healthy{replica="host:port"}.
+class ReplicaSet {
+public:
+    struct Options {
+        std::chrono::seconds maxLag{2};
+        std::chrono::milliseconds checkEvery{1000};
+        // Non-blocking connections per replica; 0 serves async reads from
+        // the primary
+        std::size_t asyncConnections{4};
+    };
+
+    struct Status {
+        std::string endpoint; // host:port
+        bool healthy{false};
+        long long lagSeconds{-1}; // -1 when unknown or not replicating
+        std::string error;
+    };
+
+    ReplicaSet(const std::string& user,
+               const std::string& password,
+               const std::string& dbName,
+               Options options);
+    ~ReplicaSet();
+
+    // Register replicas before start()
+    void add(const std::string& host, unsigned int port = 3306);
+    // Parses "host[:port],host[:port]" (port 3306 by default)
+    static bool parseEndpoints(const std::string& text,
+                               std::vector<std::pair<std::string, unsigned int>>& out);
+    // Starts the monitor thread and the async pools; replicas stay
+    // unhealthy until their first check passes
+    bool start();
+    void stop();
+
+    std::size_t size() const { return replicas_.size(); }
+    std::chrono::seconds maxLag() const { return options_.maxLag; }
+
+    // Runs a SELECT on the next healthy replica. False when none is
+    // healthy or the query fails.
+    bool query(const std::string& sql, std::vector<std::map<std::string, std::string>>& rows);
+    // The async pool of the next healthy replica, or nullptr
+    AsyncMySQL* asyncPool();
+
+    std::vector<Status> status() const;
+
+private:
+    struct Replica {
+        std::string host;
+        unsigned int port{3306};
+        std::string endpoint;
+
+        std::mutex mutex; // guards conn and shape
+        MYSQL* conn{nullptr};
+        std::string shape; // query log buffer, reused
+
+        MYSQL* monitor{nullptr}; // monitor thread only
+        std::atomic<bool> healthy{false};
+        std::atomic<long long> lag{-1};
+        mutable std::mutex errorMutex;
+        std::string error;
+
+        std::unique_ptr<AsyncMySQL> async;
+        metrics::Gauge* lagGauge{nullptr};
+        metrics::Gauge* healthyGauge{nullptr};
+    };
+
+    MYSQL* open(const Replica& replica, std::string& error) const;
+    // Next healthy replica after the round-robin cursor, or nullptr
+    Replica* pick();
+    void check(Replica& replica);
+    void monitorLoop();
+
+    std::string user_;
+    std::string password_;
+    std::string database_;
+    Options options_;
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    std::atomic<std::size_t> next_{0};
+
+    std::mutex stopMutex_;
+    std::condition_variable stopWake_;
+    bool stopping_{false};
+    std::thread monitor_;
+
+    // non-copyable
+    ReplicaSet(const ReplicaSet&) = delete;
+    ReplicaSet& operator=(const ReplicaSet&) = delete;
+};
+
+#endif // SWEET_SHOP_REPLICA_SET_H
@@ -0,0 +1,60 @@
+#ifndef SWEET_SHOP_RESPONSE_COMPRESSION_H
+#define SWEET_SHOP_RESPONSE_COMPRESSION_H
+
+#include <crow.h>
+
+#include <string>
+
+#include "Compression.h"
+
+// Crow middleware compressing text responses per Accept-Encoding. Bodies
+// under compression::kMinSize and responses that already carry a
+// Content-Encoding (precompressed payloads) pass through untouched.
+// Dynamic bodies use fast settings; repeated payloads should be wrapped
+// in a PrecompressedBody and sent with send() instead.
+struct ResponseCompression {
+    struct context {};
+
+    void before_handle(crow::request& /*req*/, crow::response& /*res*/, context& /*ctx*/) {}
+
+    void after_handle(crow::request& req, crow::response& res, context& /*ctx*/) {
+        if (res.body.size() < compression::kMinSize) return;
+        if (!res.get_header_value("Content-Encoding").empty()) return;
+        if (!compressible(res.get_header_value("Content-Type"))) return;
+        compression::Encoding encoding =
+            compression::negotiate(req.get_header_value("Accept-Encoding"));
+        if (encoding == compression::Encoding::Identity) return;
+
+        std::string out;
+        bool ok = encoding == compression::Encoding::Gzip
+            ? compression::gzip(res.body, out, 5)
+            : compression::brotli(res.body, out, 4);
+        if (!ok || out.size() >= res.body.size()) return;
+        res.body.swap(out);
+        res.set_header("Content-Encoding", compression::name(encoding));
+        res.add_header("Vary", "Accept-Encoding");
+    }
+
+    // Fills res with the best variant of a precompressed body
+    static void send(crow::response& res, const compression::PrecompressedBody& body,
+                     const std::string& acceptEncoding, const std::string& contentType) {
+        compression::Encoding encoding;
+        res.body = body.select(acceptEncoding, encoding);
+        res.set_header("Content-Type", contentType);
+        if (encoding != compression::Encoding::Identity) {
+            res.set_header("Content-Encoding", compression::name(encoding));
+        }
+        res.add_header("Vary", "Accept-Encoding");
+    }
+
+    // Crow fills in text/html when a handler sets no Content-Type
+    static bool compressible(const std::string& contentType) {
+        return contentType.empty() ||
+            contentType.compare(0, 5, "text/") == 0 ||
+            contentType.find("json") != std::string::npos ||
+            contentType.find("javascript") != std::string::npos ||
+            contentType.find("xml") != std::string::npos;
+    }
+};
+
+#endif // SWEET_SHOP_RESPONSE_COMPRESSION_H
@@ -0,0 +1,44 @@
+#ifndef SWEET_SHOP_ROW_FORMAT_H
+#define SWEET_SHOP_ROW_FORMAT_H
+
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+// Formatting shared by the embedded Storage engines so their rows read
+// exactly like the ones MySQL returns.
+namespace rowformat {
+
+// Local time as MySQL prints a TIMESTAMP
+inline std::string timestamp(std::time_t t) {
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    char buf[20];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+inline std::string now() {
+    return timestamp(std::time(nullptr));
+}
+
+// DECIMAL(10,2) text
+inline std::string money(double v) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << v;
+    return ss.str();
+}
+
+inline double roundCents(double v) {
+    return std::round(v * 100.0) / 100.0;
+}
+
+} // namespace rowformat
+
+#endif // SWEET_SHOP_ROW_FORMAT_H
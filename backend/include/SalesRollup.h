@@ -0,0 +1,88 @@
+#ifndef SWEET_SHOP_SALES_ROLLUP_H
+#define SWEET_SHOP_SALES_ROLLUP_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Purchase.h"
+#include "ShopEvents.h"
+
+class Storage; // forward declaration
+
+struct SalesBucket {
+    long long orders{0};
+    long long units{0};
+    double revenue{0.0};
+
+    void add(const SalesBucket& other) {
+        orders += other.orders;
+        units += other.units;
+        revenue += other.revenue;
+    }
+};
+
+struct SalesReport {
+    SalesBucket total;
+    std::map<int, SalesBucket> bySweet;
+    std::map<std::string, SalesBucket> byCategory;
+    // Series keyed by bucket start ("YYYY-MM-DD" or "YYYY-MM-DD HH:00")
+    std::map<std::string, SalesBucket> series;
+};
+
+// Pre-aggregated sales per hour and per day, broken down by sweet and by
+// category. Range reports merge buckets instead of scanning purchases.
+// Buckets use the database's wall-clock purchase_date, so report dates
+// mean the same thing they do in SQL.
+class SalesRollup : public ShopListener {
+public:
+    // Hourly buckets older than hourlyRetentionDays are dropped; daily
+    // buckets are kept for the whole history.
+    explicit SalesRollup(int hourlyRetentionDays = 90);
+
+    // Loads every committed purchase into the buckets. Purchases that
+    // commit while the backfill runs are buffered and applied afterwards,
+    // so it is safe to call with listeners already registered.
+    bool backfill(Storage& db);
+
+    // Inclusive date range, "YYYY-MM-DD". hourly selects the series
+    // resolution; hours outside the retention window are missing from
+    // an hourly series but still counted in the totals.
+    bool report(const std::string& startDate,
+                const std::string& endDate,
+                bool hourly,
+                SalesReport& out) const;
+
+    void onSweetCreated(const Sweet& sweet) override;
+    void onSweetUpdated(const Sweet& sweet) override;
+    void onPurchase(const Purchase& purchase) override;
+
+private:
+    struct Slice {
+        SalesBucket total;
+        std::unordered_map<int, SalesBucket> bySweet;
+        std::unordered_map<std::string, SalesBucket> byCategory;
+    };
+
+    void apply(long long hour, int sweetId, const std::string& category,
+               const SalesBucket& sale);
+    void pruneHourly(long long newestHour);
+
+    int hourlyRetentionDays_;
+    mutable std::mutex mutex_;
+    std::map<long long, Slice> hourly_; // hours since 1970-01-01 00:00
+    std::map<long long, Slice> daily_;  // days since 1970-01-01
+    std::unordered_map<int, std::string> categories_;
+
+    bool backfilling_{false};
+    long long watermark_{0}; // highest purchase id covered by the backfill
+    std::vector<Purchase> pending_;
+
+    // non-copyable
+    SalesRollup(const SalesRollup&) = delete;
+    SalesRollup& operator=(const SalesRollup&) = delete;
+};
+
+#endif // SWEET_SHOP_SALES_ROLLUP_H
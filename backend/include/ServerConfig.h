@@ -0,0 +1,47 @@
+#ifndef SWEET_SHOP_SERVER_CONFIG_H
+#define SWEET_SHOP_SERVER_CONFIG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runtime settings for the HTTP server. Values come from an optional
+// "key = value" file named by SWEET_SHOP_CONFIG, then from environment
+// variables, which take precedence:
+//
+//   port          SWEET_SHOP_PORT          listening port (8080)
+//   bind          SWEET_SHOP_BIND          listening address (0.0.0.0)
+//   threads       SWEET_SHOP_THREADS       worker threads (CPUs available)
+//   cpu_affinity  SWEET_SHOP_CPU_AFFINITY  CPUs to pin workers to, e.g.
+//                                          "0-3,8" or "auto"; unset = no pinning
+//   frontend_dir  SWEET_SHOP_FRONTEND_DIR  static files to serve (frontend);
+//                                          empty = API only
+//   cors_origins  SWEET_SHOP_CORS_ORIGINS  allowed origins, comma-separated (*)
+//   cors_methods  SWEET_SHOP_CORS_METHODS  methods allowed by preflights
+//   cors_headers  SWEET_SHOP_CORS_HEADERS  request headers allowed by preflights
+//   cors_max_age  SWEET_SHOP_CORS_MAX_AGE  seconds browsers may cache a preflight
+struct ServerConfig {
+    std::string bindAddress = "0.0.0.0";
+    std::uint16_t port = 8080;
+    unsigned int threads = 0; // 0 until load() fills in availableCpus()
+    std::vector<int> cpus;
+    std::string frontendDir = "frontend";
+    // Empty methods/headers keep the Cors middleware defaults
+    std::string corsOrigins = "*";
+    std::string corsMethods;
+    std::string corsHeaders;
+    int corsMaxAge = 86400;
+
+    // False with a message in error when a setting is malformed
+    bool load(std::string& error);
+
+    // CPUs this process may actually use: the affinity mask and any
+    // cgroup CPU quota, so a container limited to 2 CPUs sizes for 2
+    static unsigned int availableCpus();
+    // Parses "0-3,8"; "auto" means every CPU in the affinity mask
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+    // Pins the calling thread to one CPU; false where unsupported
+    static bool pinCurrentThread(int cpu);
+};
+
+#endif // SWEET_SHOP_SERVER_CONFIG_H
@@ -0,0 +1,48 @@
+#ifndef SWEET_SHOP_SHARD_MAP_H
+#define SWEET_SHOP_SHARD_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Consistent-hash ring placing sweet ids on named MySQL shards. Each shard
+// gets kPointsPerWeight points per unit of weight, and an id belongs to the
+// shard owning the first point at or after the id's hash. Adding or
+// removing a shard therefore only moves the ids next to its points.
+//
+// Map files list one shard per line, "name host[:port] [weight]", with
+// '#' comments; the first shard is the home shard, which also keeps the
+// users, the audit log and the sweet id sequence.
+class ShardMap {
+public:
+    struct Shard {
+        std::string name;
+        std::string host;
+        unsigned int port{3306};
+        unsigned int weight{1};
+
+        std::string endpoint() const { return host + ":" + std::to_string(port); }
+    };
+
+    static constexpr unsigned int kPointsPerWeight = 160;
+
+    explicit ShardMap(std::vector<Shard> shards);
+
+    // False with a message in error for an empty map, a malformed line or
+    // a repeated name
+    static bool parse(const std::string& text, std::vector<Shard>& out, std::string& error);
+    static bool load(const std::string& path, std::vector<Shard>& out, std::string& error);
+
+    // Index into shards() of the shard owning sweetId
+    std::size_t owner(int sweetId) const;
+    const std::vector<Shard>& shards() const { return shards_; }
+    const Shard& home() const { return shards_.front(); }
+
+private:
+    std::vector<Shard> shards_;
+    std::vector<std::pair<std::uint64_t, std::size_t>> ring_; // point -> shard, sorted
+};
+
+#endif // SWEET_SHOP_SHARD_MAP_H
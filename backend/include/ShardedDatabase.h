@@ -0,0 +1,204 @@
+#ifndef SWEET_SHOP_SHARDED_DATABASE_H
+#define SWEET_SHOP_SHARDED_DATABASE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Database.h"
+#include "ShardMap.h"
+#include "Storage.h"
+#include "WorkerPool.h"
+
+// Storage over several MySQL servers, each holding the sweets a ShardMap
+// gives it together with their purchases and idempotency keys. Purchases,
+// restocks and single-sweet reads go to the owning shard only; catalog
+// listings, purchase history, receipts and aggregates query every shard
+// in parallel and merge. Users and the audit log stay on the home shard,
+// which also hands out sweet ids so they are unique across shards.
+//
+// Writes that span sweets (upsertSweets, patchSweets) are atomic per
+// shard, not across shards. Purchase ids are unique only when each shard
+// runs with the same auto_increment_increment (at least the shard count)
+// and its own auto_increment_offset; connect() warns otherwise.
+//
+// reload() re-reads the map file. Sweets whose owner changed are moved
+// one at a time: copied to the new owner, then deleted from the old one.
+// Until its move completes a sweet is still served from where it is.
+// Database traffic pauses while the shards are listed and during each
+// move; async calls are queued meanwhile rather than blocking.
+// connect() runs the same pass, so moves cut short by a crash are
+// finished at the next start. Only one server process should use a map
+// while it changes.
+class ShardedDatabase : public Storage {
+public:
+    struct ShardStatus {
+        std::string name;
+        std::string endpoint;
+        unsigned int weight{1};
+        bool home{false};
+    };
+
+    ShardedDatabase(const std::string& user,
+                    const std::string& password,
+                    const std::string& dbName,
+                    const std::string& mapPath);
+
+    // Loads the map and connects every shard. False with a message in
+    // error if the map is bad or a shard is unreachable.
+    bool connect(std::string& error);
+    // Non-blocking pools on every shard, present and future
+    bool startAsync(std::size_t connectionsPerShard = 8);
+    // Re-reads the map file. The home shard cannot change. moved receives
+    // how many sweets changed shard; on failure the rest stay pending and
+    // are retried by the next reload.
+    bool reload(std::string& error, std::size_t* moved = nullptr);
+
+    std::vector<ShardStatus> shards();
+    std::size_t pendingMoves();
+    const std::string& mapPath() const { return mapPath_; }
+
+    // User operations
+    bool createUser(const std::string& username,
+                    const std::string& passwordHash,
+                    const std::string& email,
+                    bool isAdmin = false,
+                    int* outId = nullptr) override;
+    std::map<std::string, std::string> getUserByUsername(const std::string& username) override;
+
+    // Sweet operations
+    bool createSweet(const std::string& name,
+                     const std::string& description,
+                     const std::string& category,
+                     double price,
+                     int quantity,
+                     int* outId = nullptr) override;
+    std::vector<std::map<std::string, std::string>> getAllSweets(bool* ok = nullptr) override;
+    std::map<std::string, std::string> getSweetById(int id) override;
+    bool updateSweet(int id,
+                     const std::string& name,
+                     const std::string& description,
+                     const std::string& category,
+                     double price,
+                     int quantity) override;
+    bool deleteSweet(int id) override;
+    bool upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                      std::vector<int>* outIds = nullptr,
+                      std::vector<bool>* outCreated = nullptr) override;
+    bool patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                     std::vector<std::map<std::string, std::string>>* outRows = nullptr) override;
+
+    // Purchases
+    bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                       std::map<std::string, std::string>* outPurchase = nullptr,
+                       const std::string& idempotencyKey = "") override;
+    bool restockSweet(int sweetId, int quantity,
+                      const std::string& idempotencyKey = "") override;
+    bool setStockSlots(int sweetId, int slots) override;
+    std::vector<std::map<std::string, std::string>> getStockSlots(int sweetId) override;
+    std::vector<std::map<std::string, std::string>>
+    getPurchasesByUser(int userId,
+                       const std::string& beforeDate,
+                       int beforeId,
+                       int limit,
+                       bool* ok = nullptr) override;
+    std::map<std::string, std::string> getPurchaseById(int id) override;
+
+    // Idempotency keys
+    std::map<std::string, std::string> getIdempotencyKey(const std::string& key) override;
+
+    // Aggregates. getMaxPurchaseId also raises every shard's purchase id
+    // counter past the value it returns, so purchases made afterwards on
+    // any shard are above the SalesRollup watermark.
+    std::map<std::string, std::string> getSalesTotals() override;
+    std::vector<std::map<std::string, std::string>> getRevenueByCategory(bool* ok = nullptr) override;
+    long long getMaxPurchaseId() override;
+    std::vector<std::map<std::string, std::string>> getHourlySales(long long maxPurchaseId) override;
+
+    // Audit
+    bool logAudit(int userId,
+                  const std::string& action,
+                  const std::string& targetType,
+                  int targetId,
+                  const std::string& details) override;
+
+    // Non-blocking variants, on the owning shard's pool or gathered from
+    // every shard's
+    void getAllSweetsAsync(RowsCallback done) override;
+    void getSweetByIdAsync(int id, RowCallback done) override;
+    void purchaseSweetAsync(int userId, int sweetId, int quantity,
+                            const std::string& idempotencyKey, PurchaseCallback done) override;
+    void getIdempotencyKeyAsync(const std::string& key, RowCallback done) override;
+
+private:
+    // Held by every call for as long as it uses the map or a shard,
+    // including until an async call's callback; reload waits for all of
+    // them before it changes anything
+    class Pass;
+    std::shared_ptr<Pass> enter();
+    // For async calls, which may come from an event-loop thread and must
+    // not wait: runs then at once, or queues it until the gate reopens
+    void enterAsync(std::function<void(std::shared_ptr<Pass>)> then);
+    void leave();
+    void closeGate();
+    void openGate();
+
+    // Holding a Pass
+    Database& owner(int sweetId);
+    Database& home() { return *dbs_.front(); }
+    // The map's shards, then any others still holding pending moves
+    std::vector<Database*> servers();
+    // Runs call on every server at once; results in servers() order
+    template <typename Result, typename Call>
+    std::vector<Result> scatter(const std::vector<Database*>& servers, Call call);
+    // Starts work on pool_, or runs it on the calling thread when that is
+    // a pool thread or the queue is full
+    template <typename Result>
+    std::future<Result> fork(std::function<Result()> work);
+    // The catalogs of servers merged: each sweet once, from its owner, by id
+    std::vector<std::map<std::string, std::string>>
+    mergeCatalog(const std::vector<Database*>& servers,
+                 std::vector<std::vector<std::map<std::string, std::string>>> parts);
+
+    std::shared_ptr<Database> open(const ShardMap::Shard& shard, std::string& error);
+    // Copies a sweet to its owner and deletes it from where it was
+    bool moveSweet(int id, Database& from, Database& to);
+    void checkIdSpacing();
+
+    std::string user_;
+    std::string password_;
+    std::string database_;
+    std::string mapPath_;
+    std::size_t asyncConnections_{0};
+
+    // Changed only by reload, with the gate closed
+    std::unique_ptr<ShardMap> map_;
+    std::vector<std::shared_ptr<Database>> dbs_; // parallel to map_->shards()
+    std::unordered_map<int, std::shared_ptr<Database>> pending_; // sweet id -> shard still holding it
+
+    std::mutex gateMutex_;
+    std::condition_variable gateWake_;
+    std::size_t active_{0};
+    bool closed_{false};
+    std::deque<std::function<void(std::shared_ptr<Pass>)>> waiting_; // enterAsync while closed
+
+    std::mutex reloadMutex_;
+
+    // Threads for scatter and the per-shard parts of bulk writes; declared
+    // last so it drains before the shards go away
+    WorkerPool pool_;
+
+    // non-copyable
+    ShardedDatabase(const ShardedDatabase&) = delete;
+    ShardedDatabase& operator=(const ShardedDatabase&) = delete;
+};
+
+#endif // SWEET_SHOP_SHARDED_DATABASE_H
@@ -0,0 +1,27 @@
+#ifndef SWEET_SHOP_SHOP_EVENTS_H
+#define SWEET_SHOP_SHOP_EVENTS_H
+
+#include <vector>
+
+struct Sweet;
+struct Purchase;
+
+// Observer for committed changes. SweetManager and Auth notify listeners
+// after the database call succeeded, on the thread that made the change.
+class ShopListener {
+public:
+    virtual ~ShopListener() = default;
+
+    virtual void onUserCreated(bool /*isAdmin*/) {}
+    virtual void onSweetCreated(const Sweet& /*sweet*/) {}
+    virtual void onSweetUpdated(const Sweet& /*sweet*/) {}
+    virtual void onSweetDeleted(int /*sweetId*/) {}
+    // Once per bulk import, with every stored row; created[i] tells
+    // whether sweets[i] is new. By default each row is passed on to
+    // onSweetCreated or onSweetUpdated.
+    virtual void onSweetsImported(const std::vector<Sweet>& sweets, const std::vector<bool>& created);
+    virtual void onPurchase(const Purchase& /*purchase*/) {}
+    virtual void onRestock(int /*sweetId*/, int /*quantity*/) {}
+};
+
+#endif // SWEET_SHOP_SHOP_EVENTS_H
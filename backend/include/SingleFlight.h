@@ -0,0 +1,184 @@
+#ifndef SWEET_SHOP_SINGLE_FLIGHT_H
+#define SWEET_SHOP_SINGLE_FLIGHT_H
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Metrics.h"
+
+// Request coalescing for reads: while a call for a key is in flight,
+// further callers with the same key wait for its result instead of
+// issuing the same query again. Blocking callers wait on a shared future;
+// callback callers are queued and invoked with the leader's result.
+//
+// A flight older than maxWait is not joined; later callers start a new
+// one, so a leader that hangs cannot hold every reader of the key.
+//
+// Counts go to sweet_shop_singleflight_requests_total{query,result} with
+// result "executed" or "coalesced"; their ratio is the coalescing rate.
+template <typename T>
+class SingleFlight {
+public:
+    using Callback = std::function<void(T)>;
+
+    explicit SingleFlight(const std::string& query,
+                          std::chrono::milliseconds maxWait = std::chrono::seconds(30))
+        : maxWait_(maxWait),
+          executed_(metrics::counter("sweet_shop_singleflight_requests_total",
+                                     "query=\"" + query + "\",result=\"executed\"",
+                                     "Coalescable reads, by whether they ran or joined another")),
+          coalesced_(metrics::counter("sweet_shop_singleflight_requests_total",
+                                      "query=\"" + query + "\",result=\"coalesced\"")) {}
+
+    // Returns fn() or the result of the identical call already running.
+    // If the leader throws, every blocking caller sees the exception.
+    T run(const std::string& key, const std::function<T()>& fn) {
+        bool leader = false;
+        std::shared_ptr<Call> call = join(key, leader);
+        if (!leader) return call->result.get();
+        try {
+            T value = fn();
+            complete(key, call, value);
+            return value;
+        } catch (...) {
+            fail(key, call, std::current_exception());
+            throw;
+        }
+    }
+
+    // Callback form: start(finish) is invoked only by the leader and must
+    // eventually call finish with the result. If start throws, or every
+    // copy of finish is destroyed uncalled, the flight ends and callback
+    // waiters get T().
+    void runAsync(const std::string& key,
+                  const std::function<void(Callback)>& start,
+                  Callback done) {
+        std::shared_ptr<Call> call;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = calls_.find(key);
+            if (it != calls_.end() && !stale(*it->second)) {
+                it->second->waiters.push_back(std::move(done));
+                coalesced_.inc();
+                return;
+            }
+            call = newCall(key);
+            call->waiters.push_back(std::move(done));
+        }
+        auto guard = std::make_shared<Finisher>(*this, key, call);
+        try {
+            start([guard](T value) { guard->finish(value); });
+        } catch (...) {
+            guard->abandon(std::current_exception());
+        }
+    }
+
+    // Callers arriving after this start a new flight, so a read issued
+    // after a write never joins one that began before it
+    void forget(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.erase(key);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Call {
+        std::promise<T> promise;
+        std::shared_future<T> result;
+        std::vector<Callback> waiters;
+        Clock::time_point started;
+    };
+
+    // Ends an async flight exactly once: with the leader's value, or with
+    // an error when start threw or dropped its callback
+    class Finisher {
+    public:
+        Finisher(SingleFlight& owner, std::string key, std::shared_ptr<Call> call)
+            : owner_(owner), key_(std::move(key)), call_(std::move(call)) {}
+        ~Finisher() {
+            abandon(std::make_exception_ptr(std::runtime_error("single flight callback was never called")));
+        }
+
+        void finish(const T& value) {
+            if (!done_.exchange(true)) owner_.complete(key_, call_, value);
+        }
+        void abandon(std::exception_ptr error) {
+            if (!done_.exchange(true)) owner_.fail(key_, call_, error);
+        }
+
+    private:
+        SingleFlight& owner_;
+        std::string key_;
+        std::shared_ptr<Call> call_;
+        std::atomic<bool> done_{false};
+    };
+
+    bool stale(const Call& call) const {
+        return Clock::now() - call.started > maxWait_;
+    }
+
+    // Registers a fresh flight for key, replacing a stale one. Caller
+    // holds mutex_.
+    std::shared_ptr<Call> newCall(const std::string& key) {
+        auto call = std::make_shared<Call>();
+        call->result = call->promise.get_future().share();
+        call->started = Clock::now();
+        calls_[key] = call;
+        executed_.inc();
+        return call;
+    }
+
+    std::shared_ptr<Call> join(const std::string& key, bool& leader) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = calls_.find(key);
+        if (it != calls_.end() && !stale(*it->second)) {
+            coalesced_.inc();
+            leader = false;
+            return it->second;
+        }
+        leader = true;
+        return newCall(key);
+    }
+
+    std::vector<Callback> detach(const std::string& key, const std::shared_ptr<Call>& call) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = calls_.find(key);
+        if (it != calls_.end() && it->second == call) calls_.erase(it);
+        return std::move(call->waiters);
+    }
+
+    void complete(const std::string& key, const std::shared_ptr<Call>& call, const T& value) {
+        std::vector<Callback> waiters = detach(key, call);
+        call->promise.set_value(value);
+        for (auto& waiter : waiters) waiter(value);
+    }
+
+    void fail(const std::string& key, const std::shared_ptr<Call>& call, std::exception_ptr error) {
+        std::vector<Callback> waiters = detach(key, call);
+        call->promise.set_exception(error);
+        for (auto& waiter : waiters) waiter(T());
+    }
+
+    const std::chrono::milliseconds maxWait_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Call>> calls_;
+    metrics::Counter& executed_;
+    metrics::Counter& coalesced_;
+
+    // non-copyable
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+};
+
+#endif // SWEET_SHOP_SINGLE_FLIGHT_H
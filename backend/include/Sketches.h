@@ -0,0 +1,97 @@
+#ifndef SWEET_SHOP_SKETCHES_H
+#define SWEET_SHOP_SKETCHES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ShopEvents.h"
+
+// Count-Min sketch. Estimates never undercount and overcount by at most
+// epsilon * (total of all counts) with probability 1 - delta.
+class CountMinSketch {
+public:
+    CountMinSketch(double epsilon, double delta);
+
+    void add(std::uint64_t key, std::uint64_t count);
+    std::uint64_t estimate(std::uint64_t key) const;
+    // Both sketches must have been built with the same epsilon/delta
+    bool merge(const CountMinSketch& other);
+    void clear();
+
+private:
+    std::size_t width_;
+    std::size_t depth_;
+    std::vector<std::uint64_t> counts_; // depth_ rows of width_ counters
+};
+
+// HyperLogLog distinct counter with 2^precision one-byte registers;
+// standard error is about 1.04 / sqrt(2^precision).
+class HyperLogLog {
+public:
+    explicit HyperLogLog(unsigned precision = 12);
+
+    void add(std::uint64_t key);
+    double estimate() const;
+    bool merge(const HyperLogLog& other);
+    void clear();
+
+private:
+    unsigned precision_;
+    std::vector<std::uint8_t> registers_;
+};
+
+struct SketchConfig {
+    double epsilon{0.001};        // Count-Min error as a fraction of units sold
+    double delta{0.01};           // Count-Min failure probability
+    unsigned hllPrecision{12};    // ~1.6% error on unique buyers
+    std::size_t candidates{64};   // tracked heavy hitters per window
+    int windowSeconds{3600};
+    int windows{24};              // ring size; queries can span up to this many
+};
+
+// Streaming best-seller and unique-buyer estimates over a ring of time
+// windows. Memory is fixed by SketchConfig regardless of traffic; a query
+// over the last N windows merges their sketches.
+class SalesSketches : public ShopListener {
+public:
+    struct TopItem {
+        int sweetId;
+        std::uint64_t units;
+    };
+
+    explicit SalesSketches(const SketchConfig& config = SketchConfig());
+
+    void onPurchase(const Purchase& purchase) override;
+
+    // windows is clamped to [1, config.windows]; the current, partially
+    // filled window counts as one.
+    std::vector<TopItem> topSellers(int windows, std::size_t k) const;
+    double uniqueBuyers(int windows) const;
+
+    const SketchConfig& config() const { return config_; }
+
+private:
+    struct Window {
+        long long index{-1};
+        CountMinSketch units;
+        HyperLogLog buyers;
+        std::unordered_map<int, std::uint64_t> candidates;
+
+        Window(const SketchConfig& c)
+            : units(c.epsilon, c.delta), buyers(c.hllPrecision) {}
+    };
+
+    long long currentIndex() const;
+    Window& windowFor(long long index);
+    // Windows of the ring that fall within the last `windows` indexes
+    std::vector<const Window*> recent(int windows) const;
+
+    SketchConfig config_;
+    mutable std::mutex mutex_;
+    std::vector<Window> ring_;
+};
+
+#endif // SWEET_SHOP_SKETCHES_H
@@ -0,0 +1,80 @@
+#ifndef SWEET_SHOP_STATS_H
+#define SWEET_SHOP_STATS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "ShopEvents.h"
+
+class Storage; // forward declaration
+
+struct DashboardStats {
+    double totalRevenue{0.0};
+    long long unitsSold{0};
+    long long orderCount{0};
+    long long userCount{0};
+    int sweetCount{0};
+    long long unitsInStock{0};
+    int lowStockCount{0};   // 0 < quantity < lowStockThreshold
+    int outOfStockCount{0}; // quantity == 0
+    std::map<std::string, double> revenueByCategory;
+};
+
+// Running dashboard totals, kept current from ShopListener events so
+// /api/admin/stats never aggregates over purchases or sweets.
+class StatsEngine : public ShopListener {
+public:
+    explicit StatsEngine(int lowStockThreshold = 10);
+    ~StatsEngine() override;
+
+    // Recomputes every total from the database. False, leaving the totals
+    // as they were, when any read fails. Call before serving traffic;
+    // events that race with a rebuild are not reconciled.
+    bool rebuild(Storage& db);
+
+    // Rebuilds every `every` on a background thread, so totals that drift
+    // from writes by other server processes (or racing events) converge.
+    // stop() ends it; the destructor calls it.
+    void startResync(Storage& db, std::chrono::seconds every);
+    void stop();
+
+    DashboardStats snapshot() const;
+
+    void onUserCreated(bool isAdmin) override;
+    void onSweetCreated(const Sweet& sweet) override;
+    void onSweetUpdated(const Sweet& sweet) override;
+    void onSweetDeleted(int sweetId) override;
+    void onPurchase(const Purchase& purchase) override;
+    void onRestock(int sweetId, int quantity) override;
+
+private:
+    struct SweetState {
+        std::string category;
+        int quantity{0};
+    };
+
+    // Adds (sign = 1) or removes (sign = -1) a sweet's stock from the totals
+    void account(const SweetState& state, int sign);
+    void resyncLoop(Storage& db, std::chrono::seconds every);
+
+    int lowStockThreshold_;
+    mutable std::mutex mutex_;
+    std::unordered_map<int, SweetState> sweets_;
+    DashboardStats totals_;
+
+    std::mutex stopMutex_;
+    std::condition_variable stopWake_;
+    bool stopping_{false};
+    std::thread resync_;
+
+    // non-copyable
+    StatsEngine(const StatsEngine&) = delete;
+    StatsEngine& operator=(const StatsEngine&) = delete;
+};
+
+#endif // SWEET_SHOP_STATS_H
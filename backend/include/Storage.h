@@ -0,0 +1,163 @@
+#ifndef SWEET_SHOP_STORAGE_H
+#define SWEET_SHOP_STORAGE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Persistence interface used by SweetManager, Auth and the stats
+// subsystems. Rows are returned as column-name -> value maps with the
+// same columns and text formatting as the MySQL schema, so every engine
+// is interchangeable above this line. Implementations must be safe to
+// call from several threads at once.
+class Storage {
+public:
+    virtual ~Storage() = default;
+
+    // User operations
+    virtual bool createUser(const std::string& username,
+                            const std::string& passwordHash,
+                            const std::string& email,
+                            bool isAdmin = false,
+                            int* outId = nullptr) = 0;
+    virtual std::map<std::string, std::string>
+    getUserByUsername(const std::string& username) = 0;
+
+    // Sweet operations
+    virtual bool createSweet(const std::string& name,
+                             const std::string& description,
+                             const std::string& category,
+                             double price,
+                             int quantity,
+                             int* outId = nullptr) = 0;
+    // ok, when given, is set false if the read failed (also below)
+    virtual std::vector<std::map<std::string, std::string>> getAllSweets(bool* ok = nullptr) = 0;
+    virtual std::map<std::string, std::string> getSweetById(int id) = 0;
+    virtual bool updateSweet(int id,
+                             const std::string& name,
+                             const std::string& description,
+                             const std::string& category,
+                             double price,
+                             int quantity) = 0;
+    virtual bool deleteSweet(int id) = 0;
+
+    // Bulk catalog load in one transaction. Each row has the sweets
+    // columns name, description, category, price and quantity, plus an
+    // optional id: a row with an id replaces that sweet, or creates it
+    // under that id; a row without one is inserted. outIds receives each
+    // row's id and outCreated whether it was new, in input order.
+    virtual bool upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                              std::vector<int>* outIds = nullptr,
+                              std::vector<bool>* outCreated = nullptr) = 0;
+
+    // Partial updates in one transaction. Each change has a distinct id
+    // plus any of name, description, category, price and quantity, and
+    // only those columns are written. Fails and changes nothing if an id
+    // does not exist. outRows receives the updated rows, in input order.
+    virtual bool patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                             std::vector<std::map<std::string, std::string>>* outRows = nullptr) = 0;
+
+    // Purchases
+    // Atomically checks and decrements stock and records the purchase.
+    // When outPurchase is given it receives the committed purchase row
+    // (same columns as getPurchasesByUser).
+    //
+    // A non-empty idempotencyKey is written to idempotency_keys in the
+    // same transaction as the change. If the key is already recorded
+    // nothing is applied and the call fails; getIdempotencyKey then says
+    // what the earlier request did.
+    virtual bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                               std::map<std::string, std::string>* outPurchase = nullptr,
+                               const std::string& idempotencyKey = "") = 0;
+    virtual bool restockSweet(int sweetId, int quantity,
+                              const std::string& idempotencyKey = "") = 0;
+
+    // Hot-sweet mode for flash sales. slots > 1 spreads the sweet's stock
+    // over that many counters which purchases take from independently, so
+    // buyers of one sweet stop queueing on a single row; 1 folds it back.
+    // The reported quantity stays the total either way. Engines without
+    // row locks have nothing to split, and the defaults refuse.
+    static constexpr int kMaxStockSlots = 64;
+    virtual bool setStockSlots(int /*sweetId*/, int /*slots*/) { return false; }
+    // slot, quantity for each slot; empty when the sweet is not split
+    virtual std::vector<std::map<std::string, std::string>> getStockSlots(int /*sweetId*/) { return {}; }
+
+    // Keys are honoured for at least this long, then may be forgotten
+    static constexpr long kIdempotencyKeySeconds = 24 * 60 * 60;
+
+    // The request recorded under an idempotency key, or an empty map:
+    // idem_key, operation ("purchase" or "restock"), sweet_id, quantity,
+    // created_at, and for purchases the purchase row columns (id,
+    // user_id, sweet_name, total_price, purchase_date).
+    virtual std::map<std::string, std::string> getIdempotencyKey(const std::string& key) = 0;
+
+    // Purchase history, newest first. Keyset pagination: pass the
+    // purchase_date and id of the last row of the previous page, or an
+    // empty date for the first page. ok, when given, is set false if the
+    // read failed rather than found nothing.
+    virtual std::vector<std::map<std::string, std::string>>
+    getPurchasesByUser(int userId,
+                       const std::string& beforeDate,
+                       int beforeId,
+                       int limit,
+                       bool* ok = nullptr) = 0;
+    virtual std::map<std::string, std::string> getPurchaseById(int id) = 0;
+
+    // Dashboard aggregates, used to seed StatsEngine at startup.
+    // getSalesTotals: user_count, order_count, units_sold, revenue.
+    virtual std::map<std::string, std::string> getSalesTotals() = 0;
+    // One row per category: category, revenue, units_sold.
+    virtual std::vector<std::map<std::string, std::string>> getRevenueByCategory(bool* ok = nullptr) = 0;
+
+    // Sales rollup backfill. getMaxPurchaseId returns -1 on error.
+    // getHourlySales groups purchases with id <= maxPurchaseId by
+    // hour ("YYYY-MM-DD HH:00:00") and sweet: hour, sweet_id, category,
+    // orders, units, revenue.
+    virtual long long getMaxPurchaseId() = 0;
+    virtual std::vector<std::map<std::string, std::string>>
+    getHourlySales(long long maxPurchaseId) = 0;
+
+    // Audit trail (audit_log). userId <= 0 records no user.
+    virtual bool logAudit(int userId,
+                          const std::string& action,
+                          const std::string& targetType,
+                          int targetId,
+                          const std::string& details) = 0;
+
+    // Non-blocking variants for request handlers. Callbacks may run on an
+    // engine's I/O thread and must not block. The defaults call the
+    // blocking method inline, which suits the in-process engines.
+    //
+    // Read callbacks get ok == false, and no rows, when the query failed,
+    // so an outage is not mistaken for an empty result.
+    using RowsCallback = std::function<void(bool, std::vector<std::map<std::string, std::string>>)>;
+    using RowCallback = std::function<void(bool, std::map<std::string, std::string>)>;
+
+    // How an async purchase ended. Error means storage failed and the
+    // purchase may or may not have been committed.
+    enum class PurchaseStatus { Done, Refused, Error };
+    // status, total, and the committed purchase row
+    using PurchaseCallback = std::function<void(PurchaseStatus, double, std::map<std::string, std::string>)>;
+
+    virtual void getAllSweetsAsync(RowsCallback done) {
+        bool ok = false;
+        auto rows = getAllSweets(&ok);
+        done(ok, std::move(rows));
+    }
+    virtual void getSweetByIdAsync(int id, RowCallback done) {
+        done(true, getSweetById(id));
+    }
+    virtual void purchaseSweetAsync(int userId, int sweetId, int quantity,
+                                    const std::string& idempotencyKey, PurchaseCallback done) {
+        double total = 0.0;
+        std::map<std::string, std::string> row;
+        bool ok = purchaseSweet(userId, sweetId, quantity, total, &row, idempotencyKey);
+        done(ok ? PurchaseStatus::Done : PurchaseStatus::Refused, total, std::move(row));
+    }
+    virtual void getIdempotencyKeyAsync(const std::string& key, RowCallback done) {
+        done(true, getIdempotencyKey(key));
+    }
+};
+
+#endif // SWEET_SHOP_STORAGE_H
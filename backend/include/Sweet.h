@@ -1,11 +1,20 @@
 #ifndef SWEET_SHOP_SWEET_H
 #define SWEET_SHOP_SWEET_H
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
 
-class Database; // forward declaration
+#include "IdempotencyCache.h"
+#include "PurchaseCache.h"
+#include "ShopEvents.h"
+#include "SingleFlight.h"
+
+class Storage; // forward declaration
 
 struct Sweet {
     int id{0};
@@ -16,11 +25,40 @@ struct Sweet {
     int quantity{0};
 };
 
+// Partial update of one sweet: only the fields flagged in `fields` are
+// written, with their new values taken from `values`
+struct SweetPatch {
+    enum Field : unsigned {
+        Name = 1,
+        Description = 2,
+        Category = 4,
+        Price = 8,
+        Quantity = 16,
+    };
+
+    int id{0};
+    unsigned fields{0};
+    Sweet values;
+};
+
 class SweetManager {
 public:
-    explicit SweetManager(Database& db);
+    // How a purchase or restock carrying an Idempotency-Key was handled
+    enum class Replay {
+        None,       // applied now, or failed
+        Replayed,   // an earlier request with the key succeeded; its result is returned
+        InProgress, // an earlier request with the key is still running
+        KeyReused,  // the key was used for a different request
+        Unavailable, // storage failed; the request may or may not have been applied
+    };
+
+    explicit SweetManager(Storage& db);
 
-    std::vector<Sweet> getAllSweets();
+    // Builds a Sweet from a Storage row map; missing columns keep defaults
+    static Sweet fromRow(const std::map<std::string, std::string>& row);
+
+    // ok, when given, is set false if storage failed
+    std::vector<Sweet> getAllSweets(bool* ok = nullptr);
     Sweet getSweetById(int id);
     bool addSweet(const std::string& name,
                   const std::string& description,
@@ -35,12 +73,87 @@ public:
                      int quantity);
     bool deleteSweet(int id);
 
+    // Applies every patch in one storage transaction, or none of them
+    // (invalid values, a repeated id or a missing sweet). Catalog reads
+    // are invalidated once for the whole batch. `updated` receives the
+    // resulting sweets in input order.
+    bool patchSweets(const std::vector<SweetPatch>& patches, std::vector<Sweet>* updated = nullptr);
+
+    // Bulk load. Sweets with id 0 are created; others replace that id, or
+    // create it. Stored in batches of batchSize rows, each one storage
+    // transaction; returns how many rows were stored before a failure.
+    std::size_t importSweets(const std::vector<Sweet>& sweets, std::size_t batchSize = 1000);
+
     // purchase returns total price on success via outTotal, false on failure
     bool purchaseSweet(int userId, int sweetId, int quantity, double& outTotal);
     bool restockSweet(int sweetId, int quantity);
 
+    // Idempotent restock: retries carrying the same key are applied once.
+    // Keys are scoped to userId.
+    bool restockSweet(int userId, int sweetId, int quantity,
+                      const std::string& idempotencyKey, Replay& replay);
+
+    // Non-blocking variants for request handlers. Callbacks may run on
+    // the storage engine's I/O thread and must not block.
+    // Callers that coalesced onto one read share one list. done(false,
+    // empty list) when storage failed. version is the catalog version
+    // sampled just before the read (see setCatalogVersion), so every
+    // change it counts is in the list.
+    using Catalog = std::shared_ptr<const std::vector<Sweet>>;
+    void getAllSweetsAsync(std::function<void(bool, Catalog, std::uint64_t version)> done);
+    // done(false, ...) on invalid input, missing sweet, insufficient stock
+    // or a storage failure
+    void purchaseSweetAsync(int userId, int sweetId, int quantity,
+                            std::function<void(bool, const Purchase&)> done);
+    // With a non-empty key a retry returns the first purchase instead of
+    // buying again. A storage failure is reported as Replay::Unavailable.
+    void purchaseSweetAsync(int userId, int sweetId, int quantity,
+                            const std::string& idempotencyKey,
+                            std::function<void(bool, const Purchase&, Replay)> done);
+
+    // Purchase history, newest first. beforeDate/beforeId are the
+    // purchaseDate and id of the last row of the previous page; leave
+    // beforeDate empty for the first page, which is usually served from
+    // the recent-purchase cache. ok, when given, is set false if storage
+    // failed.
+    std::vector<Purchase> getUserPurchases(int userId,
+                                           const std::string& beforeDate,
+                                           int beforeId,
+                                           int limit,
+                                           bool* ok = nullptr);
+    Purchase getPurchaseById(int id);
+
+    // Listeners are notified after each successful mutation. Register
+    // them before serving traffic; the list itself is not synchronized.
+    void addListener(ShopListener* listener);
+    // Counter of published catalog changes, such as the live feed's
+    // sequence number; set before serving traffic
+    void setCatalogVersion(std::function<std::uint64_t()> version);
+
 private:
-    Database& db_;
+    // Drops in-flight catalog reads a mutation of sweetId may have raced
+    void invalidateReads(int sweetId);
+    // After a keyed write failed: compares the key's stored record (empty
+    // if there is none) with the wanted fingerprint and caches it
+    Replay settleKey(const std::string& key,
+                     const std::string& wanted,
+                     const std::map<std::string, std::string>& record);
+
+    // A catalog read; ok is false when storage failed
+    struct CatalogRead {
+        bool ok{false};
+        Catalog sweets;
+        std::uint64_t version{0};
+    };
+
+    Storage& db_;
+    RecentPurchaseCache recentPurchases_;
+    // Concurrent identical catalog reads share one query
+    SingleFlight<CatalogRead> catalogFlight_;
+    SingleFlight<Sweet> sweetFlight_;
+    std::vector<ShopListener*> listeners_;
+    std::function<std::uint64_t()> catalogVersion_;
+    IdempotencyCache idempotency_;
 
     // non-copyable
     SweetManager(const SweetManager&) = delete;
@@ -0,0 +1,88 @@
+#ifndef SWEET_SHOP_TOPIC_H
+#define SWEET_SHOP_TOPIC_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+// Publish/subscribe channel backed by a ring of the last `capacity`
+// messages. Each message is framed once as {"seq":N,"event":<payload>}
+// and the same bytes are handed to every subscriber, so fan-out cost does
+// not grow with serialization. A pump thread delivers to subscribers from
+// their own cursor; one that falls more than `capacity` messages behind
+// gets a single {"type":"reset"} event and must reload its state. Sinks
+// run outside the topic lock, so a slow one never stalls publish().
+class Topic {
+public:
+    // Called on the pump thread (the hello on the subscribing thread),
+    // never after unsubscribe() returns. Must not block and must not
+    // unsubscribe itself.
+    using Sink = std::function<void(const std::string&)>;
+
+    explicit Topic(const std::string& name, std::size_t capacity = 1024);
+    ~Topic();
+
+    // payload is a JSON value; sequence numbers start at 1
+    void publish(const std::string& payload);
+
+    // New subscribers first get a {"type":"hello"} event carrying the
+    // current sequence number, then every message after it
+    std::uint64_t subscribe(Sink sink);
+    // Replays messages after seq if the ring still holds them, else resets
+    void resume(std::uint64_t subscriber, std::uint64_t seq);
+    void unsubscribe(std::uint64_t subscriber);
+
+    // Sequence number of the newest message
+    std::uint64_t head() const;
+
+private:
+    using Message = std::shared_ptr<const std::string>;
+
+    struct Subscriber {
+        Sink sink;
+        std::uint64_t cursor{0}; // last seq taken for delivery; guarded by mutex_
+        std::mutex sinkMutex;    // held while the sink runs
+        bool live{true};         // guarded by sinkMutex
+    };
+
+    // Messages taken for one subscriber, sent after mutex_ is released
+    struct Delivery {
+        std::shared_ptr<Subscriber> to;
+        std::vector<Message> messages;
+    };
+
+    static std::string frame(std::uint64_t seq, const std::string& payload);
+    // Takes everything after the subscriber's cursor; caller holds mutex_
+    void collect(const std::shared_ptr<Subscriber>& subscriber, std::vector<Delivery>& due);
+    void pump();
+
+    std::size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<Message> ring_;
+    std::uint64_t head_{0};  // seq of the newest message
+    bool dirty_{false};      // published since the pump last ran
+    std::map<std::uint64_t, std::shared_ptr<Subscriber>> subscribers_;
+    std::uint64_t nextSubscriber_{1};
+    bool stopping_{false};
+    std::thread thread_;
+
+    metrics::Gauge& subscriberGauge_;
+    metrics::Counter& published_;
+    metrics::Counter& resets_;
+
+    // non-copyable
+    Topic(const Topic&) = delete;
+    Topic& operator=(const Topic&) = delete;
+};
+
+#endif // SWEET_SHOP_TOPIC_H
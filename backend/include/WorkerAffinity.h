@@ -0,0 +1,34 @@
+#ifndef SWEET_SHOP_WORKER_AFFINITY_H
+#define SWEET_SHOP_WORKER_AFFINITY_H
+
+#include <crow.h>
+
+#include <atomic>
+#include <vector>
+
+#include "ServerConfig.h"
+
+// Crow middleware pinning worker threads to CPUs. Crow creates its
+// workers internally, so each one pins itself the first time it handles
+// a request, taking the next CPU from the list round-robin.
+struct WorkerAffinity {
+    struct context {};
+
+    // Set before the server starts; empty disables pinning
+    std::vector<int> cpus;
+
+    void before_handle(crow::request& /*req*/, crow::response& /*res*/, context& /*ctx*/) {
+        thread_local bool pinned = false;
+        if (pinned || cpus.empty()) return;
+        pinned = true;
+        unsigned int slot = next_.fetch_add(1, std::memory_order_relaxed);
+        ServerConfig::pinCurrentThread(cpus[slot % cpus.size()]);
+    }
+
+    void after_handle(crow::request& /*req*/, crow::response& /*res*/, context& /*ctx*/) {}
+
+private:
+    std::atomic<unsigned int> next_{0};
+};
+
+#endif // SWEET_SHOP_WORKER_AFFINITY_H
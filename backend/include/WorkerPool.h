@@ -0,0 +1,53 @@
+#ifndef SWEET_SHOP_WORKER_POOL_H
+#define SWEET_SHOP_WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+// Fixed set of threads running posted tasks in FIFO order, with a bounded
+// queue. CPU work that must not run on an I/O or event-loop thread goes
+// here, as does fan-out that would otherwise start a thread per call.
+// A full queue refuses the task instead of growing, so callers decide
+// how to shed or degrade.
+class WorkerPool {
+public:
+    WorkerPool(const std::string& name, std::size_t threads, std::size_t maxQueue);
+    // Runs the tasks already queued, then joins the threads
+    ~WorkerPool();
+
+    // False when the queue is full or the pool is stopping
+    bool post(std::function<void()> task);
+
+    // True on one of this pool's threads. Work that waits on the pool
+    // must not be posted from it, or it can wait on itself.
+    bool inPool() const;
+
+    std::size_t threads() const { return threads_.size(); }
+
+private:
+    void run();
+
+    std::size_t maxQueue_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_{false};
+    std::vector<std::thread> threads_;
+
+    metrics::Gauge& queuedGauge_;
+    metrics::Counter& rejected_;
+
+    // non-copyable
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+};
+
+#endif // SWEET_SHOP_WORKER_POOL_H
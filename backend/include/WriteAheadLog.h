@@ -0,0 +1,98 @@
+#ifndef SWEET_SHOP_WRITE_AHEAD_LOG_H
+#define SWEET_SHOP_WRITE_AHEAD_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Append-only, segmented write-ahead log with group commit. Callers
+// append a record (cheap, in-memory) and then wait for its LSN to become
+// durable; a single flusher thread writes everything queued since its
+// last pass and issues one fsync for the whole batch, so concurrent
+// committers share the fsync cost.
+//
+// Each record is framed as [u32 length][u32 crc32][payload], little
+// endian. Segments are files named wal-<segment>.log in the log directory.
+class WriteAheadLog {
+public:
+    // groupCommitWindow lets the flusher wait a little for more records
+    // before each fsync; zero flushes as soon as anything is queued.
+    WriteAheadLog(const std::string& dir,
+                  std::uint64_t segment,
+                  std::chrono::microseconds groupCommitWindow = std::chrono::microseconds(0));
+    ~WriteAheadLog();
+
+    // Opens the current segment for appending and starts the flusher
+    bool open();
+
+    // Queues a record; returns its LSN, or 0 once the log has failed
+    std::uint64_t append(const std::string& payload);
+    // Blocks until the LSN is on stable storage. False if a write or
+    // fsync failed; the log then rejects further appends.
+    bool waitDurable(std::uint64_t lsn);
+
+    // Records appended after this call go to a new segment; returns its number
+    std::uint64_t rotate();
+    std::uint64_t segment() const;
+    // LSN of the most recently appended record
+    std::uint64_t lastLsn() const;
+    // Everything up to this LSN is on stable storage
+    std::uint64_t durableLsn() const;
+    // True once a write or fsync has failed
+    bool failed() const;
+    std::uint64_t bytesInSegment() const;
+
+    static std::string segmentPath(const std::string& dir, std::uint64_t segment);
+    static std::string frame(const std::string& payload);
+    // Calls fn for every intact record of a file. With repair, a torn or
+    // corrupt tail (a crash mid-append) is cut off so the file can be
+    // appended to again. False if the file cannot be read or fn rejects a
+    // record.
+    static bool replay(const std::string& path,
+                       const std::function<bool(const std::string&)>& fn,
+                       bool repair = true);
+    // fflush + fsync of an open file
+    static bool sync(std::FILE* file);
+    // fsync of a directory, so files created or renamed in it survive a
+    // crash. Windows has no such call and journals the metadata itself.
+    static bool syncDir(const std::string& dir);
+
+private:
+    struct Batch {
+        std::uint64_t segment;
+        std::string bytes;
+        std::uint64_t lastLsn;
+    };
+
+    void flushLoop();
+
+    std::string dir_;
+    std::chrono::microseconds window_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable durable_;
+    std::deque<Batch> pending_;
+    std::uint64_t segment_;
+    std::uint64_t segmentBytes_{0};
+    std::uint64_t nextLsn_{1};
+    std::uint64_t durableLsn_{0};
+    bool failed_{false};
+    bool stopping_{false};
+
+    std::FILE* file_{nullptr};       // owned by the flusher once running
+    std::uint64_t fileSegment_{0};
+    std::thread flusher_;
+
+    // non-copyable
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+};
+
+#endif // SWEET_SHOP_WRITE_AHEAD_LOG_H
@@ -0,0 +1,141 @@
+#include "AssetCache.h"
+
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// First 128 bits of the SHA-256 of the content, hex encoded and quoted
+std::string strongEtag(const std::string& content) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(content.data()), content.size(), hash);
+    static const char hex[] = "0123456789abcdef";
+    std::string etag = "\"";
+    for (int i = 0; i < 16; ++i) {
+        etag += hex[hash[i] >> 4];
+        etag += hex[hash[i] & 0xF];
+    }
+    return etag + "\"";
+}
+
+// ETag of a file left on disk, from its size and modification time
+std::string fileEtag(const fs::path& path, std::uintmax_t size) {
+    std::error_code ec;
+    auto modified = fs::last_write_time(path, ec).time_since_epoch().count();
+    return "\"" + std::to_string(size) + "-" + std::to_string(modified) + "\"";
+}
+
+bool readFile(const fs::path& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool isText(const std::string& contentType) {
+    return contentType.compare(0, 5, "text/") == 0 ||
+        contentType.find("javascript") != std::string::npos ||
+        contentType.find("json") != std::string::npos ||
+        contentType.find("svg") != std::string::npos;
+}
+
+} // namespace
+
+bool AssetCache::load(const std::string& root, const std::string& indexPath) {
+    std::error_code ec;
+    fs::path base = fs::path(root);
+    if (!fs::is_directory(base, ec)) return false;
+
+    std::unordered_map<std::string, Asset> assets;
+    std::size_t bytes = 0;
+    for (fs::recursive_directory_iterator it(base, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        std::string name = it->path().filename().string();
+        if (name.empty() || name[0] == '.') continue; // no dotfiles
+
+        std::string url = "/" + fs::relative(it->path(), base, ec).generic_string();
+        Asset asset;
+        asset.contentType = contentTypeFor(url);
+        // Hashed names are immutable; anything else is revalidated by ETag
+        asset.cacheControl = isHashedName(url) ? "public, max-age=31536000, immutable"
+                                               : "no-cache";
+        std::uintmax_t size = it->file_size(ec);
+        if (size > kMaxCachedSize) {
+            asset.diskPath = it->path().string();
+            asset.etag = fileEtag(it->path(), size);
+        } else {
+            std::string content;
+            if (!readFile(it->path(), content)) continue;
+            asset.etag = strongEtag(content);
+            bytes += content.size();
+            asset.body = std::make_shared<const compression::PrecompressedBody>(
+                std::move(content), isText(asset.contentType));
+        }
+        assets.emplace(std::move(url), std::move(asset));
+    }
+    if (ec) return false;
+
+    auto index = assets.find(indexPath);
+    if (index != assets.end()) {
+        Asset root = index->second;
+        root.cacheControl = "no-cache";
+        assets.emplace("/", std::move(root));
+    }
+    assets_.swap(assets);
+    bytes_ = bytes;
+    return true;
+}
+
+const AssetCache::Asset* AssetCache::find(const std::string& urlPath) const {
+    auto it = assets_.find(urlPath);
+    return it == assets_.end() ? nullptr : &it->second;
+}
+
+std::string AssetCache::contentTypeFor(const std::string& path) {
+    static const std::unordered_map<std::string, std::string> types = {
+        {".html", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "application/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".map", "application/json"},
+        {".txt", "text/plain; charset=utf-8"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".woff", "font/woff"},
+        {".woff2", "font/woff2"},
+    };
+    std::size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+        return "application/octet-stream";
+    }
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    auto it = types.find(ext);
+    return it == types.end() ? "application/octet-stream" : it->second;
+}
+
+bool AssetCache::isHashedName(const std::string& path) {
+    // A dot-separated segment of 8+ hex digits before the extension
+    std::string name = path.substr(path.rfind('/') + 1);
+    std::size_t last = name.rfind('.');
+    if (last == std::string::npos || last == 0) return false;
+    std::size_t prev = name.rfind('.', last - 1);
+    if (prev == std::string::npos) return false;
+    std::string segment = name.substr(prev + 1, last - prev - 1);
+    return segment.size() >= 8 &&
+        segment.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos;
+}
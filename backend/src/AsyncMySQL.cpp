@@ -0,0 +1,524 @@
+#include "AsyncMySQL.h"
+#include "Metrics.h"
+#include "QueryLog.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
+
+namespace {
+
+// Client errors meaning the connection itself is gone
+bool connectionLost(unsigned int err) {
+    return err == 2006 /* CR_SERVER_GONE_ERROR */ || err == 2013 /* CR_SERVER_LOST */;
+}
+
+metrics::Histogram& queryHistogram() {
+    static metrics::Histogram& h = metrics::histogram(
+        "sweet_shop_db_async_query_seconds", "",
+        "Non-blocking MySQL statements, from submission to completion");
+    return h;
+}
+
+metrics::Gauge& inflightGauge() {
+    static metrics::Gauge& g = metrics::gauge(
+        "sweet_shop_db_async_inflight", "",
+        "Non-blocking MySQL statements submitted and not yet completed");
+    return g;
+}
+
+metrics::Counter& shedCounter(const char* reason) {
+    return metrics::counter("sweet_shop_db_async_shed_total", std::string("reason=\"") + reason + "\"",
+                            "Non-blocking MySQL work failed without running: queue full or no connection in time");
+}
+
+AsyncMySQL::Result shedResult(const char* error) {
+    AsyncMySQL::Result r;
+    r.error = error;
+    return r;
+}
+
+} // namespace
+
+constexpr std::chrono::milliseconds AsyncMySQL::kQueueTimeout;
+constexpr std::size_t AsyncMySQL::kMaxQueued;
+
+AsyncMySQL::AsyncMySQL(const std::string& host,
+                       const std::string& user,
+                       const std::string& password,
+                       const std::string& dbName,
+                       unsigned int port,
+                       std::size_t connections)
+    : host_(host),
+      user_(user),
+      password_(password),
+      database_(dbName),
+      port_(port),
+      endpoint_(host + ":" + std::to_string(port)),
+      conns_(connections ? connections : 1),
+      watched_(conns_.size(), -1) {}
+
+AsyncMySQL::~AsyncMySQL() {
+    stop();
+}
+
+bool AsyncMySQL::start() {
+    std::lock_guard<std::mutex> lock(inboxMutex_);
+    if (running_) return true;
+    if (!openPoller()) {
+        std::cerr << "AsyncMySQL: cannot create the event poller\n";
+        return false;
+    }
+    running_ = true;
+    thread_ = std::thread(&AsyncMySQL::loop, this);
+    return true;
+}
+
+void AsyncMySQL::stop() {
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake();
+    thread_.join();
+
+    // The loop is gone; fail whatever never ran
+    Result shutdown;
+    shutdown.error = "AsyncMySQL stopped";
+    std::vector<Callback> orphans;
+    for (auto& task : inbox_) task(); // queued submissions land in pending_
+    inbox_.clear();
+    for (Op& op : pending_) orphans.push_back(std::move(op.done));
+    pending_.clear();
+    for (Conn& c : conns_) {
+        if (c.state == ConnState::Sending || c.state == ConnState::Storing) {
+            orphans.push_back(std::move(c.op.done));
+        }
+        for (Op& op : c.sessionOps) orphans.push_back(std::move(op.done));
+        c.sessionOps.clear();
+        if (c.mysql) mysql_close(c.mysql);
+        c.mysql = nullptr;
+        c.fd = -1;
+        c.state = ConnState::Down;
+    }
+    sessionWaiters_.clear();
+    closePoller();
+    for (auto& done : orphans) {
+        inflightGauge().add(-1);
+        if (done) done(shutdown);
+    }
+}
+
+bool AsyncMySQL::post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(inboxMutex_);
+        if (!running_) return false;
+        inbox_.push_back(std::move(fn));
+    }
+    wake();
+    return true;
+}
+
+void AsyncMySQL::query(std::string sql, Callback done) {
+    inflightGauge().add(1);
+    auto op = std::make_shared<Op>(Op{std::move(sql), std::move(done), Clock::now(), Clock::time_point()});
+    if (!post([this, op] {
+            if (pending_.size() >= kMaxQueued) {
+                static metrics::Counter& full = shedCounter("queue_full");
+                full.inc();
+                inflightGauge().add(-1);
+                return op->done(shedResult("too many statements waiting for a connection"));
+            }
+            pending_.push_back(std::move(*op));
+        })) {
+        inflightGauge().add(-1);
+        Result r;
+        r.error = "AsyncMySQL is not running";
+        op->done(std::move(r));
+    }
+}
+
+void AsyncMySQL::session(SessionCallback ready) {
+    auto cb = std::make_shared<SessionCallback>(std::move(ready));
+    Clock::time_point queued = Clock::now();
+    if (!post([this, cb, queued] {
+            if (sessionWaiters_.size() >= kMaxQueued) {
+                static metrics::Counter& full = shedCounter("queue_full");
+                full.inc();
+                return (*cb)(nullptr);
+            }
+            sessionWaiters_.push_back(SessionWaiter{std::move(*cb), queued});
+        })) {
+        (*cb)(nullptr);
+    }
+}
+
+void AsyncMySQL::Session::query(std::string sql, Callback done) {
+    inflightGauge().add(1);
+    auto op = std::make_shared<Op>(Op{std::move(sql), std::move(done), Clock::now(), Clock::time_point()});
+    AsyncMySQL& owner = owner_;
+    std::size_t conn = conn_;
+    if (!owner.post([&owner, conn, op] { owner.conns_[conn].sessionOps.push_back(std::move(*op)); })) {
+        inflightGauge().add(-1);
+        Result r;
+        r.error = "AsyncMySQL is not running";
+        op->done(std::move(r));
+    }
+}
+
+AsyncMySQL::Session::~Session() {
+    AsyncMySQL& owner = owner_;
+    std::size_t conn = conn_;
+    owner.post([&owner, conn] { owner.conns_[conn].leaseEnded = true; });
+}
+
+void AsyncMySQL::loop() {
+    std::vector<std::function<void()>> tasks;
+    std::vector<std::size_t> ready;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex_);
+            if (!running_) return;
+            tasks.swap(inbox_);
+        }
+        for (auto& task : tasks) task();
+        tasks.clear();
+
+        dirty_ = false;
+        dispatch();
+
+        bool busy = false, down = false;
+        for (const Conn& c : conns_) {
+            busy = busy || c.state == ConnState::Connecting || c.state == ConnState::Sending
+                   || c.state == ConnState::Storing;
+            down = down || c.state == ConnState::Down;
+        }
+        // Busy connections are also re-driven on timeout, which covers the
+        // rare statement that is blocked on a full send buffer rather than
+        // waiting to read
+        int timeout = dirty_ ? 0 : busy ? 10 : down ? 200 : 1000;
+        ready.clear();
+        waitEvents(timeout, ready);
+        for (std::size_t i : ready) {
+            if (conns_[i].state == ConnState::Idle) {
+                // Readable while idle: the server closed the connection
+                reset(conns_[i], "server closed the connection");
+            } else {
+                drive(i);
+            }
+        }
+        if (busy && ready.empty()) {
+            for (std::size_t i = 0; i < conns_.size(); ++i) drive(i);
+        }
+    }
+}
+
+void AsyncMySQL::dispatch() {
+    Clock::time_point now = Clock::now();
+    for (std::size_t i = 0; i < conns_.size(); ++i) {
+        Conn& c = conns_[i];
+        if (c.state == ConnState::Down) {
+            if (c.leased) {
+                // Whatever the session had open died with the connection
+                while (!c.sessionOps.empty()) {
+                    Op op = std::move(c.sessionOps.front());
+                    c.sessionOps.pop_front();
+                    inflightGauge().add(-1);
+                    Result r;
+                    r.error = "connection lost";
+                    op.done(std::move(r));
+                }
+                if (c.leaseEnded) c.leased = c.leaseEnded = false;
+            }
+            if (now >= c.retryAt) {
+                c.mysql = mysql_init(nullptr);
+                if (!c.mysql) continue;
+                c.state = ConnState::Connecting;
+                drive(i);
+            }
+            continue;
+        }
+        if (c.state != ConnState::Idle) continue;
+
+        if (c.leased) {
+            if (!c.sessionOps.empty()) {
+                Op op = std::move(c.sessionOps.front());
+                c.sessionOps.pop_front();
+                begin(c, std::move(op));
+                drive(i);
+            } else if (c.leaseEnded) {
+                c.leased = c.leaseEnded = false;
+            }
+            if (c.leased) continue;
+        }
+        if (!sessionWaiters_.empty()) {
+            SessionCallback ready = std::move(sessionWaiters_.front().ready);
+            sessionWaiters_.pop_front();
+            c.leased = true;
+            ready(std::shared_ptr<Session>(new Session(*this, i)));
+        } else if (!pending_.empty()) {
+            Op op = std::move(pending_.front());
+            pending_.pop_front();
+            begin(c, std::move(op));
+            drive(i);
+        }
+    }
+    expire(now);
+}
+
+void AsyncMySQL::expire(Clock::time_point now) {
+    static metrics::Counter& timedOut = shedCounter("timeout");
+    // Both queues are in arrival order, so the oldest are at the front
+    while (!pending_.empty() && now - pending_.front().queued > kQueueTimeout) {
+        Op op = std::move(pending_.front());
+        pending_.pop_front();
+        timedOut.inc();
+        inflightGauge().add(-1);
+        op.done(shedResult("no database connection became free in time"));
+    }
+    while (!sessionWaiters_.empty() && now - sessionWaiters_.front().queued > kQueueTimeout) {
+        SessionCallback ready = std::move(sessionWaiters_.front().ready);
+        sessionWaiters_.pop_front();
+        timedOut.inc();
+        ready(nullptr);
+    }
+}
+
+void AsyncMySQL::begin(Conn& conn, Op op) {
+    conn.op = std::move(op);
+    conn.op.sent = Clock::now();
+    conn.state = ConnState::Sending;
+}
+
+void AsyncMySQL::drive(std::size_t index) {
+    Conn& c = conns_[index];
+    auto watchSocket = [&] {
+        int fd = static_cast<int>(c.mysql->net.fd); // 0 until the socket exists
+        if (fd > 0 && fd != c.fd) {
+            if (c.fd >= 0) unwatch(c.fd);
+            watch(index, fd);
+            c.fd = fd;
+        }
+    };
+    auto fail = [&] {
+        static metrics::Counter& errors = metrics::counter(
+            "sweet_shop_db_errors_total", "", "Failed mysql_query calls");
+        errors.inc();
+        Result r;
+        r.error = mysql_error(c.mysql);
+        bool lost = connectionLost(mysql_errno(c.mysql));
+        finish(c, std::move(r));
+        if (lost) reset(c, "connection lost");
+    };
+
+    for (;;) {
+        switch (c.state) {
+        case ConnState::Connecting: {
+            net_async_status s = mysql_real_connect_nonblocking(
+                c.mysql, host_.c_str(), user_.c_str(), password_.c_str(),
+                database_.c_str(), port_, nullptr, 0);
+            if (s == NET_ASYNC_NOT_READY) {
+                watchSocket();
+                return;
+            }
+            if (s == NET_ASYNC_ERROR) {
+                reset(c, mysql_error(c.mysql));
+                return;
+            }
+            watchSocket();
+            c.state = ConnState::Idle;
+            dirty_ = true;
+            return;
+        }
+        case ConnState::Sending: {
+            net_async_status s = mysql_real_query_nonblocking(
+                c.mysql, c.op.sql.data(), static_cast<unsigned long>(c.op.sql.size()));
+            if (s == NET_ASYNC_NOT_READY) return;
+            if (s == NET_ASYNC_ERROR) return fail();
+            c.state = ConnState::Storing;
+            continue;
+        }
+        case ConnState::Storing: {
+            MYSQL_RES* res = nullptr;
+            net_async_status s = mysql_store_result_nonblocking(c.mysql, &res);
+            if (s == NET_ASYNC_NOT_READY) return;
+            if (s == NET_ASYNC_ERROR) return fail();
+            Result r;
+            if (res) {
+                MYSQL_FIELD* fields = mysql_fetch_fields(res);
+                unsigned int numFields = mysql_num_fields(res);
+                MYSQL_ROW row;
+                while ((row = mysql_fetch_row(res))) {
+                    std::map<std::string, std::string> rowmap;
+                    for (unsigned int i = 0; i < numFields; ++i) {
+                        rowmap[fields[i].name] = row[i] ? row[i] : "";
+                    }
+                    r.rows.push_back(std::move(rowmap));
+                }
+                mysql_free_result(res);
+            } else if (mysql_field_count(c.mysql) != 0) {
+                return fail(); // a result set was expected but could not be read
+            } else {
+                r.affectedRows = mysql_affected_rows(c.mysql);
+                r.insertId = mysql_insert_id(c.mysql);
+            }
+            r.ok = true;
+            finish(c, std::move(r));
+            return;
+        }
+        default:
+            return;
+        }
+    }
+}
+
+void AsyncMySQL::finish(Conn& conn, Result result) {
+    Op op = std::move(conn.op);
+    conn.op = Op();
+    conn.state = ConnState::Idle;
+    dirty_ = true;
+    inflightGauge().add(-1);
+    auto now = Clock::now();
+    queryHistogram().record(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - op.queued).count()));
+    // The slow query log times the statement itself, without the queueing
+    querylog::shape(op.sql.data(), op.sql.size(), shape_);
+    querylog::record(shape_, endpoint_,
+                     static_cast<std::uint64_t>(
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(now - op.sent).count()),
+                     result.ok ? result.rows.size() + result.affectedRows : 0, result.error.c_str());
+    if (op.done) op.done(std::move(result));
+}
+
+void AsyncMySQL::reset(Conn& conn, const char* why) {
+    bool wasConnecting = conn.state == ConnState::Connecting;
+    if (!wasConnecting || conn.retryAt == Clock::time_point()) {
+        std::cerr << "AsyncMySQL: " << why << "\n";
+    }
+    if (conn.fd >= 0) unwatch(conn.fd);
+    conn.fd = -1;
+    if (conn.mysql) mysql_close(conn.mysql);
+    conn.mysql = nullptr;
+    conn.state = ConnState::Down;
+    // Reconnect right away after losing an established connection; back
+    // off while the server is unreachable
+    conn.retryAt = wasConnecting ? Clock::now() + std::chrono::seconds(1) : Clock::time_point();
+    dirty_ = true;
+}
+
+#ifdef __linux__
+
+bool AsyncMySQL::openPoller() {
+    pollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pollFd_ < 0 || wakeFd_ < 0) {
+        closePoller();
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = ~0ull;
+    return epoll_ctl(pollFd_, EPOLL_CTL_ADD, wakeFd_, &ev) == 0;
+}
+
+void AsyncMySQL::closePoller() {
+    if (pollFd_ >= 0) ::close(pollFd_);
+    if (wakeFd_ >= 0) ::close(wakeFd_);
+    pollFd_ = wakeFd_ = -1;
+}
+
+void AsyncMySQL::watch(std::size_t index, int fd) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = index;
+    epoll_ctl(pollFd_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void AsyncMySQL::unwatch(int fd) {
+    epoll_ctl(pollFd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void AsyncMySQL::wake() {
+    std::uint64_t one = 1;
+    if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+        // Counter already non-zero; the loop is waking anyway
+    }
+}
+
+void AsyncMySQL::waitEvents(int timeoutMs, std::vector<std::size_t>& ready) {
+    epoll_event events[64];
+    int n = epoll_wait(pollFd_, events, 64, timeoutMs);
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.u64 == ~0ull) {
+            std::uint64_t drained;
+            if (::read(wakeFd_, &drained, sizeof(drained)) < 0) {
+                // Spurious wakeup; nothing to drain
+            }
+        } else {
+            ready.push_back(static_cast<std::size_t>(events[i].data.u64));
+        }
+    }
+}
+
+#else
+
+// Portable fallback: poll() / WSAPoll() over the connection sockets with
+// a short timeout instead of a wakeup descriptor, so new submissions wait
+// at most a couple of milliseconds.
+
+bool AsyncMySQL::openPoller() {
+    return true;
+}
+
+void AsyncMySQL::closePoller() {}
+
+void AsyncMySQL::watch(std::size_t index, int fd) {
+    watched_[index] = fd;
+}
+
+void AsyncMySQL::unwatch(int fd) {
+    std::replace(watched_.begin(), watched_.end(), fd, -1);
+}
+
+void AsyncMySQL::wake() {}
+
+void AsyncMySQL::waitEvents(int timeoutMs, std::vector<std::size_t>& ready) {
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> fds;
+#else
+    std::vector<pollfd> fds;
+#endif
+    std::vector<std::size_t> owners;
+    for (std::size_t i = 0; i < watched_.size(); ++i) {
+        if (watched_[i] < 0) continue;
+        fds.push_back({});
+        fds.back().fd = watched_[i];
+        fds.back().events = POLLIN;
+        owners.push_back(i);
+    }
+    timeoutMs = std::min(timeoutMs, 2);
+#ifdef _WIN32
+    if (fds.empty()) {
+        Sleep(static_cast<DWORD>(timeoutMs));
+        return;
+    }
+    int n = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeoutMs);
+#else
+    int n = ::poll(fds.data(), fds.size(), timeoutMs);
+#endif
+    for (std::size_t i = 0; n > 0 && i < fds.size(); ++i) {
+        if (fds[i].revents) ready.push_back(owners[i]);
+    }
+}
+
+#endif
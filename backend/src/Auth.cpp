@@ -1,12 +1,14 @@
 #include "Auth.h"
-#include "Database.h"
+#include "Storage.h"
 #include "JWT.h"
+#include "Metrics.h"
+#include "ShopEvents.h"
 
 #include <openssl/sha.h>
 #include <sstream>
 #include <iomanip>
 
-Auth::Auth(Database& db, const std::string& jwtSecret)
+Auth::Auth(Storage& db, const std::string& jwtSecret)
     : db_(db), secret_(jwtSecret) {}
 
 std::string Auth::hashPassword(const std::string& plaintext) const {
@@ -52,14 +54,17 @@ std::string Auth::registerUser(const std::string& username,
         return "";
     }
 
-    if (!db_.createUser(username, hash, email, false)) {
+    int id = 0;
+    if (!db_.createUser(username, hash, email, false, &id)) {
         return "";
     }
+    for (auto* l : listeners_) l->onUserCreated(false);
 
     std::map<std::string, std::string> claims;
     claims["username"] = username;
     claims["email"] = email;
     claims["is_admin"] = "false";
+    claims["user_id"] = std::to_string(id);
 
     return createToken(claims);
 }
@@ -88,13 +93,23 @@ std::string Auth::login(const std::string& username,
     return createToken(claims);
 }
 
+void Auth::addListener(ShopListener* listener) {
+    if (listener) listeners_.push_back(listener);
+}
+
 bool Auth::validateToken(const std::string& token) const {
+    static metrics::Histogram& verifyTime = metrics::histogram(
+        "sweet_shop_jwt_seconds", "op=\"verify\"", "JWT verify/decode latency");
+    metrics::ScopedTimer timer(verifyTime);
     JWT jwt(secret_);
     return jwt.verify(token);
 }
 
 std::map<std::string, std::string>
 Auth::decodeToken(const std::string& token) const {
+    static metrics::Histogram& decodeTime = metrics::histogram(
+        "sweet_shop_jwt_seconds", "op=\"decode\"", "JWT verify/decode latency");
+    metrics::ScopedTimer timer(decodeTime);
     JWT jwt(secret_);
     return jwt.decode(token);
 }
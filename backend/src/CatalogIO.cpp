@@ -0,0 +1,520 @@
+#include "CatalogIO.h"
+#include "RowFormat.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace catalogio {
+
+namespace {
+
+// Below this many records a single thread is faster than handing out work
+const std::size_t kParallelThreshold = 2048;
+
+const char* const kColumns[] = {"id", "name", "description", "category", "price", "quantity"};
+
+// One record of the input: [begin, end) and its 1-based number
+struct Span {
+    std::size_t begin;
+    std::size_t end;
+    std::size_t number;
+};
+
+using Fields = std::map<std::string, std::string>;
+
+struct Parsed {
+    std::vector<std::pair<std::size_t, Sweet>> sweets; // (record, sweet)
+    std::vector<RowError> errors;
+};
+
+std::string lower(std::string s) {
+    for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return s;
+}
+
+std::string trim(const std::string& s) {
+    std::size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return std::string();
+    std::size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+// Characters, not bytes, as VARCHAR(n) counts them
+std::size_t utf8Length(const std::string& s) {
+    std::size_t n = 0;
+    for (unsigned char c : s) {
+        if ((c & 0xC0) != 0x80) ++n;
+    }
+    return n;
+}
+
+bool parseInt(const std::string& text, long long max, int& out) {
+    if (text.empty() || text.size() > 10) return false;
+    long long v = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (c - '0');
+    }
+    if (v > max) return false;
+    out = static_cast<int>(v);
+    return true;
+}
+
+// Checks one record's fields against the sweets table constraints
+bool validate(const Fields& fields, Sweet& sweet, std::string& error) {
+    auto get = [&](const char* name) {
+        auto it = fields.find(name);
+        return it == fields.end() ? std::string() : it->second;
+    };
+    std::string id = trim(get("id"));
+    if (!id.empty() && (!parseInt(id, INT_MAX, sweet.id) || sweet.id == 0)) {
+        error = "id must be a positive integer";
+        return false;
+    }
+    sweet.name = trim(get("name"));
+    if (sweet.name.empty() || utf8Length(sweet.name) > 100) {
+        error = "name is required and at most 100 characters";
+        return false;
+    }
+    sweet.category = trim(get("category"));
+    if (sweet.category.empty() || utf8Length(sweet.category) > 50) {
+        error = "category is required and at most 50 characters";
+        return false;
+    }
+    sweet.description = get("description");
+    if (sweet.description.size() > 65535) {
+        error = "description is longer than 65535 bytes";
+        return false;
+    }
+    std::string price = trim(get("price"));
+    char* end = nullptr;
+    double p = price.empty() ? -1.0 : std::strtod(price.c_str(), &end);
+    if (price.empty() || *end != '\0' || !std::isfinite(p) || p < 0.0 || p >= 1e8) {
+        error = "price must be a number from 0 to 99999999.99";
+        return false;
+    }
+    sweet.price = rowformat::roundCents(p);
+    if (!parseInt(trim(get("quantity")), INT_MAX, sweet.quantity)) {
+        error = "quantity must be a non-negative integer";
+        return false;
+    }
+    return true;
+}
+
+// Record boundaries. CSV records end at a line break outside quotes;
+// NDJSON records are lines. Blank records are skipped but still counted
+// for NDJSON, whose errors refer to line numbers.
+std::vector<Span> split(const std::string& in, Format format) {
+    std::vector<Span> spans;
+    bool quoted = false;
+    std::size_t begin = 0, line = 0;
+    for (std::size_t i = 0; i <= in.size(); ++i) {
+        if (i < in.size()) {
+            char c = in[i];
+            if (c == '"' && format == Format::Csv) quoted = !quoted;
+            if (c != '\n' || quoted) continue;
+        }
+        ++line;
+        std::size_t end = i;
+        if (end > begin && in[end - 1] == '\r') --end;
+        if (in.find_first_not_of(" \t", begin) < end) spans.push_back({begin, end, line});
+        begin = i + 1;
+    }
+    return spans;
+}
+
+// RFC 4180 fields of one record
+bool splitCsv(const std::string& in, const Span& span, std::vector<std::string>& out, std::string& error) {
+    out.clear();
+    std::size_t i = span.begin;
+    for (;;) {
+        std::string field;
+        if (i < span.end && in[i] == '"') {
+            ++i;
+            for (;;) {
+                if (i >= span.end) {
+                    error = "unterminated quoted field";
+                    return false;
+                }
+                if (in[i] == '"') {
+                    if (i + 1 < span.end && in[i + 1] == '"') {
+                        field += '"';
+                        i += 2;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                field += in[i++];
+            }
+            if (i < span.end && in[i] != ',') {
+                error = "unexpected character after a closing quote";
+                return false;
+            }
+        } else {
+            std::size_t comma = in.find(',', i);
+            std::size_t stop = comma < span.end ? comma : span.end;
+            field.assign(in, i, stop - i);
+            i = stop;
+        }
+        out.push_back(std::move(field));
+        if (i >= span.end) return true;
+        ++i; // the comma
+    }
+}
+
+void appendUtf8(unsigned long cp, std::string& out) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Minimal reader for one flat JSON object: string keys; string, number,
+// boolean or null values. Numbers and booleans keep their text; null
+// becomes an absent field.
+class FlatJson {
+public:
+    FlatJson(const std::string& in, const Span& span) : in_(in), i_(span.begin), end_(span.end) {}
+
+    bool parse(Fields& out, std::string& error) {
+        skip();
+        if (!eat('{')) return fail(error, "expected a JSON object");
+        skip();
+        if (eat('}')) return rest(error);
+        for (;;) {
+            std::string key, value;
+            skip();
+            if (!string(key)) return fail(error, "expected a string key");
+            skip();
+            if (!eat(':')) return fail(error, "expected ':'");
+            skip();
+            if (i_ >= end_) return fail(error, "unexpected end of line");
+            char c = in_[i_];
+            if (c == '"') {
+                if (!string(value)) return fail(error, "bad string value");
+                out[key] = std::move(value);
+            } else if (c == '{' || c == '[') {
+                return fail(error, "nested values are not supported");
+            } else {
+                std::size_t start = i_;
+                while (i_ < end_ && (std::isalnum(static_cast<unsigned char>(in_[i_])) ||
+                                     in_[i_] == '-' || in_[i_] == '+' || in_[i_] == '.')) {
+                    ++i_;
+                }
+                if (i_ == start) return fail(error, "bad value");
+                value.assign(in_, start, i_ - start);
+                if (value != "null") out[key] = std::move(value);
+            }
+            skip();
+            if (eat(',')) continue;
+            if (eat('}')) return rest(error);
+            return fail(error, "expected ',' or '}'");
+        }
+    }
+
+private:
+    void skip() {
+        while (i_ < end_ && (in_[i_] == ' ' || in_[i_] == '\t')) ++i_;
+    }
+    bool eat(char c) {
+        if (i_ < end_ && in_[i_] == c) {
+            ++i_;
+            return true;
+        }
+        return false;
+    }
+    bool rest(std::string& error) {
+        skip();
+        return i_ == end_ || fail(error, "trailing characters after the object");
+    }
+    static bool fail(std::string& error, const char* message) {
+        error = message;
+        return false;
+    }
+    bool hex4(unsigned long& cp) {
+        if (i_ + 4 > end_) return false;
+        cp = 0;
+        for (int k = 0; k < 4; ++k) {
+            char c = in_[i_++];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= static_cast<unsigned long>(c - '0');
+            else if (c >= 'a' && c <= 'f') cp |= static_cast<unsigned long>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') cp |= static_cast<unsigned long>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+    bool string(std::string& out) {
+        if (!eat('"')) return false;
+        while (i_ < end_) {
+            char c = in_[i_++];
+            if (c == '"') return true;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (i_ >= end_) return false;
+            char e = in_[i_++];
+            switch (e) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned long cp = 0;
+                if (!hex4(cp)) return false;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    unsigned long low = 0;
+                    if (!eat('\\') || !eat('u') || !hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(cp, out);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    const std::string& in_;
+    std::size_t i_;
+    std::size_t end_;
+};
+
+// Parses records [first, last) of spans
+Parsed parseRange(const std::string& in, Format format, const std::vector<Span>& spans,
+                  std::size_t first, std::size_t last, const std::vector<std::string>& header) {
+    Parsed out;
+    std::vector<std::string> values;
+    for (std::size_t k = first; k < last; ++k) {
+        const Span& span = spans[k];
+        Fields fields;
+        std::string error;
+        bool ok = true;
+        if (format == Format::Csv) {
+            ok = splitCsv(in, span, values, error);
+            if (ok && values.size() != header.size()) {
+                error = "expected " + std::to_string(header.size()) + " fields, got " +
+                        std::to_string(values.size());
+                ok = false;
+            }
+            for (std::size_t c = 0; ok && c < header.size(); ++c) {
+                if (!header[c].empty()) fields[header[c]] = std::move(values[c]);
+            }
+        } else {
+            ok = FlatJson(in, span).parse(fields, error);
+        }
+        Sweet sweet;
+        if (ok) ok = validate(fields, sweet, error);
+        if (ok) {
+            out.sweets.emplace_back(span.number, std::move(sweet));
+        } else {
+            out.errors.push_back({span.number, error});
+        }
+    }
+    return out;
+}
+
+void appendCsvField(const std::string& value, std::string& out) {
+    bool quote = value.find_first_of(",\"\r\n") != std::string::npos ||
+                 (!value.empty() && (value.front() == ' ' || value.back() == ' '));
+    if (!quote) {
+        out += value;
+        return;
+    }
+    out += '"';
+    for (char c : value) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+void appendJsonString(const std::string& value, std::string& out) {
+    static const char* hex = "0123456789abcdef";
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += "\\u00";
+                out += hex[(c >> 4) & 0xF];
+                out += hex[c & 0xF];
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+bool parseFormat(const std::string& name, Format& out) {
+    std::string n = lower(trim(name.substr(0, name.find(';'))));
+    if (n == "csv" || n == "text/csv") {
+        out = Format::Csv;
+        return true;
+    }
+    if (n == "ndjson" || n == "application/x-ndjson" || n == "application/ndjson") {
+        out = Format::Ndjson;
+        return true;
+    }
+    return false;
+}
+
+ParseResult parse(const std::string& input, Format format, unsigned threads) {
+    ParseResult result;
+    std::vector<Span> spans = split(input, format);
+
+    // CSV: the first record names the columns; unknown ones are ignored
+    std::vector<std::string> header;
+    std::size_t first = 0;
+    if (format == Format::Csv) {
+        if (spans.empty()) {
+            result.errors.push_back({0, "missing header row"});
+            return result;
+        }
+        std::vector<std::string> names;
+        std::string error;
+        if (!splitCsv(input, spans[0], names, error)) {
+            result.errors.push_back({0, "header row: " + error});
+            return result;
+        }
+        std::string missing;
+        for (const char* column : kColumns) {
+            bool found = false;
+            for (const auto& name : names) found = found || lower(trim(name)) == column;
+            if (!found && std::string(column) != "id" && std::string(column) != "description") {
+                missing += missing.empty() ? column : std::string(", ") + column;
+            }
+        }
+        if (!missing.empty()) {
+            result.errors.push_back({0, "header row is missing " + missing});
+            return result;
+        }
+        for (const auto& name : names) {
+            std::string column = lower(trim(name));
+            bool known = std::find_if(std::begin(kColumns), std::end(kColumns),
+                                      [&](const char* c) { return column == c; }) != std::end(kColumns);
+            header.push_back(known ? column : std::string());
+        }
+        // Data records are numbered from 1 after the header
+        for (std::size_t k = 1; k < spans.size(); ++k) spans[k].number = k;
+        first = 1;
+    }
+    result.records = spans.size() - first;
+
+    unsigned workers = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::size_t count = spans.size() - first;
+    if (count < kParallelThreshold) workers = 1;
+    workers = static_cast<unsigned>(std::min<std::size_t>(workers, count ? count : 1));
+
+    std::vector<Parsed> parts;
+    if (workers == 1) {
+        parts.push_back(parseRange(input, format, spans, first, spans.size(), header));
+    } else {
+        std::vector<std::future<Parsed>> futures;
+        std::size_t per = (count + workers - 1) / workers;
+        for (std::size_t b = first; b < spans.size(); b += per) {
+            std::size_t e = std::min(spans.size(), b + per);
+            futures.push_back(std::async(std::launch::async, parseRange, std::cref(input), format,
+                                         std::cref(spans), b, e, std::cref(header)));
+        }
+        for (auto& f : futures) parts.push_back(f.get());
+    }
+
+    // Merge in input order; a repeated id keeps its first row
+    std::unordered_map<int, std::size_t> seen;
+    for (auto& part : parts) {
+        for (auto& entry : part.sweets) {
+            int id = entry.second.id;
+            if (id) {
+                auto ins = seen.emplace(id, entry.first);
+                if (!ins.second) {
+                    result.errors.push_back({entry.first, "duplicate id " + std::to_string(id) +
+                                                              " (first on record " +
+                                                              std::to_string(ins.first->second) + ")"});
+                    continue;
+                }
+            }
+            result.sweets.push_back(std::move(entry.second));
+        }
+        for (auto& error : part.errors) result.errors.push_back(std::move(error));
+    }
+    std::stable_sort(result.errors.begin(), result.errors.end(),
+                     [](const RowError& a, const RowError& b) { return a.record < b.record; });
+    return result;
+}
+
+void appendHeader(Format format, std::string& out) {
+    if (format == Format::Csv) out += "id,name,description,category,price,quantity\r\n";
+}
+
+void appendSweet(Format format, const Sweet& sweet, std::string& out) {
+    if (format == Format::Csv) {
+        out += std::to_string(sweet.id);
+        out += ',';
+        appendCsvField(sweet.name, out);
+        out += ',';
+        appendCsvField(sweet.description, out);
+        out += ',';
+        appendCsvField(sweet.category, out);
+        out += ',';
+        out += rowformat::money(sweet.price);
+        out += ',';
+        out += std::to_string(sweet.quantity);
+        out += "\r\n";
+        return;
+    }
+    out += "{\"id\":";
+    out += std::to_string(sweet.id);
+    out += ",\"name\":";
+    appendJsonString(sweet.name, out);
+    out += ",\"description\":";
+    appendJsonString(sweet.description, out);
+    out += ",\"category\":";
+    appendJsonString(sweet.category, out);
+    out += ",\"price\":";
+    out += rowformat::money(sweet.price);
+    out += ",\"quantity\":";
+    out += std::to_string(sweet.quantity);
+    out += "}\n";
+}
+
+const char* contentType(Format format) {
+    return format == Format::Csv ? "text/csv; charset=utf-8" : "application/x-ndjson";
+}
+
+} // namespace catalogio
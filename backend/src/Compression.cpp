@@ -0,0 +1,171 @@
+#include "Compression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#ifdef SWEET_SHOP_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace compression {
+
+namespace {
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+std::string trim(const std::string& s) {
+    std::size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) return "";
+    std::size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool brotliAvailable() {
+#ifdef SWEET_SHOP_HAVE_BROTLI
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Keep a compressed variant only if it is meaningfully smaller
+bool worthIt(const std::string& original, const std::string& compressed) {
+    return !compressed.empty() && compressed.size() + 64 < original.size();
+}
+
+// q-values the client gave gzip and br; 0 means not acceptable
+struct Preferences {
+    double gzip{0};
+    double brotli{0};
+};
+
+Preferences parse(const std::string& acceptEncoding) {
+    Preferences prefs;
+    double anyQ = -1;
+    bool gzipListed = false, brListed = false;
+    std::string header = lower(acceptEncoding);
+    std::size_t pos = 0;
+    while (pos <= header.size()) {
+        std::size_t comma = header.find(',', pos);
+        if (comma == std::string::npos) comma = header.size();
+        std::string item = header.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        double q = 1.0;
+        std::size_t semi = item.find(';');
+        if (semi != std::string::npos) {
+            std::string params = trim(item.substr(semi + 1));
+            if (params.compare(0, 2, "q=") == 0) q = std::atof(params.c_str() + 2);
+            item = item.substr(0, semi);
+        }
+        item = trim(item);
+        if (item == "gzip" || item == "x-gzip") {
+            prefs.gzip = q;
+            gzipListed = true;
+        } else if (item == "br") {
+            prefs.brotli = q;
+            brListed = true;
+        } else if (item == "*") {
+            anyQ = q;
+        }
+    }
+    if (anyQ >= 0) {
+        if (!gzipListed) prefs.gzip = anyQ;
+        if (!brListed) prefs.brotli = anyQ;
+    }
+    return prefs;
+}
+
+} // namespace
+
+Encoding negotiate(const std::string& acceptEncoding) {
+    Preferences prefs = parse(acceptEncoding);
+    if (brotliAvailable() && prefs.brotli > 0 && prefs.brotli >= prefs.gzip) return Encoding::Brotli;
+    if (prefs.gzip > 0) return Encoding::Gzip;
+    return Encoding::Identity;
+}
+
+const char* name(Encoding encoding) {
+    switch (encoding) {
+    case Encoding::Gzip: return "gzip";
+    case Encoding::Brotli: return "br";
+    default: return "";
+    }
+}
+
+bool gzip(const std::string& in, std::string& out, int level) {
+    z_stream zs{};
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+    out.resize(deflateBound(&zs, static_cast<uLong>(in.size())));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+bool brotli(const std::string& in, std::string& out, int quality) {
+#ifdef SWEET_SHOP_HAVE_BROTLI
+    std::size_t size = BrotliEncoderMaxCompressedSize(in.size());
+    if (size == 0) return false;
+    out.resize(size);
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               in.size(), reinterpret_cast<const uint8_t*>(in.data()),
+                               &size, reinterpret_cast<uint8_t*>(&out[0]))) {
+        return false;
+    }
+    out.resize(size);
+    return true;
+#else
+    (void)in;
+    (void)out;
+    (void)quality;
+    return false;
+#endif
+}
+
+PrecompressedBody::PrecompressedBody(std::string identity, bool compress)
+    : identity_(std::move(identity)) {
+    if (compress) this->compress(9, 11);
+}
+
+PrecompressedBody::PrecompressedBody(std::string identity, int gzipLevel, int brotliQuality)
+    : identity_(std::move(identity)) {
+    compress(gzipLevel, brotliQuality);
+}
+
+void PrecompressedBody::compress(int gzipLevel, int brotliQuality) {
+    if (identity_.size() < kMinSize) return;
+    if (!gzip(identity_, gzip_, gzipLevel) || !worthIt(identity_, gzip_)) gzip_.clear();
+    if (!brotli(identity_, brotli_, brotliQuality) || !worthIt(identity_, brotli_)) brotli_.clear();
+}
+
+const std::string& PrecompressedBody::select(const std::string& acceptEncoding,
+                                             Encoding& encoding) const {
+    encoding = Encoding::Identity;
+    if (gzip_.empty() && brotli_.empty()) return identity_;
+    Preferences prefs = parse(acceptEncoding);
+    // Brotli when preferred and kept; otherwise fall back to gzip if allowed
+    if (!brotli_.empty() && prefs.brotli > 0 && prefs.brotli >= prefs.gzip) {
+        encoding = Encoding::Brotli;
+        return brotli_;
+    }
+    if (!gzip_.empty() && prefs.gzip > 0) {
+        encoding = Encoding::Gzip;
+        return gzip_;
+    }
+    return identity_;
+}
+
+} // namespace compression
@@ -0,0 +1,74 @@
+#include "ConcurrencyLimiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double kShortWeight = 0.1;        // ~10 most recent requests
+const double kLongWeight = 1.0 / 600;   // ~600 requests
+
+} // namespace
+
+ConcurrencyLimiter::ConcurrencyLimiter(const std::string& name, const Options& options)
+    : options_(options),
+      limit_(options.initialLimit),
+      limitGauge_(metrics::gauge("sweet_shop_admission_limit", "class=\"" + name + "\"",
+                                 "Current adaptive concurrency limit")),
+      inflightGauge_(metrics::gauge("sweet_shop_admission_inflight", "class=\"" + name + "\"",
+                                    "Requests holding an admission slot")),
+      rejected_(metrics::counter("sweet_shop_admission_rejected_total",
+                                 "class=\"" + name + "\",reason=\"limit\"",
+                                 "Requests shed with 503 by admission control")) {
+    limitGauge_.set(options.initialLimit);
+}
+
+bool ConcurrencyLimiter::tryAcquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (inflight_ >= static_cast<int>(limit_)) {
+        rejected_.inc();
+        return false;
+    }
+    inflightGauge_.set(++inflight_);
+    return true;
+}
+
+void ConcurrencyLimiter::release(std::chrono::nanoseconds latency, bool failed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    inflightGauge_.set(--inflight_);
+    update(static_cast<double>(latency.count()), failed);
+}
+
+void ConcurrencyLimiter::update(double rtt, bool failed) {
+    if (failed) {
+        limit_ = std::max<double>(options_.minLimit, limit_ * options_.backoff);
+        limitGauge_.set(static_cast<std::int64_t>(limit_));
+        return;
+    }
+    if (rtt <= 0) return;
+    shortRtt_ = shortRtt_ == 0 ? rtt : shortRtt_ + (rtt - shortRtt_) * kShortWeight;
+    longRtt_ = longRtt_ == 0 ? rtt : longRtt_ + (rtt - longRtt_) * kLongWeight;
+    // Latency recovered well below the old baseline: let the baseline
+    // follow quickly instead of over several hundred samples
+    if (longRtt_ > 2 * shortRtt_) longRtt_ *= 0.95;
+
+    double gradient = std::max(0.5, std::min(1.0, options_.tolerance * longRtt_ / shortRtt_));
+    double estimate = limit_ * gradient + std::sqrt(limit_);
+    // Only grow when the current limit is actually in use
+    if (estimate > limit_ && inflight_ + 1 < limit_ / 2) return;
+    limit_ = limit_ * (1 - options_.smoothing) + estimate * options_.smoothing;
+    limit_ = std::max<double>(options_.minLimit, std::min<double>(options_.maxLimit, limit_));
+    limitGauge_.set(static_cast<std::int64_t>(limit_));
+}
+
+int ConcurrencyLimiter::limit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(limit_);
+}
+
+int ConcurrencyLimiter::retryAfterSeconds() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Roughly how long the requests in flight take to drain, at least 1s
+    double drain = inflight_ * shortRtt_ / std::max(1.0, limit_) / 1e9;
+    return std::max(1, static_cast<int>(std::ceil(drain)));
+}
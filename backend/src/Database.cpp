@@ -1,8 +1,49 @@
 #include "Database.h"
+#include "Metrics.h"
+#include "QueryLog.h"
+#include "RowFormat.h"
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <cstring>
+#include <initializer_list>
+
+// Times the enclosing call into sweet_shop_db_call_seconds{method="..."}
+#define DB_TIMED(method)                                                        \
+    static metrics::Histogram& dbCallHistogram_ = metrics::histogram(           \
+        "sweet_shop_db_call_seconds", "method=\"" method "\"",                 \
+        "Latency of Database calls, including connection wait");                \
+    metrics::ScopedTimer dbCallTimer_(dbCallHistogram_)
+
+// DB_TIMED for calls that complete in a callback: the timer stops when the
+// last callback holding a copy of dbCallTimer_ is destroyed
+#define DB_TIMED_ASYNC(method)                                                  \
+    static metrics::Histogram& dbCallHistogram_ = metrics::histogram(           \
+        "sweet_shop_db_call_seconds", "method=\"" method "\"",                 \
+        "Latency of Database calls, including connection wait");                \
+    auto dbCallTimer_ = std::make_shared<metrics::ScopedTimer>(dbCallHistogram_)
+
+namespace {
+
+// Read-after-write key of one sweet row
+std::string sweetKey(int id) {
+    return "sweet:" + std::to_string(id);
+}
+
+// Sweets as served; append a WHERE clause. A split sweet's stock is its
+// row's quantity plus its slots, summed once per split sweet in a
+// grouped join rather than in a subquery run for every row.
+const std::string kSweetSelect =
+    "SELECT id,name,description,category,price,"
+    "sweets.quantity+COALESCE(k.quantity,0) AS quantity,created_at,updated_at"
+    " FROM sweets LEFT JOIN (SELECT sweet_id,SUM(quantity) AS quantity FROM sweet_stock_slots"
+    " GROUP BY sweet_id) k ON k.sweet_id=sweets.id";
+
+} // namespace
 
 Database::Database(const std::string& host,
                    const std::string& user,
@@ -14,13 +55,15 @@ Database::Database(const std::string& host,
       user_(user),
       password_(password),
       database_(dbName),
-      port_(port) {}
+      port_(port),
+      endpoint_(host + ":" + std::to_string(port)) {}
 
 Database::~Database() {
     disconnect();
 }
 
 bool Database::connect() {
+    auto lock = lockConnection();
     if (conn_) return true;
     conn_ = mysql_init(nullptr);
     if (!conn_) {
@@ -39,6 +82,7 @@ bool Database::connect() {
 }
 
 void Database::disconnect() {
+    auto lock = lockConnection();
     if (conn_) {
         mysql_close(conn_);
         conn_ = nullptr;
@@ -49,7 +93,70 @@ bool Database::isConnected() const {
     return conn_ != nullptr;
 }
 
+Database::ConnectionLock::ConnectionLock(Database& db)
+    : db_(db) {
+    // Only this thread stores its own id, and clears it before unlocking
+    if (db_.lockOwner_.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+        db_.mutex_.lock();
+        ++db_.lockDepth_;
+        return;
+    }
+    static metrics::Histogram& wait = metrics::histogram(
+        "sweet_shop_db_pool_wait_seconds", "",
+        "Time spent waiting for the database connection");
+    {
+        metrics::ScopedTimer timer(wait);
+        db_.mutex_.lock();
+    }
+    db_.lockOwner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    db_.lockDepth_ = 1;
+}
+
+Database::ConnectionLock::~ConnectionLock() {
+    if (--db_.lockDepth_ == 0) db_.lockOwner_.store(std::thread::id(), std::memory_order_relaxed);
+    db_.mutex_.unlock();
+}
+
+Database::ConnectionLock Database::lockConnection() {
+    return ConnectionLock(*this);
+}
+
+int Database::execute(const char* query) {
+    auto start = std::chrono::steady_clock::now();
+    int rc = mysql_query(conn_, query);
+    auto end = std::chrono::steady_clock::now();
+    querylog::shape(query, std::strlen(query), statementShape_);
+    statementStart_ = start;
+    statementOpen_ = true;
+    if (rc != 0) {
+        static metrics::Counter& errors = metrics::counter(
+            "sweet_shop_db_errors_total", "", "Failed mysql_query calls");
+        errors.inc();
+        logStatement(end, 0, mysql_error(conn_));
+    } else if (mysql_field_count(conn_) == 0) {
+        logStatement(end, mysql_affected_rows(conn_), nullptr);
+    }
+    return rc;
+}
+
+MYSQL_RES* Database::storeResult() {
+    MYSQL_RES* res = mysql_store_result(conn_);
+    if (statementOpen_) {
+        logStatement(std::chrono::steady_clock::now(), res ? mysql_num_rows(res) : 0,
+                     res ? nullptr : mysql_error(conn_));
+    }
+    return res;
+}
+
+void Database::logStatement(std::chrono::steady_clock::time_point end, std::uint64_t rows,
+                            const char* error) {
+    statementOpen_ = false;
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - statementStart_).count();
+    querylog::record(statementShape_, endpoint_, static_cast<std::uint64_t>(nanos), rows, error);
+}
+
 std::string Database::escape(const std::string& input) {
+    auto lock = lockConnection();
     if (!conn_) return input;
     std::string out;
     out.resize(input.size() * 2 + 1);
@@ -64,7 +171,10 @@ std::string Database::escape(const std::string& input) {
 bool Database::createUser(const std::string& username,
                           const std::string& passwordHash,
                           const std::string& email,
-                          bool isAdmin) {
+                          bool isAdmin,
+                          int* outId) {
+    DB_TIMED("createUser");
+    auto lock = lockConnection();
     if (!connect()) return false;
     std::string u = escape(username);
     std::string p = escape(passwordHash);
@@ -72,22 +182,34 @@ bool Database::createUser(const std::string& username,
     std::ostringstream q;
     q << "INSERT INTO users (username, password_hash, email, is_admin) VALUES ('"
       << u << "','" << p << "','" << e << "'," << (isAdmin ? 1 : 0) << ")";
-    if (mysql_query(conn_, q.str().c_str()) != 0) {
+    if (execute(q.str().c_str()) != 0) {
         // Duplicate or other error
         return false;
     }
+    if (outId) *outId = static_cast<int>(mysql_insert_id(conn_));
+    pin("user:" + username);
     return true;
 }
 
 std::map<std::string, std::string> Database::getUserByUsername(const std::string& username) {
+    DB_TIMED("getUserByUsername");
     std::map<std::string, std::string> result;
-    if (!connect()) return result;
-    std::string u = escape(username);
     std::ostringstream q;
-    q << "SELECT id,username,password_hash,email,is_admin,created_at FROM users WHERE username='"
-      << u << "' LIMIT 1";
-    if (mysql_query(conn_, q.str().c_str()) != 0) return result;
-    MYSQL_RES* res = mysql_store_result(conn_);
+    {
+        auto lock = lockConnection();
+        if (!connect()) return result;
+        q << "SELECT id,username,password_hash,email,is_admin,created_at FROM users WHERE username='"
+          << escape(username) << "' LIMIT 1";
+    }
+    std::vector<std::map<std::string, std::string>> rows;
+    if (replicaRead(q.str(), "user:" + username, rows)) {
+        if (!rows.empty()) result = std::move(rows.front());
+        return result;
+    }
+    auto lock = lockConnection();
+    if (!connect()) return result;
+    if (execute(q.str().c_str()) != 0) return result;
+    MYSQL_RES* res = storeResult();
     if (!res) return result;
     MYSQL_ROW row = mysql_fetch_row(res);
     if (!row) {
@@ -108,49 +230,55 @@ bool Database::createSweet(const std::string& name,
                            const std::string& description,
                            const std::string& category,
                            double price,
-                           int quantity) {
+                           int quantity,
+                           int* outId) {
+    DB_TIMED("createSweet");
+    auto lock = lockConnection();
     if (!connect()) return false;
+    // Ids come from sweet_id_seq, as for imports, not AUTO_INCREMENT
+    long long reserved = reserveSweetIds(1);
+    if (reserved < 0) return false;
+    int id = static_cast<int>(reserved);
     std::string n = escape(name);
     std::string d = escape(description);
     std::string c = escape(category);
     std::ostringstream q;
-    q << "INSERT INTO sweets (name, description, category, price, quantity) VALUES ('"
-      << n << "','" << d << "','" << c << "'," << price << "," << quantity << ")";
-    if (mysql_query(conn_, q.str().c_str()) != 0) {
+    q << "INSERT INTO sweets (id, name, description, category, price, quantity) VALUES (" << id
+      << ",'" << n << "','" << d << "','" << c << "'," << price << "," << quantity << ")";
+    if (execute(q.str().c_str()) != 0) {
         return false;
     }
+    pin("catalog");
+    pin(sweetKey(id));
+    if (outId) *outId = id;
     return true;
 }
 
-std::vector<std::map<std::string, std::string>> Database::getAllSweets() {
+std::vector<std::map<std::string, std::string>> Database::getAllSweets(bool* ok) {
+    DB_TIMED("getAllSweets");
     std::vector<std::map<std::string, std::string>> out;
-    if (!connect()) return out;
-    const char* q = "SELECT id,name,description,category,price,quantity,created_at,updated_at FROM sweets";
-    if (mysql_query(conn_, q) != 0) return out;
-    MYSQL_RES* res = mysql_store_result(conn_);
-    if (!res) return out;
-    MYSQL_FIELD* fields = mysql_fetch_fields(res);
-    unsigned int num_fields = mysql_num_fields(res);
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(res))) {
-        std::map<std::string, std::string> rowmap;
-        for (unsigned int i = 0; i < num_fields; ++i) {
-            rowmap[fields[i].name] = row[i] ? row[i] : "";
-        }
-        out.push_back(std::move(rowmap));
+    const std::string& q = kSweetSelect;
+    if (replicaRead(q, "catalog", out)) {
+        if (ok) *ok = true;
+        return out;
     }
-    mysql_free_result(res);
-    return out;
+    return queryRows(q, ok);
 }
 
 std::map<std::string, std::string> Database::getSweetById(int id) {
+    DB_TIMED("getSweetById");
     std::map<std::string, std::string> result;
-    if (!connect()) return result;
     std::ostringstream q;
-    q << "SELECT id,name,description,category,price,quantity,created_at,updated_at FROM sweets WHERE id="
-      << id << " LIMIT 1";
-    if (mysql_query(conn_, q.str().c_str()) != 0) return result;
-    MYSQL_RES* res = mysql_store_result(conn_);
+    q << kSweetSelect << " WHERE id=" << id << " LIMIT 1";
+    std::vector<std::map<std::string, std::string>> rows;
+    if (replicaRead(q.str(), sweetKey(id), rows)) {
+        if (!rows.empty()) result = std::move(rows.front());
+        return result;
+    }
+    auto lock = lockConnection();
+    if (!connect()) return result;
+    if (execute(q.str().c_str()) != 0) return result;
+    MYSQL_RES* res = storeResult();
     if (!res) return result;
     MYSQL_ROW row = mysql_fetch_row(res);
     if (!row) {
@@ -172,6 +300,8 @@ bool Database::updateSweet(int id,
                            const std::string& category,
                            double price,
                            int quantity) {
+    DB_TIMED("updateSweet");
+    auto lock = lockConnection();
     if (!connect()) return false;
     std::string n = escape(name);
     std::string d = escape(description);
@@ -180,51 +310,405 @@ bool Database::updateSweet(int id,
     q << "UPDATE sweets SET name='" << n << "', description='" << d
       << "', category='" << c << "', price=" << price
       << ", quantity=" << quantity << " WHERE id=" << id;
-    if (mysql_query(conn_, q.str().c_str()) != 0) return false;
+    // A split sweet's slots are emptied so quantity is its whole stock
+    std::string slots = "UPDATE sweet_stock_slots SET quantity=0 WHERE sweet_id=" + std::to_string(id);
+    if (execute("START TRANSACTION") != 0) return false;
+    if (execute(slots.c_str()) != 0 || execute(q.str().c_str()) != 0 || execute("COMMIT") != 0) {
+        execute("ROLLBACK");
+        return false;
+    }
+    pin("catalog");
+    pin(sweetKey(id));
     return true;
 }
 
 bool Database::deleteSweet(int id) {
+    DB_TIMED("deleteSweet");
+    auto lock = lockConnection();
     if (!connect()) return false;
     std::ostringstream q;
     q << "DELETE FROM sweets WHERE id=" << id;
-    if (mysql_query(conn_, q.str().c_str()) != 0) return false;
+    if (execute(q.str().c_str()) != 0) return false;
+    markSplit(id, false);
+    pin("catalog");
+    pin(sweetKey(id));
     return true;
 }
 
-bool Database::purchaseSweet(int userId, int sweetId, int quantity, double& outTotal) {
-    outTotal = 0.0;
+namespace {
+
+// Rows per multi-row statement in upsertSweets; keeps each statement far
+// below max_allowed_packet
+const std::size_t kUpsertChunkRows = 1000;
+
+std::string field(const std::map<std::string, std::string>& row, const char* name) {
+    auto it = row.find(name);
+    return it == row.end() ? std::string() : it->second;
+}
+
+} // namespace
+
+bool Database::upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                            std::vector<int>* outIds,
+                            std::vector<bool>* outCreated) {
+    DB_TIMED("upsertSweets");
+    std::vector<int> ids(rows.size(), 0);
+    std::vector<bool> created(rows.size(), true);
+    auto lock = lockConnection();
     if (!connect()) return false;
-    // Start transaction
-    if (mysql_query(conn_, "START TRANSACTION") != 0) {
-        return false;
+
+    std::vector<std::size_t> keyed, fresh;
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        (field(rows[i], "id").empty() ? fresh : keyed).push_back(i);
     }
+    auto values = [&](std::ostringstream& q, const std::map<std::string, std::string>& row, int id) {
+        q << "(" << id << ",'" << escape(field(row, "name")) << "','" << escape(field(row, "description"))
+          << "','" << escape(field(row, "category")) << "',"
+          << rowformat::money(std::stod(field(row, "price")))
+          << "," << std::stoi(field(row, "quantity")) << ")";
+    };
 
-    // Lock and read current quantity and price
-    std::ostringstream q1;
-    q1 << "SELECT quantity, price FROM sweets WHERE id=" << sweetId << " FOR UPDATE";
-    if (mysql_query(conn_, q1.str().c_str()) != 0) {
-        mysql_query(conn_, "ROLLBACK");
+    // New rows get explicit ids: a multi-row INSERT is not promised
+    // consecutive AUTO_INCREMENT values once other inserts interleave
+    if (!fresh.empty()) {
+        long long first = reserveSweetIds(static_cast<int>(fresh.size()));
+        if (first < 0) return false;
+        for (std::size_t k = 0; k < fresh.size(); ++k) ids[fresh[k]] = static_cast<int>(first + k);
+    }
+
+    if (execute("START TRANSACTION") != 0) return false;
+    auto rollback = [&]() {
+        execute("ROLLBACK");
         return false;
+    };
+
+    for (std::size_t begin = 0; begin < keyed.size(); begin += kUpsertChunkRows) {
+        std::size_t end = std::min(keyed.size(), begin + kUpsertChunkRows);
+        std::ostringstream in;
+        for (std::size_t k = begin; k < end; ++k) {
+            ids[keyed[k]] = std::stoi(field(rows[keyed[k]], "id"));
+            in << (k == begin ? "" : ",") << ids[keyed[k]];
+        }
+        // Replaced sweets get their quantity as their whole stock; slots
+        // are locked before rows, as everywhere
+        std::ostringstream slots;
+        slots << "UPDATE sweet_stock_slots SET quantity=0 WHERE sweet_id IN (" << in.str() << ")";
+        if (execute(slots.str().c_str()) != 0) return rollback();
+        // Which of these ids exist already; also locks them until COMMIT
+        std::ostringstream existing;
+        existing << "SELECT id FROM sweets WHERE id IN (" << in.str() << ") FOR UPDATE";
+        if (execute(existing.str().c_str()) != 0) return rollback();
+        MYSQL_RES* res = storeResult();
+        if (!res) return rollback();
+        std::set<int> found;
+        while (MYSQL_ROW row = mysql_fetch_row(res)) {
+            if (row[0]) found.insert(std::atoi(row[0]));
+        }
+        mysql_free_result(res);
+        for (std::size_t k = begin; k < end; ++k) created[keyed[k]] = !found.count(ids[keyed[k]]);
+
+        std::ostringstream q;
+        q << "INSERT INTO sweets (id, name, description, category, price, quantity) VALUES ";
+        for (std::size_t k = begin; k < end; ++k) {
+            if (k != begin) q << ",";
+            values(q, rows[keyed[k]], ids[keyed[k]]);
+        }
+        q << " ON DUPLICATE KEY UPDATE name=VALUES(name), description=VALUES(description),"
+          << " category=VALUES(category), price=VALUES(price), quantity=VALUES(quantity)";
+        if (execute(q.str().c_str()) != 0) return rollback();
     }
-    MYSQL_RES* res = mysql_store_result(conn_);
-    if (!res) { mysql_query(conn_, "ROLLBACK"); return false; }
-    MYSQL_ROW row = mysql_fetch_row(res);
-    if (!row) { mysql_free_result(res); mysql_query(conn_, "ROLLBACK"); return false; }
-    int curQty = row[0] ? std::stoi(row[0]) : 0;
-    double price = row[1] ? std::stod(row[1]) : 0.0;
-    mysql_free_result(res);
 
-    if (curQty < quantity) {
-        mysql_query(conn_, "ROLLBACK");
+    for (std::size_t begin = 0; begin < fresh.size(); begin += kUpsertChunkRows) {
+        std::size_t end = std::min(fresh.size(), begin + kUpsertChunkRows);
+        std::ostringstream q;
+        q << "INSERT INTO sweets (id, name, description, category, price, quantity) VALUES ";
+        for (std::size_t k = begin; k < end; ++k) {
+            if (k != begin) q << ",";
+            values(q, rows[fresh[k]], ids[fresh[k]]);
+        }
+        if (execute(q.str().c_str()) != 0) return rollback();
+    }
+
+    if (execute("COMMIT") != 0) return rollback();
+    pin("catalog");
+    for (int id : ids) pin(sweetKey(id));
+    if (outIds) *outIds = std::move(ids);
+    if (outCreated) *outCreated = std::move(created);
+    return true;
+}
+
+bool Database::patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                           std::vector<std::map<std::string, std::string>>* outRows) {
+    DB_TIMED("patchSweets");
+    static const char* const columns[] = {"name", "description", "category", "price", "quantity"};
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    std::vector<int> ids;
+    ids.reserve(changes.size());
+    for (const auto& change : changes) ids.push_back(std::stoi(field(change, "id")));
+    // Column value as SQL; numbers are reformatted so nothing else gets in
+    auto literal = [&](const std::string& column, const std::string& value) {
+        if (column == "price") return rowformat::money(std::stod(value));
+        if (column == "quantity") return std::to_string(std::stoi(value));
+        return "'" + escape(value) + "'";
+    };
+
+    if (execute("START TRANSACTION") != 0) return false;
+    auto rollback = [&]() {
+        execute("ROLLBACK");
         return false;
+    };
+
+    std::map<int, std::map<std::string, std::string>> updated;
+    for (std::size_t begin = 0; begin < changes.size(); begin += kUpsertChunkRows) {
+        std::size_t end = std::min(changes.size(), begin + kUpsertChunkRows);
+        std::ostringstream in, newStock;
+        for (std::size_t k = begin; k < end; ++k) {
+            in << (k == begin ? "" : ",") << ids[k];
+            if (changes[k].count("quantity")) newStock << (newStock.tellp() == 0 ? "" : ",") << ids[k];
+        }
+
+        // A new quantity is the sweet's whole stock, so its slots, if
+        // split, are emptied; before the rows are locked, as everywhere
+        if (newStock.tellp() != 0) {
+            std::ostringstream slots;
+            slots << "UPDATE sweet_stock_slots SET quantity=0 WHERE sweet_id IN (" << newStock.str() << ")";
+            if (execute(slots.str().c_str()) != 0) return rollback();
+        }
+
+        // Locks the rows, and proves they all exist before anything is written
+        std::ostringstream existing;
+        existing << "SELECT id FROM sweets WHERE id IN (" << in.str() << ") FOR UPDATE";
+        if (execute(existing.str().c_str()) != 0) return rollback();
+        MYSQL_RES* res = storeResult();
+        if (!res) return rollback();
+        my_ulonglong found = mysql_num_rows(res);
+        mysql_free_result(res);
+        if (found != end - begin) return rollback();
+
+        // All of the chunk's changes in one statement: each column that
+        // any change sets becomes a CASE over the ids that set it
+        std::ostringstream q;
+        q << "UPDATE sweets SET ";
+        bool first = true;
+        for (const char* column : columns) {
+            std::ostringstream cases;
+            for (std::size_t k = begin; k < end; ++k) {
+                auto it = changes[k].find(column);
+                if (it == changes[k].end()) continue;
+                cases << " WHEN " << ids[k] << " THEN " << literal(column, it->second);
+            }
+            if (cases.tellp() == 0) continue;
+            q << (first ? "" : ", ") << column << "=CASE id" << cases.str() << " ELSE " << column << " END";
+            first = false;
+        }
+        q << " WHERE id IN (" << in.str() << ")";
+        if (!first && execute(q.str().c_str()) != 0) return rollback();
+
+        if (outRows) {
+            std::ostringstream read;
+            read << kSweetSelect << " WHERE id IN (" << in.str() << ")";
+            auto rows = queryRows(read.str());
+            if (rows.size() != end - begin) return rollback();
+            for (auto& row : rows) {
+                int id = std::atoi(row["id"].c_str());
+                updated[id] = std::move(row);
+            }
+        }
+    }
+
+    if (execute("COMMIT") != 0) return rollback();
+    pin("catalog");
+    for (int id : ids) pin(sweetKey(id));
+    if (outRows) {
+        outRows->clear();
+        for (int id : ids) outRows->push_back(updated[id]);
+    }
+    return true;
+}
+
+namespace {
+
+// Split stock. Everything that writes a split sweet's stock locks its
+// slots before its row, and a purchase from one slot only takes a shared
+// lock on the row (when its purchase row is inserted), so none of them
+// can deadlock one another.
+
+// stock shared by count slots, the remainder going to the first ones
+std::vector<long long> spreadStock(long long stock, std::size_t count) {
+    std::vector<long long> shares(count, stock / static_cast<long long>(count));
+    for (long long i = 0; i < stock % static_cast<long long>(count); ++i) ++shares[i];
+    return shares;
+}
+
+// First read of a split purchase: price, name and each slot's stock,
+// without locks. A sweet without slots gives one row with an empty slot.
+std::string slotSnapshotQuery(int sweetId) {
+    return "SELECT s.price,s.name,k.slot,k.quantity AS stock FROM sweets s"
+           " LEFT JOIN sweet_stock_slots k ON k.sweet_id=s.id WHERE s.id=" + std::to_string(sweetId);
+}
+
+// Slots that held at least quantity in the snapshot, in the order to try
+// them: from a random one on, so concurrent buyers start on different rows
+std::vector<int> slotCandidates(const std::vector<std::map<std::string, std::string>>& snapshot,
+                                int quantity) {
+    std::vector<int> slots;
+    for (const auto& row : snapshot) {
+        if (std::stoll(field(row, "stock")) >= quantity) slots.push_back(std::stoi(field(row, "slot")));
+    }
+    thread_local std::minstd_rand rng(std::random_device{}());
+    if (!slots.empty()) std::rotate(slots.begin(), slots.begin() + rng() % slots.size(), slots.end());
+    return slots;
+}
+
+// Takes quantity from one slot if it still holds that much
+std::string takeFromSlotQuery(int sweetId, int slot, int quantity) {
+    std::ostringstream q;
+    q << "UPDATE sweet_stock_slots SET quantity=quantity-" << quantity << " WHERE sweet_id=" << sweetId
+      << " AND slot=" << slot << " AND quantity>=" << quantity;
+    return q.str();
+}
+
+std::string lockSlotsQuery(int sweetId) {
+    return "SELECT slot,quantity FROM sweet_stock_slots WHERE sweet_id=" + std::to_string(sweetId) +
+           " ORDER BY slot FOR UPDATE";
+}
+
+// Also counts the sweet's slots, unlocked, so a purchase that expected
+// an unsplit sweet finds out
+std::string lockRowQuery(int sweetId) {
+    std::string id = std::to_string(sweetId);
+    return "SELECT quantity,price,name,(SELECT COUNT(*) FROM sweet_stock_slots WHERE sweet_id=" + id +
+           ") AS slots FROM sweets WHERE id=" + id + " FOR UPDATE";
+}
+
+// A split sweet's whole stock from its locked row and slots; ids receives
+// the slot numbers
+long long lockedStock(const std::map<std::string, std::string>& row,
+                      const std::vector<std::map<std::string, std::string>>& slots,
+                      std::vector<int>& ids) {
+    long long stock = std::stoll(field(row, "quantity"));
+    ids.clear();
+    for (const auto& slot : slots) {
+        ids.push_back(std::stoi(field(slot, "slot")));
+        stock += std::stoll(field(slot, "quantity"));
+    }
+    return stock;
+}
+
+// Shares stock out over the existing, locked slots
+std::string respreadQuery(int sweetId, const std::vector<int>& slots, long long stock) {
+    auto shares = spreadStock(stock, slots.size());
+    std::ostringstream q;
+    q << "UPDATE sweet_stock_slots SET quantity=CASE slot";
+    for (std::size_t i = 0; i < slots.size(); ++i) q << " WHEN " << slots[i] << " THEN " << shares[i];
+    q << " END WHERE sweet_id=" << sweetId;
+    return q.str();
+}
+
+std::string rowStockQuery(int sweetId, long long quantity) {
+    return "UPDATE sweets SET quantity=" + std::to_string(quantity) + " WHERE id=" + std::to_string(sweetId);
+}
+
+metrics::Counter& respreads() {
+    static metrics::Counter& counter = metrics::counter(
+        "sweet_shop_db_stock_respreads_total", "",
+        "Purchases of split sweets that no single slot could cover");
+    return counter;
+}
+
+} // namespace
+
+bool Database::isSplit(int sweetId) {
+    std::lock_guard<std::mutex> lock(splitMutex_);
+    return split_.count(sweetId) != 0;
+}
+
+void Database::markSplit(int sweetId, bool split) {
+    std::lock_guard<std::mutex> lock(splitMutex_);
+    if (split) {
+        split_.insert(sweetId);
+    } else {
+        split_.erase(sweetId);
+    }
+}
+
+Database::Take Database::takeFromRow(int sweetId, int quantity, double& price, std::string& name) {
+    bool ok = false;
+    auto rows = queryRows(lockRowQuery(sweetId), &ok);
+    if (!ok || rows.empty()) return Take::Failed;
+    auto& row = rows.front();
+    if (row["slots"] != "0") return Take::Split;
+    int curQty = row["quantity"].empty() ? 0 : std::stoi(row["quantity"]);
+    if (curQty < quantity) return Take::Failed;
+    price = row["price"].empty() ? 0.0 : std::stod(row["price"]);
+    name = row["name"];
+    if (execute(rowStockQuery(sweetId, curQty - quantity).c_str()) != 0) return Take::Failed;
+    return Take::Taken;
+}
+
+Database::Take Database::takeFromSlots(int sweetId, int quantity, double& price, std::string& name) {
+    bool ok = false;
+    auto snapshot = queryRows(slotSnapshotQuery(sweetId), &ok);
+    if (!ok || snapshot.empty()) return Take::Failed;
+    if (snapshot.front()["slot"].empty()) {
+        // Folded back since, possibly by another process
+        markSplit(sweetId, false);
+        return takeFromRow(sweetId, quantity, price, name);
+    }
+    price = std::stod(snapshot.front()["price"]);
+    name = snapshot.front()["name"];
+    for (int slot : slotCandidates(snapshot, quantity)) {
+        if (execute(takeFromSlotQuery(sweetId, slot, quantity).c_str()) != 0) return Take::Failed;
+        if (mysql_affected_rows(conn_) == 1) return Take::Taken;
+    }
+
+    // No slot covers it alone: lock them all and the row, take quantity
+    // from the whole stock and share the rest out again
+    auto slots = queryRows(lockSlotsQuery(sweetId), &ok);
+    if (!ok) return Take::Failed;
+    auto rows = queryRows(lockRowQuery(sweetId), &ok);
+    if (!ok || rows.empty()) return Take::Failed;
+    std::vector<int> ids;
+    long long stock = lockedStock(rows.front(), slots, ids);
+    if (stock < quantity) return Take::Failed;
+    price = std::stod(rows.front()["price"]);
+    name = rows.front()["name"];
+    if (!ids.empty() && execute(respreadQuery(sweetId, ids, stock - quantity).c_str()) != 0) {
+        return Take::Failed;
     }
+    if (execute(rowStockQuery(sweetId, ids.empty() ? stock - quantity : 0).c_str()) != 0) {
+        return Take::Failed;
+    }
+    respreads().inc();
+    return Take::Taken;
+}
+
+bool Database::purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                             std::map<std::string, std::string>* outPurchase,
+                             const std::string& idempotencyKey) {
+    DB_TIMED("purchaseSweet");
+    outTotal = 0.0;
+    auto lock = lockConnection();
+    if (!connect()) return false;
 
-    int newQty = curQty - quantity;
-    std::ostringstream q2;
-    q2 << "UPDATE sweets SET quantity=" << newQty << " WHERE id=" << sweetId;
-    if (mysql_query(conn_, q2.str().c_str()) != 0) {
-        mysql_query(conn_, "ROLLBACK");
+    // Decrement the stock, from the row or a slot. A sweet another process
+    // split since this one last bought it is retried once from the slots.
+    double price = 0.0;
+    std::string sweetName;
+    bool split = isSplit(sweetId);
+    Take taken = Take::Failed;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (execute("START TRANSACTION") != 0) return false;
+        taken = split ? takeFromSlots(sweetId, quantity, price, sweetName)
+                      : takeFromRow(sweetId, quantity, price, sweetName);
+        if (taken != Take::Split) break;
+        execute("ROLLBACK");
+        split = true;
+        markSplit(sweetId, true);
+    }
+    if (taken != Take::Taken) {
+        execute("ROLLBACK");
         return false;
     }
 
@@ -232,24 +716,774 @@ bool Database::purchaseSweet(int userId, int sweetId, int quantity, double& outT
     std::ostringstream q3;
     q3 << "INSERT INTO purchases (user_id, sweet_id, quantity, total_price) VALUES ("
        << userId << "," << sweetId << "," << quantity << "," << total << ")";
-    if (mysql_query(conn_, q3.str().c_str()) != 0) {
-        mysql_query(conn_, "ROLLBACK");
+    if (execute(q3.str().c_str()) != 0) {
+        execute("ROLLBACK");
         return false;
     }
+    unsigned long long purchaseId = mysql_insert_id(conn_);
+
+    // Read back the server-assigned timestamp so callers can cache the row
+    std::string purchaseDate;
+    if (outPurchase) {
+        std::ostringstream q4;
+        q4 << "SELECT purchase_date FROM purchases WHERE id=" << purchaseId;
+        if (execute(q4.str().c_str()) == 0) {
+            MYSQL_RES* dateRes = storeResult();
+            if (dateRes) {
+                MYSQL_ROW dateRow = mysql_fetch_row(dateRes);
+                if (dateRow && dateRow[0]) purchaseDate = dateRow[0];
+                mysql_free_result(dateRes);
+            }
+        }
+    }
+
+    // Recorded in the same transaction, so the key exists exactly when the
+    // purchase does; a key seen before fails here and rolls it all back
+    if (!idempotencyKey.empty()) {
+        std::ostringstream q5;
+        q5 << "INSERT INTO idempotency_keys (idem_key, operation, sweet_id, quantity, purchase_id)"
+           << " VALUES ('" << escape(idempotencyKey) << "','purchase'," << sweetId << ","
+           << quantity << "," << purchaseId << ")";
+        if (execute(q5.str().c_str()) != 0) {
+            execute("ROLLBACK");
+            return false;
+        }
+    }
 
-    if (mysql_query(conn_, "COMMIT") != 0) {
-        mysql_query(conn_, "ROLLBACK");
+    if (execute("COMMIT") != 0) {
+        execute("ROLLBACK");
         return false;
     }
 
     outTotal = total;
+    if (outPurchase) {
+        std::ostringstream totalStr;
+        totalStr << total;
+        auto& p = *outPurchase;
+        p["id"] = std::to_string(purchaseId);
+        p["user_id"] = std::to_string(userId);
+        p["sweet_id"] = std::to_string(sweetId);
+        p["sweet_name"] = sweetName;
+        p["quantity"] = std::to_string(quantity);
+        p["total_price"] = totalStr.str();
+        p["purchase_date"] = purchaseDate;
+    }
+    // The catalog lists stock too, so it is pinned like the sweet
+    pin("catalog");
+    pin(sweetKey(sweetId));
     return true;
 }
 
-bool Database::restockSweet(int sweetId, int quantity) {
+bool Database::restockSweet(int sweetId, int quantity, const std::string& idempotencyKey) {
+    DB_TIMED("restockSweet");
+    auto lock = lockConnection();
     if (!connect()) return false;
     std::ostringstream q;
     q << "UPDATE sweets SET quantity = quantity + " << quantity << " WHERE id=" << sweetId;
-    if (mysql_query(conn_, q.str().c_str()) != 0) return false;
+    if (idempotencyKey.empty()) {
+        if (execute(q.str().c_str()) != 0) return false;
+        pin("catalog");
+        pin(sweetKey(sweetId));
+        return true;
+    }
+
+    // The increment is blind, so a keyed restock commits together with its key
+    if (execute("START TRANSACTION") != 0) return false;
+    std::ostringstream k;
+    k << "INSERT INTO idempotency_keys (idem_key, operation, sweet_id, quantity) VALUES ('"
+      << escape(idempotencyKey) << "','restock'," << sweetId << "," << quantity << ")";
+    if (execute(q.str().c_str()) != 0 || execute(k.str().c_str()) != 0 || execute("COMMIT") != 0) {
+        execute("ROLLBACK");
+        return false;
+    }
+    pin("catalog");
+    pin(sweetKey(sweetId));
+    return true;
+}
+
+bool Database::setStockSlots(int sweetId, int slots) {
+    DB_TIMED("setStockSlots");
+    if (slots < 1 || slots > kMaxStockSlots) return false;
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    if (execute("START TRANSACTION") != 0) return false;
+    auto rollback = [&]() {
+        execute("ROLLBACK");
+        return false;
+    };
+    bool ok = false;
+    auto locked = queryRows(lockSlotsQuery(sweetId), &ok);
+    if (!ok) return rollback();
+    auto rows = queryRows(lockRowQuery(sweetId), &ok);
+    if (!ok || rows.empty()) return rollback();
+    std::vector<int> ids;
+    long long stock = lockedStock(rows.front(), locked, ids);
+    if (!writeSlots(sweetId, slots, stock) || execute("COMMIT") != 0) return rollback();
+    markSplit(sweetId, slots > 1);
     return true;
+}
+
+std::vector<std::map<std::string, std::string>> Database::getStockSlots(int sweetId) {
+    DB_TIMED("getStockSlots");
+    return queryRows("SELECT slot,quantity FROM sweet_stock_slots WHERE sweet_id=" +
+                     std::to_string(sweetId) + " ORDER BY slot");
+}
+
+bool Database::writeSlots(int sweetId, int count, long long stock) {
+    std::string clear = "DELETE FROM sweet_stock_slots WHERE sweet_id=" + std::to_string(sweetId);
+    if (execute(clear.c_str()) != 0) return false;
+    if (count > 1) {
+        auto shares = spreadStock(stock, static_cast<std::size_t>(count));
+        std::ostringstream q;
+        q << "INSERT INTO sweet_stock_slots (sweet_id, slot, quantity) VALUES ";
+        for (int slot = 0; slot < count; ++slot) {
+            q << (slot == 0 ? "" : ",") << "(" << sweetId << "," << slot << "," << shares[slot] << ")";
+        }
+        if (execute(q.str().c_str()) != 0) return false;
+    }
+    return execute(rowStockQuery(sweetId, count > 1 ? 0 : stock).c_str()) == 0;
+}
+
+std::vector<std::map<std::string, std::string>>
+Database::getPurchasesByUser(int userId,
+                             const std::string& beforeDate,
+                             int beforeId,
+                             int limit,
+                             bool* ok) {
+    DB_TIMED("getPurchasesByUser");
+    std::vector<std::map<std::string, std::string>> out;
+    if (ok) *ok = false;
+    auto lock = lockConnection();
+    if (!connect()) return out;
+    // Seeks on idx_user_history (user_id, purchase_date, id, ...), so a page
+    // costs the same no matter how deep into the history it is.
+    std::ostringstream q;
+    q << "SELECT p.id,p.user_id,p.sweet_id,s.name AS sweet_name,p.quantity,p.total_price,p.purchase_date"
+      << " FROM purchases p JOIN sweets s ON s.id=p.sweet_id"
+      << " WHERE p.user_id=" << userId;
+    if (!beforeDate.empty()) {
+        std::string d = escape(beforeDate);
+        q << " AND (p.purchase_date<'" << d << "' OR (p.purchase_date='" << d
+          << "' AND p.id<" << beforeId << "))";
+    }
+    q << " ORDER BY p.purchase_date DESC, p.id DESC LIMIT " << limit;
+    if (execute(q.str().c_str()) != 0) return out;
+    MYSQL_RES* res = storeResult();
+    if (!res) return out;
+    MYSQL_FIELD* fields = mysql_fetch_fields(res);
+    unsigned int num_fields = mysql_num_fields(res);
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(res))) {
+        std::map<std::string, std::string> rowmap;
+        for (unsigned int i = 0; i < num_fields; ++i) {
+            rowmap[fields[i].name] = row[i] ? row[i] : "";
+        }
+        out.push_back(std::move(rowmap));
+    }
+    mysql_free_result(res);
+    if (ok) *ok = true;
+    return out;
+}
+
+std::map<std::string, std::string> Database::getPurchaseById(int id) {
+    DB_TIMED("getPurchaseById");
+    std::map<std::string, std::string> result;
+    auto lock = lockConnection();
+    if (!connect()) return result;
+    std::ostringstream q;
+    q << "SELECT p.id,p.user_id,p.sweet_id,s.name AS sweet_name,p.quantity,p.total_price,p.purchase_date"
+      << " FROM purchases p JOIN sweets s ON s.id=p.sweet_id WHERE p.id=" << id << " LIMIT 1";
+    if (execute(q.str().c_str()) != 0) return result;
+    MYSQL_RES* res = storeResult();
+    if (!res) return result;
+    MYSQL_ROW row = mysql_fetch_row(res);
+    if (!row) {
+        mysql_free_result(res);
+        return result;
+    }
+    MYSQL_FIELD* fields = mysql_fetch_fields(res);
+    unsigned int num_fields = mysql_num_fields(res);
+    for (unsigned int i = 0; i < num_fields; ++i) {
+        result[fields[i].name] = row[i] ? row[i] : "";
+    }
+    mysql_free_result(res);
+    return result;
+}
+
+namespace {
+
+// Idempotency record joined with the purchase it produced, if any
+std::string idempotencyKeyQuery(const std::string& escapedKey) {
+    return "SELECT k.idem_key,k.operation,k.sweet_id,k.quantity,k.created_at,"
+           "p.id,p.user_id,s.name AS sweet_name,p.total_price,p.purchase_date"
+           " FROM idempotency_keys k LEFT JOIN purchases p ON p.id=k.purchase_id"
+           " LEFT JOIN sweets s ON s.id=p.sweet_id"
+           " WHERE k.idem_key='" + escapedKey + "' LIMIT 1";
+}
+
+// Escaping without a connection, for statements built off the blocking
+// connection's lock. Keys are ASCII, so the connection charset is moot.
+std::string escapeAscii(const std::string& input) {
+    std::string out;
+    out.resize(input.size() * 2 + 1);
+    unsigned long len = mysql_escape_string(&out[0], input.c_str(),
+                                            static_cast<unsigned long>(input.size()));
+    out.resize(len);
+    return out;
+}
+
+} // namespace
+
+std::map<std::string, std::string> Database::getIdempotencyKey(const std::string& key) {
+    DB_TIMED("getIdempotencyKey");
+    auto rows = queryRows(idempotencyKeyQuery(escape(key)));
+    if (rows.empty()) return {};
+    return std::move(rows.front());
+}
+
+std::vector<std::map<std::string, std::string>> Database::queryRows(const std::string& query, bool* ok) {
+    std::vector<std::map<std::string, std::string>> out;
+    if (ok) *ok = false;
+    auto lock = lockConnection();
+    if (!connect()) return out;
+    if (execute(query.c_str()) != 0) return out;
+    MYSQL_RES* res = storeResult();
+    if (!res) return out;
+    if (ok) *ok = true;
+    MYSQL_FIELD* fields = mysql_fetch_fields(res);
+    unsigned int num_fields = mysql_num_fields(res);
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(res))) {
+        std::map<std::string, std::string> rowmap;
+        for (unsigned int i = 0; i < num_fields; ++i) {
+            rowmap[fields[i].name] = row[i] ? row[i] : "";
+        }
+        out.push_back(std::move(rowmap));
+    }
+    mysql_free_result(res);
+    return out;
+}
+
+std::map<std::string, std::string> Database::getSalesTotals() {
+    DB_TIMED("getSalesTotals");
+    auto rows = queryRows(
+        "SELECT (SELECT COUNT(*) FROM users) AS user_count,"
+        " COUNT(*) AS order_count,"
+        " COALESCE(SUM(quantity),0) AS units_sold,"
+        " COALESCE(SUM(total_price),0) AS revenue"
+        " FROM purchases");
+    if (rows.empty()) return {};
+    return rows.front();
+}
+
+std::vector<std::map<std::string, std::string>> Database::getRevenueByCategory(bool* ok) {
+    DB_TIMED("getRevenueByCategory");
+    return queryRows(
+        "SELECT s.category, SUM(p.total_price) AS revenue, SUM(p.quantity) AS units_sold"
+        " FROM purchases p JOIN sweets s ON s.id=p.sweet_id"
+        " GROUP BY s.category",
+        ok);
+}
+
+long long Database::getMaxPurchaseId() {
+    DB_TIMED("getMaxPurchaseId");
+    auto rows = queryRows("SELECT COALESCE(MAX(id),0) AS max_id FROM purchases");
+    if (rows.empty()) return -1;
+    return std::stoll(rows.front()["max_id"]);
+}
+
+std::vector<std::map<std::string, std::string>> Database::getHourlySales(long long maxPurchaseId) {
+    DB_TIMED("getHourlySales");
+    std::ostringstream q;
+    q << "SELECT DATE_FORMAT(p.purchase_date,'%Y-%m-%d %H:00:00') AS hour,"
+      << " p.sweet_id, s.category, COUNT(*) AS orders,"
+      << " SUM(p.quantity) AS units, SUM(p.total_price) AS revenue"
+      << " FROM purchases p JOIN sweets s ON s.id=p.sweet_id"
+      << " WHERE p.id<=" << maxPurchaseId
+      << " GROUP BY hour, p.sweet_id, s.category";
+    return queryRows(q.str());
+}
+
+bool Database::logAudit(int userId,
+                        const std::string& action,
+                        const std::string& targetType,
+                        int targetId,
+                        const std::string& details) {
+    DB_TIMED("logAudit");
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    std::string a = escape(action);
+    std::string t = escape(targetType);
+    std::string d = escape(details);
+    std::ostringstream q;
+    q << "INSERT INTO audit_log (user_id, action, target_type, target_id, details) VALUES (";
+    if (userId > 0) q << userId; else q << "NULL";
+    q << ",'" << a << "','" << t << "'," << targetId << ",'" << d << "')";
+    if (execute(q.str().c_str()) != 0) return false;
+    return true;
+}
+
+bool Database::listSweetIds(std::vector<int>& ids) {
+    DB_TIMED("listSweetIds");
+    bool ok = false;
+    auto rows = queryRows("SELECT id FROM sweets", &ok);
+    ids.clear();
+    for (const auto& row : rows) ids.push_back(std::stoi(row.at("id")));
+    return ok;
+}
+
+bool Database::exportSweet(int id, SweetRows& out) {
+    DB_TIMED("exportSweet");
+    out = SweetRows();
+    std::string where = std::to_string(id);
+    bool ok = false;
+    auto sweet = queryRows(kSweetSelect + " WHERE id=" + where, &ok);
+    if (!ok) return false;
+    if (sweet.empty()) return true;
+    out.sweet = std::move(sweet.front());
+    out.purchases = queryRows("SELECT id,user_id,sweet_id,quantity,total_price,purchase_date"
+                              " FROM purchases WHERE sweet_id=" + where, &ok);
+    if (!ok) return false;
+    out.idempotencyKeys = queryRows("SELECT idem_key,operation,sweet_id,quantity,purchase_id,created_at"
+                                    " FROM idempotency_keys WHERE sweet_id=" + where, &ok);
+    if (!ok) return false;
+    auto slots = queryRows("SELECT COUNT(*) AS slots FROM sweet_stock_slots WHERE sweet_id=" + where, &ok);
+    if (!ok || slots.empty()) return false;
+    out.stockSlots = std::stoi(slots.front()["slots"]);
+    return true;
+}
+
+bool Database::importSweet(const SweetRows& rows) {
+    DB_TIMED("importSweet");
+    if (rows.sweet.empty()) return false;
+    int id = std::stoi(field(rows.sweet, "id"));
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    // Every value goes in quoted, as read; an empty purchase_id was NULL
+    auto tuple = [&](std::ostringstream& q, const std::map<std::string, std::string>& row,
+                     std::initializer_list<const char*> columns) {
+        q << "(";
+        bool first = true;
+        for (const char* column : columns) {
+            std::string value = field(row, column);
+            q << (first ? "" : ",");
+            if (value.empty() && std::strcmp(column, "purchase_id") == 0) {
+                q << "NULL";
+            } else {
+                q << "'" << escape(value) << "'";
+            }
+            first = false;
+        }
+        q << ")";
+    };
+
+    if (execute("START TRANSACTION") != 0) return false;
+    auto rollback = [&]() {
+        execute("ROLLBACK");
+        return false;
+    };
+
+    std::ostringstream sweet;
+    sweet << "INSERT INTO sweets (id,name,description,category,price,quantity,created_at,updated_at) VALUES ";
+    tuple(sweet, rows.sweet, {"id", "name", "description", "category", "price", "quantity", "created_at", "updated_at"});
+    sweet << " ON DUPLICATE KEY UPDATE name=VALUES(name), description=VALUES(description),"
+          << " category=VALUES(category), price=VALUES(price), quantity=VALUES(quantity),"
+          << " updated_at=VALUES(updated_at)";
+    if (execute(sweet.str().c_str()) != 0) return rollback();
+    // Replaces any slots of an earlier copy; the row holds the whole stock
+    int slots = std::max(rows.stockSlots, 1);
+    if (!writeSlots(id, slots, std::stoll(field(rows.sweet, "quantity")))) return rollback();
+
+    for (std::size_t begin = 0; begin < rows.purchases.size(); begin += kUpsertChunkRows) {
+        std::size_t end = std::min(rows.purchases.size(), begin + kUpsertChunkRows);
+        std::ostringstream q;
+        q << "INSERT IGNORE INTO purchases (id,user_id,sweet_id,quantity,total_price,purchase_date) VALUES ";
+        for (std::size_t k = begin; k < end; ++k) {
+            if (k != begin) q << ",";
+            tuple(q, rows.purchases[k], {"id", "user_id", "sweet_id", "quantity", "total_price", "purchase_date"});
+        }
+        if (execute(q.str().c_str()) != 0) return rollback();
+    }
+    for (const auto& key : rows.idempotencyKeys) {
+        std::ostringstream q;
+        q << "INSERT IGNORE INTO idempotency_keys (idem_key,operation,sweet_id,quantity,purchase_id,created_at) VALUES ";
+        tuple(q, key, {"idem_key", "operation", "sweet_id", "quantity", "purchase_id", "created_at"});
+        if (execute(q.str().c_str()) != 0) return rollback();
+    }
+
+    if (execute("COMMIT") != 0) return rollback();
+    markSplit(id, slots > 1);
+    pin("catalog");
+    pin(sweetKey(id));
+    return true;
+}
+
+bool Database::dropSweet(int id) {
+    DB_TIMED("dropSweet");
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    std::string where = std::to_string(id);
+    if (execute("START TRANSACTION") != 0) return false;
+    // Children first: purchases reference the sweet ON DELETE RESTRICT
+    std::string keys = "DELETE FROM idempotency_keys WHERE sweet_id=" + where;
+    std::string purchases = "DELETE FROM purchases WHERE sweet_id=" + where;
+    std::string slots = "DELETE FROM sweet_stock_slots WHERE sweet_id=" + where;
+    std::string sweet = "DELETE FROM sweets WHERE id=" + where;
+    if (execute(keys.c_str()) != 0 || execute(purchases.c_str()) != 0 || execute(slots.c_str()) != 0 ||
+        execute(sweet.c_str()) != 0 || execute("COMMIT") != 0) {
+        execute("ROLLBACK");
+        return false;
+    }
+    markSplit(id, false);
+    pin("catalog");
+    pin(sweetKey(id));
+    return true;
+}
+
+long long Database::reserveSweetIds(int count) {
+    DB_TIMED("reserveSweetIds");
+    if (count < 1) return -1;
+    auto lock = lockConnection();
+    if (!connect()) return -1;
+    // LAST_INSERT_ID(expr) hands the new value back through
+    // mysql_insert_id, race-free without a transaction. Starting above
+    // the largest id present covers sweets created before the counter
+    // was used.
+    std::string q = "UPDATE sweet_id_seq SET id=LAST_INSERT_ID("
+                    "GREATEST(id,(SELECT COALESCE(MAX(id),0) FROM sweets))+" + std::to_string(count) + ")";
+    if (execute(q.c_str()) != 0 || mysql_affected_rows(conn_) != 1) return -1;
+    return static_cast<long long>(mysql_insert_id(conn_)) - count + 1;
+}
+
+bool Database::raiseSweetIdFloor(long long floor) {
+    DB_TIMED("raiseSweetIdFloor");
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    std::string q = "UPDATE sweet_id_seq SET id=GREATEST(id," + std::to_string(floor) + ")";
+    return execute(q.c_str()) == 0;
+}
+
+bool Database::raisePurchaseIdFloor(long long floor) {
+    DB_TIMED("raisePurchaseIdFloor");
+    auto lock = lockConnection();
+    if (!connect()) return false;
+    // InnoDB never sets the counter below MAX(id)+1, so this only raises it
+    std::string q = "ALTER TABLE purchases AUTO_INCREMENT=" + std::to_string(floor + 1);
+    return execute(q.c_str()) == 0;
+}
+
+bool Database::idSpacing(long long& increment, long long& offset) {
+    bool ok = false;
+    auto rows = queryRows("SELECT @@auto_increment_increment AS inc, @@auto_increment_offset AS off", &ok);
+    if (!ok || rows.empty()) return false;
+    increment = std::stoll(rows.front()["inc"]);
+    offset = std::stoll(rows.front()["off"]);
+    return true;
+}
+
+bool Database::startAsync(std::size_t connections) {
+    if (async_) return true;
+    async_.reset(new AsyncMySQL(host_, user_, password_, database_, port_, connections));
+    if (!async_->start()) {
+        async_.reset();
+        return false;
+    }
+    return true;
+}
+
+void Database::useReplicas(std::unique_ptr<ReplicaSet> replicas) {
+    replicas_ = std::move(replicas);
+}
+
+void Database::pin(const std::string& key) {
+    if (!replicas_) return;
+    auto now = std::chrono::steady_clock::now();
+    // A replica in rotation is at most maxLag behind; Seconds_Behind_Source
+    // rounds down, hence the extra second
+    auto until = now + replicas_->maxLag() + std::chrono::seconds(1);
+    std::lock_guard<std::mutex> lock(pinsMutex_);
+    if (pins_.size() >= 4096) {
+        for (auto it = pins_.begin(); it != pins_.end();) {
+            it = it->second <= now ? pins_.erase(it) : std::next(it);
+        }
+    }
+    pins_[key] = until;
+}
+
+bool Database::pinned(const std::string& key) {
+    std::lock_guard<std::mutex> lock(pinsMutex_);
+    auto it = pins_.find(key);
+    if (it == pins_.end()) return false;
+    if (it->second > std::chrono::steady_clock::now()) return true;
+    pins_.erase(it);
+    return false;
+}
+
+namespace {
+
+metrics::Counter& routedReads(bool replica) {
+    static metrics::Counter& toReplica = metrics::counter(
+        "sweet_shop_db_reads_total", "target=\"replica\"",
+        "Replica-eligible reads, by the server that answered");
+    static metrics::Counter& toPrimary = metrics::counter("sweet_shop_db_reads_total", "target=\"primary\"");
+    return replica ? toReplica : toPrimary;
+}
+
+} // namespace
+
+bool Database::replicaRead(const std::string& query, const std::string& pinKey,
+                           std::vector<std::map<std::string, std::string>>& rows) {
+    if (!replicas_) return false;
+    bool ok = !pinned(pinKey) && replicas_->query(query, rows);
+    routedReads(ok).inc();
+    return ok;
+}
+
+void Database::readAsync(std::string query, const std::string& pinKey, AsyncMySQL::Callback done) {
+    AsyncMySQL* replica = replicas_ && !pinned(pinKey) ? replicas_->asyncPool() : nullptr;
+    if (!replica) {
+        if (replicas_) routedReads(false).inc();
+        return async_->query(std::move(query), std::move(done));
+    }
+    AsyncMySQL* primary = async_.get();
+    replica->query(query, [primary, query, done](AsyncMySQL::Result r) {
+        routedReads(r.ok).inc();
+        if (r.ok) return done(std::move(r));
+        primary->query(query, done);
+    });
+}
+
+void Database::getAllSweetsAsync(RowsCallback done) {
+    if (!async_) return Storage::getAllSweetsAsync(std::move(done));
+    DB_TIMED_ASYNC("getAllSweetsAsync");
+    readAsync(kSweetSelect, "catalog",
+              [done, dbCallTimer_](AsyncMySQL::Result r) { done(r.ok, std::move(r.rows)); });
+}
+
+void Database::getSweetByIdAsync(int id, RowCallback done) {
+    if (!async_) return Storage::getSweetByIdAsync(id, std::move(done));
+    DB_TIMED_ASYNC("getSweetByIdAsync");
+    std::ostringstream q;
+    q << kSweetSelect << " WHERE id=" << id << " LIMIT 1";
+    readAsync(q.str(), sweetKey(id), [done, dbCallTimer_](AsyncMySQL::Result r) {
+        done(r.ok, r.rows.empty() ? std::map<std::string, std::string>() : std::move(r.rows.front()));
+    });
+}
+
+namespace {
+
+// purchaseSweet as a chain of statements on one leased connection. Each
+// step issues the next statement from the previous one's completion;
+// any failure rolls back, reporting Refused for missing stock and Error
+// for a failed statement.
+struct AsyncPurchase : std::enable_shared_from_this<AsyncPurchase> {
+    using Step = void (AsyncPurchase::*)(AsyncMySQL::Result&);
+
+    std::shared_ptr<AsyncMySQL::Session> session;
+    int userId{0};
+    int sweetId{0};
+    int quantity{0};
+    std::string idempotencyKey; // escaped
+    Storage::PurchaseCallback done;
+    std::shared_ptr<metrics::ScopedTimer> timer;
+    bool split{false};
+    std::function<void(bool)> foundSplit; // reports the sweet's mode when it differs
+
+    double price{0.0};
+    double total{0.0};
+    std::string sweetName;
+    unsigned long long purchaseId{0};
+    std::string purchaseDate;
+    bool restarted{false};
+    std::vector<int> candidates;
+    std::size_t nextCandidate{0};
+    std::vector<std::map<std::string, std::string>> lockedSlots;
+
+    void then(const std::string& sql, Step next) {
+        auto self = shared_from_this();
+        session->query(sql, [self, next](AsyncMySQL::Result r) {
+            if (!r.ok) return self->fail(Storage::PurchaseStatus::Error);
+            (self.get()->*next)(r);
+        });
+    }
+
+    void fail(Storage::PurchaseStatus status = Storage::PurchaseStatus::Refused) {
+        auto self = shared_from_this();
+        session->query("ROLLBACK", [self, status](AsyncMySQL::Result) {
+            self->done(status, 0.0, std::map<std::string, std::string>());
+        });
+    }
+
+    void run() {
+        then("START TRANSACTION", split ? &AsyncPurchase::snapshot : &AsyncPurchase::started);
+    }
+
+    // Split since this process last looked: start over, once, on the slots
+    void restart() {
+        if (restarted) return fail();
+        restarted = true;
+        auto self = shared_from_this();
+        session->query("ROLLBACK", [self](AsyncMySQL::Result r) {
+            if (!r.ok) return self->fail(Storage::PurchaseStatus::Error);
+            self->run();
+        });
+    }
+
+    void started(AsyncMySQL::Result&) {
+        then(lockRowQuery(sweetId), &AsyncPurchase::locked);
+    }
+
+    void locked(AsyncMySQL::Result& r) {
+        if (r.rows.empty()) return fail();
+        auto& row = r.rows.front();
+        if (row["slots"] != "0") {
+            split = true;
+            foundSplit(true);
+            return restart();
+        }
+        int curQty = row["quantity"].empty() ? 0 : std::stoi(row["quantity"]);
+        price = row["price"].empty() ? 0.0 : std::stod(row["price"]);
+        sweetName = row["name"];
+        if (curQty < quantity) return fail();
+        total = price * quantity;
+        then(rowStockQuery(sweetId, curQty - quantity), &AsyncPurchase::updated);
+    }
+
+    // The split path, as in Database::takeFromSlots
+    void snapshot(AsyncMySQL::Result&) {
+        then(slotSnapshotQuery(sweetId), &AsyncPurchase::snapshotRead);
+    }
+
+    void snapshotRead(AsyncMySQL::Result& r) {
+        if (r.rows.empty()) return fail();
+        auto& row = r.rows.front();
+        if (row["slot"].empty()) {
+            split = false;
+            foundSplit(false);
+            return started(r);
+        }
+        price = std::stod(row["price"]);
+        sweetName = row["name"];
+        candidates = slotCandidates(r.rows, quantity);
+        nextSlot();
+    }
+
+    void nextSlot() {
+        if (nextCandidate == candidates.size()) {
+            return then(lockSlotsQuery(sweetId), &AsyncPurchase::slotsLocked);
+        }
+        then(takeFromSlotQuery(sweetId, candidates[nextCandidate++], quantity), &AsyncPurchase::slotTried);
+    }
+
+    void slotTried(AsyncMySQL::Result& r) {
+        if (r.affectedRows != 1) return nextSlot();
+        total = price * quantity;
+        updated(r);
+    }
+
+    void slotsLocked(AsyncMySQL::Result& r) {
+        lockedSlots = std::move(r.rows);
+        then(lockRowQuery(sweetId), &AsyncPurchase::rowLocked);
+    }
+
+    void rowLocked(AsyncMySQL::Result& r) {
+        if (r.rows.empty()) return fail();
+        std::vector<int> ids;
+        long long stock = lockedStock(r.rows.front(), lockedSlots, ids);
+        if (stock < quantity) return fail();
+        price = std::stod(r.rows.front()["price"]);
+        sweetName = r.rows.front()["name"];
+        total = price * quantity;
+        respreads().inc();
+        if (ids.empty()) return then(rowStockQuery(sweetId, stock - quantity), &AsyncPurchase::updated);
+        then(respreadQuery(sweetId, ids, stock - quantity), &AsyncPurchase::respread);
+    }
+
+    void respread(AsyncMySQL::Result&) {
+        then(rowStockQuery(sweetId, 0), &AsyncPurchase::updated);
+    }
+
+    void updated(AsyncMySQL::Result&) {
+        std::ostringstream q;
+        q << "INSERT INTO purchases (user_id, sweet_id, quantity, total_price) VALUES ("
+          << userId << "," << sweetId << "," << quantity << "," << total << ")";
+        then(q.str(), &AsyncPurchase::inserted);
+    }
+
+    void inserted(AsyncMySQL::Result& r) {
+        purchaseId = r.insertId;
+        std::ostringstream q;
+        q << "SELECT purchase_date FROM purchases WHERE id=" << purchaseId;
+        then(q.str(), &AsyncPurchase::dated);
+    }
+
+    void dated(AsyncMySQL::Result& r) {
+        if (!r.rows.empty()) purchaseDate = r.rows.front()["purchase_date"];
+        if (idempotencyKey.empty()) return then("COMMIT", &AsyncPurchase::committed);
+        std::ostringstream q;
+        q << "INSERT INTO idempotency_keys (idem_key, operation, sweet_id, quantity, purchase_id)"
+          << " VALUES ('" << idempotencyKey << "','purchase'," << sweetId << "," << quantity
+          << "," << purchaseId << ")";
+        then(q.str(), &AsyncPurchase::recorded);
+    }
+
+    void recorded(AsyncMySQL::Result&) {
+        then("COMMIT", &AsyncPurchase::committed);
+    }
+
+    void committed(AsyncMySQL::Result&) {
+        std::ostringstream totalStr;
+        totalStr << total;
+        done(Storage::PurchaseStatus::Done, total, {
+            {"id", std::to_string(purchaseId)},
+            {"user_id", std::to_string(userId)},
+            {"sweet_id", std::to_string(sweetId)},
+            {"sweet_name", sweetName},
+            {"quantity", std::to_string(quantity)},
+            {"total_price", totalStr.str()},
+            {"purchase_date", purchaseDate},
+        });
+    }
+};
+
+} // namespace
+
+void Database::purchaseSweetAsync(int userId, int sweetId, int quantity,
+                                  const std::string& idempotencyKey, PurchaseCallback done) {
+    if (!async_) {
+        return Storage::purchaseSweetAsync(userId, sweetId, quantity, idempotencyKey, std::move(done));
+    }
+    DB_TIMED_ASYNC("purchaseSweetAsync");
+    auto txn = std::make_shared<AsyncPurchase>();
+    txn->userId = userId;
+    txn->sweetId = sweetId;
+    txn->quantity = quantity;
+    txn->idempotencyKey = escapeAscii(idempotencyKey);
+    txn->split = isSplit(sweetId);
+    txn->foundSplit = [this, sweetId](bool split) { markSplit(sweetId, split); };
+    txn->done = std::move(done);
+    if (replicas_) {
+        txn->done = [this, sweetId, done = std::move(txn->done)](PurchaseStatus status, double total,
+                                                                  std::map<std::string, std::string> row) {
+            if (status != PurchaseStatus::Refused) {
+                pin("catalog");
+                pin(sweetKey(sweetId));
+            }
+            done(status, total, std::move(row));
+        };
+    }
+    txn->timer = dbCallTimer_;
+    async_->session([txn](std::shared_ptr<AsyncMySQL::Session> session) {
+        if (!session) return txn->done(PurchaseStatus::Error, 0.0, std::map<std::string, std::string>());
+        txn->session = std::move(session);
+        txn->run();
+    });
+}
+
+void Database::getIdempotencyKeyAsync(const std::string& key, RowCallback done) {
+    if (!async_) return Storage::getIdempotencyKeyAsync(key, std::move(done));
+    DB_TIMED_ASYNC("getIdempotencyKeyAsync");
+    async_->query(idempotencyKeyQuery(escapeAscii(key)), [done, dbCallTimer_](AsyncMySQL::Result r) {
+        done(r.ok, r.rows.empty() ? std::map<std::string, std::string>() : std::move(r.rows.front()));
+    });
 }
\ No newline at end of file
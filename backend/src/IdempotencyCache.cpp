@@ -0,0 +1,104 @@
+#include "IdempotencyCache.h"
+
+#include <functional>
+
+namespace {
+
+std::size_t atLeastOne(std::size_t n) {
+    return n ? n : 1;
+}
+
+} // namespace
+
+IdempotencyCache::IdempotencyCache(std::size_t capacity, std::chrono::seconds ttl, std::size_t shards)
+    : perShard_(atLeastOne(capacity / atLeastOne(shards))),
+      ttl_(ttl),
+      fresh_(metrics::counter("sweet_shop_idempotency_requests_total", "result=\"new\"",
+                              "Requests carrying an Idempotency-Key, by cache outcome")),
+      replayed_(metrics::counter("sweet_shop_idempotency_requests_total", "result=\"replayed\"")),
+      inProgress_(metrics::counter("sweet_shop_idempotency_requests_total", "result=\"in_progress\"")),
+      mismatched_(metrics::counter("sweet_shop_idempotency_requests_total", "result=\"mismatch\"")) {
+    shards_.reserve(atLeastOne(shards));
+    for (std::size_t i = 0; i < atLeastOne(shards); ++i) shards_.emplace_back(new Shard());
+}
+
+IdempotencyCache::Shard& IdempotencyCache::shardFor(const std::string& key) {
+    return *shards_[std::hash<std::string>()(key) % shards_.size()];
+}
+
+void IdempotencyCache::insert(Shard& shard, const std::string& key, Entry entry) {
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        shard.lru.erase(it->second.lru);
+        shard.entries.erase(it);
+    }
+    while (shard.entries.size() >= perShard_ && !shard.lru.empty()) {
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(key);
+    entry.lru = shard.lru.begin();
+    shard.entries.emplace(key, std::move(entry));
+}
+
+IdempotencyCache::Claim IdempotencyCache::claim(const std::string& key,
+                                                const std::string& fingerprint,
+                                                std::map<std::string, std::string>& stored) {
+    Shard& shard = shardFor(key);
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end() && it->second.expires > now) {
+        Entry& entry = it->second;
+        shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru);
+        if (entry.fingerprint != fingerprint) {
+            mismatched_.inc();
+            return Claim::Mismatch;
+        }
+        if (!entry.done) {
+            inProgress_.inc();
+            return Claim::InProgress;
+        }
+        replayed_.inc();
+        stored = entry.result;
+        return Claim::Done;
+    }
+
+    Entry entry;
+    entry.fingerprint = fingerprint;
+    entry.expires = now + ttl_;
+    insert(shard, key, std::move(entry));
+    fresh_.inc();
+    return Claim::New;
+}
+
+void IdempotencyCache::complete(const std::string& key,
+                                const std::string& fingerprint,
+                                std::map<std::string, std::string> result) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry entry;
+    entry.fingerprint = fingerprint;
+    entry.done = true;
+    entry.result = std::move(result);
+    entry.expires = Clock::now() + ttl_;
+    insert(shard, key, std::move(entry));
+}
+
+void IdempotencyCache::release(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end() || it->second.done) return;
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+std::size_t IdempotencyCache::size() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->entries.size();
+    }
+    return total;
+}
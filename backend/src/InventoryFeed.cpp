@@ -0,0 +1,71 @@
+#include "InventoryFeed.h"
+
+#include <cstdio>
+
+#include "Purchase.h"
+#include "RowFormat.h"
+#include "Sweet.h"
+
+namespace {
+
+std::string quote(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+    return out + "\"";
+}
+
+std::string upsert(const Sweet& s) {
+    return "{\"type\":\"upsert\",\"sweet\":{\"id\":" + std::to_string(s.id) +
+        ",\"name\":" + quote(s.name) +
+        ",\"description\":" + quote(s.description) +
+        ",\"category\":" + quote(s.category) +
+        ",\"price\":" + rowformat::money(s.price) +
+        ",\"quantity\":" + std::to_string(s.quantity) + "}}";
+}
+
+} // namespace
+
+void InventoryFeed::onSweetCreated(const Sweet& sweet) {
+    topic_.publish(upsert(sweet));
+}
+
+void InventoryFeed::onSweetUpdated(const Sweet& sweet) {
+    topic_.publish(upsert(sweet));
+}
+
+void InventoryFeed::onSweetDeleted(int sweetId) {
+    topic_.publish("{\"type\":\"delete\",\"id\":" + std::to_string(sweetId) + "}");
+}
+
+void InventoryFeed::onSweetsImported(const std::vector<Sweet>&, const std::vector<bool>&) {
+    topic_.publish("{\"type\":\"reset\"}");
+}
+
+void InventoryFeed::onPurchase(const Purchase& purchase) {
+    publishStock(purchase.sweetId, -purchase.quantity);
+}
+
+void InventoryFeed::onRestock(int sweetId, int quantity) {
+    publishStock(sweetId, quantity);
+}
+
+void InventoryFeed::publishStock(int sweetId, int delta) {
+    topic_.publish("{\"type\":\"stock\",\"id\":" + std::to_string(sweetId) +
+                   ",\"delta\":" + std::to_string(delta) + "}");
+}
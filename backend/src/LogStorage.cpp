@@ -0,0 +1,1019 @@
+#include "LogStorage.h"
+#include "RowFormat.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+using rowformat::money;
+using rowformat::now;
+using rowformat::roundCents;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Record types. Purchase and Restock are deltas against a sweet's stock;
+// PurchasePut restores a purchase row without touching stock and only
+// appears in snapshots, where sweets are already written post-purchase.
+// A keyed Purchase or Restock carries its idempotency key as a trailing
+// field, so the change and its key are one record; snapshots write keys
+// as IdempotencyPut. A Batch wraps several records that must be applied
+// all or not at all.
+enum RecordType : std::uint8_t {
+    kUserPut = 1,
+    kSweetPut = 2,
+    kSweetDelete = 3,
+    kPurchase = 4,
+    kRestock = 5,
+    kAudit = 6,
+    kPurchasePut = 7,
+    kCounters = 8,
+    kIdempotencyPut = 9,
+    kBatch = 10,
+};
+
+class Writer {
+public:
+    explicit Writer(RecordType type) { out_.push_back(static_cast<char>(type)); }
+    Writer& i32(std::int32_t v) { return raw(&v, sizeof(v)); }
+    Writer& i64(std::int64_t v) { return raw(&v, sizeof(v)); }
+    Writer& f64(double v) { return raw(&v, sizeof(v)); }
+    Writer& b(bool v) { out_.push_back(v ? 1 : 0); return *this; }
+    Writer& str(const std::string& s) {
+        i32(static_cast<std::int32_t>(s.size()));
+        out_ += s;
+        return *this;
+    }
+    const std::string& bytes() const { return out_; }
+
+private:
+    Writer& raw(const void* p, std::size_t n) {
+        out_.append(static_cast<const char*>(p), n);
+        return *this;
+    }
+    std::string out_;
+};
+
+class Reader {
+public:
+    explicit Reader(const std::string& in) : in_(in) {}
+    bool ok() const { return ok_; }
+    bool atEnd() const { return pos_ >= in_.size(); }
+    std::uint8_t type() { char c = 0; raw(&c, 1); return static_cast<std::uint8_t>(c); }
+    std::int32_t i32() { std::int32_t v = 0; raw(&v, sizeof(v)); return v; }
+    std::int64_t i64() { std::int64_t v = 0; raw(&v, sizeof(v)); return v; }
+    double f64() { double v = 0; raw(&v, sizeof(v)); return v; }
+    bool b() { char c = 0; raw(&c, 1); return c != 0; }
+    std::string str() {
+        std::int32_t n = i32();
+        if (!ok_ || n < 0 || pos_ + static_cast<std::size_t>(n) > in_.size()) {
+            ok_ = false;
+            return std::string();
+        }
+        std::string s = in_.substr(pos_, static_cast<std::size_t>(n));
+        pos_ += static_cast<std::size_t>(n);
+        return s;
+    }
+
+private:
+    void raw(void* p, std::size_t n) {
+        if (!ok_ || pos_ + n > in_.size()) {
+            ok_ = false;
+            return;
+        }
+        std::memcpy(p, in_.data() + pos_, n);
+        pos_ += n;
+    }
+    const std::string& in_;
+    std::size_t pos_{0};
+    bool ok_{true};
+};
+
+// Parses "<prefix><number><suffix>"; 0 if the name does not match
+std::uint64_t fileNumber(const std::string& name, const std::string& prefix, const std::string& suffix) {
+    if (name.size() <= prefix.size() + suffix.size()) return 0;
+    if (name.compare(0, prefix.size(), prefix) != 0) return 0;
+    if (name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) return 0;
+    std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) return 0;
+    return std::stoull(digits);
+}
+
+std::string snapshotPath(const std::string& dir, std::uint64_t segment) {
+    char name[48];
+    std::snprintf(name, sizeof(name), "snapshot-%020llu.snap", static_cast<unsigned long long>(segment));
+    return (fs::path(dir) / name).string();
+}
+
+} // namespace
+
+LogStorage::LogStorage(const std::string& dataDir,
+                       std::uint64_t snapshotEveryBytes,
+                       std::chrono::microseconds groupCommitWindow)
+    : dir_(dataDir),
+      snapshotEveryBytes_(snapshotEveryBytes),
+      groupCommitWindow_(groupCommitWindow) {}
+
+LogStorage::~LogStorage() {
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex_);
+        stopping_ = true;
+    }
+    snapshotWake_.notify_all();
+    if (snapshotter_.joinable()) snapshotter_.join();
+    wal_.reset(); // drains and fsyncs anything still queued
+}
+
+bool LogStorage::open() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (wal_) return true;
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        std::cerr << "LogStorage: cannot create " << dir_ << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    std::uint64_t snapshot = 0;
+    std::vector<std::uint64_t> segments;
+    for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+        std::string name = entry.path().filename().string();
+        if (std::uint64_t n = fileNumber(name, "snapshot-", ".snap")) {
+            snapshot = std::max(snapshot, n);
+        } else if (std::uint64_t n = fileNumber(name, "wal-", ".log")) {
+            segments.push_back(n);
+        } else if (fileNumber(name, "snapshot-", ".tmp")) {
+            fs::remove(entry.path(), ec); // interrupted snapshot
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    State recovered;
+    if (snapshot) {
+        bool ok = WriteAheadLog::replay(snapshotPath(dir_, snapshot),
+                                        [&](const std::string& r) { return apply(recovered, r); },
+                                        false);
+        if (!ok) {
+            std::cerr << "LogStorage: snapshot " << snapshot << " is unreadable\n";
+            return false;
+        }
+    }
+    std::uint64_t active = snapshot ? snapshot : 1;
+    std::size_t replayed = 0;
+    for (std::uint64_t seg : segments) {
+        if (seg < snapshot) continue; // already covered by the snapshot
+        bool ok = WriteAheadLog::replay(WriteAheadLog::segmentPath(dir_, seg),
+                                        [&](const std::string& r) {
+                                            ++replayed;
+                                            return apply(recovered, r);
+                                        });
+        if (!ok) {
+            std::cerr << "LogStorage: WAL segment " << seg << " holds an undecodable record\n";
+            return false;
+        }
+        active = seg;
+    }
+    state_ = std::move(recovered);
+    std::cout << "LogStorage: recovered " << state_.sweets.size() << " sweets and "
+              << state_.purchases.size() << " purchases (snapshot " << snapshot
+              << ", " << replayed << " WAL records)\n";
+
+    wal_.reset(new WriteAheadLog(dir_, active, groupCommitWindow_));
+    if (!wal_->open()) {
+        std::cerr << "LogStorage: cannot open WAL segment " << active << "\n";
+        wal_.reset();
+        return false;
+    }
+    snapshotter_ = std::thread(&LogStorage::snapshotLoop, this);
+    return true;
+}
+
+bool LogStorage::apply(State& state, const std::string& record) {
+    Reader r(record);
+    switch (r.type()) {
+    case kUserPut: {
+        UserRecord u;
+        u.id = r.i32();
+        u.username = r.str();
+        u.passwordHash = r.str();
+        u.email = r.str();
+        u.isAdmin = r.b();
+        u.createdAt = r.str();
+        if (!r.ok()) return false;
+        state.userIds[u.username] = u.id;
+        state.nextUserId = std::max(state.nextUserId, u.id + 1);
+        state.users[u.id] = std::move(u);
+        return true;
+    }
+    case kSweetPut: {
+        SweetRecord s;
+        s.id = r.i32();
+        s.name = r.str();
+        s.description = r.str();
+        s.category = r.str();
+        s.price = r.f64();
+        s.quantity = r.i32();
+        s.createdAt = r.str();
+        s.updatedAt = r.str();
+        s.purchases = r.i64();
+        if (!r.ok()) return false;
+        state.nextSweetId = std::max(state.nextSweetId, s.id + 1);
+        state.sweets[s.id] = std::move(s);
+        return true;
+    }
+    case kSweetDelete: {
+        int id = r.i32();
+        if (!r.ok()) return false;
+        state.sweets.erase(id);
+        return true;
+    }
+    case kPurchase:
+    case kPurchasePut: {
+        bool delta = record[0] == static_cast<char>(kPurchase);
+        PurchaseRecord p;
+        p.id = r.i32();
+        p.userId = r.i32();
+        p.sweetId = r.i32();
+        p.sweetName = r.str();
+        p.quantity = r.i32();
+        p.totalPrice = r.f64();
+        p.purchaseDate = r.str();
+        std::string key = r.atEnd() ? std::string() : r.str();
+        if (!r.ok()) return false;
+        if (!key.empty()) recordKey(state, key, {"purchase", p.sweetId, p.quantity, p.id, p.purchaseDate});
+        if (delta) {
+            auto it = state.sweets.find(p.sweetId);
+            if (it != state.sweets.end()) {
+                it->second.quantity -= p.quantity;
+                ++it->second.purchases;
+            }
+        }
+        state.nextPurchaseId = std::max(state.nextPurchaseId, p.id + 1);
+        state.history[p.userId][std::make_pair(p.purchaseDate, p.id)] = p.id;
+        state.purchases[p.id] = std::move(p);
+        return true;
+    }
+    case kRestock: {
+        int id = r.i32();
+        int quantity = r.i32();
+        std::string updatedAt = r.str();
+        std::string key = r.atEnd() ? std::string() : r.str();
+        if (!r.ok()) return false;
+        if (!key.empty()) recordKey(state, key, {"restock", id, quantity, 0, updatedAt});
+        auto it = state.sweets.find(id);
+        if (it != state.sweets.end()) {
+            it->second.quantity += quantity;
+            it->second.updatedAt = updatedAt;
+        }
+        return true;
+    }
+    case kAudit: {
+        AuditRecord a;
+        a.id = r.i32();
+        a.userId = r.i32();
+        a.action = r.str();
+        a.targetType = r.str();
+        a.targetId = r.i32();
+        a.details = r.str();
+        a.createdAt = r.str();
+        if (!r.ok()) return false;
+        state.nextAuditId = std::max(state.nextAuditId, a.id + 1);
+        state.audit.push_back(std::move(a));
+        return true;
+    }
+    case kIdempotencyPut: {
+        std::string key = r.str();
+        KeyRecord k;
+        k.operation = r.str();
+        k.sweetId = r.i32();
+        k.quantity = r.i32();
+        k.purchaseId = r.i32();
+        k.createdAt = r.str();
+        if (!r.ok()) return false;
+        recordKey(state, key, std::move(k));
+        return true;
+    }
+    case kBatch: {
+        std::int32_t count = r.i32();
+        std::vector<std::string> records;
+        for (std::int32_t i = 0; i < count && r.ok(); ++i) records.push_back(r.str());
+        if (!r.ok()) return false;
+        for (const auto& inner : records) {
+            if (!apply(state, inner)) return false;
+        }
+        return true;
+    }
+    case kCounters: {
+        // Ids are never reused, even for rows deleted before the snapshot
+        int users = r.i32(), sweets = r.i32(), purchases = r.i32(), audit = r.i32();
+        if (!r.ok()) return false;
+        state.nextUserId = std::max(state.nextUserId, users);
+        state.nextSweetId = std::max(state.nextSweetId, sweets);
+        state.nextPurchaseId = std::max(state.nextPurchaseId, purchases);
+        state.nextAuditId = std::max(state.nextAuditId, audit);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+namespace {
+
+std::string encodeSweet(int id, const std::string& name, const std::string& description,
+                        const std::string& category, double price, int quantity,
+                        const std::string& createdAt, const std::string& updatedAt,
+                        long long purchases) {
+    return Writer(kSweetPut).i32(id).str(name).str(description).str(category)
+        .f64(price).i32(quantity).str(createdAt).str(updatedAt).i64(purchases).bytes();
+}
+
+std::string encodePurchase(RecordType type, int id, int userId, int sweetId,
+                           const std::string& sweetName, int quantity, double total,
+                           const std::string& date, const std::string& key = "") {
+    Writer w(type);
+    w.i32(id).i32(userId).i32(sweetId).str(sweetName).i32(quantity).f64(total).str(date);
+    if (!key.empty()) w.str(key);
+    return w.bytes();
+}
+
+std::string encodeRestock(int sweetId, int quantity, const std::string& date, const std::string& key) {
+    Writer w(kRestock);
+    w.i32(sweetId).i32(quantity).str(date);
+    if (!key.empty()) w.str(key);
+    return w.bytes();
+}
+
+} // namespace
+
+void LogStorage::writeSnapshot(const State& state, std::string& out) {
+    out += WriteAheadLog::frame(Writer(kCounters).i32(state.nextUserId).i32(state.nextSweetId)
+                                    .i32(state.nextPurchaseId).i32(state.nextAuditId).bytes());
+    for (const auto& kv : state.users) {
+        const UserRecord& u = kv.second;
+        out += WriteAheadLog::frame(Writer(kUserPut).i32(u.id).str(u.username).str(u.passwordHash)
+                                        .str(u.email).b(u.isAdmin).str(u.createdAt).bytes());
+    }
+    for (const auto& kv : state.sweets) {
+        const SweetRecord& s = kv.second;
+        out += WriteAheadLog::frame(encodeSweet(s.id, s.name, s.description, s.category, s.price,
+                                                s.quantity, s.createdAt, s.updatedAt, s.purchases));
+    }
+    for (const auto& kv : state.purchases) {
+        const PurchaseRecord& p = kv.second;
+        out += WriteAheadLog::frame(encodePurchase(kPurchasePut, p.id, p.userId, p.sweetId,
+                                                   p.sweetName, p.quantity, p.totalPrice,
+                                                   p.purchaseDate));
+    }
+    for (const AuditRecord& a : state.audit) {
+        out += WriteAheadLog::frame(Writer(kAudit).i32(a.id).i32(a.userId).str(a.action)
+                                        .str(a.targetType).i32(a.targetId).str(a.details)
+                                        .str(a.createdAt).bytes());
+    }
+    // Oldest first, so recovery rebuilds the expiry order
+    for (const auto& entry : state.keyOrder) {
+        auto it = state.keys.find(entry.second);
+        if (it == state.keys.end() || it->second.createdAt != entry.first) continue;
+        const KeyRecord& k = it->second;
+        out += WriteAheadLog::frame(Writer(kIdempotencyPut).str(entry.second).str(k.operation)
+                                        .i32(k.sweetId).i32(k.quantity).i32(k.purchaseId)
+                                        .str(k.createdAt).bytes());
+    }
+}
+
+void LogStorage::recordKey(State& state, const std::string& key, KeyRecord record) {
+    std::string cutoff = rowformat::timestamp(std::time(nullptr) - kIdempotencyKeySeconds);
+    while (!state.keyOrder.empty() && state.keyOrder.front().first < cutoff) {
+        auto old = state.keys.find(state.keyOrder.front().second);
+        if (old != state.keys.end() && old->second.createdAt == state.keyOrder.front().first) {
+            state.keys.erase(old);
+        }
+        state.keyOrder.pop_front();
+    }
+    state.keyOrder.emplace_back(record.createdAt, key);
+    state.keys[key] = std::move(record);
+}
+
+void LogStorage::capture(const State& state, const std::string& record, Undo& undo) {
+    auto sweet = [&](int id) {
+        for (const auto& saved : undo.sweets) {
+            if (saved.first == id) return; // the earliest row is the one to restore
+        }
+        auto it = state.sweets.find(id);
+        undo.sweets.emplace_back(id, it == state.sweets.end() ? std::nullopt
+                                                              : std::optional<SweetRecord>(it->second));
+    };
+    auto key = [&](const std::string& k) {
+        for (const auto& saved : undo.keys) {
+            if (saved.first == k) return;
+        }
+        auto it = state.keys.find(k);
+        undo.keys.emplace_back(k, it == state.keys.end() ? std::nullopt
+                                                         : std::optional<KeyRecord>(it->second));
+    };
+    Reader r(record);
+    switch (r.type()) {
+    case kUserPut: {
+        int id = r.i32();
+        undo.users.emplace_back(id, r.str());
+        break;
+    }
+    case kSweetPut:
+    case kSweetDelete:
+        sweet(r.i32());
+        break;
+    case kPurchase: {
+        int id = r.i32();
+        r.i32();
+        int sweetId = r.i32();
+        r.str();
+        r.i32();
+        r.f64();
+        r.str();
+        std::string k = r.atEnd() ? std::string() : r.str();
+        sweet(sweetId);
+        undo.purchases.push_back(id);
+        if (!k.empty()) key(k);
+        break;
+    }
+    case kRestock: {
+        int id = r.i32();
+        r.i32();
+        r.str();
+        std::string k = r.atEnd() ? std::string() : r.str();
+        sweet(id);
+        if (!k.empty()) key(k);
+        break;
+    }
+    case kBatch: {
+        std::int32_t count = r.i32();
+        for (std::int32_t i = 0; i < count && r.ok(); ++i) capture(state, r.str(), undo);
+        break;
+    }
+    default:
+        break; // kAudit is covered by auditSize; the rest only come from snapshots
+    }
+}
+
+void LogStorage::restore(State& state, const Undo& undo) {
+    for (const auto& saved : undo.sweets) {
+        if (saved.second) {
+            state.sweets[saved.first] = *saved.second;
+        } else {
+            state.sweets.erase(saved.first);
+        }
+    }
+    for (int id : undo.purchases) {
+        auto it = state.purchases.find(id);
+        if (it == state.purchases.end()) continue;
+        auto history = state.history.find(it->second.userId);
+        if (history != state.history.end()) {
+            history->second.erase(std::make_pair(it->second.purchaseDate, id));
+            if (history->second.empty()) state.history.erase(history);
+        }
+        state.purchases.erase(it);
+    }
+    for (const auto& user : undo.users) {
+        state.users.erase(user.first);
+        state.userIds.erase(user.second);
+    }
+    // keyOrder keeps the entry; expiry and snapshots skip entries whose
+    // key is gone or was recorded at another time
+    for (const auto& saved : undo.keys) {
+        if (saved.second) {
+            state.keys[saved.first] = *saved.second;
+        } else {
+            state.keys.erase(saved.first);
+        }
+    }
+    if (state.audit.size() > undo.auditSize) state.audit.resize(undo.auditSize);
+    state.nextUserId = undo.nextIds[0];
+    state.nextSweetId = undo.nextIds[1];
+    state.nextPurchaseId = undo.nextIds[2];
+    state.nextAuditId = undo.nextIds[3];
+}
+
+std::uint64_t LogStorage::log(const std::string& record) {
+    if (wal_->failed()) return 0;
+    // Undo entries are only needed until their records are durable
+    std::uint64_t durable = wal_->durableLsn();
+    while (!undo_.empty() && undo_.front().lsn <= durable) undo_.pop_front();
+
+    Undo undo;
+    undo.nextIds[0] = state_.nextUserId;
+    undo.nextIds[1] = state_.nextSweetId;
+    undo.nextIds[2] = state_.nextPurchaseId;
+    undo.nextIds[3] = state_.nextAuditId;
+    undo.auditSize = state_.audit.size();
+    capture(state_, record, undo);
+    apply(state_, record);
+    undo.lsn = wal_->append(record);
+    if (!undo.lsn) {
+        // The log failed after the check; this is the newest mutation
+        restore(state_, undo);
+        return 0;
+    }
+    undo_.push_back(std::move(undo));
+    return undo_.back().lsn;
+}
+
+void LogStorage::rollback() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    // The log stops at its first failure, so everything past the durable
+    // LSN failed; newest first restores the state before the oldest
+    std::uint64_t durable = wal_->durableLsn();
+    while (!undo_.empty() && undo_.back().lsn > durable) {
+        restore(state_, undo_.back());
+        undo_.pop_back();
+    }
+}
+
+bool LogStorage::commit(std::uint64_t lsn) {
+    bool durable = wal_->waitDurable(lsn);
+    if (!durable) {
+        rollback();
+        return false;
+    }
+    if (wal_->bytesInSegment() >= snapshotEveryBytes_) {
+        std::lock_guard<std::mutex> lock(snapshotMutex_);
+        if (!snapshotDue_) {
+            snapshotDue_ = true;
+            snapshotWake_.notify_one();
+        }
+    }
+    return durable;
+}
+
+void LogStorage::snapshotLoop() {
+    std::unique_lock<std::mutex> lock(snapshotMutex_);
+    for (;;) {
+        snapshotWake_.wait(lock, [&] { return stopping_ || snapshotDue_; });
+        if (stopping_) return;
+        lock.unlock();
+        if (!takeSnapshot()) std::cerr << "LogStorage: snapshot failed; WAL keeps growing\n";
+        lock.lock();
+        snapshotDue_ = false;
+    }
+}
+
+bool LogStorage::takeSnapshot() {
+    // Copy the state and switch segments atomically with respect to
+    // writers, so the snapshot is exactly "everything before segment n"
+    State copy;
+    std::uint64_t segment = 0, boundary = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        copy = state_;
+        boundary = wal_->lastLsn();
+        segment = wal_->rotate();
+    }
+
+    std::string bytes;
+    writeSnapshot(copy, bytes);
+    std::string finalPath = snapshotPath(dir_, segment);
+    std::string tmpPath = fs::path(finalPath).replace_extension(".tmp").string();
+    std::FILE* f = std::fopen(tmpPath.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    ok = WriteAheadLog::sync(f) && ok;
+    std::fclose(f);
+    // The copy may hold mutations still in flight; it only replaces the
+    // older files once they are durable, and is dropped if they never are
+    if (boundary) ok = wal_->waitDurable(boundary) && ok;
+    std::error_code ec;
+    if (!ok) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    fs::rename(tmpPath, finalPath, ec);
+    if (ec) return false;
+    if (!WriteAheadLog::syncDir(dir_)) return false;
+
+    for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+        std::string name = entry.path().filename().string();
+        std::uint64_t n = fileNumber(name, "wal-", ".log");
+        if (!n) n = fileNumber(name, "snapshot-", ".snap");
+        if (n && n < segment) fs::remove(entry.path(), ec);
+    }
+    return true;
+}
+
+std::map<std::string, std::string> LogStorage::sweetRow(const SweetRecord& s) {
+    return {
+        {"id", std::to_string(s.id)},
+        {"name", s.name},
+        {"description", s.description},
+        {"category", s.category},
+        {"price", money(s.price)},
+        {"quantity", std::to_string(s.quantity)},
+        {"created_at", s.createdAt},
+        {"updated_at", s.updatedAt},
+    };
+}
+
+std::map<std::string, std::string> LogStorage::purchaseRow(const PurchaseRecord& p) {
+    return {
+        {"id", std::to_string(p.id)},
+        {"user_id", std::to_string(p.userId)},
+        {"sweet_id", std::to_string(p.sweetId)},
+        {"sweet_name", p.sweetName},
+        {"quantity", std::to_string(p.quantity)},
+        {"total_price", money(p.totalPrice)},
+        {"purchase_date", p.purchaseDate},
+    };
+}
+
+bool LogStorage::createUser(const std::string& username,
+                            const std::string& passwordHash,
+                            const std::string& email,
+                            bool isAdmin,
+                            int* outId) {
+    std::uint64_t lsn = 0;
+    int id = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        if (state_.userIds.count(username)) return false; // UNIQUE(username)
+        id = state_.nextUserId;
+        std::string record = Writer(kUserPut).i32(id).str(username).str(passwordHash)
+                                 .str(email).b(isAdmin).str(now()).bytes();
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    if (!commit(lsn)) return false;
+    if (outId) *outId = id;
+    return true;
+}
+
+std::map<std::string, std::string> LogStorage::getUserByUsername(const std::string& username) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto id = state_.userIds.find(username);
+    if (id == state_.userIds.end()) return {};
+    const UserRecord& u = state_.users.at(id->second);
+    return {
+        {"id", std::to_string(u.id)},
+        {"username", u.username},
+        {"password_hash", u.passwordHash},
+        {"email", u.email},
+        {"is_admin", u.isAdmin ? "1" : "0"},
+        {"created_at", u.createdAt},
+    };
+}
+
+bool LogStorage::createSweet(const std::string& name,
+                             const std::string& description,
+                             const std::string& category,
+                             double price,
+                             int quantity,
+                             int* outId) {
+    std::uint64_t lsn = 0;
+    int id = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        id = state_.nextSweetId;
+        std::string ts = now();
+        std::string record = encodeSweet(id, name, description, category, roundCents(price),
+                                         quantity, ts, ts, 0);
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    if (!commit(lsn)) return false;
+    if (outId) *outId = id;
+    return true;
+}
+
+bool LogStorage::upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                              std::vector<int>* outIds,
+                              std::vector<bool>* outCreated) {
+    std::vector<int> ids(rows.size(), 0);
+    std::vector<bool> created(rows.size(), true);
+    std::uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        std::string ts = now();
+        int nextId = state_.nextSweetId;
+        Writer batch(kBatch);
+        batch.i32(static_cast<std::int32_t>(rows.size()));
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            const auto& row = rows[i];
+            auto id = row.find("id");
+            ids[i] = id != row.end() && !id->second.empty() ? std::stoi(id->second) : nextId++;
+            nextId = std::max(nextId, ids[i] + 1);
+            std::string createdAt = ts;
+            long long purchases = 0;
+            auto it = state_.sweets.find(ids[i]);
+            if (it != state_.sweets.end()) {
+                created[i] = false;
+                createdAt = it->second.createdAt;
+                purchases = it->second.purchases;
+            }
+            batch.str(encodeSweet(ids[i], row.at("name"),
+                                  row.count("description") ? row.at("description") : std::string(),
+                                  row.at("category"), roundCents(std::stod(row.at("price"))),
+                                  std::stoi(row.at("quantity")), createdAt, ts, purchases));
+        }
+        // One record, so a crash never leaves half a batch behind
+        lsn = log(batch.bytes());
+        if (!lsn) return false;
+    }
+    if (!commit(lsn)) return false;
+    if (outIds) *outIds = std::move(ids);
+    if (outCreated) *outCreated = std::move(created);
+    return true;
+}
+
+bool LogStorage::patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                             std::vector<std::map<std::string, std::string>>* outRows) {
+    std::vector<std::map<std::string, std::string>> rows;
+    rows.reserve(changes.size());
+    std::uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        for (const auto& change : changes) {
+            if (!state_.sweets.count(std::stoi(change.at("id")))) return false;
+        }
+        std::string ts = now();
+        Writer batch(kBatch);
+        batch.i32(static_cast<std::int32_t>(changes.size()));
+        for (const auto& change : changes) {
+            SweetRecord s = state_.sweets.at(std::stoi(change.at("id")));
+            for (const auto& kv : change) {
+                if (kv.first == "name") s.name = kv.second;
+                else if (kv.first == "description") s.description = kv.second;
+                else if (kv.first == "category") s.category = kv.second;
+                else if (kv.first == "price") s.price = roundCents(std::stod(kv.second));
+                else if (kv.first == "quantity") s.quantity = std::stoi(kv.second);
+            }
+            s.updatedAt = ts;
+            batch.str(encodeSweet(s.id, s.name, s.description, s.category, s.price, s.quantity,
+                                  s.createdAt, s.updatedAt, s.purchases));
+            rows.push_back(sweetRow(s));
+        }
+        lsn = log(batch.bytes());
+        if (!lsn) return false;
+    }
+    if (!commit(lsn)) return false;
+    if (outRows) *outRows = std::move(rows);
+    return true;
+}
+
+std::vector<std::map<std::string, std::string>> LogStorage::getAllSweets(bool* ok) {
+    std::vector<std::map<std::string, std::string>> out;
+    if (ok) *ok = true;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<const SweetRecord*> all;
+    all.reserve(state_.sweets.size());
+    for (const auto& kv : state_.sweets) all.push_back(&kv.second);
+    std::sort(all.begin(), all.end(),
+              [](const SweetRecord* a, const SweetRecord* b) { return a->id < b->id; });
+    out.reserve(all.size());
+    for (const SweetRecord* s : all) out.push_back(sweetRow(*s));
+    return out;
+}
+
+std::map<std::string, std::string> LogStorage::getSweetById(int id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = state_.sweets.find(id);
+    if (it == state_.sweets.end()) return {};
+    return sweetRow(it->second);
+}
+
+bool LogStorage::updateSweet(int id,
+                             const std::string& name,
+                             const std::string& description,
+                             const std::string& category,
+                             double price,
+                             int quantity) {
+    std::uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        auto it = state_.sweets.find(id);
+        if (it == state_.sweets.end()) return true; // UPDATE matching no rows
+        const SweetRecord& s = it->second;
+        std::string record = encodeSweet(id, name, description, category, roundCents(price),
+                                         quantity, s.createdAt, now(), s.purchases);
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    return commit(lsn);
+}
+
+bool LogStorage::deleteSweet(int id) {
+    std::uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        auto it = state_.sweets.find(id);
+        if (it == state_.sweets.end()) return true;
+        if (it->second.purchases > 0) return false; // purchases.sweet_id ON DELETE RESTRICT
+        std::string record = Writer(kSweetDelete).i32(id).bytes();
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    return commit(lsn);
+}
+
+bool LogStorage::purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                               std::map<std::string, std::string>* outPurchase,
+                               const std::string& idempotencyKey) {
+    outTotal = 0.0;
+    std::uint64_t lsn = 0;
+    PurchaseRecord p;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        if (!state_.users.count(userId)) return false; // users FK
+        if (!idempotencyKey.empty() && state_.keys.count(idempotencyKey)) return false;
+        auto it = state_.sweets.find(sweetId);
+        if (it == state_.sweets.end()) return false;
+        const SweetRecord& sweet = it->second;
+        if (sweet.quantity < quantity) return false;
+
+        p.id = state_.nextPurchaseId;
+        p.userId = userId;
+        p.sweetId = sweetId;
+        p.sweetName = sweet.name;
+        p.quantity = quantity;
+        p.totalPrice = roundCents(sweet.price * quantity);
+        p.purchaseDate = now();
+        std::string record = encodePurchase(kPurchase, p.id, p.userId, p.sweetId, p.sweetName,
+                                            p.quantity, p.totalPrice, p.purchaseDate,
+                                            idempotencyKey);
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    if (!commit(lsn)) return false;
+    outTotal = p.totalPrice;
+    if (outPurchase) *outPurchase = purchaseRow(p);
+    return true;
+}
+
+bool LogStorage::restockSweet(int sweetId, int quantity, const std::string& idempotencyKey) {
+    std::uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        if (!idempotencyKey.empty() && state_.keys.count(idempotencyKey)) return false;
+        // Unknown sweets still record the key, like an UPDATE matching no rows
+        if (!state_.sweets.count(sweetId) && idempotencyKey.empty()) return true;
+        std::string record = encodeRestock(sweetId, quantity, now(), idempotencyKey);
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    return commit(lsn);
+}
+
+std::vector<std::map<std::string, std::string>>
+LogStorage::getPurchasesByUser(int userId,
+                               const std::string& beforeDate,
+                               int beforeId,
+                               int limit,
+                               bool* ok) {
+    std::vector<std::map<std::string, std::string>> out;
+    if (ok) *ok = true; // served from memory
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto hit = state_.history.find(userId);
+    if (hit == state_.history.end()) return out;
+    const auto& history = hit->second;
+    auto end = beforeDate.empty() ? history.end()
+                                  : history.lower_bound(std::make_pair(beforeDate, beforeId));
+    for (auto it = std::make_reverse_iterator(end);
+         it != history.rend() && static_cast<int>(out.size()) < limit; ++it) {
+        out.push_back(purchaseRow(state_.purchases.at(it->second)));
+    }
+    return out;
+}
+
+std::map<std::string, std::string> LogStorage::getPurchaseById(int id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = state_.purchases.find(id);
+    if (it == state_.purchases.end()) return {};
+    return purchaseRow(it->second);
+}
+
+std::map<std::string, std::string> LogStorage::getIdempotencyKey(const std::string& key) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = state_.keys.find(key);
+    if (it == state_.keys.end()) return {};
+    const KeyRecord& k = it->second;
+    std::map<std::string, std::string> row;
+    auto purchase = state_.purchases.find(k.purchaseId);
+    if (k.purchaseId && purchase != state_.purchases.end()) row = purchaseRow(purchase->second);
+    row["idem_key"] = key;
+    row["operation"] = k.operation;
+    row["sweet_id"] = std::to_string(k.sweetId);
+    row["quantity"] = std::to_string(k.quantity);
+    row["created_at"] = k.createdAt;
+    return row;
+}
+
+std::map<std::string, std::string> LogStorage::getSalesTotals() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    long long units = 0;
+    double revenue = 0.0;
+    for (const auto& kv : state_.purchases) {
+        units += kv.second.quantity;
+        revenue += kv.second.totalPrice;
+    }
+    return {
+        {"user_count", std::to_string(state_.users.size())},
+        {"order_count", std::to_string(state_.purchases.size())},
+        {"units_sold", std::to_string(units)},
+        {"revenue", money(revenue)},
+    };
+}
+
+std::vector<std::map<std::string, std::string>> LogStorage::getRevenueByCategory(bool* ok) {
+    if (ok) *ok = true;
+    struct Totals {
+        long long units{0};
+        double revenue{0.0};
+    };
+    std::map<std::string, Totals> byCategory;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& kv : state_.purchases) {
+            auto sweet = state_.sweets.find(kv.second.sweetId);
+            if (sweet == state_.sweets.end()) continue;
+            Totals& t = byCategory[sweet->second.category];
+            t.units += kv.second.quantity;
+            t.revenue += kv.second.totalPrice;
+        }
+    }
+    std::vector<std::map<std::string, std::string>> out;
+    for (const auto& kv : byCategory) {
+        out.push_back({
+            {"category", kv.first},
+            {"revenue", money(kv.second.revenue)},
+            {"units_sold", std::to_string(kv.second.units)},
+        });
+    }
+    return out;
+}
+
+long long LogStorage::getMaxPurchaseId() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return state_.nextPurchaseId - 1;
+}
+
+std::vector<std::map<std::string, std::string>>
+LogStorage::getHourlySales(long long maxPurchaseId) {
+    struct Totals {
+        std::string category;
+        long long orders{0};
+        long long units{0};
+        double revenue{0.0};
+    };
+    std::map<std::pair<std::string, int>, Totals> groups;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& kv : state_.purchases) {
+            const PurchaseRecord& p = kv.second;
+            if (p.id > maxPurchaseId) continue;
+            std::string hour = p.purchaseDate.substr(0, 13) + ":00:00";
+            Totals& t = groups[std::make_pair(hour, p.sweetId)];
+            if (t.orders == 0) {
+                auto sweet = state_.sweets.find(p.sweetId);
+                if (sweet != state_.sweets.end()) t.category = sweet->second.category;
+            }
+            ++t.orders;
+            t.units += p.quantity;
+            t.revenue += p.totalPrice;
+        }
+    }
+    std::vector<std::map<std::string, std::string>> out;
+    for (const auto& kv : groups) {
+        out.push_back({
+            {"hour", kv.first.first},
+            {"sweet_id", std::to_string(kv.first.second)},
+            {"category", kv.second.category},
+            {"orders", std::to_string(kv.second.orders)},
+            {"units", std::to_string(kv.second.units)},
+            {"revenue", money(kv.second.revenue)},
+        });
+    }
+    return out;
+}
+
+bool LogStorage::logAudit(int userId,
+                          const std::string& action,
+                          const std::string& targetType,
+                          int targetId,
+                          const std::string& details) {
+    std::uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!wal_) return false;
+        std::string record = Writer(kAudit).i32(state_.nextAuditId).i32(userId).str(action)
+                                 .str(targetType).i32(targetId).str(details).str(now()).bytes();
+        lsn = log(record);
+        if (!lsn) return false;
+    }
+    return commit(lsn);
+}
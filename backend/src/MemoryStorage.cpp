@@ -0,0 +1,512 @@
+#include "MemoryStorage.h"
+#include "RowFormat.h"
+
+#include <algorithm>
+
+using rowformat::money;
+using rowformat::now;
+using rowformat::roundCents;
+
+MemoryStorage::MemoryStorage(std::size_t stripes)
+    : stripeCount_(stripes ? stripes : 1),
+      sweets_(stripeCount_),
+      histories_(stripeCount_),
+      purchaseIndex_(stripeCount_) {}
+
+MemoryStorage::Stripe<std::unordered_map<int, MemoryStorage::SweetRecord>>&
+MemoryStorage::sweetStripe(int id) {
+    return sweets_[static_cast<std::size_t>(id) % stripeCount_];
+}
+
+MemoryStorage::Stripe<std::unordered_map<int, MemoryStorage::History>>&
+MemoryStorage::historyStripe(int userId) {
+    return histories_[static_cast<std::size_t>(userId) % stripeCount_];
+}
+
+MemoryStorage::Stripe<std::unordered_map<int, std::pair<int, std::string>>>&
+MemoryStorage::purchaseIndexStripe(int id) {
+    return purchaseIndex_[static_cast<std::size_t>(id) % stripeCount_];
+}
+
+std::map<std::string, std::string> MemoryStorage::sweetRow(const SweetRecord& s) {
+    return {
+        {"id", std::to_string(s.id)},
+        {"name", s.name},
+        {"description", s.description},
+        {"category", s.category},
+        {"price", money(s.price)},
+        {"quantity", std::to_string(s.quantity)},
+        {"created_at", s.createdAt},
+        {"updated_at", s.updatedAt},
+    };
+}
+
+std::map<std::string, std::string> MemoryStorage::purchaseRow(const PurchaseRecord& p) {
+    return {
+        {"id", std::to_string(p.id)},
+        {"user_id", std::to_string(p.userId)},
+        {"sweet_id", std::to_string(p.sweetId)},
+        {"sweet_name", p.sweetName},
+        {"quantity", std::to_string(p.quantity)},
+        {"total_price", money(p.totalPrice)},
+        {"purchase_date", p.purchaseDate},
+    };
+}
+
+bool MemoryStorage::createUser(const std::string& username,
+                               const std::string& passwordHash,
+                               const std::string& email,
+                               bool isAdmin,
+                               int* outId) {
+    std::unique_lock<std::shared_mutex> lock(usersMutex_);
+    if (users_.count(username)) return false; // UNIQUE(username)
+    UserRecord u;
+    u.id = nextUserId_++;
+    u.username = username;
+    u.passwordHash = passwordHash;
+    u.email = email;
+    u.isAdmin = isAdmin;
+    u.createdAt = now();
+    if (outId) *outId = u.id;
+    users_.emplace(username, std::move(u));
+    return true;
+}
+
+std::map<std::string, std::string> MemoryStorage::getUserByUsername(const std::string& username) {
+    std::shared_lock<std::shared_mutex> lock(usersMutex_);
+    auto it = users_.find(username);
+    if (it == users_.end()) return {};
+    const UserRecord& u = it->second;
+    return {
+        {"id", std::to_string(u.id)},
+        {"username", u.username},
+        {"password_hash", u.passwordHash},
+        {"email", u.email},
+        {"is_admin", u.isAdmin ? "1" : "0"},
+        {"created_at", u.createdAt},
+    };
+}
+
+bool MemoryStorage::createSweet(const std::string& name,
+                                const std::string& description,
+                                const std::string& category,
+                                double price,
+                                int quantity,
+                                int* outId) {
+    SweetRecord s;
+    s.id = nextSweetId_++;
+    s.name = name;
+    s.description = description;
+    s.category = category;
+    s.price = roundCents(price);
+    s.quantity = quantity;
+    s.createdAt = s.updatedAt = now();
+    auto& stripe = sweetStripe(s.id);
+    {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        stripe.rows.emplace(s.id, s);
+    }
+    if (outId) *outId = s.id;
+    return true;
+}
+
+bool MemoryStorage::upsertSweets(const std::vector<std::map<std::string, std::string>>& rows,
+                                 std::vector<int>* outIds,
+                                 std::vector<bool>* outCreated) {
+    // Row by row: readers may see part of the batch, as with every other
+    // aggregate in this engine
+    std::vector<int> ids(rows.size(), 0);
+    std::vector<bool> created(rows.size(), true);
+    std::string ts = now();
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        const auto& row = rows[i];
+        SweetRecord s;
+        auto id = row.find("id");
+        if (id != row.end() && !id->second.empty()) {
+            s.id = std::stoi(id->second);
+            // Later creates must not hand out this id
+            int next = nextSweetId_;
+            while (next <= s.id && !nextSweetId_.compare_exchange_weak(next, s.id + 1)) {}
+        } else {
+            s.id = nextSweetId_++;
+        }
+        s.name = row.at("name");
+        s.description = row.count("description") ? row.at("description") : std::string();
+        s.category = row.at("category");
+        s.price = roundCents(std::stod(row.at("price")));
+        s.quantity = std::stoi(row.at("quantity"));
+        s.createdAt = s.updatedAt = ts;
+        ids[i] = s.id;
+
+        auto& stripe = sweetStripe(s.id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.rows.find(s.id);
+        if (it == stripe.rows.end()) {
+            stripe.rows.emplace(s.id, std::move(s));
+            continue;
+        }
+        created[i] = false;
+        s.createdAt = it->second.createdAt;
+        s.purchases = it->second.purchases;
+        it->second = std::move(s);
+    }
+    if (outIds) *outIds = std::move(ids);
+    if (outCreated) *outCreated = std::move(created);
+    return true;
+}
+
+bool MemoryStorage::patchSweets(const std::vector<std::map<std::string, std::string>>& changes,
+                                std::vector<std::map<std::string, std::string>>* outRows) {
+    std::vector<int> ids;
+    ids.reserve(changes.size());
+    for (const auto& change : changes) ids.push_back(std::stoi(change.at("id")));
+
+    // Every stripe involved, locked in index order, so the batch is
+    // all-or-nothing and cannot deadlock against another batch
+    std::vector<std::size_t> stripes;
+    for (int id : ids) stripes.push_back(static_cast<std::size_t>(id) % stripeCount_);
+    std::sort(stripes.begin(), stripes.end());
+    stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(stripes.size());
+    for (std::size_t i : stripes) locks.emplace_back(sweets_[i].mutex);
+
+    for (int id : ids) {
+        if (!sweetStripe(id).rows.count(id)) return false;
+    }
+    std::string ts = now();
+    std::vector<std::map<std::string, std::string>> rows;
+    rows.reserve(changes.size());
+    for (std::size_t i = 0; i < changes.size(); ++i) {
+        SweetRecord& s = sweetStripe(ids[i]).rows.at(ids[i]);
+        for (const auto& kv : changes[i]) {
+            if (kv.first == "name") s.name = kv.second;
+            else if (kv.first == "description") s.description = kv.second;
+            else if (kv.first == "category") s.category = kv.second;
+            else if (kv.first == "price") s.price = roundCents(std::stod(kv.second));
+            else if (kv.first == "quantity") s.quantity = std::stoi(kv.second);
+        }
+        s.updatedAt = ts;
+        rows.push_back(sweetRow(s));
+    }
+    if (outRows) *outRows = std::move(rows);
+    return true;
+}
+
+std::vector<std::map<std::string, std::string>> MemoryStorage::getAllSweets(bool* ok) {
+    if (ok) *ok = true;
+    std::vector<SweetRecord> all;
+    for (auto& stripe : sweets_) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        for (const auto& kv : stripe.rows) all.push_back(kv.second);
+    }
+    std::sort(all.begin(), all.end(),
+              [](const SweetRecord& a, const SweetRecord& b) { return a.id < b.id; });
+    std::vector<std::map<std::string, std::string>> out;
+    out.reserve(all.size());
+    for (const auto& s : all) out.push_back(sweetRow(s));
+    return out;
+}
+
+std::map<std::string, std::string> MemoryStorage::getSweetById(int id) {
+    auto& stripe = sweetStripe(id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.rows.find(id);
+    if (it == stripe.rows.end()) return {};
+    return sweetRow(it->second);
+}
+
+bool MemoryStorage::updateSweet(int id,
+                                const std::string& name,
+                                const std::string& description,
+                                const std::string& category,
+                                double price,
+                                int quantity) {
+    auto& stripe = sweetStripe(id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.rows.find(id);
+    if (it == stripe.rows.end()) return true; // UPDATE matching no rows
+    SweetRecord& s = it->second;
+    s.name = name;
+    s.description = description;
+    s.category = category;
+    s.price = roundCents(price);
+    s.quantity = quantity;
+    s.updatedAt = now();
+    return true;
+}
+
+bool MemoryStorage::deleteSweet(int id) {
+    auto& stripe = sweetStripe(id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.rows.find(id);
+    if (it == stripe.rows.end()) return true;
+    if (it->second.purchases > 0) return false; // purchases.sweet_id ON DELETE RESTRICT
+    stripe.rows.erase(it);
+    return true;
+}
+
+bool MemoryStorage::purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                                  std::map<std::string, std::string>* outPurchase,
+                                  const std::string& idempotencyKey) {
+    outTotal = 0.0;
+    if (userId <= 0 || userId >= nextUserId_) return false; // users FK; ids are never reused
+
+    // Lock order: sweet stripe -> keys -> history stripe -> purchase index stripe
+    auto& stripe = sweetStripe(sweetId);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    // A keyed purchase holds the key table throughout, so the key is
+    // checked and recorded atomically with the purchase
+    std::unique_lock<std::mutex> keysLock(keysMutex_, std::defer_lock);
+    if (!idempotencyKey.empty()) {
+        keysLock.lock();
+        if (keys_.count(idempotencyKey)) return false;
+    }
+    auto it = stripe.rows.find(sweetId);
+    if (it == stripe.rows.end()) return false;
+    SweetRecord& sweet = it->second;
+    if (sweet.quantity < quantity) return false;
+
+    PurchaseRecord p;
+    p.id = nextPurchaseId_++;
+    p.userId = userId;
+    p.sweetId = sweetId;
+    p.sweetName = sweet.name;
+    p.quantity = quantity;
+    p.totalPrice = roundCents(sweet.price * quantity);
+    p.purchaseDate = now();
+
+    sweet.quantity -= quantity;
+    ++sweet.purchases;
+    {
+        auto& history = historyStripe(userId);
+        std::lock_guard<std::mutex> historyLock(history.mutex);
+        history.rows[userId].emplace(std::make_pair(p.purchaseDate, p.id), p);
+    }
+    {
+        auto& index = purchaseIndexStripe(p.id);
+        std::lock_guard<std::mutex> indexLock(index.mutex);
+        index.rows.emplace(p.id, std::make_pair(userId, p.purchaseDate));
+    }
+    if (!idempotencyKey.empty()) {
+        recordKey(idempotencyKey, {"purchase", sweetId, quantity, p.id, p.purchaseDate});
+    }
+
+    outTotal = p.totalPrice;
+    if (outPurchase) *outPurchase = purchaseRow(p);
+    return true;
+}
+
+bool MemoryStorage::restockSweet(int sweetId, int quantity, const std::string& idempotencyKey) {
+    auto& stripe = sweetStripe(sweetId);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    std::unique_lock<std::mutex> keysLock(keysMutex_, std::defer_lock);
+    if (!idempotencyKey.empty()) {
+        keysLock.lock();
+        if (keys_.count(idempotencyKey)) return false;
+        recordKey(idempotencyKey, {"restock", sweetId, quantity, 0, now()});
+    }
+    auto it = stripe.rows.find(sweetId);
+    if (it == stripe.rows.end()) return true;
+    it->second.quantity += quantity;
+    it->second.updatedAt = now();
+    return true;
+}
+
+void MemoryStorage::recordKey(const std::string& key, KeyRecord record) {
+    std::string cutoff = rowformat::timestamp(std::time(nullptr) - kIdempotencyKeySeconds);
+    while (!keyOrder_.empty() && keyOrder_.front().first < cutoff) {
+        auto old = keys_.find(keyOrder_.front().second);
+        if (old != keys_.end() && old->second.createdAt == keyOrder_.front().first) keys_.erase(old);
+        keyOrder_.pop_front();
+    }
+    keyOrder_.emplace_back(record.createdAt, key);
+    keys_[key] = std::move(record);
+}
+
+std::map<std::string, std::string> MemoryStorage::getIdempotencyKey(const std::string& key) {
+    KeyRecord k;
+    {
+        std::lock_guard<std::mutex> lock(keysMutex_);
+        auto it = keys_.find(key);
+        if (it == keys_.end()) return {};
+        k = it->second;
+    }
+    std::map<std::string, std::string> row;
+    if (k.purchaseId) row = getPurchaseById(k.purchaseId);
+    row["idem_key"] = key;
+    row["operation"] = k.operation;
+    row["sweet_id"] = std::to_string(k.sweetId);
+    row["quantity"] = std::to_string(k.quantity);
+    row["created_at"] = k.createdAt;
+    return row;
+}
+
+std::vector<std::map<std::string, std::string>>
+MemoryStorage::getPurchasesByUser(int userId,
+                                  const std::string& beforeDate,
+                                  int beforeId,
+                                  int limit,
+                                  bool* ok) {
+    std::vector<std::map<std::string, std::string>> out;
+    if (ok) *ok = true;
+    auto& stripe = historyStripe(userId);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto hit = stripe.rows.find(userId);
+    if (hit == stripe.rows.end()) return out;
+    const History& history = hit->second;
+    auto end = beforeDate.empty() ? history.end()
+                                  : history.lower_bound(std::make_pair(beforeDate, beforeId));
+    for (auto it = std::make_reverse_iterator(end);
+         it != history.rend() && static_cast<int>(out.size()) < limit; ++it) {
+        out.push_back(purchaseRow(it->second));
+    }
+    return out;
+}
+
+std::map<std::string, std::string> MemoryStorage::getPurchaseById(int id) {
+    std::pair<int, std::string> key;
+    {
+        auto& index = purchaseIndexStripe(id);
+        std::lock_guard<std::mutex> lock(index.mutex);
+        auto it = index.rows.find(id);
+        if (it == index.rows.end()) return {};
+        key = it->second;
+    }
+    auto& stripe = historyStripe(key.first);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto hit = stripe.rows.find(key.first);
+    if (hit == stripe.rows.end()) return {};
+    auto it = hit->second.find(std::make_pair(key.second, id));
+    if (it == hit->second.end()) return {};
+    return purchaseRow(it->second);
+}
+
+std::map<std::string, std::string> MemoryStorage::getSalesTotals() {
+    long long orders = 0, units = 0;
+    double revenue = 0.0;
+    for (auto& stripe : histories_) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        for (const auto& user : stripe.rows) {
+            for (const auto& kv : user.second) {
+                ++orders;
+                units += kv.second.quantity;
+                revenue += kv.second.totalPrice;
+            }
+        }
+    }
+    std::size_t users = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(usersMutex_);
+        users = users_.size();
+    }
+    return {
+        {"user_count", std::to_string(users)},
+        {"order_count", std::to_string(orders)},
+        {"units_sold", std::to_string(units)},
+        {"revenue", money(revenue)},
+    };
+}
+
+std::vector<std::map<std::string, std::string>> MemoryStorage::getRevenueByCategory(bool* ok) {
+    if (ok) *ok = true;
+    struct Totals {
+        long long units{0};
+        double revenue{0.0};
+    };
+    std::unordered_map<int, Totals> bySweet;
+    for (auto& stripe : histories_) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        for (const auto& user : stripe.rows) {
+            for (const auto& kv : user.second) {
+                Totals& t = bySweet[kv.second.sweetId];
+                t.units += kv.second.quantity;
+                t.revenue += kv.second.totalPrice;
+            }
+        }
+    }
+    std::map<std::string, Totals> byCategory;
+    for (const auto& kv : bySweet) {
+        auto& stripe = sweetStripe(kv.first);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.rows.find(kv.first);
+        if (it == stripe.rows.end()) continue;
+        Totals& t = byCategory[it->second.category];
+        t.units += kv.second.units;
+        t.revenue += kv.second.revenue;
+    }
+    std::vector<std::map<std::string, std::string>> out;
+    for (const auto& kv : byCategory) {
+        out.push_back({
+            {"category", kv.first},
+            {"revenue", money(kv.second.revenue)},
+            {"units_sold", std::to_string(kv.second.units)},
+        });
+    }
+    return out;
+}
+
+long long MemoryStorage::getMaxPurchaseId() {
+    return nextPurchaseId_ - 1;
+}
+
+std::vector<std::map<std::string, std::string>>
+MemoryStorage::getHourlySales(long long maxPurchaseId) {
+    struct Totals {
+        long long orders{0};
+        long long units{0};
+        double revenue{0.0};
+    };
+    std::map<std::pair<std::string, int>, Totals> groups;
+    for (auto& stripe : histories_) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        for (const auto& user : stripe.rows) {
+            for (const auto& kv : user.second) {
+                const PurchaseRecord& p = kv.second;
+                if (p.id > maxPurchaseId) continue;
+                std::string hour = p.purchaseDate.substr(0, 13) + ":00:00";
+                Totals& t = groups[std::make_pair(hour, p.sweetId)];
+                ++t.orders;
+                t.units += p.quantity;
+                t.revenue += p.totalPrice;
+            }
+        }
+    }
+    std::vector<std::map<std::string, std::string>> out;
+    for (const auto& kv : groups) {
+        std::string category;
+        {
+            auto& stripe = sweetStripe(kv.first.second);
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            auto it = stripe.rows.find(kv.first.second);
+            if (it != stripe.rows.end()) category = it->second.category;
+        }
+        out.push_back({
+            {"hour", kv.first.first},
+            {"sweet_id", std::to_string(kv.first.second)},
+            {"category", category},
+            {"orders", std::to_string(kv.second.orders)},
+            {"units", std::to_string(kv.second.units)},
+            {"revenue", money(kv.second.revenue)},
+        });
+    }
+    return out;
+}
+
+bool MemoryStorage::logAudit(int userId,
+                             const std::string& action,
+                             const std::string& targetType,
+                             int targetId,
+                             const std::string& details) {
+    AuditRecord a;
+    a.id = nextAuditId_++;
+    a.userId = userId;
+    a.action = action;
+    a.targetType = targetType;
+    a.targetId = targetId;
+    a.details = details;
+    a.createdAt = now();
+    std::lock_guard<std::mutex> lock(auditMutex_);
+    audit_.push_back(std::move(a));
+    return true;
+}
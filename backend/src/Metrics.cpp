@@ -0,0 +1,205 @@
+#include "Metrics.h"
+
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace metrics {
+
+int Histogram::bucketFor(std::uint64_t nanos) {
+    if (nanos < static_cast<std::uint64_t>(kSubBuckets)) return static_cast<int>(nanos);
+    int exponent = 63;
+    while (!(nanos >> exponent)) --exponent;
+    if (exponent > kMaxExponent) return kBuckets - 1;
+    int sub = static_cast<int>((nanos >> (exponent - kSubBits)) & (kSubBuckets - 1));
+    return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+std::uint64_t Histogram::bucketUpperBound(int bucket) {
+    if (bucket < kSubBuckets) return static_cast<std::uint64_t>(bucket) + 1;
+    int exponent = bucket / kSubBuckets + kSubBits - 1;
+    std::uint64_t sub = static_cast<std::uint64_t>(bucket % kSubBuckets);
+    return (1ULL << exponent) + ((sub + 1) << (exponent - kSubBits));
+}
+
+std::size_t Histogram::shardIndex() {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return index;
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    snap.counts.assign(kBuckets, 0);
+    for (const Shard& s : shards_) {
+        for (int i = 0; i < kBuckets; ++i) {
+            std::uint64_t c = s.counts[i].load(std::memory_order_relaxed);
+            snap.counts[i] += c;
+            snap.count += c;
+        }
+        snap.sumNanos += s.sumNanos.load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+std::uint64_t Histogram::Snapshot::percentile(double q) const {
+    if (count == 0) return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(count));
+    if (rank >= count) rank = count - 1;
+    std::uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen > rank) return bucketUpperBound(i);
+    }
+    return bucketUpperBound(kBuckets - 1);
+}
+
+void Histogram::Snapshot::merge(const Snapshot& other) {
+    if (counts.empty()) counts.assign(kBuckets, 0);
+    for (std::size_t i = 0; i < other.counts.size() && i < counts.size(); ++i) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sumNanos += other.sumNanos;
+}
+
+namespace {
+
+enum class Kind { Histogram, Counter, Gauge };
+
+struct Family {
+    Kind kind;
+    std::string help;
+    // Ordered by label string so the exposition is stable between scrapes
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, Family> families;
+};
+
+Registry& registry() {
+    static Registry* r = new Registry(); // never destroyed; series outlive statics
+    return *r;
+}
+
+Family& family(Registry& r, const std::string& name, Kind kind, const std::string& help) {
+    auto it = r.families.find(name);
+    if (it == r.families.end()) {
+        it = r.families.emplace(name, Family{kind, help, {}, {}, {}}).first;
+    } else if (it->second.help.empty()) {
+        it->second.help = help;
+    }
+    return it->second;
+}
+
+template <typename T>
+T& series(std::map<std::string, std::unique_ptr<T>>& m, const std::string& labels) {
+    auto& slot = m[labels];
+    if (!slot) slot.reset(new T());
+    return *slot;
+}
+
+std::string withLabels(const std::string& name, const std::string& labels,
+                       const std::string& extra = "") {
+    std::string all = labels;
+    if (!extra.empty()) all += (all.empty() ? "" : ",") + extra;
+    return all.empty() ? name : name + "{" + all + "}";
+}
+
+} // namespace
+
+Histogram& histogram(const std::string& name, const std::string& labels,
+                     const std::string& help) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return series(family(r, name, Kind::Histogram, help).histograms, labels);
+}
+
+Counter& counter(const std::string& name, const std::string& labels,
+                 const std::string& help) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return series(family(r, name, Kind::Counter, help).counters, labels);
+}
+
+Gauge& gauge(const std::string& name, const std::string& labels,
+             const std::string& help) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return series(family(r, name, Kind::Gauge, help).gauges, labels);
+}
+
+std::string escapeLabel(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string renderPrometheus() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::ostringstream out;
+    out << std::setprecision(9);
+    for (const auto& kv : r.families) {
+        const std::string& name = kv.first;
+        const Family& f = kv.second;
+        if (!f.help.empty()) out << "# HELP " << name << " " << f.help << "\n";
+        switch (f.kind) {
+        case Kind::Counter:
+            out << "# TYPE " << name << " counter\n";
+            for (const auto& s : f.counters) {
+                out << withLabels(name, s.first) << " " << s.second->value() << "\n";
+            }
+            break;
+        case Kind::Gauge:
+            out << "# TYPE " << name << " gauge\n";
+            for (const auto& s : f.gauges) {
+                out << withLabels(name, s.first) << " " << s.second->value() << "\n";
+            }
+            break;
+        case Kind::Histogram:
+            out << "# TYPE " << name << " histogram\n";
+            for (const auto& s : f.histograms) {
+                Histogram::Snapshot snap = s.second->snapshot();
+                // Export at power-of-two boundaries from ~1us to ~69s; they
+                // coincide with internal bucket edges so counts are exact.
+                std::uint64_t cumulative = 0;
+                int bucket = 0;
+                for (int e = 10; e <= 36; ++e) {
+                    std::uint64_t bound = 1ULL << e;
+                    while (bucket < Histogram::kBuckets &&
+                           Histogram::bucketUpperBound(bucket) <= bound) {
+                        cumulative += snap.counts[bucket++];
+                    }
+                    std::ostringstream le;
+                    le << "le=\"" << std::setprecision(9) << static_cast<double>(bound) / 1e9 << "\"";
+                    out << withLabels(name + "_bucket", s.first, le.str()) << " " << cumulative << "\n";
+                }
+                out << withLabels(name + "_bucket", s.first, "le=\"+Inf\"") << " " << snap.count << "\n";
+                out << withLabels(name + "_sum", s.first) << " "
+                    << static_cast<double>(snap.sumNanos) / 1e9 << "\n";
+                out << withLabels(name + "_count", s.first) << " " << snap.count << "\n";
+            }
+            break;
+        }
+    }
+    return out.str();
+}
+
+} // namespace metrics
@@ -0,0 +1,88 @@
+#include "PurchaseCache.h"
+
+#include <algorithm>
+
+RecentPurchaseCache::RecentPurchaseCache(std::size_t perUser,
+                                         std::size_t maxUsers,
+                                         std::chrono::milliseconds ttl)
+    : perUser_(perUser), maxUsers_(maxUsers), ttl_(ttl) {}
+
+RecentPurchaseCache::Entry& RecentPurchaseCache::touch(int userId) {
+    auto it = entries_.find(userId);
+    if (it != entries_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second;
+    }
+    if (entries_.size() >= maxUsers_ && !lru_.empty()) {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(userId);
+    Entry& entry = entries_[userId];
+    entry.lru = lru_.begin();
+    return entry;
+}
+
+void RecentPurchaseCache::trim(Entry& entry) {
+    if (entry.rows.size() > perUser_) {
+        entry.rows.resize(perUser_);
+        entry.complete = false;
+    }
+}
+
+bool RecentPurchaseCache::getFirstPage(int userId, int limit, std::vector<Purchase>& out) {
+    if (limit <= 0) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(userId);
+    if (it == entries_.end() || !it->second.seeded) return false;
+    Entry& entry = it->second;
+    if (std::chrono::steady_clock::now() - entry.seededAt > ttl_) {
+        // Reseed from the database; rows appended meanwhile are merged in
+        entry.seeded = false;
+        return false;
+    }
+    std::size_t want = static_cast<std::size_t>(limit);
+    if (entry.rows.size() < want && !entry.complete) return false;
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    std::size_t n = std::min(want, entry.rows.size());
+    out.assign(entry.rows.begin(), entry.rows.begin() + n);
+    return true;
+}
+
+void RecentPurchaseCache::fill(int userId, const std::vector<Purchase>& newestFirst, bool complete) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = touch(userId);
+    if (entry.seeded) return;
+    // Purchases appended while the page was being read may or may not be
+    // in it; merge by id so neither copy is lost nor duplicated.
+    std::deque<Purchase> merged(newestFirst.begin(), newestFirst.end());
+    for (const auto& p : entry.rows) {
+        bool seen = std::any_of(merged.begin(), merged.end(),
+                                [&](const Purchase& m) { return m.id == p.id; });
+        if (!seen) merged.push_back(p);
+    }
+    std::sort(merged.begin(), merged.end(), [](const Purchase& a, const Purchase& b) {
+        if (a.purchaseDate != b.purchaseDate) return a.purchaseDate > b.purchaseDate;
+        return a.id > b.id;
+    });
+    entry.rows = std::move(merged);
+    entry.seeded = true;
+    entry.seededAt = std::chrono::steady_clock::now();
+    entry.complete = complete;
+    trim(entry);
+}
+
+void RecentPurchaseCache::append(const Purchase& purchase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = touch(purchase.userId);
+    entry.rows.push_front(purchase);
+    trim(entry);
+}
+
+void RecentPurchaseCache::invalidate(int userId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(userId);
+    if (it == entries_.end()) return;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
@@ -0,0 +1,219 @@
+#include "QueryLog.h"
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <mutex>
+#include <unordered_map>
+
+namespace querylog {
+
+namespace {
+
+// Longer shapes are cut off with " ..."
+const std::size_t kMaxShapeLength = 1024;
+const int kMaxDepth = 32;
+const char* const kOther = "(other)";
+
+bool identChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || c == '@';
+}
+
+bool endsWith(const std::string& s, const char* suffix, std::size_t length) {
+    return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+}
+
+// A group holding only placeholders, e.g. "(?,?,NULL)", becomes "(...)",
+// and a repeat of one right after another is dropped, so IN lists and
+// multi-row VALUES have one shape whatever their length
+void collapseList(std::string& out, std::size_t open) {
+    bool values = false;
+    for (std::size_t i = open + 1; i + 1 < out.size(); ++i) {
+        char c = out[i];
+        if (c == '?') {
+            values = true;
+        } else if (out.compare(i, 4, "NULL") == 0) {
+            values = true;
+            i += 3;
+        } else if (c != ',' && c != ' ') {
+            return;
+        }
+    }
+    if (!values) return;
+    out.resize(open);
+    out += "(...)";
+    if (endsWith(out, "(...),(...)", 11)) {
+        out.resize(out.size() - 6);
+    } else if (endsWith(out, "(...), (...)", 12)) {
+        out.resize(out.size() - 7);
+    }
+}
+
+// Likewise for the branches of a CASE over literals
+void collapseCase(std::string& out) {
+    if (endsWith(out, " WHEN ? THEN ? WHEN ? THEN ?", 28)) out.resize(out.size() - 14);
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::unordered_map<std::string, ShapeStats> shapes;
+    std::vector<SlowQuery> slow; // ring once full
+    std::size_t next{0};
+};
+
+Registry& registry() {
+    static Registry* r = new Registry(); // never destroyed, like the metrics
+    return *r;
+}
+
+std::atomic<std::int64_t> thresholdNanos{100 * 1000 * 1000};
+
+} // namespace
+
+void shape(const char* sql, std::size_t length, std::string& out) {
+    out.clear();
+    std::size_t opens[kMaxDepth];
+    int depth = 0;
+    bool space = false;
+    std::size_t i = 0;
+    while (i < length) {
+        if (out.size() >= kMaxShapeLength) {
+            out += " ...";
+            return;
+        }
+        char c = sql[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            space = true;
+            ++i;
+            continue;
+        }
+        if (space && !out.empty() && out.back() != '(') out += ' ';
+        space = false;
+
+        if (c == '\'' || c == '"') {
+            // Backslash escapes and doubled quotes stay inside the literal
+            for (++i; i < length; ++i) {
+                if (sql[i] == '\\') {
+                    ++i;
+                } else if (sql[i] == c) {
+                    if (i + 1 < length && sql[i + 1] == c) {
+                        ++i;
+                    } else {
+                        ++i;
+                        break;
+                    }
+                }
+            }
+            out += '?';
+            collapseCase(out);
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            while (i < length && (identChar(sql[i]) || sql[i] == '.')) ++i;
+            out += '?';
+            collapseCase(out);
+        } else if (identChar(c)) {
+            while (i < length && identChar(sql[i])) out += sql[i++];
+        } else if (c == '(') {
+            if (depth < kMaxDepth) opens[depth] = out.size();
+            ++depth;
+            out += c;
+            ++i;
+        } else if (c == ')') {
+            out += c;
+            ++i;
+            if (depth > 0 && --depth < kMaxDepth) collapseList(out, opens[depth]);
+        } else {
+            out += c;
+            ++i;
+        }
+    }
+}
+
+void record(const std::string& shape, const std::string& server,
+            std::uint64_t nanos, std::uint64_t rows, const char* error) {
+    bool failed = error && *error;
+    bool slow = static_cast<std::int64_t>(nanos) >= thresholdNanos.load(std::memory_order_relaxed);
+    SlowQuery entry;
+    if (slow) {
+        static metrics::Counter& slowTotal = metrics::counter(
+            "sweet_shop_db_slow_queries_total", "",
+            "Statements at or above the slow query threshold");
+        slowTotal.inc();
+        entry.shape = shape;
+        entry.server = server;
+        entry.at = std::chrono::system_clock::now();
+        entry.nanos = nanos;
+        entry.rows = rows;
+        if (failed) entry.error = error;
+    }
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto it = r.shapes.find(shape);
+    if (it == r.shapes.end()) {
+        const std::string key = r.shapes.size() < kMaxShapes ? shape : kOther;
+        it = r.shapes.find(key);
+        if (it == r.shapes.end()) {
+            it = r.shapes.emplace(key, ShapeStats()).first;
+            it->second.shape = key;
+        }
+    }
+    ShapeStats& stats = it->second;
+    ++stats.calls;
+    if (failed) ++stats.errors;
+    stats.rows += rows;
+    stats.totalNanos += nanos;
+    stats.maxNanos = std::max(stats.maxNanos, nanos);
+    if (!slow) return;
+    ++stats.slow;
+    if (r.slow.size() < kSlowEntries) {
+        r.slow.push_back(std::move(entry));
+    } else {
+        r.slow[r.next] = std::move(entry);
+    }
+    r.next = (r.next + 1) % kSlowEntries;
+}
+
+void setThreshold(std::chrono::nanoseconds threshold) {
+    thresholdNanos.store(static_cast<std::int64_t>(threshold.count()), std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds threshold() {
+    return std::chrono::nanoseconds(thresholdNanos.load(std::memory_order_relaxed));
+}
+
+std::vector<ShapeStats> shapes() {
+    std::vector<ShapeStats> out;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        out.reserve(r.shapes.size());
+        for (const auto& entry : r.shapes) out.push_back(entry.second);
+    }
+    std::sort(out.begin(), out.end(), [](const ShapeStats& a, const ShapeStats& b) {
+        return a.totalNanos > b.totalNanos;
+    });
+    return out;
+}
+
+std::vector<SlowQuery> slowQueries() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::vector<SlowQuery> out;
+    out.reserve(r.slow.size());
+    for (std::size_t k = 1; k <= r.slow.size(); ++k) {
+        out.push_back(r.slow[(r.next + kSlowEntries - k) % kSlowEntries]);
+    }
+    return out;
+}
+
+void reset() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.shapes.clear();
+    r.slow.clear();
+    r.next = 0;
+}
+
+} // namespace querylog
@@ -0,0 +1,256 @@
+#include "ReplicaSet.h"
+#include "QueryLog.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+ReplicaSet::ReplicaSet(const std::string& user,
+                       const std::string& password,
+                       const std::string& dbName,
+                       Options options)
+    : user_(user),
+      password_(password),
+      database_(dbName),
+      options_(options) {}
+
+ReplicaSet::~ReplicaSet() {
+    stop();
+}
+
+void ReplicaSet::add(const std::string& host, unsigned int port) {
+    std::unique_ptr<Replica> r(new Replica());
+    r->host = host;
+    r->port = port;
+    r->endpoint = host + ":" + std::to_string(port);
+    replicas_.push_back(std::move(r));
+}
+
+bool ReplicaSet::parseEndpoints(const std::string& text,
+                                std::vector<std::pair<std::string, unsigned int>>& out) {
+    out.clear();
+    std::size_t pos = 0;
+    while (pos <= text.size()) {
+        std::size_t comma = text.find(',', pos);
+        if (comma == std::string::npos) comma = text.size();
+        std::string item = text.substr(pos, comma - pos);
+        pos = comma + 1;
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.empty()) continue;
+        std::size_t colon = item.rfind(':');
+        unsigned long port = 3306;
+        if (colon != std::string::npos) {
+            std::string digits = item.substr(colon + 1);
+            if (digits.empty() || digits.size() > 5 ||
+                digits.find_first_not_of("0123456789") != std::string::npos) {
+                return false;
+            }
+            port = std::stoul(digits);
+            item.erase(colon);
+        }
+        if (item.empty() || port == 0 || port > 65535) return false;
+        out.emplace_back(item, static_cast<unsigned int>(port));
+    }
+    return !out.empty();
+}
+
+bool ReplicaSet::start() {
+    if (replicas_.empty()) return false;
+    for (auto& r : replicas_) {
+        std::string labels = "replica=\"" + metrics::escapeLabel(r->endpoint) + "\"";
+        r->lagGauge = &metrics::gauge("sweet_shop_db_replica_lag_seconds", labels,
+                                      "Seconds_Behind_Source of each read replica; -1 when not replicating");
+        r->healthyGauge = &metrics::gauge("sweet_shop_db_replica_healthy", labels,
+                                          "1 while a read replica is taking reads");
+        if (options_.asyncConnections > 0) {
+            r->async.reset(new AsyncMySQL(r->host, user_, password_, database_, r->port,
+                                          options_.asyncConnections));
+            if (!r->async->start()) r->async.reset();
+        }
+        // Checked once up front so reads can use the replica straight away
+        check(*r);
+    }
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stopping_ = false;
+    }
+    monitor_ = std::thread([this] { monitorLoop(); });
+    return true;
+}
+
+void ReplicaSet::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stopping_ = true;
+    }
+    stopWake_.notify_all();
+    if (monitor_.joinable()) monitor_.join();
+    for (auto& r : replicas_) {
+        r->healthy = false;
+        if (r->async) r->async->stop();
+        std::lock_guard<std::mutex> lock(r->mutex);
+        if (r->conn) mysql_close(r->conn);
+        r->conn = nullptr;
+        if (r->monitor) mysql_close(r->monitor);
+        r->monitor = nullptr;
+    }
+}
+
+MYSQL* ReplicaSet::open(const Replica& replica, std::string& error) const {
+    MYSQL* conn = mysql_init(nullptr);
+    if (!conn) {
+        error = "mysql_init failed";
+        return nullptr;
+    }
+    // A dead replica must not hold up the monitor or a read for long
+    unsigned int timeout = 2;
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    if (!mysql_real_connect(conn, replica.host.c_str(), user_.c_str(), password_.c_str(),
+                            database_.c_str(), replica.port, nullptr, 0)) {
+        error = mysql_error(conn);
+        mysql_close(conn);
+        return nullptr;
+    }
+    return conn;
+}
+
+ReplicaSet::Replica* ReplicaSet::pick() {
+    std::size_t n = replicas_.size();
+    std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < n; ++i) {
+        Replica* r = replicas_[(start + i) % n].get();
+        if (r->healthy.load(std::memory_order_relaxed)) return r;
+    }
+    return nullptr;
+}
+
+bool ReplicaSet::query(const std::string& sql, std::vector<std::map<std::string, std::string>>& rows) {
+    Replica* r = pick();
+    if (!r) return false;
+    std::lock_guard<std::mutex> lock(r->mutex);
+    std::string error;
+    if (!r->conn) r->conn = open(*r, error);
+    if (!r->conn) {
+        r->healthy = false;
+        return false;
+    }
+    // Timed and counted like Database::execute, under the replica's endpoint
+    auto start = std::chrono::steady_clock::now();
+    int rc = mysql_query(r->conn, sql.c_str());
+    MYSQL_RES* res = rc == 0 ? mysql_store_result(r->conn) : nullptr;
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    querylog::shape(sql.data(), sql.size(), r->shape);
+    querylog::record(r->shape, r->endpoint, static_cast<std::uint64_t>(nanos.count()),
+                     res ? mysql_num_rows(res) : 0, res ? nullptr : mysql_error(r->conn));
+    if (rc != 0) {
+        static metrics::Counter& errors = metrics::counter(
+            "sweet_shop_db_errors_total", "", "Failed mysql_query calls");
+        errors.inc();
+        mysql_close(r->conn);
+        r->conn = nullptr;
+        // Out of rotation until the monitor sees it well again
+        r->healthy = false;
+        return false;
+    }
+    if (!res) return false;
+    MYSQL_FIELD* fields = mysql_fetch_fields(res);
+    unsigned int numFields = mysql_num_fields(res);
+    rows.clear();
+    while (MYSQL_ROW row = mysql_fetch_row(res)) {
+        std::map<std::string, std::string> rowmap;
+        for (unsigned int i = 0; i < numFields; ++i) {
+            rowmap[fields[i].name] = row[i] ? row[i] : "";
+        }
+        rows.push_back(std::move(rowmap));
+    }
+    mysql_free_result(res);
+    return true;
+}
+
+AsyncMySQL* ReplicaSet::asyncPool() {
+    Replica* r = pick();
+    return r ? r->async.get() : nullptr;
+}
+
+void ReplicaSet::check(Replica& r) {
+    std::string error;
+    long long lag = -1;
+    bool healthy = false;
+    if (!r.monitor) r.monitor = open(r, error);
+    if (r.monitor) {
+        // MySQL 8.0.22 renamed the statement and its columns
+        const char* lagColumn = "Seconds_Behind_Source";
+        const char* ioColumn = "Replica_IO_Running";
+        const char* sqlColumn = "Replica_SQL_Running";
+        bool ran = mysql_query(r.monitor, "SHOW REPLICA STATUS") == 0;
+        if (!ran && mysql_query(r.monitor, "SHOW SLAVE STATUS") == 0) {
+            ran = true;
+            lagColumn = "Seconds_Behind_Master";
+            ioColumn = "Slave_IO_Running";
+            sqlColumn = "Slave_SQL_Running";
+        }
+        MYSQL_RES* res = ran ? mysql_store_result(r.monitor) : nullptr;
+        MYSQL_ROW row = res ? mysql_fetch_row(res) : nullptr;
+        if (!ran) {
+            error = mysql_error(r.monitor);
+            mysql_close(r.monitor);
+            r.monitor = nullptr;
+        } else if (!row) {
+            error = "not a replica";
+        } else {
+            MYSQL_FIELD* fields = mysql_fetch_fields(res);
+            unsigned int numFields = mysql_num_fields(res);
+            const char* lagValue = nullptr;
+            bool io = false, sql = false;
+            for (unsigned int i = 0; i < numFields; ++i) {
+                if (std::strcmp(fields[i].name, lagColumn) == 0) lagValue = row[i];
+                if (std::strcmp(fields[i].name, ioColumn) == 0) io = row[i] && std::strcmp(row[i], "Yes") == 0;
+                if (std::strcmp(fields[i].name, sqlColumn) == 0) sql = row[i] && std::strcmp(row[i], "Yes") == 0;
+            }
+            if (!io || !sql || !lagValue) {
+                error = "replication is not running";
+            } else {
+                lag = std::atoll(lagValue);
+                healthy = lag <= options_.maxLag.count();
+                if (!healthy) error = "lag " + std::to_string(lag) + "s is over the limit";
+            }
+        }
+        if (res) mysql_free_result(res);
+    }
+
+    if (r.healthy.exchange(healthy) != healthy) {
+        std::cerr << "Read replica " << r.endpoint << (healthy ? " is taking reads" : " left rotation: " + error)
+                  << "\n";
+    }
+    r.lag = lag;
+    {
+        std::lock_guard<std::mutex> lock(r.errorMutex);
+        r.error = error;
+    }
+    if (r.lagGauge) r.lagGauge->set(lag);
+    if (r.healthyGauge) r.healthyGauge->set(healthy ? 1 : 0);
+}
+
+void ReplicaSet::monitorLoop() {
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    while (!stopWake_.wait_for(lock, options_.checkEvery, [this] { return stopping_; })) {
+        lock.unlock();
+        for (auto& r : replicas_) check(*r);
+        lock.lock();
+    }
+}
+
+std::vector<ReplicaSet::Status> ReplicaSet::status() const {
+    std::vector<Status> out;
+    for (const auto& r : replicas_) {
+        Status s;
+        s.endpoint = r->endpoint;
+        s.healthy = r->healthy;
+        s.lagSeconds = r->lag;
+        std::lock_guard<std::mutex> lock(r->errorMutex);
+        s.error = r->error;
+        out.push_back(std::move(s));
+    }
+    return out;
+}
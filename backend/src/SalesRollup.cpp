@@ -0,0 +1,181 @@
+#include "SalesRollup.h"
+#include "Storage.h"
+#include "Sweet.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant)
+long long daysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const long long era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<long long>(doe) - 719468;
+}
+
+void civilFromDays(long long z, int& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const long long era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int>(yoe + era * 400) + (m <= 2);
+}
+
+// "YYYY-MM-DD" or "YYYY-MM-DD HH:MM:SS" -> hours since epoch
+bool parseHour(const std::string& text, long long& outHour) {
+    int y = 0, h = 0;
+    unsigned m = 0, d = 0;
+    int n = std::sscanf(text.c_str(), "%d-%u-%u %d", &y, &m, &d, &h);
+    if (n < 3 || m < 1 || m > 12 || d < 1 || d > 31 || h < 0 || h > 23) return false;
+    outHour = daysFromCivil(y, m, d) * 24 + (n == 4 ? h : 0);
+    return true;
+}
+
+std::string formatDay(long long day) {
+    int y;
+    unsigned m, d;
+    civilFromDays(day, y, m, d);
+    std::ostringstream ss;
+    ss << std::setfill('0') << std::setw(4) << y << "-" << std::setw(2) << m
+       << "-" << std::setw(2) << d;
+    return ss.str();
+}
+
+std::string formatHour(long long hour) {
+    long long day = hour >= 0 ? hour / 24 : (hour - 23) / 24;
+    std::ostringstream ss;
+    ss << formatDay(day) << " " << std::setfill('0') << std::setw(2)
+       << (hour - day * 24) << ":00";
+    return ss.str();
+}
+
+} // namespace
+
+SalesRollup::SalesRollup(int hourlyRetentionDays)
+    : hourlyRetentionDays_(hourlyRetentionDays) {}
+
+void SalesRollup::apply(long long hour, int sweetId, const std::string& category,
+                        const SalesBucket& sale) {
+    long long day = hour >= 0 ? hour / 24 : (hour - 23) / 24;
+    for (Slice* slice : {&hourly_[hour], &daily_[day]}) {
+        slice->total.add(sale);
+        slice->bySweet[sweetId].add(sale);
+        slice->byCategory[category].add(sale);
+    }
+}
+
+void SalesRollup::pruneHourly(long long newestHour) {
+    long long cutoff = newestHour - static_cast<long long>(hourlyRetentionDays_) * 24;
+    hourly_.erase(hourly_.begin(), hourly_.lower_bound(cutoff));
+}
+
+bool SalesRollup::backfill(Storage& db) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        backfilling_ = true;
+    }
+    // Purchases committed after this point are buffered, and the query
+    // below is bounded by the same id, so nothing is counted twice.
+    long long watermark = db.getMaxPurchaseId();
+    bool ok = watermark >= 0;
+    auto rows = ok ? db.getHourlySales(watermark)
+                   : std::vector<std::map<std::string, std::string>>{};
+    auto sweets = db.getAllSweets();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& row : sweets) {
+        categories_[std::stoi(row.at("id"))] = row.at("category");
+    }
+    if (ok) {
+        hourly_.clear();
+        daily_.clear();
+        watermark_ = watermark;
+        long long newest = 0;
+        for (auto& row : rows) {
+            long long hour = 0;
+            if (!parseHour(row["hour"], hour)) continue;
+            SalesBucket sale;
+            sale.orders = std::stoll(row["orders"]);
+            sale.units = std::stoll(row["units"]);
+            sale.revenue = std::stod(row["revenue"]);
+            apply(hour, std::stoi(row["sweet_id"]), row["category"], sale);
+            if (hour > newest) newest = hour;
+        }
+        pruneHourly(newest);
+    }
+    backfilling_ = false;
+    std::vector<Purchase> pending;
+    pending.swap(pending_);
+    for (const auto& p : pending) {
+        if (p.id <= watermark_) continue;
+        long long hour = 0;
+        if (!parseHour(p.purchaseDate, hour)) continue;
+        apply(hour, p.sweetId, categories_[p.sweetId],
+              SalesBucket{1, p.quantity, p.totalPrice});
+    }
+    return ok;
+}
+
+bool SalesRollup::report(const std::string& startDate,
+                         const std::string& endDate,
+                         bool hourly,
+                         SalesReport& out) const {
+    long long startHour = 0, endHour = 0;
+    if (!parseHour(startDate, startHour) || !parseHour(endDate, endHour)) return false;
+    if (endHour < startHour) return false;
+    long long startDay = startHour / 24;
+    long long endDay = endHour / 24;
+
+    out = SalesReport{};
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = daily_.lower_bound(startDay);
+         it != daily_.end() && it->first <= endDay; ++it) {
+        const Slice& slice = it->second;
+        out.total.add(slice.total);
+        for (const auto& kv : slice.bySweet) out.bySweet[kv.first].add(kv.second);
+        for (const auto& kv : slice.byCategory) out.byCategory[kv.first].add(kv.second);
+        if (!hourly) out.series[formatDay(it->first)] = slice.total;
+    }
+    if (hourly) {
+        for (auto it = hourly_.lower_bound(startDay * 24);
+             it != hourly_.end() && it->first < (endDay + 1) * 24; ++it) {
+            out.series[formatHour(it->first)] = it->second.total;
+        }
+    }
+    return true;
+}
+
+void SalesRollup::onSweetCreated(const Sweet& sweet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    categories_[sweet.id] = sweet.category;
+}
+
+void SalesRollup::onSweetUpdated(const Sweet& sweet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    categories_[sweet.id] = sweet.category;
+}
+
+void SalesRollup::onPurchase(const Purchase& purchase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (backfilling_) {
+        pending_.push_back(purchase);
+        return;
+    }
+    if (purchase.id <= watermark_) return;
+    long long hour = 0;
+    if (!parseHour(purchase.purchaseDate, hour)) return;
+    apply(hour, purchase.sweetId, categories_[purchase.sweetId],
+          SalesBucket{1, purchase.quantity, purchase.totalPrice});
+    if (!hourly_.empty() && hourly_.begin()->first < hour - hourlyRetentionDays_ * 24LL) {
+        pruneHourly(hour);
+    }
+}
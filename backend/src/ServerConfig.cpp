@@ -0,0 +1,218 @@
+#include "ServerConfig.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+std::string trim(const std::string& s) {
+    std::size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return "";
+    std::size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool parseUnsigned(const std::string& text, unsigned long max, unsigned long& out) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    out = std::strtoul(text.c_str(), nullptr, 10);
+    return out <= max;
+}
+
+// Settings from the file named by SWEET_SHOP_CONFIG, keyed by file name
+bool readFile(const std::string& path, std::map<std::string, std::string>& settings,
+              std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot read " + path;
+        return false;
+    }
+    std::string line;
+    int number = 0;
+    while (std::getline(in, line)) {
+        ++number;
+        std::size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        line = trim(line);
+        if (line.empty()) continue;
+        std::size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            error = path + ":" + std::to_string(number) + ": expected key = value";
+            return false;
+        }
+        settings[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+    return true;
+}
+
+#ifdef __linux__
+// CPU quota of the cgroup (v2, then v1) in whole CPUs; 0 when unlimited
+unsigned int cgroupCpuLimit() {
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    std::string quota;
+    double period = 0;
+    if (v2 >> quota >> period) {
+        if (quota == "max" || period <= 0) return 0;
+        return static_cast<unsigned int>(std::ceil(std::atof(quota.c_str()) / period));
+    }
+    std::ifstream q("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream p("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    long long us = 0;
+    if (q >> us && p >> period && us > 0 && period > 0) {
+        return static_cast<unsigned int>(std::ceil(us / period));
+    }
+    return 0;
+}
+#endif
+
+} // namespace
+
+bool ServerConfig::load(std::string& error) {
+    std::map<std::string, std::string> settings;
+    if (const char* path = std::getenv("SWEET_SHOP_CONFIG")) {
+        if (!readFile(path, settings, error)) return false;
+    }
+    const char* env[][2] = {
+        {"port", "SWEET_SHOP_PORT"},
+        {"bind", "SWEET_SHOP_BIND"},
+        {"threads", "SWEET_SHOP_THREADS"},
+        {"cpu_affinity", "SWEET_SHOP_CPU_AFFINITY"},
+        {"frontend_dir", "SWEET_SHOP_FRONTEND_DIR"},
+        {"cors_origins", "SWEET_SHOP_CORS_ORIGINS"},
+        {"cors_methods", "SWEET_SHOP_CORS_METHODS"},
+        {"cors_headers", "SWEET_SHOP_CORS_HEADERS"},
+        {"cors_max_age", "SWEET_SHOP_CORS_MAX_AGE"},
+    };
+    for (const auto& e : env) {
+        if (const char* value = std::getenv(e[1])) settings[e[0]] = trim(value);
+    }
+
+    for (const auto& kv : settings) {
+        const std::string& key = kv.first;
+        const std::string& value = kv.second;
+        unsigned long n = 0;
+        if (key == "port") {
+            if (!parseUnsigned(value, 65535, n) || n == 0) {
+                error = "invalid port: " + value;
+                return false;
+            }
+            port = static_cast<std::uint16_t>(n);
+        } else if (key == "bind") {
+            if (value.empty()) {
+                error = "empty bind address";
+                return false;
+            }
+            bindAddress = value;
+        } else if (key == "threads") {
+            if (!parseUnsigned(value, 1024, n)) {
+                error = "invalid thread count: " + value;
+                return false;
+            }
+            threads = static_cast<unsigned int>(n);
+        } else if (key == "cpu_affinity") {
+            if (!value.empty() && !parseCpuList(value, cpus)) {
+                error = "invalid cpu_affinity: " + value;
+                return false;
+            }
+        } else if (key == "frontend_dir") {
+            frontendDir = value;
+        } else if (key == "cors_origins") {
+            corsOrigins = value;
+        } else if (key == "cors_methods") {
+            corsMethods = value;
+        } else if (key == "cors_headers") {
+            corsHeaders = value;
+        } else if (key == "cors_max_age") {
+            if (!parseUnsigned(value, 31536000, n)) {
+                error = "invalid cors_max_age: " + value;
+                return false;
+            }
+            corsMaxAge = static_cast<int>(n);
+        } else {
+            error = "unknown setting: " + key;
+            return false;
+        }
+    }
+    if (threads == 0) threads = availableCpus();
+    return true;
+}
+
+unsigned int ServerConfig::availableCpus() {
+    unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+#ifdef __linux__
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        cpus = std::min(cpus, static_cast<unsigned int>(std::max(1, CPU_COUNT(&mask))));
+    }
+    unsigned int quota = cgroupCpuLimit();
+    if (quota > 0) cpus = std::min(cpus, quota);
+#endif
+    return cpus;
+}
+
+bool ServerConfig::parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    std::vector<int> parsed;
+    if (trim(text) == "auto") {
+#ifdef __linux__
+        cpu_set_t mask;
+        if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return false;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &mask)) parsed.push_back(cpu);
+        }
+#else
+        unsigned int n = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int cpu = 0; cpu < n; ++cpu) parsed.push_back(static_cast<int>(cpu));
+#endif
+        cpus.swap(parsed);
+        return true;
+    }
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        item = trim(item);
+        std::size_t dash = item.find('-');
+        unsigned long first = 0, last = 0;
+        if (dash == std::string::npos) {
+            if (!parseUnsigned(item, 4095, first)) return false;
+            last = first;
+        } else if (!parseUnsigned(trim(item.substr(0, dash)), 4095, first) ||
+                   !parseUnsigned(trim(item.substr(dash + 1)), 4095, last) || last < first) {
+            return false;
+        }
+        for (unsigned long cpu = first; cpu <= last; ++cpu) parsed.push_back(static_cast<int>(cpu));
+    }
+    if (parsed.empty()) return false;
+    cpus.swap(parsed);
+    return true;
+}
+
+bool ServerConfig::pinCurrentThread(int cpu) {
+#ifdef _WIN32
+    if (cpu < 0 || cpu >= 64) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,114 @@
+#include "ShardMap.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace {
+
+// FNV-1a with a splitmix64 finish, so short keys that differ in one
+// character still land far apart on the ring
+std::uint64_t ringHash(const std::string& key) {
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+bool parseUnsigned(const std::string& text, unsigned long max, unsigned long& out) {
+    if (text.empty() || text.size() > 10 || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    out = std::stoul(text);
+    return out > 0 && out <= max;
+}
+
+} // namespace
+
+ShardMap::ShardMap(std::vector<Shard> shards) : shards_(std::move(shards)) {
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+        unsigned int points = kPointsPerWeight * shards_[i].weight;
+        for (unsigned int p = 0; p < points; ++p) {
+            ring_.emplace_back(ringHash(shards_[i].name + "#" + std::to_string(p)), i);
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+std::size_t ShardMap::owner(int sweetId) const {
+    if (ring_.empty()) return 0;
+    std::uint64_t h = ringHash(std::to_string(sweetId));
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(h, std::size_t(0)));
+    return it == ring_.end() ? ring_.front().second : it->second;
+}
+
+bool ShardMap::parse(const std::string& text, std::vector<Shard>& out, std::string& error) {
+    out.clear();
+    std::set<std::string> names;
+    std::istringstream lines(text);
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(lines, line)) {
+        ++lineNo;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string name, address, weight, extra;
+        if (!(words >> name)) continue;
+        words >> address >> weight >> extra;
+        std::string where = "line " + std::to_string(lineNo) + ": ";
+        if (address.empty() || !extra.empty()) {
+            error = where + "expected \"name host[:port] [weight]\"";
+            return false;
+        }
+        Shard shard;
+        shard.name = name;
+        shard.host = address;
+        std::size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            unsigned long port = 0;
+            if (!parseUnsigned(address.substr(colon + 1), 65535, port)) {
+                error = where + "bad port in " + address;
+                return false;
+            }
+            shard.port = static_cast<unsigned int>(port);
+            shard.host = address.substr(0, colon);
+        }
+        if (!weight.empty()) {
+            unsigned long w = 0;
+            if (!parseUnsigned(weight, 100, w)) {
+                error = where + "weight must be 1-100";
+                return false;
+            }
+            shard.weight = static_cast<unsigned int>(w);
+        }
+        if (shard.host.empty() || !names.insert(name).second) {
+            error = where + (shard.host.empty() ? "missing host" : "shard " + name + " listed twice");
+            return false;
+        }
+        out.push_back(std::move(shard));
+    }
+    if (out.empty()) {
+        error = "no shards listed";
+        return false;
+    }
+    return true;
+}
+
+bool ShardMap::load(const std::string& path, std::vector<Shard>& out, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot read " + path;
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return parse(text.str(), out, error);
+}
@@ -0,0 +1,717 @@
+#include "ShardedDatabase.h"
+
+#include "Metrics.h"
+#include "RowFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <set>
+#include <tuple>
+#include <utility>
+
+class ShardedDatabase::Pass {
+public:
+    explicit Pass(ShardedDatabase& db) : db_(&db) {}
+    ~Pass() { release(); }
+
+    // Lets a waiting reload go ahead. Async calls release before handing
+    // their result on, in case the callback makes another call.
+    void release() {
+        if (db_) db_->leave();
+        db_ = nullptr;
+    }
+
+private:
+    ShardedDatabase* db_;
+
+    // non-copyable
+    Pass(const Pass&) = delete;
+    Pass& operator=(const Pass&) = delete;
+};
+
+namespace {
+
+using Row = std::map<std::string, std::string>;
+using Rows = std::vector<Row>;
+
+metrics::Gauge& pendingGauge() {
+    static metrics::Gauge& g = metrics::gauge(
+        "sweet_shop_db_shard_pending_moves", "",
+        "Sweets waiting to move to the shard that now owns them");
+    return g;
+}
+
+metrics::Counter& movesCounter() {
+    static metrics::Counter& c = metrics::counter(
+        "sweet_shop_db_shard_moves_total", "", "Sweets moved between shards");
+    return c;
+}
+
+// Shard calls in flight at once from scatter and bulk writes; more wait
+// in the queue, and past that run on the caller's thread
+const std::size_t kPoolThreads = 16;
+const std::size_t kPoolQueue = 1024;
+
+// One async result per shard; the last to arrive calls finish with all,
+// and with ok == false if any shard failed
+template <typename Part>
+class Gather {
+public:
+    using Finish = std::function<void(bool, std::vector<Part>)>;
+
+    Gather(std::size_t n, Finish finish) : parts_(n), left_(n), finish_(std::move(finish)) {}
+
+    void set(std::size_t i, bool ok, Part part) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            parts_[i] = std::move(part);
+            ok_ = ok_ && ok;
+            if (--left_ != 0) return;
+        }
+        finish_(ok_, std::move(parts_));
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Part> parts_;
+    std::size_t left_;
+    bool ok_{true};
+    Finish finish_;
+};
+
+// The first non-empty row of a scatter
+Row firstFound(std::vector<Row> rows) {
+    for (auto& row : rows) {
+        if (!row.empty()) return std::move(row);
+    }
+    return {};
+}
+
+} // namespace
+
+ShardedDatabase::ShardedDatabase(const std::string& user,
+                                 const std::string& password,
+                                 const std::string& dbName,
+                                 const std::string& mapPath)
+    : user_(user),
+      password_(password),
+      database_(dbName),
+      mapPath_(mapPath),
+      pool_("shards", kPoolThreads, kPoolQueue) {}
+
+std::shared_ptr<ShardedDatabase::Pass> ShardedDatabase::enter() {
+    std::unique_lock<std::mutex> lock(gateMutex_);
+    gateWake_.wait(lock, [this] { return !closed_; });
+    ++active_;
+    return std::make_shared<Pass>(*this);
+}
+
+void ShardedDatabase::enterAsync(std::function<void(std::shared_ptr<Pass>)> then) {
+    {
+        std::lock_guard<std::mutex> lock(gateMutex_);
+        if (closed_) {
+            waiting_.push_back(std::move(then));
+            return;
+        }
+        ++active_;
+    }
+    then(std::make_shared<Pass>(*this));
+}
+
+void ShardedDatabase::leave() {
+    std::lock_guard<std::mutex> lock(gateMutex_);
+    if (--active_ == 0) gateWake_.notify_all();
+}
+
+void ShardedDatabase::closeGate() {
+    std::unique_lock<std::mutex> lock(gateMutex_);
+    closed_ = true;
+    gateWake_.wait(lock, [this] { return active_ == 0; });
+}
+
+void ShardedDatabase::openGate() {
+    std::deque<std::function<void(std::shared_ptr<Pass>)>> resumed;
+    {
+        std::lock_guard<std::mutex> lock(gateMutex_);
+        closed_ = false;
+        resumed.swap(waiting_);
+        active_ += resumed.size();
+        gateWake_.notify_all();
+    }
+    // Each holds its pass already, so a reload closing the gate again
+    // waits for them like any other call
+    for (auto& then : resumed) then(std::make_shared<Pass>(*this));
+}
+
+Database& ShardedDatabase::owner(int sweetId) {
+    auto it = pending_.find(sweetId);
+    return it != pending_.end() ? *it->second : *dbs_[map_->owner(sweetId)];
+}
+
+std::vector<Database*> ShardedDatabase::servers() {
+    std::vector<Database*> out;
+    for (const auto& db : dbs_) out.push_back(db.get());
+    for (const auto& p : pending_) {
+        if (std::find(out.begin(), out.end(), p.second.get()) == out.end()) out.push_back(p.second.get());
+    }
+    return out;
+}
+
+template <typename Result, typename Call>
+std::vector<Result> ShardedDatabase::scatter(const std::vector<Database*>& servers, Call call) {
+    std::vector<Result> out;
+    if (servers.size() == 1) {
+        out.push_back(call(*servers.front()));
+        return out;
+    }
+    std::vector<std::future<Result>> parts;
+    for (Database* db : servers) {
+        parts.push_back(fork<Result>([db, &call] { return call(*db); }));
+    }
+    for (auto& part : parts) out.push_back(part.get());
+    return out;
+}
+
+template <typename Result>
+std::future<Result> ShardedDatabase::fork(std::function<Result()> work) {
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(work));
+    std::future<Result> result = task->get_future();
+    // A pool thread waiting on its own pool could wait forever
+    if (pool_.inPool() || !pool_.post([task] { (*task)(); })) (*task)();
+    return result;
+}
+
+Rows ShardedDatabase::mergeCatalog(const std::vector<Database*>& servers, std::vector<Rows> parts) {
+    Rows out;
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        for (auto& row : parts[i]) {
+            // A copy left behind by an interrupted move is not the owner's
+            if (&owner(std::stoi(row["id"])) == servers[i]) out.push_back(std::move(row));
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const Row& a, const Row& b) {
+        return std::stoi(a.at("id")) < std::stoi(b.at("id"));
+    });
+    return out;
+}
+
+std::shared_ptr<Database> ShardedDatabase::open(const ShardMap::Shard& shard, std::string& error) {
+    std::shared_ptr<Database> db(new Database(shard.host, user_, password_, database_, shard.port));
+    if (!db->connect()) {
+        error = "cannot connect to shard " + shard.name + " at " + shard.endpoint();
+        return nullptr;
+    }
+    if (asyncConnections_ > 0 && !db->startAsync(asyncConnections_)) {
+        std::cerr << "Shard " << shard.name << ": non-blocking client unavailable; using blocking calls\n";
+    }
+    return db;
+}
+
+bool ShardedDatabase::connect(std::string& error) {
+    return reload(error);
+}
+
+bool ShardedDatabase::startAsync(std::size_t connectionsPerShard) {
+    std::lock_guard<std::mutex> reloading(reloadMutex_);
+    asyncConnections_ = connectionsPerShard;
+    bool ok = true;
+    for (const auto& db : dbs_) ok = db->startAsync(connectionsPerShard) && ok;
+    return ok;
+}
+
+void ShardedDatabase::checkIdSpacing() {
+    if (dbs_.size() < 2) return;
+    std::set<long long> offsets;
+    long long step = 0;
+    bool same = true;
+    for (const auto& db : dbs_) {
+        long long increment = 0, offset = 0;
+        if (!db->idSpacing(increment, offset)) return;
+        if (step != 0 && increment != step) same = false;
+        step = increment;
+        offsets.insert(offset % increment);
+    }
+    if (!same || step < static_cast<long long>(dbs_.size()) || offsets.size() != dbs_.size()) {
+        std::cerr << "Warning: shards need one auto_increment_increment of at least " << dbs_.size()
+                  << " and distinct auto_increment_offset values, or purchase ids will collide\n";
+    }
+}
+
+bool ShardedDatabase::moveSweet(int id, Database& from, Database& to) {
+    Database::SweetRows rows;
+    if (!from.exportSweet(id, rows)) return false;
+    if (rows.sweet.empty()) return true; // deleted since the listing
+    if (!to.importSweet(rows)) return false;
+    // The new copy is the live one from here on. If the delete fails, the
+    // old copy is ignored by reads and removed by the next reload.
+    if (!from.dropSweet(id)) {
+        std::cerr << "Sweet " << id << " was moved but its old copy could not be deleted\n";
+    }
+    return true;
+}
+
+bool ShardedDatabase::reload(std::string& error, std::size_t* moved) {
+    std::lock_guard<std::mutex> reloading(reloadMutex_);
+    if (moved) *moved = 0;
+    std::vector<ShardMap::Shard> shards;
+    if (!ShardMap::load(mapPath_, shards, error)) return false;
+    if (map_ && shards.front().name != map_->home().name) {
+        error = "the home shard (first line) must stay " + map_->home().name;
+        return false;
+    }
+
+    // Connections are kept for shards whose address did not change
+    std::vector<std::shared_ptr<Database>> dbs;
+    for (const auto& shard : shards) {
+        std::shared_ptr<Database> db;
+        for (std::size_t i = 0; map_ && i < map_->shards().size(); ++i) {
+            const auto& old = map_->shards()[i];
+            if (old.name == shard.name && old.endpoint() == shard.endpoint()) db = dbs_[i];
+        }
+        if (!db) db = open(shard, error);
+        if (!db) return false;
+        dbs.push_back(std::move(db));
+    }
+    std::unique_ptr<ShardMap> next(new ShardMap(shards));
+
+    // Every server that may hold sweets: the new map's, the old map's, and
+    // any still holding pending moves
+    std::vector<std::shared_ptr<Database>> holders = dbs;
+    auto addHolder = [&](const std::shared_ptr<Database>& db) {
+        if (std::find(holders.begin(), holders.end(), db) == holders.end()) holders.push_back(db);
+    };
+    for (const auto& db : dbs_) addHolder(db);
+    for (const auto& p : pending_) addHolder(p.second);
+
+    closeGate();
+    std::map<int, std::vector<std::size_t>> where;
+    for (std::size_t i = 0; i < holders.size(); ++i) {
+        std::vector<int> ids;
+        if (!holders[i]->listSweetIds(ids)) {
+            openGate();
+            error = "cannot list the sweets on every shard";
+            return false;
+        }
+        for (int id : ids) where[id].push_back(i);
+    }
+    std::unordered_map<int, std::shared_ptr<Database>> pending;
+    std::vector<std::pair<int, std::shared_ptr<Database>>> stale;
+    long long maxId = 0;
+    for (const auto& w : where) {
+        int id = w.first;
+        maxId = std::max<long long>(maxId, id);
+        const auto& target = dbs[next->owner(id)];
+        bool onTarget = std::any_of(w.second.begin(), w.second.end(),
+                                    [&](std::size_t i) { return holders[i] == target; });
+        for (std::size_t i : w.second) {
+            if (holders[i] == target) continue;
+            if (onTarget) {
+                stale.emplace_back(id, holders[i]);
+            } else if (!pending.count(id)) {
+                pending[id] = holders[i];
+            } else {
+                std::cerr << "Sweet " << id << " is on several shards, none of them its owner;"
+                          << " moving one copy and leaving the others\n";
+            }
+        }
+    }
+    // Ids created before sharding, or on a shard added since, must not be
+    // handed out again
+    if (!dbs.front()->raiseSweetIdFloor(maxId)) {
+        openGate();
+        error = "cannot update sweet_id_seq on the home shard";
+        return false;
+    }
+    map_ = std::move(next);
+    dbs_ = std::move(dbs);
+    pending_ = std::move(pending);
+    pendingGauge().set(static_cast<double>(pending_.size()));
+    openGate();
+
+    checkIdSpacing();
+    for (const auto& s : stale) {
+        if (!s.second->dropSweet(s.first)) {
+            std::cerr << "Could not delete the old copy of sweet " << s.first << "\n";
+        }
+    }
+
+    // One sweet at a time, so traffic only ever waits for a single move
+    std::vector<std::pair<int, std::shared_ptr<Database>>> moves(pending_.begin(), pending_.end());
+    for (const auto& m : moves) {
+        closeGate();
+        bool ok = moveSweet(m.first, *m.second, *dbs_[map_->owner(m.first)]);
+        if (ok) pending_.erase(m.first);
+        openGate();
+        pendingGauge().set(static_cast<double>(pending_.size()));
+        if (!ok) {
+            error = "moving sweet " + std::to_string(m.first) + " failed; " +
+                    std::to_string(pending_.size()) + " moves left for the next reload";
+            return false;
+        }
+        movesCounter().inc();
+        if (moved) ++*moved;
+    }
+    return true;
+}
+
+std::vector<ShardedDatabase::ShardStatus> ShardedDatabase::shards() {
+    auto pass = enter();
+    std::vector<ShardStatus> out;
+    for (const auto& shard : map_->shards()) {
+        ShardStatus s;
+        s.name = shard.name;
+        s.endpoint = shard.endpoint();
+        s.weight = shard.weight;
+        s.home = out.empty();
+        out.push_back(std::move(s));
+    }
+    return out;
+}
+
+std::size_t ShardedDatabase::pendingMoves() {
+    auto pass = enter();
+    return pending_.size();
+}
+
+bool ShardedDatabase::createUser(const std::string& username,
+                                 const std::string& passwordHash,
+                                 const std::string& email,
+                                 bool isAdmin,
+                                 int* outId) {
+    auto pass = enter();
+    return home().createUser(username, passwordHash, email, isAdmin, outId);
+}
+
+Row ShardedDatabase::getUserByUsername(const std::string& username) {
+    auto pass = enter();
+    return home().getUserByUsername(username);
+}
+
+bool ShardedDatabase::createSweet(const std::string& name,
+                                  const std::string& description,
+                                  const std::string& category,
+                                  double price,
+                                  int quantity,
+                                  int* outId) {
+    auto pass = enter();
+    long long id = home().reserveSweetIds(1);
+    if (id < 0) return false;
+    Row row{{"id", std::to_string(id)},
+            {"name", name},
+            {"description", description},
+            {"category", category},
+            {"price", rowformat::money(price)},
+            {"quantity", std::to_string(quantity)}};
+    if (!owner(static_cast<int>(id)).upsertSweets({row})) return false;
+    if (outId) *outId = static_cast<int>(id);
+    return true;
+}
+
+Rows ShardedDatabase::getAllSweets(bool* ok) {
+    auto pass = enter();
+    auto all = servers();
+    std::atomic<bool> allOk{true};
+    auto parts = scatter<Rows>(all, [&allOk](Database& db) {
+        bool shardOk = false;
+        Rows rows = db.getAllSweets(&shardOk);
+        if (!shardOk) allOk = false;
+        return rows;
+    });
+    if (ok) *ok = allOk;
+    // A partial catalog would look like deleted sweets
+    return allOk ? mergeCatalog(all, std::move(parts)) : Rows();
+}
+
+Row ShardedDatabase::getSweetById(int id) {
+    auto pass = enter();
+    return owner(id).getSweetById(id);
+}
+
+bool ShardedDatabase::updateSweet(int id,
+                                  const std::string& name,
+                                  const std::string& description,
+                                  const std::string& category,
+                                  double price,
+                                  int quantity) {
+    auto pass = enter();
+    return owner(id).updateSweet(id, name, description, category, price, quantity);
+}
+
+bool ShardedDatabase::deleteSweet(int id) {
+    auto pass = enter();
+    return owner(id).deleteSweet(id);
+}
+
+bool ShardedDatabase::upsertSweets(const Rows& rows,
+                                   std::vector<int>* outIds,
+                                   std::vector<bool>* outCreated) {
+    auto pass = enter();
+    std::vector<int> ids(rows.size(), 0);
+    std::vector<char> created(rows.size(), 1); // not vector<bool>: written from several threads
+    std::vector<std::size_t> fresh;
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        auto it = rows[i].find("id");
+        if (it == rows[i].end() || it->second.empty()) {
+            fresh.push_back(i);
+        } else {
+            ids[i] = std::stoi(it->second);
+        }
+    }
+    // New rows get their ids first, so they can be routed like the rest
+    if (!fresh.empty()) {
+        long long first = home().reserveSweetIds(static_cast<int>(fresh.size()));
+        if (first < 0) return false;
+        for (std::size_t k = 0; k < fresh.size(); ++k) ids[fresh[k]] = static_cast<int>(first + k);
+    }
+
+    std::map<Database*, std::vector<std::size_t>> groups;
+    for (std::size_t i = 0; i < rows.size(); ++i) groups[&owner(ids[i])].push_back(i);
+    std::vector<std::future<bool>> writes;
+    for (const auto& group : groups) {
+        Database* db = group.first;
+        const std::vector<std::size_t>& members = group.second;
+        writes.push_back(fork<bool>([&, db] {
+            Rows part;
+            for (std::size_t i : members) {
+                part.push_back(rows[i]);
+                part.back()["id"] = std::to_string(ids[i]);
+            }
+            std::vector<bool> partCreated;
+            if (!db->upsertSweets(part, nullptr, &partCreated)) return false;
+            for (std::size_t k = 0; k < members.size(); ++k) created[members[k]] = partCreated[k];
+            return true;
+        }));
+    }
+    bool ok = true;
+    for (auto& write : writes) ok = write.get() && ok;
+    if (!ok) return false;
+    if (outIds) *outIds = std::move(ids);
+    if (outCreated) outCreated->assign(created.begin(), created.end());
+    return true;
+}
+
+bool ShardedDatabase::patchSweets(const Rows& changes, Rows* outRows) {
+    auto pass = enter();
+    std::map<Database*, std::vector<std::size_t>> groups;
+    for (std::size_t i = 0; i < changes.size(); ++i) {
+        groups[&owner(std::stoi(changes[i].at("id")))].push_back(i);
+    }
+    Rows updated(changes.size());
+    std::vector<std::future<bool>> writes;
+    for (const auto& group : groups) {
+        Database* db = group.first;
+        const std::vector<std::size_t>& members = group.second;
+        writes.push_back(fork<bool>([&, db] {
+            Rows part, partRows;
+            for (std::size_t i : members) part.push_back(changes[i]);
+            if (!db->patchSweets(part, outRows ? &partRows : nullptr)) return false;
+            for (std::size_t k = 0; k < partRows.size(); ++k) updated[members[k]] = std::move(partRows[k]);
+            return true;
+        }));
+    }
+    bool ok = true;
+    for (auto& write : writes) ok = write.get() && ok;
+    if (!ok) return false;
+    if (outRows) *outRows = std::move(updated);
+    return true;
+}
+
+bool ShardedDatabase::purchaseSweet(int userId, int sweetId, int quantity, double& outTotal,
+                                    Row* outPurchase, const std::string& idempotencyKey) {
+    auto pass = enter();
+    return owner(sweetId).purchaseSweet(userId, sweetId, quantity, outTotal, outPurchase, idempotencyKey);
+}
+
+bool ShardedDatabase::restockSweet(int sweetId, int quantity, const std::string& idempotencyKey) {
+    auto pass = enter();
+    return owner(sweetId).restockSweet(sweetId, quantity, idempotencyKey);
+}
+
+bool ShardedDatabase::setStockSlots(int sweetId, int slots) {
+    auto pass = enter();
+    return owner(sweetId).setStockSlots(sweetId, slots);
+}
+
+Rows ShardedDatabase::getStockSlots(int sweetId) {
+    auto pass = enter();
+    return owner(sweetId).getStockSlots(sweetId);
+}
+
+Rows ShardedDatabase::getPurchasesByUser(int userId,
+                                         const std::string& beforeDate,
+                                         int beforeId,
+                                         int limit,
+                                         bool* ok) {
+    auto pass = enter();
+    // Each shard's page is already newest first, so the merged page is the
+    // newest `limit` of all of them. One failed shard fails the page.
+    std::atomic<bool> allOk{true};
+    auto parts = scatter<Rows>(servers(), [&](Database& db) {
+        bool shardOk = false;
+        Rows rows = db.getPurchasesByUser(userId, beforeDate, beforeId, limit, &shardOk);
+        if (!shardOk) allOk = false;
+        return rows;
+    });
+    if (ok) *ok = allOk;
+    Rows out;
+    std::set<std::string> seen;
+    for (auto& part : parts) {
+        for (auto& row : part) {
+            if (seen.insert(row["id"]).second) out.push_back(std::move(row));
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const Row& a, const Row& b) {
+        return std::make_tuple(a.at("purchase_date"), std::stoll(a.at("id"))) >
+               std::make_tuple(b.at("purchase_date"), std::stoll(b.at("id")));
+    });
+    if (out.size() > static_cast<std::size_t>(std::max(limit, 0))) out.resize(static_cast<std::size_t>(limit));
+    return out;
+}
+
+Row ShardedDatabase::getPurchaseById(int id) {
+    auto pass = enter();
+    return firstFound(scatter<Row>(servers(), [id](Database& db) { return db.getPurchaseById(id); }));
+}
+
+Row ShardedDatabase::getIdempotencyKey(const std::string& key) {
+    auto pass = enter();
+    return firstFound(scatter<Row>(servers(), [&key](Database& db) { return db.getIdempotencyKey(key); }));
+}
+
+Row ShardedDatabase::getSalesTotals() {
+    auto pass = enter();
+    auto parts = scatter<Row>(servers(), [](Database& db) { return db.getSalesTotals(); });
+    long long users = 0, orders = 0, units = 0;
+    double revenue = 0.0;
+    for (auto& part : parts) {
+        if (part.empty()) return {};
+        users += std::stoll(part["user_count"]);
+        orders += std::stoll(part["order_count"]);
+        units += std::stoll(part["units_sold"]);
+        revenue += std::stod(part["revenue"]);
+    }
+    return {{"user_count", std::to_string(users)},
+            {"order_count", std::to_string(orders)},
+            {"units_sold", std::to_string(units)},
+            {"revenue", rowformat::money(revenue)}};
+}
+
+Rows ShardedDatabase::getRevenueByCategory(bool* ok) {
+    auto pass = enter();
+    std::atomic<bool> allOk{true};
+    auto parts = scatter<Rows>(servers(), [&allOk](Database& db) {
+        bool shardOk = false;
+        Rows rows = db.getRevenueByCategory(&shardOk);
+        if (!shardOk) allOk = false;
+        return rows;
+    });
+    if (ok) *ok = allOk;
+    if (!allOk) return {};
+    std::map<std::string, std::pair<double, long long>> byCategory;
+    for (auto& part : parts) {
+        for (auto& row : part) {
+            auto& total = byCategory[row["category"]];
+            total.first += std::stod(row["revenue"]);
+            total.second += std::stoll(row["units_sold"]);
+        }
+    }
+    Rows out;
+    for (const auto& c : byCategory) {
+        out.push_back({{"category", c.first},
+                       {"revenue", rowformat::money(c.second.first)},
+                       {"units_sold", std::to_string(c.second.second)}});
+    }
+    return out;
+}
+
+long long ShardedDatabase::getMaxPurchaseId() {
+    auto pass = enter();
+    auto all = servers();
+    auto maxima = scatter<long long>(all, [](Database& db) { return db.getMaxPurchaseId(); });
+    long long top = 0;
+    for (long long m : maxima) {
+        if (m < 0) return -1;
+        top = std::max(top, m);
+    }
+    // Shards count purchase ids independently. Lifting every counter past
+    // the highest id keeps later purchases above this watermark.
+    for (Database* db : all) {
+        if (!db->raisePurchaseIdFloor(top)) return -1;
+    }
+    return top;
+}
+
+Rows ShardedDatabase::getHourlySales(long long maxPurchaseId) {
+    auto pass = enter();
+    auto parts = scatter<Rows>(servers(), [maxPurchaseId](Database& db) {
+        return db.getHourlySales(maxPurchaseId);
+    });
+    Rows out;
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(out));
+    }
+    return out;
+}
+
+bool ShardedDatabase::logAudit(int userId,
+                               const std::string& action,
+                               const std::string& targetType,
+                               int targetId,
+                               const std::string& details) {
+    auto pass = enter();
+    return home().logAudit(userId, action, targetType, targetId, details);
+}
+
+void ShardedDatabase::getAllSweetsAsync(RowsCallback done) {
+    enterAsync([this, done](std::shared_ptr<Pass> pass) {
+        auto all = servers();
+        auto gather = std::make_shared<Gather<Rows>>(all.size(), [this, all, pass, done](bool ok,
+                                                                                         std::vector<Rows> parts) {
+            // A partial catalog would look like deleted sweets
+            Rows merged = ok ? mergeCatalog(all, std::move(parts)) : Rows();
+            pass->release();
+            done(ok, std::move(merged));
+        });
+        for (std::size_t i = 0; i < all.size(); ++i) {
+            all[i]->getAllSweetsAsync([gather, i](bool ok, Rows rows) { gather->set(i, ok, std::move(rows)); });
+        }
+    });
+}
+
+void ShardedDatabase::getSweetByIdAsync(int id, RowCallback done) {
+    enterAsync([this, id, done](std::shared_ptr<Pass> pass) {
+        owner(id).getSweetByIdAsync(id, [pass, done](bool ok, Row row) {
+            pass->release();
+            done(ok, std::move(row));
+        });
+    });
+}
+
+void ShardedDatabase::purchaseSweetAsync(int userId, int sweetId, int quantity,
+                                         const std::string& idempotencyKey, PurchaseCallback done) {
+    enterAsync([this, userId, sweetId, quantity, idempotencyKey, done](std::shared_ptr<Pass> pass) {
+        owner(sweetId).purchaseSweetAsync(userId, sweetId, quantity, idempotencyKey,
+                                          [pass, done](PurchaseStatus status, double total, Row row) {
+            pass->release();
+            done(status, total, std::move(row));
+        });
+    });
+}
+
+void ShardedDatabase::getIdempotencyKeyAsync(const std::string& key, RowCallback done) {
+    enterAsync([this, key, done](std::shared_ptr<Pass> pass) {
+        auto all = servers();
+        auto gather = std::make_shared<Gather<Row>>(all.size(), [pass, done](bool ok, std::vector<Row> parts) {
+            pass->release();
+            // A key found anywhere is an answer even if another shard failed
+            Row found = firstFound(std::move(parts));
+            done(ok || !found.empty(), std::move(found));
+        });
+        for (std::size_t i = 0; i < all.size(); ++i) {
+            all[i]->getIdempotencyKeyAsync(key, [gather, i](bool ok, Row row) { gather->set(i, ok, std::move(row)); });
+        }
+    });
+}
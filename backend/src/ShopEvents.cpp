@@ -0,0 +1,12 @@
+#include "ShopEvents.h"
+#include "Sweet.h"
+
+void ShopListener::onSweetsImported(const std::vector<Sweet>& sweets, const std::vector<bool>& created) {
+    for (std::size_t i = 0; i < sweets.size(); ++i) {
+        if (created[i]) {
+            onSweetCreated(sweets[i]);
+        } else {
+            onSweetUpdated(sweets[i]);
+        }
+    }
+}
@@ -0,0 +1,194 @@
+#include "Sketches.h"
+#include "Purchase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <queue>
+
+namespace {
+
+std::uint64_t mix64(std::uint64_t x) {
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+unsigned leadingZeros(std::uint64_t x) {
+    unsigned n = 0;
+    for (std::uint64_t bit = 1ULL << 63; bit && !(x & bit); bit >>= 1) ++n;
+    return n;
+}
+
+} // namespace
+
+CountMinSketch::CountMinSketch(double epsilon, double delta)
+    : width_(static_cast<std::size_t>(std::ceil(std::exp(1.0) / epsilon))),
+      depth_(static_cast<std::size_t>(std::ceil(std::log(1.0 / delta)))),
+      counts_(width_ * depth_, 0) {}
+
+void CountMinSketch::add(std::uint64_t key, std::uint64_t count) {
+    for (std::size_t row = 0; row < depth_; ++row) {
+        std::size_t col = mix64(key ^ (row * 0x9e3779b97f4a7c15ULL)) % width_;
+        counts_[row * width_ + col] += count;
+    }
+}
+
+std::uint64_t CountMinSketch::estimate(std::uint64_t key) const {
+    std::uint64_t best = UINT64_MAX;
+    for (std::size_t row = 0; row < depth_; ++row) {
+        std::size_t col = mix64(key ^ (row * 0x9e3779b97f4a7c15ULL)) % width_;
+        best = std::min(best, counts_[row * width_ + col]);
+    }
+    return depth_ ? best : 0;
+}
+
+bool CountMinSketch::merge(const CountMinSketch& other) {
+    if (other.width_ != width_ || other.depth_ != depth_) return false;
+    for (std::size_t i = 0; i < counts_.size(); ++i) counts_[i] += other.counts_[i];
+    return true;
+}
+
+void CountMinSketch::clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+}
+
+HyperLogLog::HyperLogLog(unsigned precision)
+    : precision_(std::min(16u, std::max(4u, precision))),
+      registers_(std::size_t(1) << precision_, 0) {}
+
+void HyperLogLog::add(std::uint64_t key) {
+    std::uint64_t h = mix64(key);
+    std::size_t idx = static_cast<std::size_t>(h >> (64 - precision_));
+    std::uint64_t rest = (h << precision_) | (1ULL << (precision_ - 1));
+    std::uint8_t rank = static_cast<std::uint8_t>(leadingZeros(rest) + 1);
+    if (rank > registers_[idx]) registers_[idx] = rank;
+}
+
+double HyperLogLog::estimate() const {
+    const double m = static_cast<double>(registers_.size());
+    double sum = 0.0;
+    std::size_t zeros = 0;
+    for (std::uint8_t r : registers_) {
+        sum += std::ldexp(1.0, -r);
+        if (r == 0) ++zeros;
+    }
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) {
+        e = m * std::log(m / static_cast<double>(zeros)); // linear counting
+    }
+    return e;
+}
+
+bool HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision_ != precision_) return false;
+    for (std::size_t i = 0; i < registers_.size(); ++i) {
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+    return true;
+}
+
+void HyperLogLog::clear() {
+    std::fill(registers_.begin(), registers_.end(), 0);
+}
+
+SalesSketches::SalesSketches(const SketchConfig& config)
+    : config_(config) {
+    if (config_.windows < 1) config_.windows = 1;
+    if (config_.windowSeconds < 1) config_.windowSeconds = 1;
+    ring_.reserve(config_.windows);
+    for (int i = 0; i < config_.windows; ++i) ring_.emplace_back(config_);
+}
+
+long long SalesSketches::currentIndex() const {
+    return static_cast<long long>(std::time(nullptr)) / config_.windowSeconds;
+}
+
+SalesSketches::Window& SalesSketches::windowFor(long long index) {
+    Window& w = ring_[static_cast<std::size_t>(index % config_.windows)];
+    if (w.index != index) {
+        w.index = index;
+        w.units.clear();
+        w.buyers.clear();
+        w.candidates.clear();
+    }
+    return w;
+}
+
+std::vector<const SalesSketches::Window*> SalesSketches::recent(int windows) const {
+    windows = std::max(1, std::min(windows, config_.windows));
+    long long now = currentIndex();
+    std::vector<const Window*> out;
+    for (const auto& w : ring_) {
+        if (w.index > now - windows && w.index <= now) out.push_back(&w);
+    }
+    return out;
+}
+
+void SalesSketches::onPurchase(const Purchase& purchase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Window& w = windowFor(currentIndex());
+    w.units.add(static_cast<std::uint64_t>(purchase.sweetId),
+                static_cast<std::uint64_t>(purchase.quantity));
+    w.buyers.add(static_cast<std::uint64_t>(purchase.userId));
+
+    // Heavy-hitter candidates: keep the largest estimates seen this window
+    std::uint64_t est = w.units.estimate(static_cast<std::uint64_t>(purchase.sweetId));
+    auto it = w.candidates.find(purchase.sweetId);
+    if (it != w.candidates.end()) {
+        it->second = est;
+    } else if (w.candidates.size() < config_.candidates) {
+        w.candidates[purchase.sweetId] = est;
+    } else {
+        auto smallest = std::min_element(
+            w.candidates.begin(), w.candidates.end(),
+            [](const auto& a, const auto& b) { return a.second < b.second; });
+        if (smallest->second < est) {
+            w.candidates.erase(smallest);
+            w.candidates[purchase.sweetId] = est;
+        }
+    }
+}
+
+std::vector<SalesSketches::TopItem> SalesSketches::topSellers(int windows, std::size_t k) const {
+    std::vector<TopItem> out;
+    if (k == 0) return out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto parts = recent(windows);
+    CountMinSketch merged(config_.epsilon, config_.delta);
+    std::unordered_map<int, bool> candidates;
+    for (const Window* w : parts) {
+        merged.merge(w->units);
+        for (const auto& kv : w->candidates) candidates[kv.first] = true;
+    }
+
+    // Min-heap of the k best estimates over the merged sketch
+    auto worse = [](const TopItem& a, const TopItem& b) { return a.units > b.units; };
+    std::priority_queue<TopItem, std::vector<TopItem>, decltype(worse)> heap(worse);
+    for (const auto& kv : candidates) {
+        TopItem item{kv.first, merged.estimate(static_cast<std::uint64_t>(kv.first))};
+        if (heap.size() < k) {
+            heap.push(item);
+        } else if (heap.top().units < item.units) {
+            heap.pop();
+            heap.push(item);
+        }
+    }
+    while (!heap.empty()) {
+        out.push_back(heap.top());
+        heap.pop();
+    }
+    std::reverse(out.begin(), out.end());
+    return out;
+}
+
+double SalesSketches::uniqueBuyers(int windows) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HyperLogLog merged(config_.hllPrecision);
+    for (const Window* w : recent(windows)) merged.merge(w->buyers);
+    return merged.estimate();
+}
@@ -0,0 +1,137 @@
+#include "Stats.h"
+#include "Storage.h"
+#include "Purchase.h"
+#include "Sweet.h"
+
+#include <iostream>
+#include <string>
+
+StatsEngine::StatsEngine(int lowStockThreshold)
+    : lowStockThreshold_(lowStockThreshold) {}
+
+StatsEngine::~StatsEngine() {
+    stop();
+}
+
+void StatsEngine::account(const SweetState& state, int sign) {
+    totals_.sweetCount += sign;
+    totals_.unitsInStock += sign * static_cast<long long>(state.quantity);
+    if (state.quantity == 0) {
+        totals_.outOfStockCount += sign;
+    } else if (state.quantity < lowStockThreshold_) {
+        totals_.lowStockCount += sign;
+    }
+}
+
+bool StatsEngine::rebuild(Storage& db) {
+    auto totals = db.getSalesTotals();
+    if (totals.empty()) return false;
+    bool ok = false;
+    auto categories = db.getRevenueByCategory(&ok);
+    if (!ok) return false;
+    auto rows = db.getAllSweets(&ok);
+    if (!ok) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    totals_ = DashboardStats{};
+    sweets_.clear();
+    totals_.userCount = std::stoll(totals["user_count"]);
+    totals_.orderCount = std::stoll(totals["order_count"]);
+    totals_.unitsSold = std::stoll(totals["units_sold"]);
+    totals_.totalRevenue = std::stod(totals["revenue"]);
+    for (auto& row : categories) {
+        totals_.revenueByCategory[row["category"]] = std::stod(row["revenue"]);
+    }
+    for (const auto& row : rows) {
+        SweetState state;
+        state.category = row.count("category") ? row.at("category") : "";
+        state.quantity = row.count("quantity") ? std::stoi(row.at("quantity")) : 0;
+        account(state, 1);
+        sweets_[std::stoi(row.at("id"))] = state;
+    }
+    return true;
+}
+
+void StatsEngine::startResync(Storage& db, std::chrono::seconds every) {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stopping_ = false;
+    }
+    resync_ = std::thread([this, &db, every] { resyncLoop(db, every); });
+}
+
+void StatsEngine::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stopping_ = true;
+    }
+    stopWake_.notify_all();
+    if (resync_.joinable()) resync_.join();
+}
+
+void StatsEngine::resyncLoop(Storage& db, std::chrono::seconds every) {
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    while (!stopWake_.wait_for(lock, every, [this] { return stopping_; })) {
+        lock.unlock();
+        if (!rebuild(db)) std::cerr << "Dashboard resync failed; keeping the running totals\n";
+        lock.lock();
+    }
+}
+
+DashboardStats StatsEngine::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totals_;
+}
+
+void StatsEngine::onUserCreated(bool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++totals_.userCount;
+}
+
+void StatsEngine::onSweetCreated(const Sweet& sweet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sweets_.count(sweet.id)) return;
+    SweetState state{sweet.category, sweet.quantity};
+    account(state, 1);
+    sweets_[sweet.id] = state;
+}
+
+void StatsEngine::onSweetUpdated(const Sweet& sweet) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sweets_.find(sweet.id);
+    if (it == sweets_.end()) return;
+    account(it->second, -1);
+    it->second = SweetState{sweet.category, sweet.quantity};
+    account(it->second, 1);
+}
+
+void StatsEngine::onSweetDeleted(int sweetId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sweets_.find(sweetId);
+    if (it == sweets_.end()) return;
+    account(it->second, -1);
+    sweets_.erase(it);
+}
+
+void StatsEngine::onPurchase(const Purchase& purchase) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++totals_.orderCount;
+    totals_.unitsSold += purchase.quantity;
+    totals_.totalRevenue += purchase.totalPrice;
+    auto it = sweets_.find(purchase.sweetId);
+    if (it == sweets_.end()) return;
+    totals_.revenueByCategory[it->second.category] += purchase.totalPrice;
+    account(it->second, -1);
+    it->second.quantity -= purchase.quantity;
+    account(it->second, 1);
+}
+
+void StatsEngine::onRestock(int sweetId, int quantity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sweets_.find(sweetId);
+    if (it == sweets_.end()) return;
+    account(it->second, -1);
+    it->second.quantity += quantity;
+    account(it->second, 1);
+}
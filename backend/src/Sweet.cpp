@@ -1,31 +1,62 @@
 #include "Sweet.h"
-#include "Database.h"
+#include "RowFormat.h"
+#include "Storage.h"
+#include <algorithm>
 #include <iostream>
+#include <set>
 #include <sstream>
 
-SweetManager::SweetManager(Database& db)
-    : db_(db) {}
+namespace {
 
-std::vector<Sweet> SweetManager::getAllSweets() {
-    std::vector<Sweet> sweets;
-    auto rows = db_.getAllSweets();
-    for (const auto& row : rows) {
-        Sweet s;
-        if (row.count("id")) s.id = std::stoi(row.at("id"));
-        if (row.count("name")) s.name = row.at("name");
-        if (row.count("description")) s.description = row.at("description");
-        if (row.count("category")) s.category = row.at("category");
-        if (row.count("price")) s.price = std::stod(row.at("price"));
-        if (row.count("quantity")) s.quantity = std::stoi(row.at("quantity"));
-        sweets.push_back(s);
-    }
+Purchase purchaseFromRow(const std::map<std::string, std::string>& row) {
+    Purchase p;
+    if (row.count("id")) p.id = std::stoi(row.at("id"));
+    if (row.count("user_id")) p.userId = std::stoi(row.at("user_id"));
+    if (row.count("sweet_id")) p.sweetId = std::stoi(row.at("sweet_id"));
+    if (row.count("sweet_name")) p.sweetName = row.at("sweet_name");
+    if (row.count("quantity")) p.quantity = std::stoi(row.at("quantity"));
+    if (row.count("total_price")) p.totalPrice = std::stod(row.at("total_price"));
+    if (row.count("purchase_date")) p.purchaseDate = row.at("purchase_date");
+    return p;
+}
+
+// Keys are per user, so two clients picking the same key never collide
+std::string scopedKey(int userId, const std::string& key) {
+    return std::to_string(userId) + ":" + key;
+}
+
+// What a key was used for; a retry must match it exactly
+std::string fingerprint(const std::string& operation, const std::string& sweetId,
+                        const std::string& quantity) {
+    return operation + ":" + sweetId + ":" + quantity;
+}
+
+std::string column(const std::map<std::string, std::string>& row, const std::string& name) {
+    auto it = row.find(name);
+    return it == row.end() ? std::string() : it->second;
+}
+
+SweetManager::Catalog toSweets(const std::vector<std::map<std::string, std::string>>& rows) {
+    auto sweets = std::make_shared<std::vector<Sweet>>();
+    sweets->reserve(rows.size());
+    for (const auto& row : rows) sweets->push_back(SweetManager::fromRow(row));
     return sweets;
 }
 
-Sweet SweetManager::getSweetById(int id) {
+} // namespace
+
+SweetManager::SweetManager(Storage& db)
+    : db_(db),
+      catalogFlight_("catalog"),
+      sweetFlight_("sweet") {}
+
+void SweetManager::invalidateReads(int sweetId) {
+    catalogFlight_.forget("all");
+    sweetFlight_.forget(std::to_string(sweetId));
+}
+
+Sweet SweetManager::fromRow(const std::map<std::string, std::string>& row) {
     Sweet s;
-    auto row = db_.getSweetById(id);
-    if (row.empty()) return s;
     if (row.count("id")) s.id = std::stoi(row.at("id"));
     if (row.count("name")) s.name = row.at("name");
     if (row.count("description")) s.description = row.at("description");
@@ -35,6 +66,41 @@ Sweet SweetManager::getSweetById(int id) {
     return s;
 }
 
+std::vector<Sweet> SweetManager::getAllSweets(bool* ok) {
+    CatalogRead read = catalogFlight_.run("all", [this] {
+        CatalogRead fresh;
+        fresh.sweets = toSweets(db_.getAllSweets(&fresh.ok));
+        return fresh;
+    });
+    if (ok) *ok = read.ok;
+    return read.sweets ? *read.sweets : std::vector<Sweet>();
+}
+
+void SweetManager::getAllSweetsAsync(std::function<void(bool, Catalog, std::uint64_t)> done) {
+    catalogFlight_.runAsync("all", [this](std::function<void(CatalogRead)> finish) {
+        // Changes are published after they commit, so sampling before the
+        // read leaves out none that the version counts
+        std::uint64_t version = catalogVersion_ ? catalogVersion_() : 0;
+        db_.getAllSweetsAsync([finish, version](bool ok, std::vector<std::map<std::string, std::string>> rows) {
+            CatalogRead read;
+            read.ok = ok;
+            read.sweets = toSweets(rows);
+            read.version = version;
+            finish(std::move(read));
+        });
+    }, [done](CatalogRead read) {
+        done(read.ok, read.sweets ? read.sweets : toSweets({}), read.version);
+    });
+}
+
+Sweet SweetManager::getSweetById(int id) {
+    return sweetFlight_.run(std::to_string(id), [this, id] {
+        auto row = db_.getSweetById(id);
+        if (row.empty()) return Sweet{};
+        return fromRow(row);
+    });
+}
+
 bool SweetManager::addSweet(const std::string& name,
                             const std::string& description,
                             const std::string& category,
@@ -43,7 +109,14 @@ bool SweetManager::addSweet(const std::string& name,
     if (name.empty() || category.empty() || price < 0 || quantity < 0) {
         return false;
     }
-    return db_.createSweet(name, description, category, price, quantity);
+    int id = 0;
+    if (!db_.createSweet(name, description, category, price, quantity, &id)) {
+        return false;
+    }
+    invalidateReads(id);
+    Sweet s{id, name, description, category, price, quantity};
+    for (auto* l : listeners_) l->onSweetCreated(s);
+    return true;
 }
 
 bool SweetManager::updateSweet(int id,
@@ -55,24 +128,309 @@ bool SweetManager::updateSweet(int id,
     if (id <= 0 || name.empty() || category.empty() || price < 0 || quantity < 0) {
         return false;
     }
-    return db_.updateSweet(id, name, description, category, price, quantity);
+    if (!db_.updateSweet(id, name, description, category, price, quantity)) {
+        return false;
+    }
+    invalidateReads(id);
+    Sweet s{id, name, description, category, price, quantity};
+    for (auto* l : listeners_) l->onSweetUpdated(s);
+    return true;
 }
 
 bool SweetManager::deleteSweet(int id) {
     if (id <= 0) return false;
-    return db_.deleteSweet(id);
+    if (!db_.deleteSweet(id)) return false;
+    invalidateReads(id);
+    for (auto* l : listeners_) l->onSweetDeleted(id);
+    return true;
+}
+
+bool SweetManager::patchSweets(const std::vector<SweetPatch>& patches, std::vector<Sweet>* updated) {
+    if (patches.empty()) return false;
+    std::vector<std::map<std::string, std::string>> changes;
+    changes.reserve(patches.size());
+    std::set<int> seen;
+    for (const auto& p : patches) {
+        const Sweet& v = p.values;
+        if (p.id <= 0 || p.fields == 0 || !seen.insert(p.id).second) return false;
+        std::map<std::string, std::string> change{{"id", std::to_string(p.id)}};
+        if (p.fields & SweetPatch::Name) {
+            if (v.name.empty()) return false;
+            change["name"] = v.name;
+        }
+        if (p.fields & SweetPatch::Description) change["description"] = v.description;
+        if (p.fields & SweetPatch::Category) {
+            if (v.category.empty()) return false;
+            change["category"] = v.category;
+        }
+        if (p.fields & SweetPatch::Price) {
+            if (v.price < 0) return false;
+            change["price"] = rowformat::money(v.price);
+        }
+        if (p.fields & SweetPatch::Quantity) {
+            if (v.quantity < 0) return false;
+            change["quantity"] = std::to_string(v.quantity);
+        }
+        changes.push_back(std::move(change));
+    }
+
+    std::vector<std::map<std::string, std::string>> rows;
+    if (!db_.patchSweets(changes, &rows)) return false;
+
+    // One catalog invalidation for the whole batch
+    catalogFlight_.forget("all");
+    std::vector<Sweet> sweets;
+    sweets.reserve(rows.size());
+    for (const auto& row : rows) {
+        Sweet s = fromRow(row);
+        sweetFlight_.forget(std::to_string(s.id));
+        for (auto* l : listeners_) l->onSweetUpdated(s);
+        sweets.push_back(std::move(s));
+    }
+    if (updated) *updated = std::move(sweets);
+    return true;
+}
+
+std::size_t SweetManager::importSweets(const std::vector<Sweet>& sweets, std::size_t batchSize) {
+    if (batchSize == 0) batchSize = 1;
+    std::size_t stored = 0;
+    std::vector<std::map<std::string, std::string>> rows;
+    std::vector<int> ids;
+    std::vector<bool> batchCreated;
+    std::vector<Sweet> imported;
+    std::vector<bool> created;
+    while (stored < sweets.size()) {
+        std::size_t end = std::min(sweets.size(), stored + batchSize);
+        rows.clear();
+        for (std::size_t i = stored; i < end; ++i) {
+            const Sweet& s = sweets[i];
+            std::map<std::string, std::string> row{
+                {"name", s.name},
+                {"description", s.description},
+                {"category", s.category},
+                {"price", rowformat::money(s.price)},
+                {"quantity", std::to_string(s.quantity)},
+            };
+            if (s.id > 0) row["id"] = std::to_string(s.id);
+            rows.push_back(std::move(row));
+        }
+        if (!db_.upsertSweets(rows, &ids, &batchCreated)) break;
+
+        // One catalog invalidation per batch rather than per row
+        catalogFlight_.forget("all");
+        for (std::size_t k = 0; k < ids.size(); ++k) {
+            imported.push_back(sweets[stored + k]);
+            imported.back().id = ids[k];
+            created.push_back(batchCreated[k]);
+            sweetFlight_.forget(std::to_string(ids[k]));
+        }
+        stored = end;
+    }
+    // Listeners hear of the import once, including the batches stored
+    // before a failure
+    if (!imported.empty()) {
+        for (auto* l : listeners_) l->onSweetsImported(imported, created);
+    }
+    return stored;
 }
 
 bool SweetManager::purchaseSweet(int userId, int sweetId, int quantity, double& outTotal) {
     if (userId <= 0 || sweetId <= 0 || quantity <= 0) {
         return false;
     }
-    return db_.purchaseSweet(userId, sweetId, quantity, outTotal);
+    std::map<std::string, std::string> row;
+    if (!db_.purchaseSweet(userId, sweetId, quantity, outTotal, &row)) {
+        return false;
+    }
+    invalidateReads(sweetId);
+    Purchase purchase = purchaseFromRow(row);
+    recentPurchases_.append(purchase);
+    for (auto* l : listeners_) l->onPurchase(purchase);
+    return true;
+}
+
+void SweetManager::purchaseSweetAsync(int userId, int sweetId, int quantity,
+                                      std::function<void(bool, const Purchase&)> done) {
+    purchaseSweetAsync(userId, sweetId, quantity, "",
+                       [done](bool ok, const Purchase& p, Replay) { done(ok, p); });
+}
+
+void SweetManager::purchaseSweetAsync(int userId, int sweetId, int quantity,
+                                      const std::string& idempotencyKey,
+                                      std::function<void(bool, const Purchase&, Replay)> done) {
+    if (userId <= 0 || sweetId <= 0 || quantity <= 0) {
+        done(false, Purchase{}, Replay::None);
+        return;
+    }
+    std::string key, fp;
+    if (!idempotencyKey.empty()) {
+        key = scopedKey(userId, idempotencyKey);
+        fp = fingerprint("purchase", std::to_string(sweetId), std::to_string(quantity));
+        std::map<std::string, std::string> stored;
+        switch (idempotency_.claim(key, fp, stored)) {
+        case IdempotencyCache::Claim::Done:
+            done(true, purchaseFromRow(stored), Replay::Replayed);
+            return;
+        case IdempotencyCache::Claim::InProgress:
+            done(false, Purchase{}, Replay::InProgress);
+            return;
+        case IdempotencyCache::Claim::Mismatch:
+            done(false, Purchase{}, Replay::KeyReused);
+            return;
+        case IdempotencyCache::Claim::New:
+            break;
+        }
+    }
+    db_.purchaseSweetAsync(userId, sweetId, quantity, key,
+                           [this, userId, sweetId, key, fp, done](Storage::PurchaseStatus status, double,
+                                                                  std::map<std::string, std::string> row) {
+        if (status != Storage::PurchaseStatus::Done) {
+            bool failed = status == Storage::PurchaseStatus::Error;
+            // A failed commit may still have gone through; reread the history
+            if (failed) recentPurchases_.invalidate(userId);
+            if (key.empty()) {
+                // Without a key a failed commit may still have gone through
+                if (failed) invalidateReads(sweetId);
+                done(false, Purchase{}, failed ? Replay::Unavailable : Replay::None);
+                return;
+            }
+            // Out of stock, or the key was recorded by another server or
+            // before a restart; only storage can tell which
+            db_.getIdempotencyKeyAsync(key, [this, sweetId, key, fp, failed, done](
+                                                bool ok, std::map<std::string, std::string> record) {
+                if (!ok) {
+                    // Unknown outcome; a retry with the key finds out
+                    idempotency_.release(key);
+                    if (failed) invalidateReads(sweetId);
+                    done(false, Purchase{}, Replay::Unavailable);
+                    return;
+                }
+                Replay replay = settleKey(key, fp, record);
+                if (failed && replay == Replay::None) replay = Replay::Unavailable;
+                if (replay == Replay::Replayed) {
+                    done(true, purchaseFromRow(record), replay);
+                } else {
+                    done(false, Purchase{}, replay);
+                }
+            });
+            return;
+        }
+        if (!key.empty()) idempotency_.complete(key, fp, row);
+        invalidateReads(sweetId);
+        Purchase purchase = purchaseFromRow(row);
+        recentPurchases_.append(purchase);
+        for (auto* l : listeners_) l->onPurchase(purchase);
+        done(true, purchase, Replay::None);
+    });
 }
 
 bool SweetManager::restockSweet(int sweetId, int quantity) {
     if (sweetId <= 0 || quantity <= 0) {
         return false;
     }
-    return db_.restockSweet(sweetId, quantity);
+    if (!db_.restockSweet(sweetId, quantity)) return false;
+    invalidateReads(sweetId);
+    for (auto* l : listeners_) l->onRestock(sweetId, quantity);
+    return true;
+}
+
+bool SweetManager::restockSweet(int userId, int sweetId, int quantity,
+                                const std::string& idempotencyKey, Replay& replay) {
+    replay = Replay::None;
+    if (idempotencyKey.empty()) return restockSweet(sweetId, quantity);
+    if (userId <= 0 || sweetId <= 0 || quantity <= 0) {
+        return false;
+    }
+    std::string key = scopedKey(userId, idempotencyKey);
+    std::string fp = fingerprint("restock", std::to_string(sweetId), std::to_string(quantity));
+    std::map<std::string, std::string> stored;
+    switch (idempotency_.claim(key, fp, stored)) {
+    case IdempotencyCache::Claim::Done:
+        replay = Replay::Replayed;
+        return true;
+    case IdempotencyCache::Claim::InProgress:
+        replay = Replay::InProgress;
+        return false;
+    case IdempotencyCache::Claim::Mismatch:
+        replay = Replay::KeyReused;
+        return false;
+    case IdempotencyCache::Claim::New:
+        break;
+    }
+    if (!db_.restockSweet(sweetId, quantity, key)) {
+        replay = settleKey(key, fp, db_.getIdempotencyKey(key));
+        return replay == Replay::Replayed;
+    }
+    idempotency_.complete(key, fp, {
+        {"operation", "restock"},
+        {"sweet_id", std::to_string(sweetId)},
+        {"quantity", std::to_string(quantity)},
+    });
+    invalidateReads(sweetId);
+    for (auto* l : listeners_) l->onRestock(sweetId, quantity);
+    return true;
+}
+
+SweetManager::Replay SweetManager::settleKey(const std::string& key,
+                                             const std::string& wanted,
+                                             const std::map<std::string, std::string>& record) {
+    if (record.empty()) {
+        idempotency_.release(key);
+        return Replay::None;
+    }
+    std::string recorded = fingerprint(column(record, "operation"), column(record, "sweet_id"),
+                                       column(record, "quantity"));
+    idempotency_.complete(key, recorded, record);
+    return recorded == wanted ? Replay::Replayed : Replay::KeyReused;
+}
+
+std::vector<Purchase> SweetManager::getUserPurchases(int userId,
+                                                     const std::string& beforeDate,
+                                                     int beforeId,
+                                                     int limit,
+                                                     bool* outOk) {
+    std::vector<Purchase> purchases;
+    if (outOk) *outOk = true;
+    if (userId <= 0 || limit <= 0) return purchases;
+
+    bool firstPage = beforeDate.empty();
+    if (firstPage && recentPurchases_.getFirstPage(userId, limit, purchases)) {
+        return purchases;
+    }
+
+    // Seed the cache with a full cache-sized page even if fewer rows were asked for
+    int fetch = limit;
+    int cacheSize = static_cast<int>(recentPurchases_.perUserCapacity());
+    if (firstPage && fetch < cacheSize) fetch = cacheSize;
+
+    bool ok = false;
+    auto rows = db_.getPurchasesByUser(userId, beforeDate, beforeId, fetch, &ok);
+    if (outOk) *outOk = ok;
+    for (const auto& row : rows) {
+        purchases.push_back(purchaseFromRow(row));
+    }
+    // A failed read must not seed the cache as an empty history
+    if (firstPage && ok) {
+        recentPurchases_.fill(userId, purchases,
+                              static_cast<int>(purchases.size()) < fetch);
+    }
+    if (static_cast<int>(purchases.size()) > limit) {
+        purchases.resize(limit);
+    }
+    return purchases;
+}
+
+void SweetManager::addListener(ShopListener* listener) {
+    if (listener) listeners_.push_back(listener);
+}
+
+void SweetManager::setCatalogVersion(std::function<std::uint64_t()> version) {
+    catalogVersion_ = std::move(version);
+}
+
+Purchase SweetManager::getPurchaseById(int id) {
+    if (id <= 0) return Purchase{};
+    auto row = db_.getPurchaseById(id);
+    if (row.empty()) return Purchase{};
+    return purchaseFromRow(row);
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "Topic.h"
+
+Topic::Topic(const std::string& name, std::size_t capacity)
+    : capacity_(capacity ? capacity : 1),
+      ring_(capacity_),
+      subscriberGauge_(metrics::gauge("sweet_shop_topic_subscribers", "topic=\"" + name + "\"",
+                                      "Live subscribers per pub/sub topic")),
+      published_(metrics::counter("sweet_shop_topic_published_total", "topic=\"" + name + "\"",
+                                  "Messages published per pub/sub topic")),
+      resets_(metrics::counter("sweet_shop_topic_resets_total", "topic=\"" + name + "\"",
+                               "Subscribers that fell behind the ring and were reset")) {
+    thread_ = std::thread(&Topic::pump, this);
+}
+
+Topic::~Topic() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+std::string Topic::frame(std::uint64_t seq, const std::string& payload) {
+    return "{\"seq\":" + std::to_string(seq) + ",\"event\":" + payload + "}";
+}
+
+void Topic::publish(const std::string& payload) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++head_;
+        ring_[head_ % capacity_] = std::make_shared<const std::string>(frame(head_, payload));
+        dirty_ = true;
+    }
+    published_.inc();
+    wake_.notify_one();
+}
+
+std::uint64_t Topic::subscribe(Sink sink) {
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->sink = std::move(sink);
+    // Held until the hello is out, so the pump cannot send anything first
+    std::lock_guard<std::mutex> sending(subscriber->sinkMutex);
+    std::uint64_t id, seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = nextSubscriber_++;
+        seq = head_;
+        subscriber->cursor = seq;
+        subscribers_.emplace(id, subscriber);
+        subscriberGauge_.set(static_cast<std::int64_t>(subscribers_.size()));
+    }
+    subscriber->sink(frame(seq, "{\"type\":\"hello\"}"));
+    return id;
+}
+
+void Topic::resume(std::uint64_t subscriber, std::uint64_t seq) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = subscribers_.find(subscriber);
+        if (it == subscribers_.end() || seq > head_) return;
+        // Out of range cursors are reset by collect()
+        it->second->cursor = seq;
+        dirty_ = true;
+    }
+    wake_.notify_one();
+}
+
+void Topic::unsubscribe(std::uint64_t subscriber) {
+    std::shared_ptr<Subscriber> gone;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = subscribers_.find(subscriber);
+        if (it == subscribers_.end()) return;
+        gone = std::move(it->second);
+        subscribers_.erase(it);
+        subscriberGauge_.set(static_cast<std::int64_t>(subscribers_.size()));
+    }
+    // Waits out a delivery already in progress; the pump skips it after
+    std::lock_guard<std::mutex> sending(gone->sinkMutex);
+    gone->live = false;
+}
+
+std::uint64_t Topic::head() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return head_;
+}
+
+void Topic::collect(const std::shared_ptr<Subscriber>& subscriber, std::vector<Delivery>& due) {
+    if (subscriber->cursor == head_) return;
+    Delivery delivery{subscriber, {}};
+    if (head_ - subscriber->cursor > capacity_) {
+        delivery.messages.push_back(std::make_shared<const std::string>(frame(head_, "{\"type\":\"reset\"}")));
+        subscriber->cursor = head_;
+        resets_.inc();
+    } else {
+        delivery.messages.reserve(static_cast<std::size_t>(head_ - subscriber->cursor));
+        while (subscriber->cursor < head_) {
+            ++subscriber->cursor;
+            delivery.messages.push_back(ring_[subscriber->cursor % capacity_]);
+        }
+    }
+    due.push_back(std::move(delivery));
+}
+
+void Topic::pump() {
+    std::vector<Delivery> due;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || dirty_; });
+        if (stopping_) return;
+        dirty_ = false;
+        for (auto& kv : subscribers_) collect(kv.second, due);
+        lock.unlock();
+        for (auto& delivery : due) {
+            Subscriber& to = *delivery.to;
+            std::lock_guard<std::mutex> sending(to.sinkMutex);
+            if (!to.live) continue;
+            for (const auto& message : delivery.messages) to.sink(*message);
+        }
+        due.clear();
+        lock.lock();
+    }
+}
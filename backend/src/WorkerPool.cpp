@@ -0,0 +1,57 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(const std::string& name, std::size_t threads, std::size_t maxQueue)
+    : maxQueue_(maxQueue),
+      queuedGauge_(metrics::gauge("sweet_shop_worker_pool_queued", "pool=\"" + name + "\"",
+                                  "Tasks waiting for a worker pool thread")),
+      rejected_(metrics::counter("sweet_shop_worker_pool_rejected_total", "pool=\"" + name + "\"",
+                                 "Tasks refused because the pool queue was full")) {
+    threads = std::max<std::size_t>(1, threads);
+    threads_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) threads_.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_) t.join();
+}
+
+bool WorkerPool::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || queue_.size() >= maxQueue_) {
+            rejected_.inc();
+            return false;
+        }
+        queue_.push_back(std::move(task));
+        queuedGauge_.set(static_cast<std::int64_t>(queue_.size()));
+    }
+    wake_.notify_one();
+    return true;
+}
+
+bool WorkerPool::inPool() const {
+    std::thread::id self = std::this_thread::get_id();
+    return std::any_of(threads_.begin(), threads_.end(),
+                       [self](const std::thread& t) { return t.get_id() == self; });
+}
+
+void WorkerPool::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) return; // stopping, and drained
+        std::function<void()> task = std::move(queue_.front());
+        queue_.pop_front();
+        queuedGauge_.set(static_cast<std::int64_t>(queue_.size()));
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
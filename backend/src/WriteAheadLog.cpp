@@ -0,0 +1,233 @@
+#include "WriteAheadLog.h"
+
+#include <array>
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::uint32_t crc32(const char* data, std::size_t len) {
+    static const std::array<std::uint32_t, 256> table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    std::uint32_t c = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < len; ++i) {
+        c = table[(c ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+void putU32(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+std::uint32_t getU32(const char* p) {
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& dir,
+                             std::uint64_t segment,
+                             std::chrono::microseconds groupCommitWindow)
+    : dir_(dir), window_(groupCommitWindow), segment_(segment), fileSegment_(segment) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_all();
+    if (flusher_.joinable()) flusher_.join();
+    if (file_) std::fclose(file_);
+}
+
+std::string WriteAheadLog::segmentPath(const std::string& dir, std::uint64_t segment) {
+    char name[40];
+    std::snprintf(name, sizeof(name), "wal-%020llu.log", static_cast<unsigned long long>(segment));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+std::string WriteAheadLog::frame(const std::string& payload) {
+    std::string out;
+    out.reserve(payload.size() + 8);
+    putU32(out, static_cast<std::uint32_t>(payload.size()));
+    putU32(out, crc32(payload.data(), payload.size()));
+    out += payload;
+    return out;
+}
+
+bool WriteAheadLog::sync(std::FILE* file) {
+    if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool WriteAheadLog::syncDir(const std::string& dir) {
+#ifdef _WIN32
+    (void)dir;
+    return true;
+#else
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool WriteAheadLog::replay(const std::string& path,
+                           const std::function<bool(const std::string&)>& fn,
+                           bool repair) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::uintmax_t good = 0;
+    char header[8];
+    std::string payload;
+    while (std::fread(header, 1, 8, f) == 8) {
+        std::uint32_t len = getU32(header);
+        std::uint32_t crc = getU32(header + 4);
+        payload.resize(len);
+        if (len && std::fread(&payload[0], 1, len, f) != len) break;
+        if (crc32(payload.data(), payload.size()) != crc) break;
+        if (!fn(payload)) {
+            std::fclose(f);
+            return false;
+        }
+        good += 8 + len;
+    }
+    std::fclose(f);
+    std::error_code ec;
+    if (repair && std::filesystem::file_size(path, ec) != good && !ec) {
+        std::cerr << "WAL: truncating torn tail of " << path << " at byte " << good << "\n";
+        std::filesystem::resize_file(path, good, ec);
+    }
+    return true;
+}
+
+bool WriteAheadLog::open() {
+    file_ = std::fopen(segmentPath(dir_, segment_).c_str(), "ab");
+    if (!file_) return false;
+    std::error_code ec;
+    auto size = std::filesystem::file_size(segmentPath(dir_, segment_), ec);
+    segmentBytes_ = ec ? 0 : static_cast<std::uint64_t>(size);
+    fileSegment_ = segment_;
+    if (!syncDir(dir_)) std::cerr << "WAL: cannot fsync " << dir_ << "\n";
+    flusher_ = std::thread(&WriteAheadLog::flushLoop, this);
+    return true;
+}
+
+std::uint64_t WriteAheadLog::append(const std::string& payload) {
+    std::string framed = frame(payload);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) return 0;
+    std::uint64_t lsn = nextLsn_++;
+    if (pending_.empty() || pending_.back().segment != segment_) {
+        pending_.push_back(Batch{segment_, std::string(), lsn});
+    }
+    pending_.back().bytes += framed;
+    pending_.back().lastLsn = lsn;
+    segmentBytes_ += framed.size();
+    queued_.notify_one();
+    return lsn;
+}
+
+bool WriteAheadLog::waitDurable(std::uint64_t lsn) {
+    if (lsn == 0) return false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_.wait(lock, [&] { return durableLsn_ >= lsn || failed_; });
+    return durableLsn_ >= lsn;
+}
+
+std::uint64_t WriteAheadLog::rotate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++segment_;
+    segmentBytes_ = 0;
+    return segment_;
+}
+
+std::uint64_t WriteAheadLog::segment() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segment_;
+}
+
+std::uint64_t WriteAheadLog::lastLsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nextLsn_ - 1;
+}
+
+std::uint64_t WriteAheadLog::durableLsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return durableLsn_;
+}
+
+bool WriteAheadLog::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+std::uint64_t WriteAheadLog::bytesInSegment() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segmentBytes_;
+}
+
+void WriteAheadLog::flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        queued_.wait(lock, [&] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty() && stopping_) return;
+        if (window_.count() > 0 && !stopping_) {
+            // Let more committers join this fsync
+            queued_.wait_for(lock, window_, [&] { return stopping_; });
+        }
+        std::deque<Batch> batches;
+        batches.swap(pending_);
+        lock.unlock();
+
+        bool ok = true;
+        std::uint64_t last = 0;
+        for (const Batch& b : batches) {
+            if (b.segment != fileSegment_) {
+                // Everything for the old segment was written in earlier batches
+                ok = ok && sync(file_);
+                std::fclose(file_);
+                file_ = std::fopen(segmentPath(dir_, b.segment).c_str(), "ab");
+                fileSegment_ = b.segment;
+                if (!file_) { ok = false; break; }
+                // The new segment's directory entry must survive too
+                ok = ok && syncDir(dir_);
+            }
+            ok = ok && std::fwrite(b.bytes.data(), 1, b.bytes.size(), file_) == b.bytes.size();
+            last = b.lastLsn;
+        }
+        ok = ok && file_ && sync(file_);
+
+        lock.lock();
+        if (ok) {
+            durableLsn_ = last;
+        } else {
+            std::cerr << "WAL: write or fsync failed; rejecting further writes\n";
+            failed_ = true;
+        }
+        durable_.notify_all();
+        if (!ok) return;
+    }
+}
@@ -0,0 +1,142 @@
+// Microbenchmarks for the request hot paths that do not need MySQL.
+//
+//   sweet_shop_bench                       # writes sweet_shop_bench.json
+//   sweet_shop_bench --benchmark_out=x.json --benchmark_filter=JWT
+//
+// Results are always written as JSON (to sweet_shop_bench.json unless
+// --benchmark_out is given) so runs can be compared across releases with
+// Google Benchmark's tools/compare.py.
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Auth.h"
+#include "JWT.h"
+#include "MemoryStorage.h"
+#include "Sweet.h"
+
+namespace {
+
+const std::string kSecret = "your-secret-key-here";
+
+// Same claim set Auth::login issues
+std::map<std::string, std::string> loginClaims() {
+    return {
+        {"username", "customer1"},
+        {"email", "customer1@example.com"},
+        {"is_admin", "false"},
+        {"user_id", "2"},
+    };
+}
+
+// A catalog row as Database::getAllSweets returns it
+std::map<std::string, std::string> sweetRow(int id) {
+    return {
+        {"id", std::to_string(id)},
+        {"name", "Dark Chocolate Bar " + std::to_string(id)},
+        {"description", "Premium dark chocolate with 70% cocoa"},
+        {"category", "Chocolate"},
+        {"price", "2.99"},
+        {"quantity", "45"},
+        {"created_at", "2024-01-15 10:30:00"},
+        {"updated_at", "2024-01-15 10:30:00"},
+    };
+}
+
+void BM_JWTEncode(benchmark::State& state) {
+    JWT jwt(kSecret);
+    auto claims = loginClaims();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jwt.encode(claims, 604800));
+    }
+}
+BENCHMARK(BM_JWTEncode);
+
+void BM_JWTDecode(benchmark::State& state) {
+    JWT jwt(kSecret);
+    std::string token = jwt.encode(loginClaims(), 604800);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jwt.decode(token));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(token.size()));
+}
+BENCHMARK(BM_JWTDecode);
+
+void BM_JWTVerify(benchmark::State& state) {
+    JWT jwt(kSecret);
+    std::string token = jwt.encode(loginClaims(), 604800);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jwt.verify(token));
+    }
+}
+BENCHMARK(BM_JWTVerify);
+
+void BM_Base64UrlEncode(benchmark::State& state) {
+    JWT jwt(kSecret);
+    std::string input(static_cast<std::size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jwt.base64UrlEncode(input));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+// Header, signature and typical payload sizes
+BENCHMARK(BM_Base64UrlEncode)->Arg(27)->Arg(32)->Arg(128)->Arg(512);
+
+void BM_Base64UrlDecode(benchmark::State& state) {
+    JWT jwt(kSecret);
+    std::string encoded = jwt.base64UrlEncode(
+        std::string(static_cast<std::size_t>(state.range(0)), 'x'));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jwt.base64UrlDecode(encoded));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_Base64UrlDecode)->Arg(27)->Arg(32)->Arg(128)->Arg(512);
+
+void BM_HashPassword(benchmark::State& state) {
+    MemoryStorage storage;
+    Auth auth(storage, kSecret);
+    std::string password = "correct horse battery staple";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(auth.hashPassword(password));
+    }
+}
+BENCHMARK(BM_HashPassword);
+
+// Row-map to Sweet conversion done by SweetManager::getAllSweets
+void BM_SweetRowMapping(benchmark::State& state) {
+    std::vector<std::map<std::string, std::string>> rows;
+    for (int i = 1; i <= state.range(0); ++i) rows.push_back(sweetRow(i));
+    for (auto _ : state) {
+        std::vector<Sweet> sweets;
+        sweets.reserve(rows.size());
+        for (const auto& row : rows) sweets.push_back(SweetManager::fromRow(row));
+        benchmark::DoNotOptimize(sweets.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SweetRowMapping)->Arg(10)->Arg(100)->Arg(1000)->Arg(10000);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<char*> args(argv, argv + argc);
+    bool hasOut = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]).rfind("--benchmark_out=", 0) == 0) hasOut = true;
+    }
+    std::string outArg = "--benchmark_out=sweet_shop_bench.json";
+    std::string formatArg = "--benchmark_out_format=json";
+    if (!hasOut) args.push_back(&outArg[0]);
+    args.push_back(&formatArg[0]);
+    int count = static_cast<int>(args.size());
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,472 @@
+// Open-loop HTTP load generator for the full stack (Crow, Auth,
+// SweetManager and the storage engine).
+//
+//   sweet_shop_loadgen --rate 500 --duration 30 --connections 32
+//   sweet_shop_loadgen --rate 200 --mix catalog=60,sweet=20,login=10,purchase=10
+//   sweet_shop_loadgen --rate 500 --record run.trace      # save the schedule
+//   sweet_shop_loadgen --replay run.trace --speed 2       # replay it at 2x
+//
+// Requests are scheduled at fixed intended start times (rate per second),
+// independent of how fast the server answers. Latency is measured from the
+// intended start, so time a request spent waiting for a free connection
+// behind a slow response is counted (coordinated-omission correction);
+// the raw send-to-response service time is reported alongside.
+//
+// Trace format, one request per line:
+//   <offset_ms> <type> <METHOD> <path> [<json body>]
+// Offsets are relative to the start of the run. A path or body containing
+// {token} gets the bearer token of the --user login.
+
+#include <asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    double rate = 100.0;        // requests per second
+    double duration = 10.0;     // seconds
+    double warmup = 2.0;        // seconds excluded from the report
+    int connections = 16;
+    std::string mix = "catalog=60,sweet=20,login=10,purchase=10";
+    int sweets = 100;           // sweet and purchase targets are ids 1..sweets
+    std::string user = "customer1";
+    std::string password = "password123";
+    std::uint64_t seed = 1;
+    std::string record;
+    std::string replay;
+    double speed = 1.0;
+    std::string json;
+};
+
+struct Request {
+    Clock::duration offset;
+    std::string type;
+    std::string method;
+    std::string path;
+    std::string body;
+    bool auth{false};
+};
+
+// Latency and outcome counters for one request type
+struct Result {
+    metrics::Histogram latency;  // intended start -> response
+    metrics::Histogram service;  // send -> response
+    std::atomic<std::uint64_t> ok{0};
+    std::atomic<std::uint64_t> httpErrors{0};
+    std::atomic<std::uint64_t> ioErrors{0};
+};
+
+std::uint64_t splitmix(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Deterministic request i of a synthetic run, so the same seed always
+// produces the same schedule whichever connection ends up sending it
+Request synthesize(const Options& opt,
+                   const std::vector<std::pair<std::string, int>>& mix,
+                   int mixTotal,
+                   std::uint64_t i) {
+    std::uint64_t r = splitmix(opt.seed ^ splitmix(i));
+    int pick = static_cast<int>(r % static_cast<std::uint64_t>(mixTotal));
+    std::string type = mix.back().first;
+    for (const auto& m : mix) {
+        if (pick < m.second) {
+            type = m.first;
+            break;
+        }
+        pick -= m.second;
+    }
+    r = splitmix(r);
+
+    Request req;
+    req.offset = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(i) / opt.rate));
+    req.type = type;
+    if (type == "catalog") {
+        req.method = "GET";
+        req.path = "/api/sweets";
+    } else if (type == "sweet") {
+        req.method = "GET";
+        req.path = "/api/sweets/" + std::to_string(1 + r % static_cast<std::uint64_t>(opt.sweets));
+    } else if (type == "login") {
+        req.method = "POST";
+        req.path = "/api/auth/login";
+        req.body = "{\"username\":\"" + opt.user + "\",\"password\":\"" + opt.password + "\"}";
+    } else {
+        req.method = "POST";
+        req.path = "/api/sweets/" + std::to_string(1 + r % static_cast<std::uint64_t>(opt.sweets)) + "/purchase";
+        req.body = "{\"quantity\":1}";
+        req.auth = true;
+    }
+    return req;
+}
+
+bool parseTraceLine(const std::string& line, Request& req) {
+    std::istringstream in(line);
+    double ms = 0;
+    if (!(in >> ms >> req.type >> req.method >> req.path)) return false;
+    std::getline(in, req.body);
+    req.body.erase(0, req.body.find_first_not_of(' '));
+    req.offset = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    req.auth = req.path.find("{token}") != std::string::npos || req.body.find("{token}") != std::string::npos
+               || req.type == "purchase";
+    return true;
+}
+
+// One keep-alive HTTP/1.1 connection with blocking I/O
+class Connection {
+public:
+    Connection(asio::io_context& io, const Options& opt) : socket_(io), opt_(opt) {}
+
+    // Sends one request and reads the whole response; returns the HTTP
+    // status, or 0 on a connection or protocol error
+    int roundTrip(const std::string& method, const std::string& path,
+                  const std::string& body, const std::string& token, std::string* responseBody = nullptr) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (!socket_.is_open() && !connect()) return 0;
+            std::ostringstream req;
+            req << method << ' ' << path << " HTTP/1.1\r\n"
+                << "Host: " << opt_.host << ':' << opt_.port << "\r\n"
+                << "Connection: keep-alive\r\n";
+            if (!token.empty()) req << "Authorization: Bearer " << token << "\r\n";
+            if (!body.empty() || method == "POST" || method == "PUT") {
+                req << "Content-Type: application/json\r\n"
+                    << "Content-Length: " << body.size() << "\r\n";
+            }
+            req << "\r\n" << body;
+
+            asio::error_code ec;
+            asio::write(socket_, asio::buffer(req.str()), ec);
+            int status = ec ? 0 : readResponse(responseBody);
+            if (status) return status;
+            close();
+            // The server may have dropped an idle keep-alive connection;
+            // retry once on a fresh one
+        }
+        return 0;
+    }
+
+private:
+    bool connect() {
+        asio::error_code ec;
+        asio::ip::tcp::resolver resolver(socket_.get_executor());
+        auto endpoints = resolver.resolve(opt_.host, opt_.port, ec);
+        if (ec) return false;
+        asio::connect(socket_, endpoints, ec);
+        if (ec) return false;
+        socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+        return true;
+    }
+
+    void close() {
+        asio::error_code ec;
+        socket_.close(ec);
+        buffer_.consume(buffer_.size());
+    }
+
+    int readResponse(std::string* responseBody) {
+        asio::error_code ec;
+        std::size_t headerEnd = asio::read_until(socket_, buffer_, "\r\n\r\n", ec);
+        if (ec) return 0;
+        std::string head(asio::buffers_begin(buffer_.data()),
+                         asio::buffers_begin(buffer_.data()) + static_cast<std::ptrdiff_t>(headerEnd));
+        buffer_.consume(headerEnd);
+
+        int status = 0;
+        if (head.size() > 12) status = std::atoi(head.c_str() + 9); // "HTTP/1.1 200"
+        std::size_t length = 0;
+        bool closeAfter = false;
+        std::istringstream lines(head);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::string lower(line);
+            std::transform(lower.begin(), lower.end(), lower.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (lower.rfind("content-length:", 0) == 0) {
+                length = static_cast<std::size_t>(std::strtoull(line.c_str() + 15, nullptr, 10));
+            } else if (lower.rfind("connection: close", 0) == 0) {
+                closeAfter = true;
+            }
+        }
+        if (buffer_.size() < length) {
+            asio::read(socket_, buffer_, asio::transfer_exactly(length - buffer_.size()), ec);
+            if (ec) return 0;
+        }
+        if (responseBody) {
+            responseBody->assign(asio::buffers_begin(buffer_.data()),
+                                 asio::buffers_begin(buffer_.data()) + static_cast<std::ptrdiff_t>(length));
+        }
+        buffer_.consume(length);
+        if (closeAfter) close();
+        return status;
+    }
+
+    asio::ip::tcp::socket socket_;
+    asio::streambuf buffer_;
+    const Options& opt_;
+};
+
+// Pulls the "token" string out of the login response
+std::string extractToken(const std::string& body) {
+    std::size_t pos = body.find("\"token\"");
+    if (pos == std::string::npos) return std::string();
+    pos = body.find('"', body.find(':', pos));
+    if (pos == std::string::npos) return std::string();
+    std::size_t end = body.find('"', pos + 1);
+    return end == std::string::npos ? std::string() : body.substr(pos + 1, end - pos - 1);
+}
+
+std::string substitute(std::string s, const std::string& token) {
+    for (std::size_t pos; (pos = s.find("{token}")) != std::string::npos;) s.replace(pos, 7, token);
+    return s;
+}
+
+double ms(std::uint64_t nanos) {
+    return static_cast<double>(nanos) / 1e6;
+}
+
+void usage() {
+    std::cerr <<
+        "usage: sweet_shop_loadgen [options]\n"
+        "  --host H --port P        server (127.0.0.1:8080)\n"
+        "  --rate N                 requests per second, open loop (100)\n"
+        "  --duration S --warmup S  run length and unreported warmup, seconds (10, 2)\n"
+        "  --connections N          keep-alive connections (16)\n"
+        "  --mix t=w,...            weights for catalog, sweet, login, purchase\n"
+        "  --sweets N               sweet and purchase ids 1..N (100)\n"
+        "  --user U --password P    account used for login and purchases\n"
+        "  --seed N                 schedule seed (1)\n"
+        "  --record FILE            write the synthetic schedule as a trace\n"
+        "  --replay FILE --speed X  send a recorded trace, X times faster\n"
+        "  --json FILE              also write the report as JSON\n";
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--help" || a == "-h" || i + 1 >= argc) return false;
+        std::string v = argv[++i];
+        if (a == "--host") opt.host = v;
+        else if (a == "--port") opt.port = v;
+        else if (a == "--rate") opt.rate = std::atof(v.c_str());
+        else if (a == "--duration") opt.duration = std::atof(v.c_str());
+        else if (a == "--warmup") opt.warmup = std::atof(v.c_str());
+        else if (a == "--connections") opt.connections = std::atoi(v.c_str());
+        else if (a == "--mix") opt.mix = v;
+        else if (a == "--sweets") opt.sweets = std::atoi(v.c_str());
+        else if (a == "--user") opt.user = v;
+        else if (a == "--password") opt.password = v;
+        else if (a == "--seed") opt.seed = std::strtoull(v.c_str(), nullptr, 10);
+        else if (a == "--record") opt.record = v;
+        else if (a == "--replay") opt.replay = v;
+        else if (a == "--speed") opt.speed = std::atof(v.c_str());
+        else if (a == "--json") opt.json = v;
+        else return false;
+    }
+    return opt.rate > 0 && opt.duration > 0 && opt.connections > 0 && opt.sweets > 0 && opt.speed > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    // Build the whole schedule up front so sending never waits on it
+    std::vector<Request> schedule;
+    if (!opt.replay.empty()) {
+        std::ifstream in(opt.replay);
+        if (!in) {
+            std::cerr << "Cannot read trace " << opt.replay << "\n";
+            return 1;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            Request req;
+            if (!parseTraceLine(line, req)) {
+                std::cerr << "Skipping malformed trace line: " << line << "\n";
+                continue;
+            }
+            req.offset = std::chrono::duration_cast<Clock::duration>(req.offset / opt.speed);
+            schedule.push_back(std::move(req));
+        }
+        std::stable_sort(schedule.begin(), schedule.end(),
+                         [](const Request& a, const Request& b) { return a.offset < b.offset; });
+    } else {
+        std::vector<std::pair<std::string, int>> mix;
+        int mixTotal = 0;
+        std::istringstream parts(opt.mix);
+        std::string part;
+        while (std::getline(parts, part, ',')) {
+            std::size_t eq = part.find('=');
+            std::string type = part.substr(0, eq);
+            int weight = eq == std::string::npos ? 1 : std::atoi(part.c_str() + eq + 1);
+            if (type != "catalog" && type != "sweet" && type != "login" && type != "purchase") {
+                std::cerr << "Unknown request type in --mix: " << type << "\n";
+                return 2;
+            }
+            if (weight <= 0) continue;
+            mix.emplace_back(type, weight);
+            mixTotal += weight;
+        }
+        if (mixTotal == 0) {
+            usage();
+            return 2;
+        }
+        auto total = static_cast<std::uint64_t>(opt.rate * opt.duration);
+        schedule.reserve(total);
+        for (std::uint64_t i = 0; i < total; ++i) schedule.push_back(synthesize(opt, mix, mixTotal, i));
+        if (!opt.record.empty()) {
+            std::ofstream out(opt.record);
+            out << "# offset_ms type method path [body]\n";
+            for (const Request& r : schedule) {
+                out << std::chrono::duration<double, std::milli>(r.offset).count() << ' '
+                    << r.type << ' ' << r.method << ' ' << r.path;
+                if (!r.body.empty()) out << ' ' << r.body;
+                out << '\n';
+            }
+        }
+    }
+    if (schedule.empty()) {
+        std::cerr << "Nothing to send\n";
+        return 1;
+    }
+
+    asio::io_context io;
+    std::string token;
+    {
+        Connection setup(io, opt);
+        std::string body;
+        int status = setup.roundTrip("POST", "/api/auth/login",
+                                     "{\"username\":\"" + opt.user + "\",\"password\":\"" + opt.password + "\"}",
+                                     std::string(), &body);
+        token = extractToken(body);
+        // Every purchase and login would fail too, so the run would only
+        // measure error paths
+        if (status != 200 || token.empty()) {
+            std::cerr << "Login as " << opt.user << " failed (HTTP " << status
+                      << "); create the account or pass --user/--password\n";
+            return 1;
+        }
+    }
+
+    std::map<std::string, std::unique_ptr<Result>> results;
+    for (const Request& r : schedule) {
+        if (!results.count(r.type)) results[r.type].reset(new Result());
+    }
+    Result all;
+
+    const auto warmup = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(opt.replay.empty() ? opt.warmup : 0.0));
+    std::atomic<std::size_t> next{0};
+    const Clock::time_point start = Clock::now();
+
+    auto worker = [&] {
+        Connection conn(io, opt);
+        for (;;) {
+            std::size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= schedule.size()) return;
+            const Request& req = schedule[i];
+            Clock::time_point intended = start + req.offset;
+            std::this_thread::sleep_until(intended);
+
+            Clock::time_point sent = Clock::now();
+            int status = conn.roundTrip(req.method, substitute(req.path, token),
+                                        substitute(req.body, token), req.auth ? token : std::string());
+            Clock::time_point done = Clock::now();
+            if (req.offset < warmup) continue;
+
+            Result& res = *results.at(req.type);
+            auto latency = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(done - intended).count());
+            auto service = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count());
+            for (Result* r : {&res, &all}) {
+                r->latency.record(latency);
+                r->service.record(service);
+                if (status == 0) ++r->ioErrors;
+                else if (status >= 400) ++r->httpErrors;
+                else ++r->ok;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < opt.connections; ++i) threads.emplace_back(worker);
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    double measured = elapsed - std::chrono::duration<double>(warmup).count();
+
+    std::ostringstream json;
+    json << "{\"target_rate\":" << (opt.replay.empty() ? opt.rate : 0.0)
+         << ",\"elapsed_seconds\":" << elapsed << ",\"types\":{";
+    std::cout << std::fixed << std::setprecision(2)
+              << "Sent " << schedule.size() << " requests in " << elapsed << " s over "
+              << opt.connections << " connections\n"
+              << "Latency in ms from intended start (service time = send to response)\n\n"
+              << std::left << std::setw(10) << "type" << std::right
+              << std::setw(9) << "ok" << std::setw(8) << "4xx5xx" << std::setw(7) << "io"
+              << std::setw(9) << "req/s" << std::setw(9) << "p50" << std::setw(9) << "p90"
+              << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "max"
+              << std::setw(11) << "svc p50" << std::setw(9) << "svc p99" << "\n";
+
+    bool first = true;
+    auto report = [&](const std::string& name, const Result& r) {
+        metrics::Histogram::Snapshot lat = r.latency.snapshot();
+        metrics::Histogram::Snapshot svc = r.service.snapshot();
+        double rps = measured > 0 ? static_cast<double>(lat.count) / measured : 0.0;
+        std::cout << std::left << std::setw(10) << name << std::right
+                  << std::setw(9) << r.ok.load() << std::setw(8) << r.httpErrors.load()
+                  << std::setw(7) << r.ioErrors.load() << std::setw(9) << rps
+                  << std::setw(9) << ms(lat.percentile(0.50)) << std::setw(9) << ms(lat.percentile(0.90))
+                  << std::setw(9) << ms(lat.percentile(0.99)) << std::setw(9) << ms(lat.percentile(0.999))
+                  << std::setw(9) << ms(lat.percentile(1.0))
+                  << std::setw(11) << ms(svc.percentile(0.50)) << std::setw(9) << ms(svc.percentile(0.99))
+                  << "\n";
+        if (!first) json << ',';
+        first = false;
+        json << '"' << name << "\":{\"ok\":" << r.ok.load() << ",\"http_errors\":" << r.httpErrors.load()
+             << ",\"io_errors\":" << r.ioErrors.load() << ",\"rps\":" << rps
+             << ",\"p50_ms\":" << ms(lat.percentile(0.50)) << ",\"p90_ms\":" << ms(lat.percentile(0.90))
+             << ",\"p99_ms\":" << ms(lat.percentile(0.99)) << ",\"p999_ms\":" << ms(lat.percentile(0.999))
+             << ",\"max_ms\":" << ms(lat.percentile(1.0))
+             << ",\"service_p50_ms\":" << ms(svc.percentile(0.50))
+             << ",\"service_p99_ms\":" << ms(svc.percentile(0.99)) << '}';
+    };
+    for (const auto& kv : results) report(kv.first, *kv.second);
+    report("all", all);
+    json << "}}\n";
+
+    if (!opt.json.empty()) {
+        std::ofstream out(opt.json);
+        out << json.str();
+    }
+    return all.ok.load() + all.httpErrors.load() == 0 ? 1 : 0;
+}
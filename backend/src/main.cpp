@@ -1,56 +1,1251 @@
 #include <crow.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include "AdmissionControl.h"
+#include "AssetCache.h"
+#include "Auth.h"
+#include "CatalogIO.h"
+#include "Cors.h"
+#include "Database.h"
+#include "HttpMetrics.h"
+#include "InventoryFeed.h"
+#include "LogStorage.h"
+#include "MemoryStorage.h"
+#include "Metrics.h"
+#include "QueryLog.h"
+#include "ResponseCompression.h"
+#include "RowFormat.h"
+#include "SalesRollup.h"
+#include "ServerConfig.h"
+#include "ShardedDatabase.h"
+#include "SingleFlight.h"
+#include "Sketches.h"
+#include "Stats.h"
+#include "Sweet.h"
+#include "Topic.h"
+#include "WorkerAffinity.h"
+#include "WorkerPool.h"
+
+namespace {
+
+using Claims = std::map<std::string, std::string>;
+
+// Claims of a valid "Authorization: Bearer <jwt>" header; empty when the
+// header is missing or the token does not verify.
+std::map<std::string, std::string> authenticate(const crow::request& req, const Auth& auth) {
+    const std::string& header = req.get_header_value("Authorization");
+    const std::string prefix = "Bearer ";
+    if (header.compare(0, prefix.size(), prefix) != 0) return {};
+    std::string token = header.substr(prefix.size());
+    if (!auth.validateToken(token)) return {};
+    return auth.decodeToken(token);
+}
+
+// Tokens carry a user_id claim; older ones without it fall back to
+// looking the user up by name, a blocking read.
+int userIdFromClaims(const std::map<std::string, std::string>& claims, Storage& db) {
+    auto it = claims.find("user_id");
+    if (it != claims.end() && !it->second.empty() && it->second != "0") {
+        return std::atoi(it->second.c_str());
+    }
+    it = claims.find("username");
+    if (it == claims.end()) return 0;
+    auto user = db.getUserByUsername(it->second);
+    return user.count("id") ? std::atoi(user["id"].c_str()) : 0;
+}
+
+// True when body is an object holding every key as a string
+bool hasStrings(const crow::json::rvalue& body, std::initializer_list<const char*> keys) {
+    if (!body || body.t() != crow::json::type::Object) return false;
+    for (const char* key : keys) {
+        if (!body.has(key) || body[key].t() != crow::json::type::String) return false;
+    }
+    return true;
+}
+
+// Reads body[key] as a whole number from min to max. False when it is
+// missing, not a number, fractional or out of range; never truncates.
+bool wholeNumber(const crow::json::rvalue& body, const char* key, double min, double max, double& out) {
+    if (!body || body.t() != crow::json::type::Object || !body.has(key)) return false;
+    if (body[key].t() != crow::json::type::Number) return false;
+    double value = body[key].d();
+    if (!(value >= min && value <= max) || value != std::floor(value)) return false;
+    out = value;
+    return true;
+}
+
+bool isAdmin(const std::map<std::string, std::string>& claims) {
+    auto it = claims.find("is_admin");
+    return it != claims.end() && (it->second == "1" || it->second == "true");
+}
+
+crow::json::wvalue purchaseToJson(const Purchase& p) {
+    crow::json::wvalue json;
+    json["id"] = p.id;
+    json["user_id"] = p.userId;
+    json["sweet_id"] = p.sweetId;
+    json["sweet_name"] = p.sweetName;
+    json["quantity"] = p.quantity;
+    json["total_price"] = p.totalPrice;
+    json["purchase_date"] = p.purchaseDate;
+    return json;
+}
+
+crow::json::wvalue sweetToJson(const Sweet& s) {
+    crow::json::wvalue json;
+    json["id"] = s.id;
+    json["name"] = s.name;
+    json["description"] = s.description;
+    json["category"] = s.category;
+    json["price"] = s.price;
+    json["quantity"] = s.quantity;
+    return json;
+}
+
+using BodyPtr = std::shared_ptr<const compression::PrecompressedBody>;
+
+// Last serialized body of a hot read with its compressed variants, so
+// an unchanged result is not compressed again. get() may compress: call
+// it from a worker pool, not an I/O or event-loop thread.
+class BodyCache {
+public:
+    BodyPtr get(std::string body) {
+        // Held across the rebuild, so callers racing with the same new
+        // body compress it once
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!current_ || current_->identity() != body) {
+            current_ = std::make_shared<const compression::PrecompressedBody>(
+                std::move(body), compression::kDynamicGzipLevel, compression::kDynamicBrotliQuality);
+        }
+        return current_;
+    }
+
+private:
+    std::mutex mutex_;
+    BodyPtr current_;
+};
+
+// True when an If-None-Match header names the asset's current ETag, in
+// any of its encodings
+bool etagMatches(const std::string& ifNoneMatch, const std::string& etag) {
+    if (ifNoneMatch.empty()) return false;
+    if (ifNoneMatch == "*") return true;
+    std::string base = etag.substr(1, etag.size() - 2);
+    std::size_t pos = 0;
+    while (pos < ifNoneMatch.size()) {
+        std::size_t comma = ifNoneMatch.find(',', pos);
+        if (comma == std::string::npos) comma = ifNoneMatch.size();
+        std::string tag = ifNoneMatch.substr(pos, comma - pos);
+        pos = comma + 1;
+        std::size_t open = tag.find('"');
+        std::size_t close = tag.rfind('"');
+        if (open == std::string::npos || close <= open) continue;
+        tag = tag.substr(open + 1, close - open - 1);
+        if (tag == base || tag == base + "-gzip" || tag == base + "-br") return true;
+    }
+    return false;
+}
+
+// A static file from the asset cache, or 304 when the client's copy is
+// current. Compressed variants get their own ETag, as they are different
+// bytes.
+crow::response assetResponse(const crow::request& req, const AssetCache::Asset& asset) {
+    crow::response res(200);
+    res.set_header("Cache-Control", asset.cacheControl);
+    if (etagMatches(req.get_header_value("If-None-Match"), asset.etag)) {
+        res.code = 304;
+        res.set_header("ETag", asset.etag);
+        return res;
+    }
+    if (!asset.body) {
+        // Too large to keep in memory: Crow streams it from disk
+        res.set_static_file_info_unsafe(asset.diskPath);
+        res.set_header("ETag", asset.etag);
+        return res;
+    }
+    ResponseCompression::send(res, *asset.body, req.get_header_value("Accept-Encoding"),
+                              asset.contentType);
+    std::string encoding = res.get_header_value("Content-Encoding");
+    res.set_header("ETag", encoding.empty()
+        ? asset.etag
+        : asset.etag.substr(0, asset.etag.size() - 1) + "-" + encoding + "\"");
+    return res;
+}
+
+crow::response jsonError(int code, const std::string& message) {
+    crow::json::wvalue body;
+    body["error"] = message;
+    crow::response res(code, body);
+    return res;
+}
+
+// Idempotency-Key header, if any. Keys are 1-128 characters from
+// [A-Za-z0-9._:-], which covers UUIDs and ULIDs; false when malformed.
+bool idempotencyKey(const crow::request& req, std::string& key) {
+    key = req.get_header_value("Idempotency-Key");
+    if (key.empty()) return true;
+    if (key.size() > 128) return false;
+    for (char c : key) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '_' && c != ':' && c != '-') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Error for a keyed request that was not applied, or nullptr to report
+// the operation's own failure
+const char* replayError(SweetManager::Replay replay, int& code) {
+    switch (replay) {
+    case SweetManager::Replay::InProgress:
+        code = 409;
+        return "A request with this Idempotency-Key is still in progress";
+    case SweetManager::Replay::KeyReused:
+        code = 422;
+        return "Idempotency-Key was already used for a different request";
+    case SweetManager::Replay::Unavailable:
+        code = 503;
+        return "Storage unavailable; the request may not have been applied";
+    default:
+        return nullptr;
+    }
+}
+
+// Reads the fields present in a PATCH body into patch (ignoring "id").
+// False with a message when one has the wrong type or is out of range.
+bool patchFromJson(const crow::json::rvalue& body, SweetPatch& patch, std::string& error) {
+    struct Text {
+        const char* key;
+        unsigned field;
+        std::string Sweet::*member;
+        std::size_t maxLength; // matches the sweets column
+        bool required;
+    };
+    const Text texts[] = {
+        {"name", SweetPatch::Name, &Sweet::name, 100, true},
+        {"description", SweetPatch::Description, &Sweet::description, 65535, false},
+        {"category", SweetPatch::Category, &Sweet::category, 50, true},
+    };
+    for (const Text& t : texts) {
+        if (!body.has(t.key)) continue;
+        if (body[t.key].t() != crow::json::type::String) {
+            error = std::string(t.key) + " must be a string";
+            return false;
+        }
+        std::string value = body[t.key].s();
+        if ((t.required && value.empty()) || value.size() > t.maxLength) {
+            error = std::string(t.key) + " must be " + (t.required ? "1" : "0") + "-" +
+                    std::to_string(t.maxLength) + " characters";
+            return false;
+        }
+        patch.values.*t.member = std::move(value);
+        patch.fields |= t.field;
+    }
+    if (body.has("price")) {
+        double price = body["price"].t() == crow::json::type::Number ? body["price"].d() : -1;
+        if (!(price >= 0 && price < 1e8)) {
+            error = "price must be a number from 0 to 99999999.99";
+            return false;
+        }
+        patch.values.price = price;
+        patch.fields |= SweetPatch::Price;
+    }
+    if (body.has("quantity")) {
+        double quantity = body["quantity"].t() == crow::json::type::Number ? body["quantity"].d() : -1;
+        if (!(quantity >= 0 && quantity <= 2147483647.0) || quantity != std::floor(quantity)) {
+            error = "quantity must be a non-negative integer";
+            return false;
+        }
+        patch.values.quantity = static_cast<int>(quantity);
+        patch.fields |= SweetPatch::Quantity;
+    }
+    if (patch.fields == 0) {
+        error = "Nothing to change: give name, description, category, price or quantity";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
 
 int main() {
-    crow::SimpleApp app;
+    ServerConfig config;
+    std::string configError;
+    if (!config.load(configError)) {
+        std::cerr << "Bad server configuration: " << configError << "\n";
+        return 1;
+    }
+
+    // SWEET_SHOP_STORAGE=memory runs without MySQL (for load testing);
+    // SWEET_SHOP_MEMORY_SWEETS sets how many catalog rows it starts with.
+    // SWEET_SHOP_STORAGE=log is the embedded durable engine, keeping its
+    // WAL and snapshots in SWEET_SHOP_DATA_DIR (default ./data).
+    // MySQL statements taking SWEET_SHOP_DB_SLOW_MS (default 100) or longer
+    // go to the slow query log
+    if (const char* slowMs = std::getenv("SWEET_SHOP_DB_SLOW_MS")) {
+        querylog::setThreshold(std::chrono::milliseconds(std::atoi(slowMs)));
+    }
+    std::unique_ptr<Storage> storage;
+    Database* mysql = nullptr;
+    ShardedDatabase* sharded = nullptr;
+    const char* engine = std::getenv("SWEET_SHOP_STORAGE");
+    if (engine && std::string(engine) == "memory") {
+        storage.reset(new MemoryStorage());
+        const char* n = std::getenv("SWEET_SHOP_MEMORY_SWEETS");
+        int count = n ? std::atoi(n) : 100;
+        const char* categories[] = {"Chocolate", "Gummies", "Hard Candy", "Caramel", "Taffy"};
+        for (int i = 1; i <= count; ++i) {
+            storage->createSweet("Sweet " + std::to_string(i), "Load test item",
+                                 categories[i % 5], 0.99 + (i % 10), 1000000);
+        }
+        std::cout << "Using in-memory storage with " << count << " sweets\n";
+    } else if (engine && std::string(engine) == "log") {
+        const char* dir = std::getenv("SWEET_SHOP_DATA_DIR");
+        LogStorage* log = new LogStorage(dir ? dir : "data");
+        storage.reset(log);
+        if (!log->open()) {
+            std::cerr << "Could not open the log storage engine\n";
+            return 1;
+        }
+    } else if (const char* shardMap = std::getenv("SWEET_SHOP_DB_SHARDS")) {
+        // Sweets spread over the MySQL servers listed in the shard map
+        // file; POST /api/admin/shards/reload re-reads it
+        sharded = new ShardedDatabase("root", "your_password", "sweet_shop", shardMap);
+        storage.reset(sharded);
+        std::string error;
+        if (!sharded->connect(error)) {
+            std::cerr << "Could not open the shards in " << shardMap << ": " << error << "\n";
+            return 1;
+        }
+        const char* n = std::getenv("SWEET_SHOP_DB_ASYNC_CONNECTIONS");
+        if (!sharded->startAsync(n ? static_cast<std::size_t>(std::atoi(n)) : 8)) {
+            std::cerr << "Non-blocking MySQL client unavailable; using blocking calls\n";
+        }
+        for (const auto& shard : sharded->shards()) {
+            std::cout << "Shard " << shard.name << " at " << shard.endpoint << " (weight " << shard.weight
+                      << (shard.home ? ", home" : "") << ")\n";
+        }
+    } else {
+        // SWEET_SHOP_DB_HOST / SWEET_SHOP_DB_PORT locate the primary
+        const char* host = std::getenv("SWEET_SHOP_DB_HOST");
+        const char* port = std::getenv("SWEET_SHOP_DB_PORT");
+        mysql = new Database(host ? host : "127.0.0.1", "root", "your_password", "sweet_shop",
+                                       port ? static_cast<unsigned int>(std::atoi(port)) : 3306);
+        storage.reset(mysql);
+        // Catalog reads and purchases run on a pool of non-blocking
+        // connections (SWEET_SHOP_DB_ASYNC_CONNECTIONS, default 8)
+        const char* n = std::getenv("SWEET_SHOP_DB_ASYNC_CONNECTIONS");
+        if (!mysql->startAsync(n ? static_cast<std::size_t>(std::atoi(n)) : 8)) {
+            std::cerr << "Non-blocking MySQL client unavailable; using blocking calls\n";
+        }
+        // Read replicas, e.g. SWEET_SHOP_DB_REPLICAS=10.0.0.2:3306,10.0.0.3:3306.
+        // One lagging more than SWEET_SHOP_DB_REPLICA_MAX_LAG seconds
+        // (default 2) stops taking reads until it catches up.
+        if (const char* list = std::getenv("SWEET_SHOP_DB_REPLICAS")) {
+            std::vector<std::pair<std::string, unsigned int>> endpoints;
+            if (!ReplicaSet::parseEndpoints(list, endpoints)) {
+                std::cerr << "SWEET_SHOP_DB_REPLICAS must be host[:port],...\n";
+                return 1;
+            }
+            ReplicaSet::Options options;
+            if (const char* lag = std::getenv("SWEET_SHOP_DB_REPLICA_MAX_LAG")) {
+                options.maxLag = std::chrono::seconds(std::atoi(lag));
+            }
+            std::unique_ptr<ReplicaSet> replicas(new ReplicaSet("root", "your_password", "sweet_shop", options));
+            for (const auto& e : endpoints) replicas->add(e.first, e.second);
+            replicas->start();
+            for (const auto& r : replicas->status()) {
+                std::cout << "Read replica " << r.endpoint << ": "
+                          << (r.healthy ? "lag " + std::to_string(r.lagSeconds) + "s" : "not in rotation (" + r.error + ")")
+                          << "\n";
+            }
+            mysql->useReplicas(std::move(replicas));
+        }
+    }
+    // The frontend is served from memory on the API's own origin, so the
+    // browser needs no CORS preflights
+    AssetCache assets;
+    if (!config.frontendDir.empty()) {
+        if (assets.load(config.frontendDir)) {
+            std::cout << "Serving " << assets.size() << " frontend files ("
+                      << assets.bytes() / 1024 << " KB cached) from " << config.frontendDir << "\n";
+        } else {
+            std::cerr << "Frontend directory " << config.frontendDir
+                      << " not found; serving the API only\n";
+        }
+    }
+
+    Storage& db = *storage;
+    Auth auth(db, "your-secret-key-here");
+    SweetManager sweets(db);
+
+    StatsEngine stats;
+    if (!stats.rebuild(db)) {
+        std::cerr << "Could not load dashboard totals; starting from zero\n";
+    }
+    sweets.addListener(&stats);
+    auth.addListener(&stats);
+    // Other server processes sharing MySQL move the totals too
+    if (mysql || sharded) stats.startResync(db, std::chrono::seconds(60));
 
-    // Root route
-    CROW_ROUTE(app, "/")([]() {
+    SalesSketches sketches;
+    sweets.addListener(&sketches);
+
+    SalesRollup rollup;
+    sweets.addListener(&rollup);
+    if (!rollup.backfill(db)) {
+        std::cerr << "Sales rollup backfill failed; reports cover new purchases only\n";
+    }
+
+    // Catalog deltas pushed to open pages over /api/live
+    Topic inventory("inventory");
+    InventoryFeed inventoryFeed(inventory);
+    sweets.addListener(&inventoryFeed);
+    sweets.setCatalogVersion([&inventory] { return inventory.head(); });
+
+    // Cors runs first so preflights are answered before anything else and
+    // every response, shed ones included, carries the CORS headers.
+    // HttpMetrics comes before AdmissionControl so shed requests are still
+    // counted and timed. Routes are declared with SHOP_ROUTE so HttpMetrics
+    // can label requests by the route they matched.
+    crow::App<Cors, HttpMetrics, AdmissionControl, WorkerAffinity, ResponseCompression> app;
+    Cors::Policy cors;
+    cors.origins = config.corsOrigins;
+    if (!config.corsMethods.empty()) cors.methods = config.corsMethods;
+    if (!config.corsHeaders.empty()) cors.headers = config.corsHeaders;
+    cors.maxAge = config.corsMaxAge;
+    app.get_middleware<Cors>().configure(cors);
+    app.get_middleware<WorkerAffinity>().cpus = config.cpus;
+
+    // Root route: the frontend when it is being served
+    SHOP_ROUTE(app, "/")([&](const crow::request& req) {
+        if (const AssetCache::Asset* index = assets.find("/")) return assetResponse(req, *index);
         crow::response res(200, "Sweet Shop API is running");
-        res.add_header("Access-Control-Allow-Origin", "*");
         return res;
     });
 
-    // Preflight (CORS)
-    CROW_ROUTE(app, "/<path>")
+    // Frontend files; /api routes are matched first
+    SHOP_ROUTE(app, "/<path>")
+        .methods("GET"_method)
+    ([&](const crow::request& req, std::string path) {
+        const AssetCache::Asset* asset = assets.find("/" + path);
+        if (!asset) return crow::response(404);
+        return assetResponse(req, *asset);
+    });
+
+    // Prometheus scrape endpoint
+    SHOP_ROUTE(app, "/metrics")
+        .methods("GET"_method)
+    ([]() {
+        crow::response res(200, metrics::renderPrometheus());
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
+
+    // Preflight (CORS). The Cors middleware answers these before routing
+    // reaches here; the route only makes every path accept OPTIONS.
+    SHOP_ROUTE(app, "/<path>")
         .methods("OPTIONS"_method)
     ([](const crow::request&, std::string) {
-        crow::response res(204);
-        res.add_header("Access-Control-Allow-Origin", "*");
-        res.add_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        res.add_header("Access-Control-Allow-Headers", "Content-Type");
-        return res;
+        return crow::response(204);
     });
 
-    // Get sweets
-    CROW_ROUTE(app, "/api/sweets")
+    // Get sweets. Completed from callbacks, so no worker thread waits on
+    // the query. Requests that shared one catalog read share one render:
+    // the list is serialized on the render pool rather than the storage
+    // I/O thread, and only compressed again when it changed. Feed-Seq is
+    // the /api/live sequence number the list is current to: a page drops
+    // live events at or below it.
+    BodyCache catalogBody;
+    SingleFlight<BodyPtr> catalogRender("catalog_render");
+    WorkerPool renderPool("render", 2, 1024);
+    SHOP_ROUTE(app, "/api/sweets")
         .methods("GET"_method)
-    ([]() {
-        crow::response res(200, "[]");
-        res.add_header("Access-Control-Allow-Origin", "*");
+    ([&](const crow::request& req, crow::response& res) {
+        std::string acceptEncoding = req.get_header_value("Accept-Encoding");
+        auto reply = [&res, acceptEncoding](BodyPtr body, std::uint64_t seq) {
+            if (!body) {
+                res = jsonError(503, "Server is busy, please retry");
+                return res.end();
+            }
+            res = crow::response(200);
+            ResponseCompression::send(res, *body, acceptEncoding, "application/json");
+            res.set_header("Feed-Seq", std::to_string(seq));
+            res.end();
+        };
+        sweets.getAllSweetsAsync([&, reply](bool ok, SweetManager::Catalog all, std::uint64_t seq) {
+            if (!ok) {
+                res = jsonError(503, "Catalog unavailable");
+                return res.end();
+            }
+            // The list stays alive until its render finishes, so its
+            // address names it for the render's lifetime
+            std::ostringstream key;
+            key << all.get();
+            catalogRender.runAsync(key.str(), [&catalogBody, &renderPool, all](std::function<void(BodyPtr)> finish) {
+                bool queued = renderPool.post([&catalogBody, all, finish] {
+                    std::vector<crow::json::wvalue> list;
+                    list.reserve(all->size());
+                    for (const auto& s : *all) list.push_back(sweetToJson(s));
+                    finish(catalogBody.get(crow::json::wvalue(std::move(list)).dump()));
+                });
+                if (!queued) finish(nullptr);
+            }, [reply, seq](BodyPtr body) { reply(std::move(body), seq); });
+        });
+    });
+
+    // Partial update of one sweet (admin only): only the fields present
+    // in the body change
+    SHOP_ROUTE(app, "/api/sweets/<int>")
+        .methods("PATCH"_method)
+    ([&](const crow::request& req, int sweetId) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        auto body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::Object) return jsonError(400, "Expected a JSON object");
+        SweetPatch patch;
+        std::string error;
+        if (!patchFromJson(body, patch, error)) return jsonError(400, error);
+        patch.id = sweetId;
+
+        std::vector<Sweet> updated;
+        if (!sweets.patchSweets({patch}, &updated)) {
+            if (sweets.getSweetById(sweetId).id == 0) return jsonError(404, "Sweet not found");
+            return jsonError(503, "Update failed");
+        }
+        crow::response res(200, sweetToJson(updated.front()));
+        return res;
+    });
+
+    // Bulk partial update (admin only), e.g. seasonal repricing. The body
+    // is an array of {"id", ...fields}; storage applies it as one UPDATE
+    // per 1000 sweets inside a single transaction, so either every change
+    // lands or none does, and the catalog cache is invalidated once.
+    const std::size_t kMaxPatches = 10000;
+    SHOP_ROUTE(app, "/api/sweets")
+        .methods("PATCH"_method)
+    ([&](const crow::request& req) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        auto body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::List) {
+            return jsonError(400, "Expected a JSON array of changes");
+        }
+        if (body.size() == 0 || body.size() > kMaxPatches) {
+            return jsonError(400, "A bulk update holds 1 to " + std::to_string(kMaxPatches) + " changes");
+        }
+
+        std::vector<SweetPatch> patches(body.size());
+        std::set<int> ids;
+        for (std::size_t i = 0; i < body.size(); ++i) {
+            const auto& item = body[i];
+            std::string where = "change " + std::to_string(i) + ": ";
+            double id = 0;
+            if (!wholeNumber(item, "id", 1, INT_MAX, id)) {
+                return jsonError(400, where + "needs a positive integer \"id\"");
+            }
+            patches[i].id = static_cast<int>(id);
+            if (!ids.insert(patches[i].id).second) {
+                return jsonError(400, where + "sweet " + std::to_string(patches[i].id) + " is listed twice");
+            }
+            std::string error;
+            if (!patchFromJson(item, patches[i], error)) return jsonError(400, where + error);
+        }
+
+        std::vector<Sweet> updated;
+        if (!sweets.patchSweets(patches, &updated)) {
+            for (int id : ids) {
+                if (sweets.getSweetById(id).id == 0) {
+                    return jsonError(404, "Sweet " + std::to_string(id) + " not found; nothing was changed");
+                }
+            }
+            return jsonError(503, "Bulk update failed; nothing was changed");
+        }
+        std::vector<crow::json::wvalue> list;
+        list.reserve(updated.size());
+        for (const auto& s : updated) list.push_back(sweetToJson(s));
+        crow::json::wvalue resBody;
+        resBody["updated"] = static_cast<unsigned long long>(updated.size());
+        resBody["sweets"] = std::move(list);
+        crow::response res(200, resBody);
+        return res;
+    });
+
+    // Live catalog changes. Each connection gets a hello carrying the
+    // current sequence number, then every delta; after reconnecting a page
+    // sends {"resume": <last seq>} to replay what it missed.
+    std::mutex liveMutex;
+    std::unordered_map<crow::websocket::connection*, std::uint64_t> liveSubscribers;
+    app.get_middleware<HttpMetrics>().addRoute("/api/live");
+    CROW_WEBSOCKET_ROUTE(app, "/api/live")
+        .onopen([&](crow::websocket::connection& conn) {
+            std::uint64_t id = inventory.subscribe(
+                [&conn](const std::string& message) { conn.send_text(message); });
+            std::lock_guard<std::mutex> lock(liveMutex);
+            liveSubscribers[&conn] = id;
+        })
+        .onmessage([&](crow::websocket::connection& conn, const std::string& data, bool) {
+            auto body = crow::json::load(data);
+            double seq = 0;
+            // Exact in a double up to 2^53, far beyond any sequence number
+            if (!wholeNumber(body, "resume", 0, 9007199254740992.0, seq)) return;
+            std::lock_guard<std::mutex> lock(liveMutex);
+            auto it = liveSubscribers.find(&conn);
+            if (it != liveSubscribers.end()) {
+                inventory.resume(it->second, static_cast<std::uint64_t>(seq));
+            }
+        })
+        .onclose([&](crow::websocket::connection& conn, const std::string&) {
+            std::lock_guard<std::mutex> lock(liveMutex);
+            auto it = liveSubscribers.find(&conn);
+            if (it == liveSubscribers.end()) return;
+            // Once this returns the topic never touches conn again
+            inventory.unsubscribe(it->second);
+            liveSubscribers.erase(it);
+        });
+
+    // Purchase a sweet as the authenticated user; non-blocking like the
+    // catalog. A retry with the same Idempotency-Key gets the original
+    // purchase back, marked with Idempotent-Replayed, and buys nothing.
+    SHOP_ROUTE(app, "/api/sweets/<int>/purchase")
+        .methods("POST"_method)
+    ([&](const crow::request& req, crow::response& res, int sweetId) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) {
+            res = jsonError(401, "Unauthorized");
+            return res.end();
+        }
+        double quantity = 0;
+        if (!wholeNumber(crow::json::load(req.body), "quantity", 1, INT_MAX, quantity)) {
+            res = jsonError(400, "quantity must be a positive integer");
+            return res.end();
+        }
+        std::string key;
+        if (!idempotencyKey(req, key)) {
+            res = jsonError(400, "Idempotency-Key must be 1-128 characters of A-Z a-z 0-9 . _ : -");
+            return res.end();
+        }
+        int userId = userIdFromClaims(claims, db);
+        sweets.purchaseSweetAsync(userId, sweetId, static_cast<int>(quantity), key,
+                                  [&res](bool ok, const Purchase& p, SweetManager::Replay replay) {
+            int code = 400;
+            if (const char* error = replayError(replay, code)) {
+                res = jsonError(code, error);
+            } else if (!ok) {
+                res = jsonError(400, "Purchase failed: unknown sweet or insufficient stock");
+            } else {
+                crow::json::wvalue resBody;
+                resBody["message"] = "Purchase successful";
+                resBody["total"] = p.totalPrice;
+                resBody["purchase"] = purchaseToJson(p);
+                res = crow::response(200, resBody);
+                if (replay == SweetManager::Replay::Replayed) res.set_header("Idempotent-Replayed", "true");
+            }
+            res.end();
+        });
+    });
+
+    // Add stock (admin only). Restocks are blind increments, so clients
+    // should send an Idempotency-Key to make retries safe.
+    SHOP_ROUTE(app, "/api/sweets/<int>/restock")
+        .methods("POST"_method)
+    ([&](const crow::request& req, int sweetId) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        double amount = 0;
+        if (!wholeNumber(crow::json::load(req.body), "quantity", 1, INT_MAX, amount)) {
+            return jsonError(400, "quantity must be a positive integer");
+        }
+        int quantity = static_cast<int>(amount);
+        std::string key;
+        if (!idempotencyKey(req, key)) {
+            return jsonError(400, "Idempotency-Key must be 1-128 characters of A-Z a-z 0-9 . _ : -");
+        }
+        if (sweets.getSweetById(sweetId).id == 0) return jsonError(404, "Sweet not found");
+
+        int userId = userIdFromClaims(claims, db);
+        SweetManager::Replay replay;
+        bool ok = sweets.restockSweet(userId, sweetId, quantity, key, replay);
+        int code = 500;
+        if (const char* error = replayError(replay, code)) return jsonError(code, error);
+        if (!ok) return jsonError(503, "Restock failed");
+
+        crow::json::wvalue resBody;
+        resBody["message"] = "Restock successful";
+        resBody["sweet_id"] = sweetId;
+        resBody["added"] = quantity;
+        crow::response res(200, resBody);
+        if (replay == SweetManager::Replay::Replayed) res.set_header("Idempotent-Replayed", "true");
+        return res;
+    });
+
+    // Hot-sweet mode (admin only; MySQL storage). PUT {"slots": n} splits
+    // the sweet's stock over n counters so a flash sale's buyers stop
+    // queueing on one row lock; n = 1 folds it back. Both answer with the
+    // slots and what each holds.
+    SHOP_ROUTE(app, "/api/admin/sweets/<int>/stock-slots")
+        .methods("GET"_method, "PUT"_method)
+    ([&](const crow::request& req, int sweetId) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        if (!mysql && !sharded) return jsonError(404, "Stock slots need MySQL storage");
+        if (sweets.getSweetById(sweetId).id == 0) return jsonError(404, "Sweet not found");
+        if (req.method == crow::HTTPMethod::Put) {
+            double slots = 0;
+            if (!wholeNumber(crow::json::load(req.body), "slots", 1, Storage::kMaxStockSlots, slots)) {
+                return jsonError(400, "slots must be 1-" + std::to_string(Storage::kMaxStockSlots));
+            }
+            if (!db.setStockSlots(sweetId, static_cast<int>(slots))) return jsonError(503, "Could not change the stock slots");
+        }
+
+        std::vector<crow::json::wvalue> list;
+        long long stock = 0;
+        for (const auto& row : db.getStockSlots(sweetId)) {
+            crow::json::wvalue entry;
+            entry["slot"] = std::stoi(row.at("slot"));
+            entry["quantity"] = std::stoll(row.at("quantity"));
+            stock += std::stoll(row.at("quantity"));
+            list.push_back(std::move(entry));
+        }
+        crow::json::wvalue resBody;
+        resBody["sweet_id"] = sweetId;
+        resBody["slot_stock"] = stock;
+        resBody["slots"] = std::move(list);
+        crow::response res(200, resBody);
         return res;
     });
 
-    // Register user
-    CROW_ROUTE(app, "/api/auth/register")
+    // Register user; answers with a token so the new user is signed in
+    SHOP_ROUTE(app, "/api/auth/register")
         .methods("POST"_method)
-    ([](const crow::request& req) {
+    ([&](const crow::request& req) {
         auto body = crow::json::load(req.body);
-        if (!body) {
-            return crow::response(400, "Invalid JSON");
+        if (!hasStrings(body, {"username", "password", "email"})) {
+            return jsonError(400, "Expected username, email and password");
         }
+        std::string username = body["username"].s();
+        std::string token = auth.registerUser(username, body["password"].s(), body["email"].s());
+        if (token.empty()) return jsonError(409, "Registration failed");
 
         crow::json::wvalue resBody;
         resBody["message"] = "registered";
-        resBody["username"] = body["username"].s();
+        resBody["username"] = username;
+        resBody["token"] = token;
 
         crow::response res(201, resBody);
-        res.add_header("Access-Control-Allow-Origin", "*");
         return res;
     });
 
-    std::cout << "Server running on http://localhost:8080\n";
-    app.port(8080).multithreaded().run();
+    // Login user
+    SHOP_ROUTE(app, "/api/auth/login")
+        .methods("POST"_method)
+    ([&](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!hasStrings(body, {"username", "password"})) {
+            return jsonError(400, "Expected username and password");
+        }
+        std::string username = body["username"].s();
+        std::string token = auth.login(username, body["password"].s());
+        if (token.empty()) return jsonError(401, "Invalid username or password");
+
+        crow::json::wvalue resBody;
+        resBody["username"] = username;
+        resBody["token"] = token;
+
+        crow::response res(200, resBody);
+        return res;
+    });
+
+    // Purchase history for the authenticated user, newest first.
+    // Pages are keyset-based: pass back next.before_date / next.before_id.
+    auto purchaseHistory = [&](const crow::request& req, const Claims& claims) -> crow::response {
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        int userId = userIdFromClaims(claims, db);
+        if (userId <= 0) return jsonError(401, "Unauthorized");
+
+        int limit = 20;
+        if (const char* l = req.url_params.get("limit")) limit = std::atoi(l);
+        if (limit <= 0 || limit > 100) limit = 20;
+        std::string beforeDate;
+        int beforeId = 0;
+        if (const char* d = req.url_params.get("before_date")) beforeDate = d;
+        if (const char* i = req.url_params.get("before_id")) beforeId = std::atoi(i);
+
+        bool ok = false;
+        auto purchases = sweets.getUserPurchases(userId, beforeDate, beforeId, limit, &ok);
+        if (!ok) return jsonError(503, "Purchase history unavailable");
+
+        std::vector<crow::json::wvalue> list;
+        for (const auto& p : purchases) list.push_back(purchaseToJson(p));
+        crow::json::wvalue resBody;
+        resBody["purchases"] = std::move(list);
+        if (static_cast<int>(purchases.size()) == limit) {
+            resBody["next"]["before_date"] = purchases.back().purchaseDate;
+            resBody["next"]["before_id"] = purchases.back().id;
+        } else {
+            resBody["next"] = nullptr;
+        }
+
+        crow::response res(200, resBody);
+        return res;
+    };
+    SHOP_ROUTE(app, "/api/purchases/history")
+        .methods("GET"_method)
+    ([&](const crow::request& req) {
+        return purchaseHistory(req, authenticate(req, auth));
+    });
+
+    // Single purchase; visible to its owner and to admins
+    auto purchaseById = [&](const crow::request& /*req*/, const Claims& claims,
+                            int id) -> crow::response {
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+
+        Purchase p = sweets.getPurchaseById(id);
+        if (p.id == 0) return jsonError(404, "Purchase not found");
+        if (!isAdmin(claims) && p.userId != userIdFromClaims(claims, db)) {
+            return jsonError(404, "Purchase not found");
+        }
+
+        crow::response res(200, purchaseToJson(p));
+        return res;
+    };
+    SHOP_ROUTE(app, "/api/purchases/<int>")
+        .methods("GET"_method)
+    ([&](const crow::request& req, int id) {
+        return purchaseById(req, authenticate(req, auth), id);
+    });
+
+    // Dashboard totals (admin only), served from StatsEngine
+    auto adminStats = [&](const crow::request& /*req*/, const Claims& claims) -> crow::response {
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+
+        DashboardStats snap = stats.snapshot();
+        crow::json::wvalue resBody;
+        resBody["total_revenue"] = snap.totalRevenue;
+        resBody["units_sold"] = snap.unitsSold;
+        resBody["orders"] = snap.orderCount;
+        resBody["users"] = snap.userCount;
+        resBody["sweets"] = snap.sweetCount;
+        resBody["units_in_stock"] = snap.unitsInStock;
+        resBody["low_stock"] = snap.lowStockCount;
+        resBody["out_of_stock"] = snap.outOfStockCount;
+        for (const auto& kv : snap.revenueByCategory) {
+            resBody["revenue_by_category"][kv.first] = kv.second;
+        }
+
+        crow::response res(200, resBody);
+        return res;
+    };
+    SHOP_ROUTE(app, "/api/admin/stats")
+        .methods("GET"_method)
+    ([&](const crow::request& req) {
+        return adminStats(req, authenticate(req, auth));
+    });
+
+    // Approximate best sellers and unique buyers (admin only) over the
+    // last `windows` sketch windows (one hour each by default)
+    auto trending = [&](const crow::request& req, const Claims& claims) -> crow::response {
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+
+        int windows = sketches.config().windows;
+        int k = 10;
+        if (const char* w = req.url_params.get("windows")) windows = std::atoi(w);
+        if (const char* kk = req.url_params.get("k")) k = std::atoi(kk);
+        if (windows < 1 || windows > sketches.config().windows) windows = sketches.config().windows;
+        if (k < 1 || k > 100) k = 10;
+
+        std::vector<crow::json::wvalue> top;
+        for (const auto& item : sketches.topSellers(windows, static_cast<std::size_t>(k))) {
+            crow::json::wvalue entry;
+            entry["sweet_id"] = item.sweetId;
+            entry["units"] = item.units;
+            top.push_back(std::move(entry));
+        }
+        crow::json::wvalue resBody;
+        resBody["window_seconds"] = sketches.config().windowSeconds * windows;
+        resBody["top_sellers"] = std::move(top);
+        resBody["unique_buyers"] = static_cast<long long>(sketches.uniqueBuyers(windows) + 0.5);
+
+        crow::response res(200, resBody);
+        return res;
+    };
+    SHOP_ROUTE(app, "/api/admin/stats/trending")
+        .methods("GET"_method)
+    ([&](const crow::request& req) {
+        return trending(req, authenticate(req, auth));
+    });
+
+    // Sales report (admin only) over an inclusive date range, merged from
+    // the precomputed rollup buckets
+    auto salesReport = [&](const crow::request& req, const Claims& claims) -> crow::response {
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+
+        const char* start = req.url_params.get("startDate");
+        const char* end = req.url_params.get("endDate");
+        const char* granularity = req.url_params.get("granularity");
+        bool hourly = granularity && std::string(granularity) == "hour";
+        SalesReport report;
+        if (!start || !end || !rollup.report(start, end, hourly, report)) {
+            return jsonError(400, "startDate and endDate must be YYYY-MM-DD");
+        }
+
+        auto bucketJson = [](const SalesBucket& b) {
+            crow::json::wvalue json;
+            json["orders"] = b.orders;
+            json["units"] = b.units;
+            json["revenue"] = b.revenue;
+            return json;
+        };
+        crow::json::wvalue resBody;
+        resBody["start_date"] = start;
+        resBody["end_date"] = end;
+        resBody["total"] = bucketJson(report.total);
+        std::vector<crow::json::wvalue> bySweet;
+        for (const auto& kv : report.bySweet) {
+            crow::json::wvalue entry = bucketJson(kv.second);
+            entry["sweet_id"] = kv.first;
+            bySweet.push_back(std::move(entry));
+        }
+        resBody["by_sweet"] = std::move(bySweet);
+        for (const auto& kv : report.byCategory) {
+            resBody["by_category"][kv.first] = bucketJson(kv.second);
+        }
+        std::vector<crow::json::wvalue> series;
+        for (const auto& kv : report.series) {
+            crow::json::wvalue entry = bucketJson(kv.second);
+            entry["period"] = kv.first;
+            series.push_back(std::move(entry));
+        }
+        resBody["series"] = std::move(series);
+
+        crow::response res(200, resBody);
+        return res;
+    };
+    SHOP_ROUTE(app, "/api/admin/sales")
+        .methods("GET"_method)
+    ([&](const crow::request& req) {
+        return salesReport(req, authenticate(req, auth));
+    });
+
+    // Bulk catalog import (admin only). The body is CSV or NDJSON, picked
+    // by ?format= or the Content-Type. Records are parsed and validated in
+    // parallel; bad ones are reported and skipped, the rest are stored in
+    // multi-row batches. ?dry_run=1 only validates.
+    SHOP_ROUTE(app, "/api/admin/sweets/import")
+        .methods("POST"_method)
+    ([&](const crow::request& req) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        catalogio::Format format;
+        const char* name = req.url_params.get("format");
+        if (!catalogio::parseFormat(name ? name : req.get_header_value("Content-Type"), format)) {
+            return jsonError(400, "format must be csv or ndjson");
+        }
+        const char* dry = req.url_params.get("dry_run");
+        bool dryRun = dry && (std::string(dry) == "1" || std::string(dry) == "true");
+
+        catalogio::ParseResult parsed = catalogio::parse(req.body, format);
+        if (!parsed.errors.empty() && parsed.errors.front().record == 0) {
+            return jsonError(400, parsed.errors.front().message);
+        }
+        std::size_t stored = dryRun ? 0 : sweets.importSweets(parsed.sweets);
+
+        const std::size_t maxErrors = 100;
+        std::vector<crow::json::wvalue> errors;
+        for (std::size_t i = 0; i < parsed.errors.size() && i < maxErrors; ++i) {
+            crow::json::wvalue entry;
+            entry["record"] = static_cast<unsigned long long>(parsed.errors[i].record);
+            entry["error"] = parsed.errors[i].message;
+            errors.push_back(std::move(entry));
+        }
+        crow::json::wvalue resBody;
+        resBody["records"] = static_cast<unsigned long long>(parsed.records);
+        resBody["valid"] = static_cast<unsigned long long>(parsed.sweets.size());
+        resBody["imported"] = static_cast<unsigned long long>(stored);
+        resBody["rejected"] = static_cast<unsigned long long>(parsed.errors.size());
+        resBody["dry_run"] = dryRun;
+        resBody["errors"] = std::move(errors);
+        // A storage failure part way leaves the earlier batches in place
+        bool failed = !dryRun && stored < parsed.sweets.size();
+        crow::response res(failed ? 500 : 200, resBody);
+        return res;
+    });
+
+    // Catalog export (admin only) in the import formats, ordered by id
+    SHOP_ROUTE(app, "/api/admin/sweets/export")
+        .methods("GET"_method)
+    ([&](const crow::request& req) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        catalogio::Format format = catalogio::Format::Csv;
+        const char* name = req.url_params.get("format");
+        if (name && !catalogio::parseFormat(name, format)) {
+            return jsonError(400, "format must be csv or ndjson");
+        }
+
+        bool ok = false;
+        std::vector<Sweet> all = sweets.getAllSweets(&ok);
+        // A header-only file would read as an empty catalog
+        if (!ok) return jsonError(503, "Catalog unavailable");
+        std::sort(all.begin(), all.end(), [](const Sweet& a, const Sweet& b) { return a.id < b.id; });
+        crow::response res(200);
+        res.body.reserve(64 + all.size() * 96);
+        catalogio::appendHeader(format, res.body);
+        for (const auto& sweet : all) catalogio::appendSweet(format, sweet, res.body);
+        res.set_header("Content-Type", catalogio::contentType(format));
+        res.set_header("Content-Disposition", format == catalogio::Format::Csv
+            ? "attachment; filename=\"sweets.csv\""
+            : "attachment; filename=\"sweets.ndjson\"");
+        return res;
+    });
+
+    // Shard map (admin only; sharded storage). Reloading re-reads the map
+    // file and moves the sweets whose owner changed before answering.
+    auto shardsJson = [&](crow::json::wvalue& body) {
+        std::vector<crow::json::wvalue> list;
+        for (const auto& shard : sharded->shards()) {
+            crow::json::wvalue entry;
+            entry["name"] = shard.name;
+            entry["endpoint"] = shard.endpoint;
+            entry["weight"] = shard.weight;
+            entry["home"] = shard.home;
+            list.push_back(std::move(entry));
+        }
+        body["map"] = sharded->mapPath();
+        body["shards"] = std::move(list);
+        body["pending_moves"] = static_cast<unsigned long long>(sharded->pendingMoves());
+    };
+    SHOP_ROUTE(app, "/api/admin/shards")
+        .methods("GET"_method)
+    ([&](const crow::request& req) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        if (!sharded) return jsonError(404, "Storage is not sharded");
+        crow::json::wvalue resBody;
+        shardsJson(resBody);
+        crow::response res(200, resBody);
+        return res;
+    });
+    SHOP_ROUTE(app, "/api/admin/shards/reload")
+        .methods("POST"_method)
+    ([&](const crow::request& req) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        if (!sharded) return jsonError(404, "Storage is not sharded");
+        std::string error;
+        std::size_t moved = 0;
+        bool ok = sharded->reload(error, &moved);
+        crow::json::wvalue resBody;
+        shardsJson(resBody);
+        resBody["moved"] = static_cast<unsigned long long>(moved);
+        if (!ok) resBody["error"] = error;
+        crow::response res(ok ? 200 : 500, resBody);
+        return res;
+    });
+
+    // Per-statement timing from the MySQL clients: one entry per query
+    // shape, most total time first, and the recent slow statements.
+    // DELETE clears both.
+    auto millis = [](std::uint64_t nanos) { return static_cast<double>(nanos) / 1e6; };
+    SHOP_ROUTE(app, "/api/admin/queries")
+        .methods("GET"_method, "DELETE"_method)
+    ([&](const crow::request& req) {
+        auto claims = authenticate(req, auth);
+        if (claims.empty()) return jsonError(401, "Unauthorized");
+        if (!isAdmin(claims)) return jsonError(403, "Admin access required");
+        if (req.method == crow::HTTPMethod::Delete) {
+            querylog::reset();
+            return crow::response(204);
+        }
+        std::vector<crow::json::wvalue> shapes;
+        for (const auto& s : querylog::shapes()) {
+            crow::json::wvalue entry;
+            entry["shape"] = s.shape;
+            entry["calls"] = static_cast<unsigned long long>(s.calls);
+            entry["errors"] = static_cast<unsigned long long>(s.errors);
+            entry["slow"] = static_cast<unsigned long long>(s.slow);
+            entry["rows"] = static_cast<unsigned long long>(s.rows);
+            entry["total_ms"] = millis(s.totalNanos);
+            entry["mean_ms"] = millis(s.totalNanos / s.calls);
+            entry["max_ms"] = millis(s.maxNanos);
+            shapes.push_back(std::move(entry));
+        }
+        std::vector<crow::json::wvalue> slow;
+        for (const auto& q : querylog::slowQueries()) {
+            crow::json::wvalue entry;
+            entry["shape"] = q.shape;
+            entry["server"] = q.server;
+            entry["at"] = rowformat::timestamp(std::chrono::system_clock::to_time_t(q.at));
+            entry["ms"] = millis(q.nanos);
+            entry["rows"] = static_cast<unsigned long long>(q.rows);
+            if (!q.error.empty()) entry["error"] = q.error;
+            slow.push_back(std::move(entry));
+        }
+        crow::json::wvalue resBody;
+        resBody["slow_ms"] = millis(static_cast<std::uint64_t>(querylog::threshold().count()));
+        resBody["shapes"] = std::move(shapes);
+        resBody["slow_queries"] = std::move(slow);
+        crow::response res(200, resBody);
+        return res;
+    });
+
+    // GET handlers reachable from /api/batch, keyed by path
+    auto dispatchGet = [&](const crow::request& sub, const Claims& claims) -> crow::response {
+        const std::string& url = sub.url;
+        if (url == "/api/sweets") {
+            bool ok = false;
+            std::vector<Sweet> all = sweets.getAllSweets(&ok);
+            if (!ok) return jsonError(503, "Catalog unavailable");
+            std::vector<crow::json::wvalue> list;
+            for (const auto& s : all) list.push_back(sweetToJson(s));
+            return crow::response(200, crow::json::wvalue(std::move(list)));
+        }
+        if (url == "/api/purchases/history") return purchaseHistory(sub, claims);
+        if (url == "/api/admin/stats") return adminStats(sub, claims);
+        if (url == "/api/admin/stats/trending") return trending(sub, claims);
+        if (url == "/api/admin/sales") return salesReport(sub, claims);
+        const std::string purchasePrefix = "/api/purchases/";
+        if (url.compare(0, purchasePrefix.size(), purchasePrefix) == 0) {
+            std::string id = url.substr(purchasePrefix.size());
+            if (!id.empty() && id.size() < 10 && id.find_first_not_of("0123456789") == std::string::npos) {
+                return purchaseById(sub, claims, std::atoi(id.c_str()));
+            }
+        }
+        return jsonError(404, "Not available in a batch: " + url);
+    };
+
+    // Several reads in one round trip. The body is an array of
+    // {"id": any, "path": "/api/...?query"}; the reply is an array of
+    // {"id", "status", "body"} in the same order. The token is verified
+    // once for the whole batch and the sub-requests run in parallel on the
+    // batch pool, so only GETs are accepted: they are independent by
+    // definition. Each sub-request takes a slot in its own admission class
+    // and gets its own 503 when that class is full.
+    const std::size_t kMaxBatch = 20;
+    WorkerPool batchPool("batch", 8, 256);
+    struct BatchRun {
+        std::vector<crow::request> subs;
+        std::vector<std::string> ids;
+        Claims claims;
+        std::vector<crow::response> results;
+        std::atomic<std::size_t> left{0};
+    };
+    // Sub-responses are already JSON, so they are spliced in rather than
+    // parsed and serialized again
+    auto batchBody = [](BatchRun& run) {
+        std::string out = "[";
+        for (std::size_t i = 0; i < run.results.size(); ++i) {
+            crow::response& r = run.results[i];
+            if (i) out += ",";
+            out += "{\"id\":" + run.ids[i] + ",\"status\":" + std::to_string(r.code) + ",\"body\":";
+            if (r.body.empty()) {
+                out += "null";
+            } else if (r.get_header_value("Content-Type").find("json") != std::string::npos) {
+                out += r.body;
+            } else {
+                out += crow::json::wvalue(r.body).dump();
+            }
+            out += "}";
+        }
+        return out + "]";
+    };
+    SHOP_ROUTE(app, "/api/batch")
+        .methods("POST"_method)
+    ([&](const crow::request& req, crow::response& res) {
+        auto items = crow::json::load(req.body);
+        if (!items || items.t() != crow::json::type::List) {
+            res = jsonError(400, "Expected a JSON array of requests");
+            return res.end();
+        }
+        if (items.size() == 0 || items.size() > kMaxBatch) {
+            res = jsonError(400, "A batch holds 1 to " + std::to_string(kMaxBatch) + " requests");
+            return res.end();
+        }
+
+        auto run = std::make_shared<BatchRun>();
+        run->subs.resize(items.size());
+        run->ids.resize(items.size());
+        run->results.resize(items.size());
+        for (std::size_t i = 0; i < items.size(); ++i) {
+            const auto& item = items[i];
+            if (item.t() != crow::json::type::Object || !item.has("path") ||
+                item["path"].t() != crow::json::type::String) {
+                res = jsonError(400, "Each request needs a \"path\"");
+                return res.end();
+            }
+            if (item.has("method") &&
+                (item["method"].t() != crow::json::type::String || std::string(item["method"].s()) != "GET")) {
+                res = jsonError(400, "Only GET requests can be batched");
+                return res.end();
+            }
+            std::string path = item["path"].s();
+            crow::request& sub = run->subs[i];
+            sub.method = crow::HTTPMethod::Get;
+            sub.raw_url = path;
+            sub.url = path.substr(0, path.find('?'));
+            sub.url_params = crow::query_string(path);
+            run->ids[i] = item.has("id") ? crow::json::wvalue(item["id"]).dump() : std::to_string(i);
+        }
+        run->claims = authenticate(req, auth);
+        run->left = items.size();
+
+        // The last sub-request to finish answers the batch
+        auto done = [&res, run, batchBody](std::size_t i, crow::response r) {
+            run->results[i] = std::move(r);
+            if (--run->left != 0) return;
+            res = crow::response(200);
+            res.set_header("Content-Type", "application/json");
+            res.body = batchBody(*run);
+            res.end();
+        };
+        AdmissionControl& admission = app.get_middleware<AdmissionControl>();
+        for (std::size_t i = 0; i < run->subs.size(); ++i) {
+            AdmissionControl::RouteClass cls = AdmissionControl::classify(run->subs[i]);
+            ConcurrencyLimiter* limiter = cls == AdmissionControl::None ? nullptr : &admission.limiter(cls);
+            if (limiter && !limiter->tryAcquire()) {
+                done(i, jsonError(503, "Server is busy, please retry"));
+                continue;
+            }
+            bool queued = batchPool.post([&dispatchGet, run, done, limiter, i] {
+                auto start = std::chrono::steady_clock::now();
+                crow::response r = dispatchGet(run->subs[i], run->claims);
+                if (limiter) limiter->release(std::chrono::steady_clock::now() - start, r.code >= 500);
+                done(i, std::move(r));
+            });
+            if (!queued) {
+                if (limiter) limiter->release(std::chrono::nanoseconds(0), false);
+                done(i, jsonError(503, "Server is busy, please retry"));
+            }
+        }
+    });
+
+    std::cout << "Server running on http://" << config.bindAddress << ":" << config.port
+              << " with " << config.threads << " worker threads\n";
+    app.bindaddr(config.bindAddress).port(config.port).concurrency(config.threads).run();
 
     return 0;
 }
@@ -0,0 +1,38 @@
+#ifndef SWEET_SHOP_TESTS_CHECK_H
+#define SWEET_SHOP_TESTS_CHECK_H
+
+#include <iostream>
+
+// Assertions for the unit tests. A failed check is reported and the test
+// carries on, so one run lists every failure; main returns checkResult().
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            ++checkFailures();                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                   \
+    do {                                                                             \
+        const auto a_ = (actual);                                                    \
+        const auto e_ = (expected);                                                  \
+        if (!(a_ == e_)) {                                                           \
+            ++checkFailures();                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is " << a_    \
+                      << ", expected " << e_ << "\n";                                \
+        }                                                                            \
+    } while (0)
+
+inline int checkResult() {
+    if (checkFailures() == 0) return 0;
+    std::cerr << checkFailures() << " check(s) failed\n";
+    return 1;
+}
+
+#endif // SWEET_SHOP_TESTS_CHECK_H
@@ -0,0 +1,133 @@
+#include "CatalogIO.h"
+#include "Check.h"
+
+#include <string>
+
+namespace {
+
+using catalogio::Format;
+
+void parsesQuotedCsvFields() {
+    std::string csv =
+        "quantity,Name,price,category,description,colour\r\n"
+        "5,\"Toffee, salted\",1.50,Caramel,\"Say \"\"chewy\"\"\nand sticky\",brown\r\n"
+        "\r\n"
+        "0, Mint ,0.5,Hard Candy,,green\n";
+    catalogio::ParseResult r = catalogio::parse(csv, Format::Csv);
+    CHECK_EQ(r.records, 2u);
+    CHECK(r.errors.empty());
+    CHECK_EQ(r.sweets.size(), 2u);
+    if (r.sweets.size() != 2) return;
+    const Sweet& toffee = r.sweets[0];
+    CHECK_EQ(toffee.id, 0);
+    CHECK_EQ(toffee.name, std::string("Toffee, salted"));
+    CHECK_EQ(toffee.description, std::string("Say \"chewy\"\nand sticky"));
+    CHECK_EQ(toffee.category, std::string("Caramel"));
+    CHECK_EQ(toffee.quantity, 5);
+    CHECK_EQ(r.sweets[1].name, std::string("Mint"));
+    CHECK(r.sweets[1].price > 0.49 && r.sweets[1].price < 0.51);
+}
+
+void reportsBadCsvRecords() {
+    std::string csv =
+        "id,name,category,price,quantity\n"
+        "1,Fudge,Chocolate,2.00,3\n"
+        "2,Fudge,Chocolate,-1,3\n"
+        "3,\"Open,Chocolate,2.00,3\n";
+    catalogio::ParseResult r = catalogio::parse(csv, Format::Csv);
+    CHECK_EQ(r.records, 3u);
+    CHECK_EQ(r.sweets.size(), 1u);
+    CHECK_EQ(r.errors.size(), 2u);
+    if (r.errors.size() == 2) {
+        CHECK_EQ(r.errors[0].record, 2u);
+        // The open quote runs to the end of the input
+        CHECK_EQ(r.errors[1].message, std::string("unterminated quoted field"));
+    }
+
+    r = catalogio::parse("id,name,category,price,quantity\n"
+                         "1,\"Fudge\"x,Chocolate,2.00,3\n"
+                         "2,Fudge,Chocolate,2.00\n"
+                         "1,Fudge again,Chocolate,2.00,3\n"
+                         "4,Fudge,Chocolate,2.00,3\n"
+                         "5,Fudge,Chocolate,2.00,3\n",
+                         Format::Csv);
+    CHECK_EQ(r.records, 5u);
+    CHECK_EQ(r.sweets.size(), 3u);
+    CHECK_EQ(r.errors.size(), 2u);
+    if (r.errors.size() == 2) {
+        CHECK_EQ(r.errors[0].message, std::string("unexpected character after a closing quote"));
+        CHECK_EQ(r.errors[1].message, std::string("expected 5 fields, got 4"));
+    }
+}
+
+void rejectsCsvWithoutRequiredColumns() {
+    catalogio::ParseResult r = catalogio::parse("name,price\nFudge,1\n", Format::Csv);
+    CHECK(r.sweets.empty());
+    CHECK_EQ(r.errors.size(), 1u);
+    if (r.errors.size() == 1) {
+        CHECK_EQ(r.errors[0].record, 0u);
+        CHECK_EQ(r.errors[0].message, std::string("header row is missing category, quantity"));
+    }
+    r = catalogio::parse("", Format::Csv);
+    CHECK_EQ(r.errors.size(), 1u);
+    if (r.errors.size() == 1) CHECK_EQ(r.errors[0].record, 0u);
+}
+
+void parsesInParallelInOrder() {
+    std::string csv = "id,name,category,price,quantity\n";
+    for (int i = 1; i <= 5000; ++i) {
+        csv += std::to_string(i) + ",Sweet " + std::to_string(i) + ",Gummies,1.00,";
+        csv += (i % 1000 == 0 ? "x" : std::to_string(i)) + "\n";
+    }
+    catalogio::ParseResult r = catalogio::parse(csv, Format::Csv, 4);
+    CHECK_EQ(r.records, 5000u);
+    CHECK_EQ(r.sweets.size(), 4995u);
+    CHECK_EQ(r.errors.size(), 5u);
+    bool ordered = true;
+    for (std::size_t k = 1; k < r.sweets.size(); ++k) ordered = ordered && r.sweets[k - 1].id < r.sweets[k].id;
+    CHECK(ordered);
+    if (!r.errors.empty()) CHECK_EQ(r.errors[0].record, 1000u);
+}
+
+void exportReadsBack() {
+    Sweet s;
+    s.id = 42;
+    s.name = "Gob, \"Stopper\"";
+    s.description = " line one\nline two ";
+    s.category = "Hard Candy";
+    s.price = 3.25;
+    s.quantity = 9;
+    std::string csv;
+    catalogio::appendHeader(Format::Csv, csv);
+    catalogio::appendSweet(Format::Csv, s, csv);
+    catalogio::ParseResult r = catalogio::parse(csv, Format::Csv);
+    CHECK(r.errors.empty());
+    CHECK_EQ(r.sweets.size(), 1u);
+    if (r.sweets.size() == 1) {
+        CHECK_EQ(r.sweets[0].id, 42);
+        CHECK_EQ(r.sweets[0].name, s.name);
+        CHECK_EQ(r.sweets[0].description, s.description);
+        CHECK_EQ(r.sweets[0].quantity, 9);
+    }
+}
+
+void parsesFormatNames() {
+    Format f = Format::Ndjson;
+    CHECK(catalogio::parseFormat("text/csv; charset=utf-8", f));
+    CHECK(f == Format::Csv);
+    CHECK(catalogio::parseFormat("NDJSON", f));
+    CHECK(f == Format::Ndjson);
+    CHECK(!catalogio::parseFormat("application/json", f));
+}
+
+} // namespace
+
+int main() {
+    parsesQuotedCsvFields();
+    reportsBadCsvRecords();
+    rejectsCsvWithoutRequiredColumns();
+    parsesInParallelInOrder();
+    exportReadsBack();
+    parsesFormatNames();
+    return checkResult();
+}
@@ -0,0 +1,199 @@
+#include "Check.h"
+#include "LogStorage.h"
+#include "WriteAheadLog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A fresh data directory, removed again at the end of the scope
+class TempDir {
+public:
+    TempDir() {
+        std::random_device rd;
+        path_ = (fs::temp_directory_path() / ("sweet_shop_test_" + std::to_string(rd()))).string();
+        fs::create_directories(path_);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        fs::remove_all(path_, ec);
+    }
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+std::vector<std::string> files(const std::string& dir, const std::string& prefix) {
+    std::vector<std::string> out;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) == 0) out.push_back(entry.path().string());
+    }
+    return out;
+}
+
+int quantity(LogStorage& db, int id) {
+    auto row = db.getSweetById(id);
+    return row.empty() ? -1 : std::stoi(row["quantity"]);
+}
+
+void walReplayReadsFramesInOrder() {
+    TempDir dir;
+    std::string path = WriteAheadLog::segmentPath(dir.path(), 1);
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    for (const char* payload : {"one", "", "three"}) {
+        std::string framed = WriteAheadLog::frame(payload);
+        std::fwrite(framed.data(), 1, framed.size(), f);
+    }
+    std::fclose(f);
+    std::vector<std::string> seen;
+    CHECK(WriteAheadLog::replay(path, [&](const std::string& r) {
+        seen.push_back(r);
+        return true;
+    }));
+    CHECK_EQ(seen.size(), 3u);
+    if (seen.size() == 3) {
+        CHECK_EQ(seen[0], std::string("one"));
+        CHECK_EQ(seen[1], std::string());
+        CHECK_EQ(seen[2], std::string("three"));
+    }
+    // A callback rejecting a record fails the replay
+    CHECK(!WriteAheadLog::replay(path, [](const std::string&) { return false; }));
+}
+
+void walReplayCutsTornAndCorruptTails() {
+    TempDir dir;
+    std::string path = WriteAheadLog::segmentPath(dir.path(), 1);
+    std::string good = WriteAheadLog::frame("kept") + WriteAheadLog::frame("also kept");
+    std::string corrupt = WriteAheadLog::frame("flipped");
+    corrupt[corrupt.size() - 1] ^= 0x01;
+    std::string torn = WriteAheadLog::frame("never finished").substr(0, 12);
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    std::string bytes = good + corrupt + torn;
+    std::fwrite(bytes.data(), 1, bytes.size(), f);
+    std::fclose(f);
+
+    int records = 0;
+    CHECK(WriteAheadLog::replay(path, [&](const std::string&) { return ++records, true; }, false));
+    CHECK_EQ(records, 2);
+    CHECK_EQ(fs::file_size(path), bytes.size()); // without repair the file is left alone
+
+    records = 0;
+    CHECK(WriteAheadLog::replay(path, [&](const std::string&) { return ++records, true; }));
+    CHECK_EQ(records, 2);
+    CHECK_EQ(fs::file_size(path), good.size());
+}
+
+void recoversStateFromWal() {
+    TempDir dir;
+    int sweet = 0, other = 0, userId = 0, purchaseId = 0;
+    {
+        LogStorage db(dir.path());
+        CHECK(db.open());
+        CHECK(db.createUser("alice", "hash", "alice@example.com", false, &userId));
+        CHECK_EQ(std::stoi(db.getUserByUsername("alice")["id"]), userId);
+        CHECK(db.createSweet("Toffee", "Chewy", "Caramel", 1.5, 10, &sweet));
+        CHECK(db.createSweet("Mint", "Fresh", "Hard Candy", 0.5, 4, &other));
+        double total = 0.0;
+        std::map<std::string, std::string> row;
+        CHECK(db.purchaseSweet(userId, sweet, 3, total, &row, "key-1"));
+        purchaseId = std::stoi(row["id"]);
+        CHECK(db.restockSweet(sweet, 5));
+        CHECK(db.updateSweet(other, "Mint", "Fresher", "Hard Candy", 0.75, 8));
+        CHECK(!db.purchaseSweet(userId, sweet, 1, total, nullptr, "key-1")); // key already used
+    }
+    LogStorage db(dir.path());
+    CHECK(db.open());
+    CHECK_EQ(quantity(db, sweet), 12);
+    CHECK_EQ(db.getSweetById(other)["description"], std::string("Fresher"));
+    CHECK_EQ(db.getUserByUsername("alice")["email"], std::string("alice@example.com"));
+    CHECK_EQ(db.getPurchaseById(purchaseId)["total_price"], std::string("4.50"));
+    CHECK_EQ(db.getIdempotencyKey("key-1")["operation"], std::string("purchase"));
+    CHECK_EQ(db.getPurchasesByUser(userId, "", 0, 10).size(), 1u);
+    // Ids keep counting after recovery
+    int third = 0;
+    CHECK(db.createSweet("Fudge", "Rich", "Chocolate", 2.0, 1, &third));
+    CHECK(third > other);
+}
+
+void recoversPastTornTail() {
+    TempDir dir;
+    int sweet = 0;
+    {
+        LogStorage db(dir.path());
+        CHECK(db.open());
+        CHECK(db.createSweet("Toffee", "Chewy", "Caramel", 1.5, 10, &sweet));
+        CHECK(db.restockSweet(sweet, 2));
+    }
+    // A crash in the middle of the next append
+    auto wal = files(dir.path(), "wal-");
+    CHECK_EQ(wal.size(), 1u);
+    if (wal.size() != 1) return;
+    std::uintmax_t intact = fs::file_size(wal[0]);
+    std::FILE* f = std::fopen(wal[0].c_str(), "ab");
+    std::string torn = WriteAheadLog::frame(std::string(40, 'x')).substr(0, 20);
+    std::fwrite(torn.data(), 1, torn.size(), f);
+    std::fclose(f);
+
+    {
+        LogStorage db(dir.path());
+        CHECK(db.open());
+        CHECK_EQ(quantity(db, sweet), 12);
+        CHECK_EQ(fs::file_size(wal[0]), intact);
+        // Appends after the repaired tail replay too
+        CHECK(db.restockSweet(sweet, 3));
+    }
+    LogStorage db(dir.path());
+    CHECK(db.open());
+    CHECK_EQ(quantity(db, sweet), 15);
+}
+
+void recoversFromSnapshotAndNewerWal() {
+    TempDir dir;
+    std::vector<int> ids;
+    {
+        // A tiny threshold snapshots after nearly every write
+        LogStorage db(dir.path(), 256);
+        CHECK(db.open());
+        for (int i = 0; i < 20; ++i) {
+            int id = 0;
+            CHECK(db.createSweet("Sweet " + std::to_string(i), "Snapshot test", "Gummies", 1.0, i, &id));
+            ids.push_back(id);
+        }
+        CHECK(db.deleteSweet(ids[0]));
+        // Let the snapshotter finish so older files get dropped
+        for (int i = 0; i < 100 && files(dir.path(), "snapshot-").empty(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    CHECK(!files(dir.path(), "snapshot-").empty());
+    CHECK(files(dir.path(), "snapshot-").size() <= 2);
+    LogStorage db(dir.path());
+    CHECK(db.open());
+    CHECK(db.getSweetById(ids[0]).empty());
+    CHECK_EQ(db.getAllSweets().size(), 19u);
+    CHECK_EQ(quantity(db, ids[19]), 19);
+    int next = 0;
+    CHECK(db.createSweet("After", "Snapshot test", "Gummies", 1.0, 1, &next));
+    CHECK(next > ids[19]); // a deleted id is never handed out again
+}
+
+} // namespace
+
+int main() {
+    walReplayReadsFramesInOrder();
+    walReplayCutsTornAndCorruptTails();
+    recoversStateFromWal();
+    recoversPastTornTail();
+    recoversFromSnapshotAndNewerWal();
+    return checkResult();
+}
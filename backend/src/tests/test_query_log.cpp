@@ -0,0 +1,99 @@
+#include "Check.h"
+#include "QueryLog.h"
+
+#include <chrono>
+#include <string>
+
+namespace {
+
+std::string shapeOf(const std::string& sql) {
+    std::string out;
+    querylog::shape(sql.data(), sql.size(), out);
+    return out;
+}
+
+void replacesLiterals() {
+    CHECK_EQ(shapeOf("SELECT * FROM sweets WHERE id=7"), std::string("SELECT * FROM sweets WHERE id=?"));
+    CHECK_EQ(shapeOf("UPDATE sweets SET price=1.25, quantity = -3 WHERE id=12"),
+             std::string("UPDATE sweets SET price=?, quantity = -? WHERE id=?"));
+    // Quotes and backslashes inside a literal do not end it
+    CHECK_EQ(shapeOf("SELECT id FROM users WHERE username='O''Brien' OR username=\"a\\\"b\""),
+             std::string("SELECT id FROM users WHERE username=? OR username=?"));
+    // Identifiers keep their digits
+    CHECK_EQ(shapeOf("SELECT t1.col2 FROM sweet_id_seq t1"), std::string("SELECT t1.col2 FROM sweet_id_seq t1"));
+}
+
+void collapsesWhitespace() {
+    CHECK_EQ(shapeOf("  SELECT\n\tid ,  name\r\n FROM   sweets  "), std::string("SELECT id , name FROM sweets"));
+}
+
+void collapsesLists() {
+    std::string in = "SELECT id FROM sweets WHERE id IN (...)";
+    CHECK_EQ(shapeOf("SELECT id FROM sweets WHERE id IN (1,2,3)"), in);
+    CHECK_EQ(shapeOf("SELECT id FROM sweets WHERE id IN (4)"), in);
+    std::string values = "INSERT INTO sweets (name, quantity) VALUES (...)";
+    CHECK_EQ(shapeOf("INSERT INTO sweets (name, quantity) VALUES ('a',1)"), values);
+    CHECK_EQ(shapeOf("INSERT INTO sweets (name, quantity) VALUES ('a',1),('b',NULL),('c',3)"), values);
+    CHECK_EQ(shapeOf("INSERT INTO sweets (name, quantity) VALUES ('a',1), ('b',2)"), values);
+    // Groups holding anything but placeholders stay
+    CHECK_EQ(shapeOf("UPDATE sweet_id_seq SET id=LAST_INSERT_ID(id+5)"),
+             std::string("UPDATE sweet_id_seq SET id=LAST_INSERT_ID(id+?)"));
+    CHECK_EQ(shapeOf("SELECT COALESCE(MAX(id),0) FROM sweets"), std::string("SELECT COALESCE(MAX(id),?) FROM sweets"));
+}
+
+void collapsesCaseBranches() {
+    std::string one = "UPDATE sweets SET quantity=CASE id WHEN ? THEN ? END";
+    CHECK_EQ(shapeOf("UPDATE sweets SET quantity=CASE id WHEN 1 THEN 5 END"), one);
+    CHECK_EQ(shapeOf("UPDATE sweets SET quantity=CASE id WHEN 1 THEN 5 WHEN 2 THEN 6 WHEN 3 THEN 'x' END"), one);
+}
+
+void capsLongShapes() {
+    std::string sql = "SELECT ";
+    for (int i = 0; i < 500; ++i) sql += "column_" + std::to_string(i) + ", ";
+    sql += "id FROM sweets";
+    std::string out = shapeOf(sql);
+    CHECK(out.size() <= 1024 + 32);
+    CHECK_EQ(out.substr(out.size() - 4), std::string(" ..."));
+}
+
+void aggregatesByShape() {
+    querylog::reset();
+    querylog::setThreshold(std::chrono::milliseconds(5));
+    std::string shape = shapeOf("SELECT * FROM sweets WHERE id=1");
+    querylog::record(shape, "db0:3306", 1000000, 1, nullptr);
+    querylog::record(shape, "db0:3306", 9000000, 0, "Lock wait timeout exceeded");
+    querylog::record(shapeOf("SELECT 1"), "db1:3306", 100, 1, "");
+
+    auto shapes = querylog::shapes();
+    CHECK_EQ(shapes.size(), 2u);
+    if (!shapes.empty()) {
+        CHECK_EQ(shapes[0].shape, shape); // most total time first
+        CHECK_EQ(shapes[0].calls, 2u);
+        CHECK_EQ(shapes[0].errors, 1u);
+        CHECK_EQ(shapes[0].slow, 1u);
+        CHECK_EQ(shapes[0].rows, 1u);
+        CHECK_EQ(shapes[0].totalNanos, 10000000u);
+        CHECK_EQ(shapes[0].maxNanos, 9000000u);
+    }
+    auto slow = querylog::slowQueries();
+    CHECK_EQ(slow.size(), 1u);
+    if (!slow.empty()) {
+        CHECK_EQ(slow[0].server, std::string("db0:3306"));
+        CHECK_EQ(slow[0].error, std::string("Lock wait timeout exceeded"));
+    }
+    querylog::reset();
+    CHECK(querylog::shapes().empty());
+    CHECK(querylog::slowQueries().empty());
+}
+
+} // namespace
+
+int main() {
+    replacesLiterals();
+    collapsesWhitespace();
+    collapsesLists();
+    collapsesCaseBranches();
+    capsLongShapes();
+    aggregatesByShape();
+    return checkResult();
+}
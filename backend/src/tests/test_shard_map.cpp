@@ -0,0 +1,90 @@
+#include "Check.h"
+#include "ShardMap.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<ShardMap::Shard> shards(const std::string& text) {
+    std::vector<ShardMap::Shard> out;
+    std::string error;
+    CHECK(ShardMap::parse(text, out, error));
+    CHECK_EQ(error, std::string());
+    return out;
+}
+
+void parsesMapFiles() {
+    auto list = shards("# home first\n"
+                       "home db0.local\n"
+                       "\n"
+                       "east db1.local:3307 2   # bigger box\n");
+    CHECK_EQ(list.size(), 2u);
+    if (list.size() != 2) return;
+    CHECK_EQ(list[0].name, std::string("home"));
+    CHECK_EQ(list[0].endpoint(), std::string("db0.local:3306"));
+    CHECK_EQ(list[0].weight, 1u);
+    CHECK_EQ(list[1].endpoint(), std::string("db1.local:3307"));
+    CHECK_EQ(list[1].weight, 2u);
+    CHECK_EQ(ShardMap(list).home().name, std::string("home"));
+}
+
+void rejectsBadMapFiles() {
+    std::vector<ShardMap::Shard> out;
+    std::string error;
+    CHECK(!ShardMap::parse("# nothing\n", out, error));
+    CHECK_EQ(error, std::string("no shards listed"));
+    CHECK(!ShardMap::parse("a db0\nb\n", out, error));
+    CHECK_EQ(error, std::string("line 2: expected \"name host[:port] [weight]\""));
+    CHECK(!ShardMap::parse("a db0:99999\n", out, error));
+    CHECK_EQ(error, std::string("line 1: bad port in db0:99999"));
+    CHECK(!ShardMap::parse("a db0 0\n", out, error));
+    CHECK_EQ(error, std::string("line 1: weight must be 1-100"));
+    CHECK(!ShardMap::parse("a db0\na db1\n", out, error));
+    CHECK_EQ(error, std::string("line 2: shard a listed twice"));
+    CHECK(!ShardMap::parse("a :3306\n", out, error));
+    CHECK_EQ(error, std::string("line 1: missing host"));
+}
+
+void spreadsIdsByWeight() {
+    ShardMap map(shards("a h0\nb h1\nc h2 2\n"));
+    std::vector<int> counts(3, 0);
+    const int ids = 40000;
+    for (int id = 1; id <= ids; ++id) ++counts[map.owner(id)];
+    // Shares of 1/4, 1/4 and 1/2, within a loose margin
+    CHECK(counts[0] > ids / 4 * 3 / 4 && counts[0] < ids / 4 * 5 / 4);
+    CHECK(counts[1] > ids / 4 * 3 / 4 && counts[1] < ids / 4 * 5 / 4);
+    CHECK(counts[2] > ids / 2 * 3 / 4 && counts[2] < ids / 2 * 5 / 4);
+    // Routing depends only on the names, not on the endpoints
+    ShardMap moved(shards("a other0:4000\nb other1\nc other2 2\n"));
+    bool same = true;
+    for (int id = 1; id <= 1000; ++id) same = same && map.owner(id) == moved.owner(id);
+    CHECK(same);
+}
+
+void addingAShardOnlyMovesIdsToIt() {
+    ShardMap before(shards("a h0\nb h1\nc h2\n"));
+    ShardMap after(shards("a h0\nb h1\nc h2\nd h3\n"));
+    const int ids = 20000;
+    int moved = 0;
+    bool onlyToNew = true;
+    for (int id = 1; id <= ids; ++id) {
+        std::size_t from = before.owner(id), to = after.owner(id);
+        if (from == to) continue;
+        ++moved;
+        onlyToNew = onlyToNew && to == 3;
+    }
+    CHECK(onlyToNew);
+    // About a quarter of the ids move to the new shard
+    CHECK(moved > ids / 4 * 3 / 4 && moved < ids / 4 * 5 / 4);
+}
+
+} // namespace
+
+int main() {
+    parsesMapFiles();
+    rejectsBadMapFiles();
+    spreadsIdsByWeight();
+    addingAShardOnlyMovesIdsToIt();
+    return checkResult();
+}
@@ -0,0 +1,105 @@
+#include "Check.h"
+#include "SingleFlight.h"
+
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Finish = std::function<void(int)>;
+
+void waitersShareTheLeadersResult() {
+    SingleFlight<int> flight("test_share");
+    Finish pending;
+    int starts = 0;
+    std::vector<int> seen;
+    for (int i = 0; i < 3; ++i) {
+        flight.runAsync("k", [&](Finish finish) {
+            ++starts;
+            pending = finish;
+        }, [&](int v) { seen.push_back(v); });
+    }
+    CHECK_EQ(starts, 1);
+    CHECK(seen.empty());
+    pending(7);
+    CHECK_EQ(seen.size(), 3u);
+    for (int v : seen) CHECK_EQ(v, 7);
+    // Calling finish again is ignored
+    pending(8);
+    CHECK_EQ(seen.size(), 3u);
+}
+
+void throwingStartFailsWaitersAndFreesTheKey() {
+    SingleFlight<int> flight("test_throw");
+    std::vector<int> seen;
+    flight.runAsync("k", [](Finish) { throw std::runtime_error("boom"); },
+                    [&](int v) { seen.push_back(v); });
+    CHECK_EQ(seen.size(), 1u);
+    if (!seen.empty()) CHECK_EQ(seen[0], 0);
+    // The next caller leads a new flight
+    int starts = 0;
+    flight.runAsync("k", [&](Finish finish) {
+        ++starts;
+        finish(5);
+    }, [&](int v) { seen.push_back(v); });
+    CHECK_EQ(starts, 1);
+    CHECK_EQ(seen.back(), 5);
+}
+
+void droppedCallbackFailsWaiters() {
+    SingleFlight<int> flight("test_drop");
+    std::vector<int> seen;
+    Finish kept;
+    flight.runAsync("k", [&](Finish finish) { kept = finish; }, [&](int v) { seen.push_back(v); });
+    flight.runAsync("k", [](Finish) {}, [&](int v) { seen.push_back(v); });
+    CHECK(seen.empty());
+    kept = nullptr; // the engine lost the query
+    CHECK_EQ(seen.size(), 2u);
+    for (int v : seen) CHECK_EQ(v, 0);
+
+    // A callback joining a blocking flight whose leader throws gets T()
+    bool threw = false;
+    int joined = -1;
+    try {
+        flight.run("j", [&]() -> int {
+            flight.runAsync("j", [](Finish) {}, [&](int v) { joined = v; });
+            throw std::runtime_error("leader failed");
+        });
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK_EQ(joined, 0);
+}
+
+void staleFlightIsNotJoined() {
+    SingleFlight<int> flight("test_stale", std::chrono::milliseconds(20));
+    Finish hung;
+    int starts = 0;
+    std::vector<int> seen;
+    flight.runAsync("k", [&](Finish finish) {
+        ++starts;
+        hung = finish;
+    }, [&](int v) { seen.push_back(v); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    CHECK_EQ(flight.run("k", [&] { return ++starts, 9; }), 9);
+    CHECK_EQ(starts, 2);
+    // The old flight still completes its own waiters
+    hung(1);
+    CHECK_EQ(seen.size(), 1u);
+    if (!seen.empty()) CHECK_EQ(seen[0], 1);
+}
+
+} // namespace
+
+int main() {
+    waitersShareTheLeadersResult();
+    throwingStartFailsWaitersAndFreesTheKey();
+    droppedCallbackFailsWaiters();
+    staleFlightIsNotJoined();
+    return checkResult();
+}
@@ -0,0 +1,113 @@
+#include "Check.h"
+#include "Purchase.h"
+#include "Sketches.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+void countMinNeverUndercounts() {
+    const double epsilon = 0.01;
+    CountMinSketch sketch(epsilon, 0.01);
+    std::uint64_t total = 0;
+    for (std::uint64_t key = 0; key < 2000; ++key) {
+        std::uint64_t count = key % 7 + 1;
+        sketch.add(key, count);
+        total += count;
+    }
+    int outside = 0;
+    for (std::uint64_t key = 0; key < 2000; ++key) {
+        std::uint64_t est = sketch.estimate(key);
+        CHECK(est >= key % 7 + 1);
+        if (est > key % 7 + 1 + epsilon * total) ++outside;
+    }
+    // The bound holds with probability 1 - delta per key
+    CHECK(outside <= 20);
+}
+
+void countMinMerge() {
+    CountMinSketch a(0.01, 0.01), b(0.01, 0.01), other(0.1, 0.01);
+    a.add(7, 5);
+    b.add(7, 3);
+    b.add(9, 1);
+    CHECK(a.merge(b));
+    CHECK(a.estimate(7) >= 8);
+    CHECK(a.estimate(9) >= 1);
+    CHECK(!a.merge(other));
+    a.clear();
+    CHECK_EQ(a.estimate(7), 0u);
+}
+
+void hyperLogLogAccuracy() {
+    for (std::uint64_t n : {100u, 10000u, 200000u}) {
+        HyperLogLog hll(12);
+        for (std::uint64_t key = 0; key < n; ++key) {
+            hll.add(key);
+            hll.add(key); // repeats do not count
+        }
+        // Standard error is about 1.6% at precision 12; allow three of them
+        CHECK(std::fabs(hll.estimate() - static_cast<double>(n)) <= 0.05 * n);
+    }
+    CHECK_EQ(HyperLogLog(12).estimate(), 0.0);
+}
+
+void hyperLogLogMergeIsUnion() {
+    HyperLogLog a(12), b(12), both(12), other(10);
+    for (std::uint64_t key = 0; key < 6000; ++key) {
+        (key < 4000 ? a : b).add(key);
+        both.add(key);
+    }
+    // Overlap 3000..3999 is counted once
+    for (std::uint64_t key = 3000; key < 4000; ++key) b.add(key);
+    CHECK(a.merge(b));
+    CHECK_EQ(a.estimate(), both.estimate());
+    CHECK(!a.merge(other));
+}
+
+void salesSketchesRankSellers() {
+    SketchConfig config;
+    config.candidates = 8;
+    SalesSketches sketches(config);
+    Purchase p;
+    // Sweet s sells s units per buyer, so higher ids sell more; many
+    // one-unit sweets push through the candidate table
+    for (int sweet = 1; sweet <= 10; ++sweet) {
+        for (int buyer = 0; buyer < 20; ++buyer) {
+            p.sweetId = sweet;
+            p.userId = buyer;
+            p.quantity = sweet;
+            sketches.onPurchase(p);
+        }
+    }
+    for (int sweet = 100; sweet < 400; ++sweet) {
+        p.sweetId = sweet;
+        p.userId = 1000 + sweet;
+        p.quantity = 1;
+        sketches.onPurchase(p);
+    }
+    // The windows argument spans the whole ring, so a test straddling a
+    // window boundary still sees every purchase
+    auto top = sketches.topSellers(config.windows, 3);
+    CHECK_EQ(top.size(), 3u);
+    if (top.size() == 3) {
+        CHECK_EQ(top[0].sweetId, 10);
+        CHECK_EQ(top[1].sweetId, 9);
+        CHECK_EQ(top[2].sweetId, 8);
+        CHECK(top[0].units >= 200);
+    }
+    CHECK(sketches.topSellers(config.windows, 0).empty());
+    double buyers = sketches.uniqueBuyers(config.windows);
+    CHECK(std::fabs(buyers - 320.0) <= 16.0);
+}
+
+} // namespace
+
+int main() {
+    countMinNeverUndercounts();
+    countMinMerge();
+    hyperLogLogAccuracy();
+    hyperLogLogMergeIsUnion();
+    salesSketchesRankSellers();
+    return checkResult();
+}
@@ -0,0 +1,57 @@
+#include "Check.h"
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+void runsEveryPostedTask() {
+    std::atomic<int> ran{0};
+    bool inPool = false;
+    {
+        WorkerPool pool("test_run", 3, 100);
+        CHECK_EQ(pool.threads(), 3u);
+        CHECK(!pool.inPool());
+        for (int i = 0; i < 50; ++i) CHECK(pool.post([&] { ++ran; }));
+        CHECK(pool.post([&] { inPool = pool.inPool(); }));
+    } // the destructor drains the queue
+    CHECK_EQ(ran.load(), 50);
+    CHECK(inPool);
+}
+
+void refusesWhenTheQueueIsFull() {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool started = false, release = false;
+    WorkerPool pool("test_full", 1, 2);
+    CHECK(pool.post([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        started = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return release; });
+    }));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return started; });
+    }
+    // The only thread is busy: two tasks fit in the queue, the third does not
+    CHECK(pool.post([] {}));
+    CHECK(pool.post([] {}));
+    CHECK(!pool.post([] {}));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+}
+
+} // namespace
+
+int main() {
+    runsEveryPostedTask();
+    refusesWhenTheQueueIsFull();
+    return checkResult();
+}
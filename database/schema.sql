@@ -35,7 +35,9 @@ CREATE TABLE purchases (
     purchase_date TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE,
     FOREIGN KEY (sweet_id) REFERENCES sweets(id) ON DELETE RESTRICT,
-    INDEX idx_user_id (user_id),
+    -- Covers per-user history pages: seek on (user_id, purchase_date, id),
+    -- the remaining columns are read straight from the index
+    INDEX idx_user_history (user_id, purchase_date, id, sweet_id, quantity, total_price),
     INDEX idx_sweet_id (sweet_id),
     INDEX idx_purchase_date (purchase_date)
 );
@@ -52,4 +54,42 @@ CREATE TABLE audit_log (
     INDEX idx_user_id (user_id),
     INDEX idx_action (action),
     INDEX idx_created_at (created_at)
-);
\ No newline at end of file
+);
+-- Idempotency-Key records for purchases and restocks. Written in the same
+-- transaction as the change, so a retried request finds its key and is
+-- answered with the stored result instead of being applied twice. Keys are
+-- prefixed with the user id by the server.
+CREATE TABLE idempotency_keys (
+    idem_key VARCHAR(160) PRIMARY KEY,
+    operation VARCHAR(16) NOT NULL,
+    sweet_id INT NOT NULL,
+    quantity INT NOT NULL,
+    purchase_id INT NULL,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    INDEX idx_created_at (created_at),
+    INDEX idx_sweet_id (sweet_id)
+);
+
+-- Keys only have to outlive client retries; the server honours them for 24h
+CREATE EVENT IF NOT EXISTS purge_idempotency_keys
+    ON SCHEDULE EVERY 1 HOUR
+    DO DELETE FROM idempotency_keys WHERE created_at < NOW() - INTERVAL 1 DAY;
+-- Sweet id counter. New sweets take their ids from it rather than from
+-- AUTO_INCREMENT, so a bulk import knows its ids before inserting; with
+-- SWEET_SHOP_DB_SHARDS the home shard hands them out for every shard.
+CREATE TABLE sweet_id_seq (
+    id INT NOT NULL
+);
+INSERT INTO sweet_id_seq (id) VALUES (0);
+
+-- Split stock of hot sweets (PUT /api/admin/sweets/<id>/stock-slots). A
+-- sweet with slot rows has its stock spread over them plus its own
+-- quantity column; each purchase decrements one slot, so concurrent
+-- buyers lock different rows instead of queueing on the sweet's.
+CREATE TABLE sweet_stock_slots (
+    sweet_id INT NOT NULL,
+    slot INT NOT NULL,
+    quantity INT NOT NULL DEFAULT 0,
+    PRIMARY KEY (sweet_id, slot),
+    FOREIGN KEY (sweet_id) REFERENCES sweets(id) ON DELETE CASCADE
+);
@@ -0,0 +1,68 @@
+-- Schema for every shard except the home one (the first in the shard map),
+-- which uses schema.sql. A shard holds the sweets it owns with their
+-- purchases and idempotency keys; users and the audit log live only on
+-- the home shard.
+CREATE DATABASE IF NOT EXISTS sweet_shop;
+USE sweet_shop;
+
+-- Always empty here; present so the shared aggregate queries run unchanged
+CREATE TABLE users (
+    id INT PRIMARY KEY AUTO_INCREMENT,
+    username VARCHAR(50) UNIQUE NOT NULL,
+    password_hash VARCHAR(255) NOT NULL,
+    email VARCHAR(100) NOT NULL,
+    is_admin BOOLEAN DEFAULT FALSE,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP
+);
+
+CREATE TABLE sweets (
+    id INT PRIMARY KEY AUTO_INCREMENT,
+    name VARCHAR(100) NOT NULL,
+    description TEXT,
+    category VARCHAR(50) NOT NULL,
+    price DECIMAL(10, 2) NOT NULL,
+    quantity INT NOT NULL DEFAULT 0,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+    INDEX idx_category (category),
+    INDEX idx_price (price),
+    INDEX idx_name (name)
+);
+
+-- As in schema.sql, without the foreign key to users, which are elsewhere
+CREATE TABLE purchases (
+    id INT PRIMARY KEY AUTO_INCREMENT,
+    user_id INT NOT NULL,
+    sweet_id INT NOT NULL,
+    quantity INT NOT NULL,
+    total_price DECIMAL(10, 2) NOT NULL,
+    purchase_date TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    FOREIGN KEY (sweet_id) REFERENCES sweets(id) ON DELETE RESTRICT,
+    INDEX idx_user_history (user_id, purchase_date, id, sweet_id, quantity, total_price),
+    INDEX idx_sweet_id (sweet_id),
+    INDEX idx_purchase_date (purchase_date)
+);
+
+CREATE TABLE sweet_stock_slots (
+    sweet_id INT NOT NULL,
+    slot INT NOT NULL,
+    quantity INT NOT NULL DEFAULT 0,
+    PRIMARY KEY (sweet_id, slot),
+    FOREIGN KEY (sweet_id) REFERENCES sweets(id) ON DELETE CASCADE
+);
+
+CREATE TABLE idempotency_keys (
+    idem_key VARCHAR(160) PRIMARY KEY,
+    operation VARCHAR(16) NOT NULL,
+    sweet_id INT NOT NULL,
+    quantity INT NOT NULL,
+    purchase_id INT NULL,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    INDEX idx_created_at (created_at),
+    INDEX idx_sweet_id (sweet_id)
+);
+
+CREATE EVENT IF NOT EXISTS purge_idempotency_keys
+    ON SCHEDULE EVERY 1 HOUR
+    DO DELETE FROM idempotency_keys WHERE created_at < NOW() - INTERVAL 1 DAY;
@@ -1,4 +1,9 @@
-const API_BASE_URL = 'http://localhost:8080';
+// Same origin whenever the page comes over http(s), whatever the port:
+// the backend serves it, or a proxy in front of the backend does. Only a
+// file:// page or the Live Server dev server talks to a local backend.
+const DEV_SERVER_PORTS = ['5500', '5501'];
+const API_BASE_URL = /^https?:$/.test(window.location.protocol) &&
+    !DEV_SERVER_PORTS.includes(window.location.port) ? '' : 'http://localhost:8080';
 
 /**
  * Make API calls to the backend
@@ -6,13 +11,15 @@ const API_BASE_URL = 'http://localhost:8080';
  * @param {string} method - HTTP method (GET, POST, PUT, DELETE)
  * @param {object} data - Request body data (optional)
  * @param {string} token - JWT token for authentication (optional)
+ * @param {object} extraHeaders - Additional request headers (optional)
  * @returns {Promise} - Response data
  */
-async function apiCall(endpoint, method = 'GET', data = null, token = null) {
+async function apiCall(endpoint, method = 'GET', data = null, token = null, extraHeaders = {}) {
     const options = {
         method: method,
         headers: {
-            'Content-Type': 'application/json'
+            'Content-Type': 'application/json',
+            ...extraHeaders
         }
     };
 
@@ -108,6 +115,17 @@ const SweetsAPI = {
         return apiCall('/api/sweets', 'GET');
     },
 
+    /**
+     * Get all sweets with the live feed sequence number they are current to
+     * @returns {Promise} - { sweets, seq }; events up to seq are already applied
+     */
+    getCatalog: async () => {
+        const response = await fetch(API_BASE_URL + '/api/sweets');
+        if (!response.ok) throw new Error(`HTTP ${response.status}`);
+        const seq = parseInt(response.headers.get('Feed-Seq'), 10) || 0;
+        return { sweets: await response.json(), seq };
+    },
+
     /**
      * Get a single sweet by ID
      * @param {number} sweetId - Sweet ID
@@ -156,6 +174,27 @@ const SweetsAPI = {
         return apiCall(`/api/sweets/${sweetId}`, 'PUT', sweetData, token);
     },
 
+    /**
+     * Change only some fields of a sweet (admin only)
+     * @param {number} sweetId - Sweet ID
+     * @param {object} fields - Any of name, description, category, price, quantity
+     * @param {string} token - JWT token
+     * @returns {Promise} - Updated sweet object
+     */
+    patch: async (sweetId, fields, token) => {
+        return apiCall(`/api/sweets/${sweetId}`, 'PATCH', fields, token);
+    },
+
+    /**
+     * Change many sweets in one transaction, e.g. seasonal repricing (admin only)
+     * @param {Array} changes - Objects with an id plus the fields to change
+     * @param {string} token - JWT token
+     * @returns {Promise} - { updated, sweets }
+     */
+    patchMany: async (changes, token) => {
+        return apiCall('/api/sweets', 'PATCH', changes, token);
+    },
+
     /**
      * Delete a sweet (admin only)
      * @param {number} sweetId - Sweet ID
@@ -171,12 +210,13 @@ const SweetsAPI = {
      * @param {number} sweetId - Sweet ID
      * @param {number} quantity - Quantity to purchase
      * @param {string} token - JWT token
+     * @param {string} idempotencyKey - Reuse the same key when retrying (optional)
      * @returns {Promise} - Purchase confirmation with total price
      */
-    purchase: async (sweetId, quantity, token) => {
+    purchase: async (sweetId, quantity, token, idempotencyKey = crypto.randomUUID()) => {
         return apiCall(`/api/sweets/${sweetId}/purchase`, 'POST', {
             quantity: quantity
-        }, token);
+        }, token, { 'Idempotency-Key': idempotencyKey });
     },
 
     /**
@@ -184,12 +224,13 @@ const SweetsAPI = {
      * @param {number} sweetId - Sweet ID
      * @param {number} quantity - Quantity to add
      * @param {string} token - JWT token
+     * @param {string} idempotencyKey - Reuse the same key when retrying (optional)
      * @returns {Promise} - Restock confirmation
      */
-    restock: async (sweetId, quantity, token) => {
+    restock: async (sweetId, quantity, token, idempotencyKey = crypto.randomUUID()) => {
         return apiCall(`/api/sweets/${sweetId}/restock`, 'POST', {
             quantity: quantity
-        }, token);
+        }, token, { 'Idempotency-Key': idempotencyKey });
     }
 };
 
@@ -198,12 +239,19 @@ const SweetsAPI = {
  */
 const PurchasesAPI = {
     /**
-     * Get user's purchase history
+     * Get user's purchase history, newest first
      * @param {string} token - JWT token
-     * @returns {Promise} - Array of purchase objects
+     * @param {object} next - Cursor from the previous page's `next` (optional)
+     * @param {number} limit - Page size (default 20, max 100)
+     * @returns {Promise} - { purchases: [...], next: cursor or null }
      */
-    getUserHistory: async (token) => {
-        return apiCall('/api/purchases/history', 'GET', null, token);
+    getUserHistory: async (token, next = null, limit = 20) => {
+        const params = new URLSearchParams({ limit: limit });
+        if (next) {
+            params.set('before_date', next.before_date);
+            params.set('before_id', next.before_id);
+        }
+        return apiCall(`/api/purchases/history?${params.toString()}`, 'GET', null, token);
     },
 
     /**
@@ -230,22 +278,54 @@ const StatsAPI = {
         return apiCall('/api/admin/stats', 'GET', null, token);
     },
 
+    /**
+     * Get approximate best sellers and unique buyers (admin only)
+     * @param {string} token - JWT token
+     * @param {number} windows - Number of hourly windows to cover (default 24)
+     * @param {number} k - Number of best sellers to return
+     * @returns {Promise} - { top_sellers: [...], unique_buyers, window_seconds }
+     */
+    getTrending: async (token, windows = 24, k = 10) => {
+        const params = new URLSearchParams({ windows: windows, k: k });
+        return apiCall(`/api/admin/stats/trending?${params.toString()}`, 'GET', null, token);
+    },
+
     /**
      * Get sales report (admin only)
      * @param {string} startDate - Start date (YYYY-MM-DD)
      * @param {string} endDate - End date (YYYY-MM-DD)
      * @param {string} token - JWT token
+     * @param {string} granularity - Series resolution, 'day' or 'hour'
      * @returns {Promise} - Sales report data
      */
-    getSalesReport: async (startDate, endDate, token) => {
+    getSalesReport: async (startDate, endDate, token, granularity = 'day') => {
         const params = new URLSearchParams({
             startDate: startDate,
-            endDate: endDate
+            endDate: endDate,
+            granularity: granularity
         });
         return apiCall(`/api/admin/sales?${params.toString()}`, 'GET', null, token);
     }
 };
 
+/**
+ * Batched reads
+ */
+const BatchAPI = {
+    /**
+     * Run several GET calls in one round trip
+     * @param {Array<{id: string, path: string}>} requests - Up to 20 API paths, with query strings
+     * @param {string} token - JWT token (optional), verified once for the batch
+     * @returns {Promise} - Object mapping each id to { status, body }
+     */
+    run: async (requests, token = null) => {
+        const results = await apiCall('/api/batch', 'POST', requests, token);
+        const byId = {};
+        results.forEach(r => { byId[r.id] = { status: r.status, body: r.body }; });
+        return byId;
+    }
+};
+
 /**
  * Utility function to check if a token is still valid
  * @param {string} token - JWT token
@@ -4,6 +4,10 @@ class SweetShopApp {
         this.currentUser = null;
         this.allSweets = [];
         this.filteredSweets = [];
+        this.live = null;
+        this.liveSeq = 0;
+        this.catalogSeq = 0; // feed seq the loaded catalog already includes
+        this.liveLog = [];   // recent deltas, replayed onto an older catalog
         this.init();
     }
 
@@ -26,6 +30,7 @@ class SweetShopApp {
             };
             this.showDashboard();
             this.loadAllSweets();
+            this.connectLive();
         } catch (err) {
             console.error('Token decode failed:', err);
             this.logout();
@@ -54,11 +59,25 @@ class SweetShopApp {
 
     async loadAllSweets() {
         try {
-            const sweets = await apiCall('/api/sweets', 'GET');
+            const { sweets, seq } = await SweetsAPI.getCatalog();
             if (Array.isArray(sweets)) {
                 this.allSweets = sweets;
-                this.filteredSweets = sweets;
-                this.renderSweets(sweets);
+                this.catalogSeq = seq;
+                // Deltas newer than the list; older ones are in it
+                const newer = this.liveLog.filter(e => e.seq > seq);
+                // A feed that started ahead of the list never sent the
+                // events in between: have the server replay them
+                const missed = seq < this.liveSeq && newer.length !== this.liveSeq - seq;
+                if (missed && this.live && this.live.readyState === WebSocket.OPEN) {
+                    this.liveLog = [];
+                    this.liveSeq = seq;
+                    this.live.send(JSON.stringify({ resume: seq }));
+                } else {
+                    this.liveLog = newer;
+                    newer.forEach(e => this.applyDelta(e.event));
+                }
+                this.filteredSweets = this.allSweets;
+                this.renderSweets(this.allSweets);
             }
         } catch (err) {
             console.error('Failed to load sweets:', err);
@@ -66,6 +85,66 @@ class SweetShopApp {
         }
     }
 
+    // Stock changes pushed by the server over a WebSocket, so open pages
+    // stay current without polling the catalog
+    connectLive() {
+        if (this.live || !('WebSocket' in window)) return;
+        const base = API_BASE_URL || window.location.origin;
+        const socket = new WebSocket(base.replace(/^http/, 'ws') + '/api/live');
+        this.live = socket;
+        socket.onopen = () => {
+            // Ask for what was missed while disconnected
+            if (this.liveSeq) socket.send(JSON.stringify({ resume: this.liveSeq }));
+        };
+        socket.onmessage = (msg) => this.applyLiveEvent(JSON.parse(msg.data));
+        socket.onclose = () => {
+            this.live = null;
+            if (this.token) setTimeout(() => this.connectLive(), 2000);
+        };
+    }
+
+    applyLiveEvent({ seq, event }) {
+        if (event.type === 'hello') {
+            if (!this.liveSeq) this.liveSeq = seq;
+            return;
+        }
+        if (event.type === 'reset') {
+            this.liveSeq = seq;
+            this.loadAllSweets();
+            return;
+        }
+        // Deltas apply in order; later ones arriving before a resume
+        // replay are sent again after it
+        if (seq !== this.liveSeq + 1) return;
+        this.liveSeq = seq;
+        // Stock deltas are relative, so one the catalog already includes
+        // must not be applied again
+        if (seq <= this.catalogSeq) return;
+        this.liveLog.push({ seq, event });
+        if (this.liveLog.length > 1024) this.liveLog.shift();
+        this.applyDelta(event);
+        filterSweets();
+    }
+
+    applyDelta(event) {
+        if (event.type === 'upsert') {
+            const index = this.allSweets.findIndex(s => s.id === event.sweet.id);
+            // A copy, so later stock deltas leave the logged event intact
+            const sweet = { ...event.sweet };
+            if (index >= 0) {
+                this.allSweets[index] = sweet;
+            } else {
+                this.allSweets.push(sweet);
+            }
+        } else if (event.type === 'delete') {
+            this.allSweets = this.allSweets.filter(s => s.id !== event.id);
+        } else if (event.type === 'stock') {
+            const sweet = this.allSweets.find(s => s.id === event.id);
+            if (!sweet) return;
+            sweet.quantity = Math.max(0, (parseInt(sweet.quantity) || 0) + event.delta);
+        }
+    }
+
     renderSweets(sweets) {
         const grid = document.getElementById('sweetsGrid');
         grid.innerHTML = '';
@@ -200,6 +279,10 @@ class SweetShopApp {
     logout() {
         this.token = '';
         this.currentUser = null;
+        if (this.live) this.live.close();
+        this.liveSeq = 0;
+        this.catalogSeq = 0;
+        this.liveLog = [];
         localStorage.removeItem('authToken');
         this.showAuthSection();
         document.getElementById('loginFormDiv').style.display = 'block';
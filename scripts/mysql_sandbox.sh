@@ -0,0 +1,175 @@
+#!/bin/bash
+
+# Sweet Shop MySQL Sandbox
+# Runs throwaway local mysqld instances with the root password the backend
+# expects: a primary on port 3307 with a GTID replica on 3308 for testing
+# replica routing, or independent shards from port 3311 for sharding.
+#
+#   mysql_sandbox.sh start        initialize, start and load the schema
+#   mysql_sandbox.sh lag <secs>   delay the replica by <secs> seconds
+#   mysql_sandbox.sh resume       remove the delay
+#   mysql_sandbox.sh status       replica status as the backend sees it
+#   mysql_sandbox.sh shards <n>   start n shards and write a shard map
+#   mysql_sandbox.sh stop         shut down and delete the sandbox
+#
+# Then run the backend against it:
+#   SWEET_SHOP_DB_PORT=3307 SWEET_SHOP_DB_REPLICAS=127.0.0.1:3308 ./sweet_shop
+#   SWEET_SHOP_DB_SHARDS=/tmp/sweet_shop_sandbox/shards.conf ./sweet_shop
+
+set -e  # Exit on error
+
+# Get script directory
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+PROJECT_ROOT="$( dirname "$SCRIPT_DIR" )"
+DATABASE_DIR="$PROJECT_ROOT/database"
+
+SANDBOX_DIR=${SANDBOX_DIR:-/tmp/sweet_shop_sandbox}
+PRIMARY_PORT=3307
+REPLICA_PORT=3308
+SHARD_BASE_PORT=3311
+# Purchase ids stay unique across shards while each uses its own offset
+MAX_SHARDS=8
+DB_PASSWORD="your_password"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+# client <port> [mysql args...]
+client() {
+    local port=$1
+    shift
+    mysql -h 127.0.0.1 -P "$port" -u root -p"$DB_PASSWORD" "$@"
+}
+
+# start_instance <name> <port> <server-id> [mysqld options...]
+start_instance() {
+    local name=$1 port=$2 id=$3
+    shift 3
+    local dir="$SANDBOX_DIR/$name"
+    if mysqladmin -h 127.0.0.1 -P "$port" -u root -p"$DB_PASSWORD" ping >/dev/null 2>&1; then
+        return 0  # already running
+    fi
+    mkdir -p "$dir"
+    if [ ! -d "$dir/data" ]; then
+        mysqld --no-defaults --initialize-insecure --datadir="$dir/data" >"$dir/init.log" 2>&1
+    fi
+    mysqld --no-defaults --datadir="$dir/data" --port="$port" --bind-address=127.0.0.1 \
+        --socket="$dir/mysql.sock" --mysqlx=OFF --pid-file="$dir/mysqld.pid" \
+        --server-id="$id" --log-bin=binlog --gtid-mode=ON --enforce-gtid-consistency=ON \
+        --log-error="$dir/error.log" "$@" &
+    for _ in $(seq 1 60); do
+        if mysqladmin -h 127.0.0.1 -P "$port" -u root ping >/dev/null 2>&1 ||
+           mysqladmin -h 127.0.0.1 -P "$port" -u root -p"$DB_PASSWORD" ping >/dev/null 2>&1; then
+            return 0
+        fi
+        sleep 1
+    done
+    echo -e "${RED}ERROR: $name did not start; see $dir/error.log${NC}"
+    exit 1
+}
+
+# Sets the root password without writing it to the binlog, so the
+# replica's GTID history stays a prefix of the primary's
+set_password() {
+    mysql -h 127.0.0.1 -P "$1" -u root -e \
+        "SET sql_log_bin=0; ALTER USER 'root'@'localhost' IDENTIFIED BY '$DB_PASSWORD';
+         CREATE USER IF NOT EXISTS 'root'@'127.0.0.1' IDENTIFIED BY '$DB_PASSWORD';
+         GRANT ALL ON *.* TO 'root'@'127.0.0.1' WITH GRANT OPTION; SET sql_log_bin=1;" 2>/dev/null || true
+}
+
+case "$1" in
+    start)
+        echo "Starting primary on $PRIMARY_PORT and replica on $REPLICA_PORT in $SANDBOX_DIR"
+        start_instance primary $PRIMARY_PORT 1
+        start_instance replica $REPLICA_PORT 2
+        set_password $PRIMARY_PORT
+        set_password $REPLICA_PORT
+
+        client $PRIMARY_PORT -e \
+            "SET sql_log_bin=0;
+             CREATE USER IF NOT EXISTS 'repl'@'%' IDENTIFIED BY 'repl';
+             GRANT REPLICATION SLAVE ON *.* TO 'repl'@'%'; SET sql_log_bin=1;"
+        client $REPLICA_PORT -e \
+            "STOP REPLICA;
+             CHANGE REPLICATION SOURCE TO SOURCE_HOST='127.0.0.1', SOURCE_PORT=$PRIMARY_PORT,
+                 SOURCE_USER='repl', SOURCE_PASSWORD='repl', SOURCE_AUTO_POSITION=1,
+                 GET_SOURCE_PUBLIC_KEY=1;
+             START REPLICA;"
+
+        if ! client $PRIMARY_PORT -e "USE sweet_shop" 2>/dev/null; then
+            client $PRIMARY_PORT < "$DATABASE_DIR/schema.sql"
+            client $PRIMARY_PORT < "$DATABASE_DIR/seed_data.sql"
+        fi
+        echo -e "${GREEN}Sandbox running${NC}"
+        echo "  SWEET_SHOP_DB_PORT=$PRIMARY_PORT SWEET_SHOP_DB_REPLICAS=127.0.0.1:$REPLICA_PORT"
+        ;;
+    lag)
+        SECONDS_BEHIND=${2:?usage: $0 lag <seconds>}
+        # A delayed replica applies each transaction SECONDS_BEHIND seconds
+        # after the primary committed it; lag shows once writes arrive
+        client $REPLICA_PORT -e \
+            "STOP REPLICA SQL_THREAD;
+             CHANGE REPLICATION SOURCE TO SOURCE_DELAY=$SECONDS_BEHIND;
+             START REPLICA SQL_THREAD;"
+        echo -e "${YELLOW}Replica delayed by ${SECONDS_BEHIND}s${NC}"
+        ;;
+    resume)
+        client $REPLICA_PORT -e \
+            "STOP REPLICA SQL_THREAD;
+             CHANGE REPLICATION SOURCE TO SOURCE_DELAY=0;
+             START REPLICA SQL_THREAD;"
+        echo -e "${GREEN}Replica delay removed${NC}"
+        ;;
+    status)
+        client $REPLICA_PORT -e "SHOW REPLICA STATUS\G" |
+            grep -E "Replica_IO_Running:|Replica_SQL_Running:|Seconds_Behind_Source:|SQL_Delay:|Last_Error:"
+        ;;
+    shards)
+        COUNT=${2:?usage: $0 shards <count>}
+        if [ "$COUNT" -lt 1 ] || [ "$COUNT" -gt $MAX_SHARDS ]; then
+            echo -e "${RED}ERROR: between 1 and $MAX_SHARDS shards${NC}"
+            exit 1
+        fi
+        MAP="$SANDBOX_DIR/shards.conf"
+        mkdir -p "$SANDBOX_DIR"
+        echo "# name host:port [weight]; the first shard is the home shard" > "$MAP"
+        for i in $(seq 1 "$COUNT"); do
+            port=$((SHARD_BASE_PORT + i - 1))
+            echo "Starting shard$i on $port"
+            start_instance "shard$i" $port $((10 + i)) \
+                --auto-increment-increment=$MAX_SHARDS --auto-increment-offset=$i
+            set_password $port
+            if ! client $port -e "USE sweet_shop" 2>/dev/null; then
+                # The home shard keeps users and the seed data; its sweets
+                # are spread over the others when the backend starts
+                if [ "$i" -eq 1 ]; then
+                    client $port < "$DATABASE_DIR/schema.sql"
+                    client $port < "$DATABASE_DIR/seed_data.sql"
+                else
+                    client $port < "$DATABASE_DIR/shard_schema.sql"
+                fi
+            fi
+            echo "shard$i 127.0.0.1:$port" >> "$MAP"
+        done
+        echo -e "${GREEN}$COUNT shards running${NC}"
+        echo "  SWEET_SHOP_DB_SHARDS=$MAP"
+        echo "  Edit the map and POST /api/admin/shards/reload to reshard"
+        ;;
+    stop)
+        for pidfile in "$SANDBOX_DIR"/*/mysqld.pid; do
+            if [ -f "$pidfile" ]; then
+                kill "$(cat "$pidfile")" 2>/dev/null || true
+            fi
+        done
+        sleep 2
+        rm -rf "$SANDBOX_DIR"
+        echo "Sandbox removed"
+        ;;
+    *)
+        echo "usage: $0 start | lag <seconds> | resume | status | shards <count> | stop"
+        exit 1
+        ;;
+esac
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 # Sweet Shop Application Run Script
-# Starts the backend server and opens the frontend
+# Starts the backend server, which also serves the frontend, and opens it
 
 set -e  # Exit on error
 
@@ -58,7 +58,7 @@ fi
 
 # Start the backend server
 echo "Starting backend server..."
-"$EXECUTABLE" &
+SWEET_SHOP_FRONTEND_DIR="$FRONTEND_DIR" "$EXECUTABLE" &
 BACKEND_PID=$!
 
 # Save PID to file for later cleanup
@@ -79,22 +79,18 @@ fi
 echo "Backend is running on http://localhost:8080"
 echo ""
 
-# Open frontend in default browser
-FRONTEND_FILE="$FRONTEND_DIR/public/index.html"
-if [ -f "$FRONTEND_FILE" ]; then
-    echo "Opening frontend..."
-    if command -v xdg-open &> /dev/null; then
-        xdg-open "file://$FRONTEND_FILE" 2>/dev/null &
-    elif command -v open &> /dev/null; then
-        open "file://$FRONTEND_FILE" 2>/dev/null &
-    elif command -v start &> /dev/null; then
-        start "file://$FRONTEND_FILE" 2>/dev/null &
-    else
-        echo -e "${YELLOW}Could not open browser automatically${NC}"
-        echo "Open manually: file://$FRONTEND_FILE"
-    fi
+# Open frontend in default browser (served by the backend itself)
+FRONTEND_URL="http://localhost:8080/"
+echo "Opening frontend..."
+if command -v xdg-open &> /dev/null; then
+    xdg-open "$FRONTEND_URL" 2>/dev/null &
+elif command -v open &> /dev/null; then
+    open "$FRONTEND_URL" 2>/dev/null &
+elif command -v start &> /dev/null; then
+    start "$FRONTEND_URL" 2>/dev/null &
 else
-    echo -e "${YELLOW}Frontend file not found at: $FRONTEND_FILE${NC}"
+    echo -e "${YELLOW}Could not open browser automatically${NC}"
+    echo "Open manually: $FRONTEND_URL"
 fi
 
 echo ""
@@ -103,7 +99,7 @@ echo -e "${GREEN}Application Running!${NC}"
 echo "================================"
 echo ""
 echo "Backend: http://localhost:8080"
-echo "Frontend: file://$FRONTEND_FILE"
+echo "Frontend: $FRONTEND_URL"
 echo ""
 echo "Press Ctrl+C to stop the server"
 echo ""